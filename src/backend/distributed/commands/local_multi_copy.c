@@ -47,6 +47,9 @@ int LocalCopyFlushThresholdByte = 512 * 1024;
 
 static void AddSlotToBuffer(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
 							CopyOutState localCopyOutState);
+static void StartLocalCopyRow(CopyOutState localCopyOutState);
+static void FinishLocalCopyRow(CitusCopyDestReceiver *copyDest, int64 shardId,
+							   CopyOutState localCopyOutState);
 static bool ShouldAddBinaryHeaders(StringInfo buffer, bool isBinary);
 static bool ShouldSendCopyNow(StringInfo buffer);
 static void DoLocalCopy(StringInfo buffer, Oid relationId, int64 shardId,
@@ -70,6 +73,36 @@ void
 WriteTupleToLocalShard(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest, int64
 					   shardId,
 					   CopyOutState localCopyOutState)
+{
+	StartLocalCopyRow(localCopyOutState);
+
+	AddSlotToBuffer(slot, copyDest, localCopyOutState);
+
+	FinishLocalCopyRow(copyDest, shardId, localCopyOutState);
+}
+
+
+/*
+ * WriteRowDataToLocalShard works like WriteTupleToLocalShard, but adds a row
+ * that is already serialized in the format of the local copy.
+ */
+void
+WriteRowDataToLocalShard(StringInfo rowData, CitusCopyDestReceiver *copyDest,
+						 int64 shardId, CopyOutState localCopyOutState)
+{
+	StartLocalCopyRow(localCopyOutState);
+
+	appendBinaryStringInfo(localCopyOutState->fe_msgbuf, rowData->data, rowData->len);
+
+	FinishLocalCopyRow(copyDest, shardId, localCopyOutState);
+}
+
+
+/*
+ * StartLocalCopyRow prepares the local copy buffer for adding a row.
+ */
+static void
+StartLocalCopyRow(CopyOutState localCopyOutState)
 {
 	/*
 	 * Since we are doing a local copy, the following statements should
@@ -82,12 +115,20 @@ WriteTupleToLocalShard(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest, in
 	{
 		AppendCopyBinaryHeaders(localCopyOutState);
 	}
+}
 
-	AddSlotToBuffer(slot, copyDest, localCopyOutState);
 
+/*
+ * FinishLocalCopyRow does a local copy of the rows in the local copy buffer
+ * if the buffer size exceeds the threshold.
+ */
+static void
+FinishLocalCopyRow(CitusCopyDestReceiver *copyDest, int64 shardId,
+				   CopyOutState localCopyOutState)
+{
 	if (ShouldSendCopyNow(localCopyOutState->fe_msgbuf))
 	{
-		if (isBinaryCopy)
+		if (localCopyOutState->binary)
 		{
 			/*
 			 * We're going to flush the buffer to disk by effectively doing a full
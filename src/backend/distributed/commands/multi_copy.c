@@ -55,8 +55,10 @@
 
 #include "access/htup.h"
 #include "access/htup_details.h"
+#include "access/parallel.h"
 #include "access/sdir.h"
 #include "access/sysattr.h"
+#include "access/transam.h"
 #include "access/xact.h"
 #include "catalog/namespace.h"
 #include "catalog/pg_attribute.h"
@@ -98,6 +100,8 @@
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/parallel_multi_copy.h"
+#include "distributed/pass_through_multi_copy.h"
 #include "distributed/placement_connection.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
@@ -121,6 +125,9 @@ static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
 /* if true, skip validation of JSONB columns during COPY */
 bool SkipJsonbValidationInCopy = true;
 
+/* if true, COPY ... TO STDOUT exports the shards of distributed tables concurrently */
+bool EnableParallelCopyTo = false;
+
 /* custom Citus option for appending to a shard */
 #define APPEND_TO_SHARD_OPTION "append_to_shard"
 
@@ -222,6 +229,35 @@ struct CopyShardState
 };
 
 
+/*
+ * CopyToShardStream is a connection over which COPY ... TO STDOUT exports
+ * shards of a distributed table concurrently with other connections. The
+ * shards that are assigned to the connection are exported one at a time.
+ */
+typedef struct CopyToShardStream
+{
+	MultiConnection *connection;
+	int waitEventSetIndex;
+
+	/* placements of the shards to export, and the next one to export */
+	List *placementList;
+	int nextPlacementIndex;
+
+	/* placement that is currently exported, or NULL if the connection is idle */
+	ShardPlacement *currentPlacement;
+
+	/* whether part of the COPY command still needs to be sent */
+	bool sendPending;
+
+	/* whether the shard started, and finished, sending data */
+	bool copyStarted;
+	bool copyFinished;
+
+	/* whether the binary header of the shard was skipped */
+	bool binaryHeaderSkipped;
+} CopyToShardStream;
+
+
 /*
  * Represents the state for allowing copy via local
  * execution.
@@ -237,6 +273,10 @@ typedef enum LocalCopyStatus
 /* Local functions forward declarations */
 static void CopyToExistingShards(CopyStmt *copyStatement,
 								 QueryCompletion *completionTag);
+static uint64 CopyRowsFromInput(CopyStmt *copyStatement,
+								Relation copiedDistributedRelation,
+								EState *executorState, TupleTableSlot *tupleTableSlot,
+								DestReceiver *dest);
 static bool IsCopyInBinaryFormat(CopyStmt *copyStatement);
 static List * FindJsonbInputColumns(TupleDesc tupleDescriptor,
 									List *inputColumnNameList);
@@ -301,6 +341,23 @@ static SelectStmt * CitusCopySelect(CopyStmt *copyStatement);
 static void CitusCopyTo(CopyStmt *copyStatement, QueryCompletion *completionTag);
 static int64 ForwardCopyDataFromConnection(CopyOutState copyOutState,
 										   MultiConnection *connection);
+static bool CanUseParallelCopyTo(CopyStmt *copyStatement);
+static bool BinaryCopyOutputIsPortable(TupleDesc tupleDescriptor);
+static void CitusParallelCopyTo(CopyStmt *copyStatement, QueryCompletion *completionTag);
+static List * OpenCopyToShardStreams(List *shardIntervalList);
+static CopyToShardStream * CopyToShardStreamForConnection(List **streamList,
+														  MultiConnection *connection);
+static int64 ForwardCopyDataFromShardStreams(CopyOutState copyOutState,
+											 CopyStmt *copyStatement,
+											 List *streamList);
+static void StartCopyToShardStream(CopyToShardStream *stream, CopyStmt *copyStatement,
+								   WaitEventSet *waitEventSet);
+static bool ContinueCopyToShardStream(CopyToShardStream *stream,
+									  CopyOutState copyOutState,
+									  WaitEventSet *waitEventSet, int64 *tuplesSent);
+static void ForwardShardCopyData(CopyToShardStream *stream, CopyOutState copyOutState,
+								 char *data, int length, int64 *tuplesSent);
+static int BinaryCopyHeaderLength(char *data, int length);
 static void ErrorIfCopyHasOnErrorLogVerbosity(CopyStmt *copyStatement);
 
 /* Private functions copied and adapted from copy.c in PostgreSQL */
@@ -314,6 +371,13 @@ static void CopySendInt16(CopyOutState outputState, int16 val);
 static void CopySendEndOfRow(CopyOutState cstate, bool includeEndOfLine);
 static void CopyAttributeOutText(CopyOutState outputState, char *string);
 static inline void CopyFlushOutput(CopyOutState outputState, char *start, char *pointer);
+static CopyShardState * GetCopyShardStateForRow(CitusCopyDestReceiver *copyDest,
+												int64 shardId, bool *firstRowInShard);
+static void SendCopyRowToPlacements(CitusCopyDestReceiver *copyDest,
+									CopyShardState *shardState, TupleTableSlot *slot,
+									StringInfo rowData);
+static StringInfo SerializeCopyRow(CitusCopyDestReceiver *copyDest,
+								   TupleTableSlot *slot, StringInfo rowData);
 static bool CitusSendTupleToPlacements(TupleTableSlot *slot,
 									   CitusCopyDestReceiver *copyDest);
 static void AddPlacementStateToCopyConnectionStateBuffer(CopyConnectionState *
@@ -325,8 +389,6 @@ static void RemovePlacementStateFromCopyConnectionStateBuffer(CopyConnectionStat
 															  CopyPlacementState *
 															  placementState);
 static uint64 ProcessAppendToShardOption(Oid relationId, CopyStmt *copyStatement);
-static uint64 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
-							  bool *columnNulls);
 
 /* CitusCopyDestReceiver functions */
 static void CitusCopyDestReceiverStartup(DestReceiver *copyDest, int operation,
@@ -451,11 +513,8 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	List *columnNameList = NIL;
 	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
 
-	bool isInputFormatBinary = IsCopyInBinaryFormat(copyStatement);
 	uint64 processedRowCount = 0;
 
-	ErrorContextCallback errorCallback;
-
 	/* allocate column values and nulls arrays */
 	Relation distributedRelation = table_open(tableId, RowExclusiveLock);
 	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
@@ -494,8 +553,6 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	}
 
 	EState *executorState = CreateExecutorState();
-	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
-	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
 
 	/* set up the destination for the COPY */
 	const bool publishableData = true;
@@ -514,6 +571,58 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	DestReceiver *dest = (DestReceiver *) copyDest;
 	dest->rStartup(dest, 0, tupleDescriptor);
 
+	if (CanUsePassThroughCopyFrom(copyStatement, copyDest))
+	{
+		/* only parse the distribution column and forward the lines as they are */
+		processedRowCount = PassThroughCopyFrom(copyStatement, copyDest);
+	}
+	else
+	{
+		Relation copiedDistributedRelation =
+			CopyFromInputRelation(distributedRelation, copyStatement,
+								  partitionColumnIndex, copyDest->copyOutState,
+								  copyDest->columnOutputFunctions);
+
+		/* parse the input in parallel workers if possible, otherwise parse it here */
+		if (!CanUseParallelCopyFrom(copyStatement, copyDest,
+									copiedDistributedRelation) ||
+			!ParallelCopyFrom(copyStatement, copyDest, &processedRowCount))
+		{
+			processedRowCount = CopyRowsFromInput(copyStatement,
+												  copiedDistributedRelation,
+												  executorState, tupleTableSlot, dest);
+		}
+	}
+
+	/* finish the COPY commands */
+	dest->rShutdown(dest);
+	dest->rDestroy(dest);
+
+	ExecDropSingleTupleTableSlot(tupleTableSlot);
+	FreeExecutorState(executorState);
+	table_close(distributedRelation, NoLock);
+
+	CHECK_FOR_INTERRUPTS();
+
+	if (completionTag != NULL)
+	{
+		CompleteCopyQueryTagCompat(completionTag, processedRowCount);
+	}
+}
+
+
+/*
+ * CopyFromInputRelation returns a copy of the given distributed relation that
+ * BeginCopyFrom uses to parse the COPY input. JSONB columns in the copy are
+ * parsed as text when citus.skip_jsonb_validation_in_copy is enabled, in which
+ * case the given column output functions are changed to send the text on as
+ * JSONB.
+ */
+Relation
+CopyFromInputRelation(Relation distributedRelation, CopyStmt *copyStatement,
+					  int partitionColumnIndex, CopyOutState copyOutState,
+					  FmgrInfo *columnOutputFunctions)
+{
 	/*
 	 * Below, we change a few fields in the Relation to control the behaviour
 	 * of BeginCopyFrom. However, we obviously should not do this in relcache
@@ -531,7 +640,8 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	*copiedDistributedRelationTuple = *distributedRelation->rd_rel;
 
 	copiedDistributedRelation->rd_rel = copiedDistributedRelationTuple;
-	copiedDistributedRelation->rd_att = CreateTupleDescCopyConstr(tupleDescriptor);
+	copiedDistributedRelation->rd_att = CreateTupleDescCopyConstr(
+		RelationGetDescr(distributedRelation));
 
 	/*
 	 * BeginCopyFrom opens all partitions of given partitioned table with relation_open
@@ -540,7 +650,7 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	 * Postgres will treat those tables as regular relations and will not open its
 	 * partitions.
 	 */
-	if (PartitionedTable(tableId))
+	if (PartitionedTable(RelationGetRelid(distributedRelation)))
 	{
 		copiedDistributedRelationTuple->relkind = RELKIND_RELATION;
 	}
@@ -556,9 +666,8 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	 * until the object is parsed by the worker, which is unable to give an accurate
 	 * line number.
 	 */
-	if (SkipJsonbValidationInCopy && !isInputFormatBinary)
+	if (SkipJsonbValidationInCopy && !IsCopyInBinaryFormat(copyStatement))
 	{
-		CopyOutState copyOutState = copyDest->copyOutState;
 		ListCell *jsonbColumnIndexCell = NULL;
 
 		/* get the column indices for all JSONB columns that appear in the input */
@@ -582,8 +691,12 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 				continue;
 			}
 
-			ereport(DEBUG1, (errmsg("parsing JSONB column %s as text",
-									NameStr(currentColumn->attname))));
+			/* parallel COPY workers do the same, only log it in the leader */
+			if (!IsParallelWorker())
+			{
+				ereport(DEBUG1, (errmsg("parsing JSONB column %s as text",
+										NameStr(currentColumn->attname))));
+			}
 
 			/* parse the column as text instead of JSONB */
 			currentColumn->atttypid = TEXTOID;
@@ -600,17 +713,39 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 				 * prepending a version number.
 				 */
 				fmgr_info(textSendAsJsonbFunctionId,
-						  &copyDest->columnOutputFunctions[jsonbColumnIndex]);
+						  &columnOutputFunctions[jsonbColumnIndex]);
 			}
 			else
 			{
 				Oid textoutFunctionId = TextOutFunctionId();
 				fmgr_info(textoutFunctionId,
-						  &copyDest->columnOutputFunctions[jsonbColumnIndex]);
+						  &columnOutputFunctions[jsonbColumnIndex]);
 			}
 		}
 	}
 
+	return copiedDistributedRelation;
+}
+
+
+/*
+ * CopyRowsFromInput parses the rows in the input of the given COPY statement
+ * and passes each of them to the given destination. It returns the number of
+ * rows that were copied.
+ */
+static uint64
+CopyRowsFromInput(CopyStmt *copyStatement, Relation copiedDistributedRelation,
+				  EState *executorState, TupleTableSlot *tupleTableSlot,
+				  DestReceiver *dest)
+{
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+	Datum *columnValues = tupleTableSlot->tts_values;
+	bool *columnNulls = tupleTableSlot->tts_isnull;
+	uint64 processedRowCount = 0;
+
+	ErrorContextCallback errorCallback;
+
 	/* initialize copy state to read from COPY data source */
 	CopyFromState copyState = BeginCopyFrom(NULL,
 											copiedDistributedRelation,
@@ -659,20 +794,7 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	/* all lines have been copied, stop showing line number in errors */
 	error_context_stack = errorCallback.previous;
 
-	/* finish the COPY commands */
-	dest->rShutdown(dest);
-	dest->rDestroy(dest);
-
-	ExecDropSingleTupleTableSlot(tupleTableSlot);
-	FreeExecutorState(executorState);
-	table_close(distributedRelation, NoLock);
-
-	CHECK_FOR_INTERRUPTS();
-
-	if (completionTag != NULL)
-	{
-		CompleteCopyQueryTagCompat(completionTag, processedRowCount);
-	}
+	return processedRowCount;
 }
 
 
@@ -2259,17 +2381,8 @@ CitusCopyDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 static bool
 CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest)
 {
-	TupleDesc tupleDescriptor = copyDest->tupleDescriptor;
-	CopyStmt *copyStatement = copyDest->copyStatement;
-
-	CopyOutState copyOutState = copyDest->copyOutState;
-	FmgrInfo *columnOutputFunctions = copyDest->columnOutputFunctions;
-	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
-	ListCell *placementStateCell = NULL;
-	bool cachedShardStateFound = false;
 	bool firstTupleInShard = false;
 
-
 	EState *executorState = copyDest->executorState;
 	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
 	MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
@@ -2286,6 +2399,105 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 	bool isColocatedIntermediateResult =
 		copyDest->colocatedIntermediateResultIdPrefix != NULL;
 
+	CopyShardState *shardState = GetCopyShardStateForRow(copyDest, shardId,
+														 &firstTupleInShard);
+
+	if (isColocatedIntermediateResult && copyDest->shouldUseLocalCopy &&
+		shardState->containsLocalPlacement)
+	{
+		if (firstTupleInShard)
+		{
+			CreateLocalColocatedIntermediateFile(copyDest, shardState);
+		}
+
+		WriteTupleToLocalFile(slot, copyDest, shardId,
+							  shardState->copyOutState, &shardState->fileDest);
+	}
+	else if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
+	{
+		WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
+	}
+
+	SendCopyRowToPlacements(copyDest, shardState, slot, NULL);
+
+	MemoryContextSwitchTo(oldContext);
+
+	copyDest->tuplesSent++;
+
+	/*
+	 * Release per tuple memory allocated in this function. If we're writing
+	 * the results of an INSERT ... SELECT then the SELECT execution will use
+	 * its own executor state and reset the per tuple expression context
+	 * separately.
+	 */
+	ResetPerTupleExprContext(executorState);
+
+	return true;
+}
+
+
+/*
+ * CitusCopyDestReceiverSendRowData sends a row that is already serialized in
+ * the COPY format of the destination to the placement(s) of the given shard.
+ * It is used when the rows are parsed and routed outside of the receiver, for
+ * instance by parallel COPY workers.
+ */
+void
+CitusCopyDestReceiverSendRowData(CitusCopyDestReceiver *copyDest, int64 shardId,
+								 StringInfo rowData)
+{
+	bool firstRowInShard = false;
+
+	/* rows can only be passed this way when copying into shards */
+	Assert(copyDest->colocatedIntermediateResultIdPrefix == NULL);
+
+	PG_TRY();
+	{
+		/* connections hash is kept in memory context */
+		MemoryContext oldContext = MemoryContextSwitchTo(copyDest->memoryContext);
+
+		CopyShardState *shardState = GetCopyShardStateForRow(copyDest, shardId,
+															 &firstRowInShard);
+
+		if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
+		{
+			WriteRowDataToLocalShard(rowData, copyDest, shardId,
+									 shardState->copyOutState);
+		}
+
+		SendCopyRowToPlacements(copyDest, shardState, NULL, rowData);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+	PG_CATCH();
+	{
+		/*
+		 * We might be able to recover from errors with ROLLBACK TO SAVEPOINT,
+		 * so unclaim the connections before throwing errors.
+		 */
+		List *connectionStateList = ConnectionStateList(copyDest->connectionStateHash);
+		UnclaimCopyConnections(connectionStateList);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	copyDest->tuplesSent++;
+}
+
+
+/*
+ * GetCopyShardStateForRow returns the state of the COPY into the given shard,
+ * and sets firstRowInShard when the shard did not receive any rows yet.
+ */
+static CopyShardState *
+GetCopyShardStateForRow(CitusCopyDestReceiver *copyDest, int64 shardId,
+						bool *firstRowInShard)
+{
+	bool cachedShardStateFound = false;
+	bool isColocatedIntermediateResult =
+		copyDest->colocatedIntermediateResultIdPrefix != NULL;
+
 	CopyShardState *shardState = GetShardState(shardId, copyDest->shardStateHash,
 											   copyDest->connectionStateHash,
 											   &cachedShardStateFound,
@@ -2294,12 +2506,9 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 											   isColocatedIntermediateResult,
 											   copyDest->isPublishable);
 
-	if (!cachedShardStateFound)
-	{
-		firstTupleInShard = true;
-	}
+	*firstRowInShard = !cachedShardStateFound;
 
-	if (firstTupleInShard && !copyDest->multiShardCopy &&
+	if (*firstRowInShard && !copyDest->multiShardCopy &&
 		hash_get_num_entries(copyDest->shardStateHash) == 2)
 	{
 		Oid relationId = copyDest->distributedRelationId;
@@ -2314,21 +2523,24 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 		}
 	}
 
-	if (isColocatedIntermediateResult && copyDest->shouldUseLocalCopy &&
-		shardState->containsLocalPlacement)
-	{
-		if (firstTupleInShard)
-		{
-			CreateLocalColocatedIntermediateFile(copyDest, shardState);
-		}
+	return shardState;
+}
 
-		WriteTupleToLocalFile(slot, copyDest, shardId,
-							  shardState->copyOutState, &shardState->fileDest);
-	}
-	else if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
-	{
-		WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
-	}
+
+/*
+ * SendCopyRowToPlacements sends a row to the remote placements of the given
+ * shard, or buffers it for placements whose connection is busy with another
+ * placement. The row is taken from rowData when it is already serialized, and
+ * serialized from the slot otherwise.
+ */
+static void
+SendCopyRowToPlacements(CitusCopyDestReceiver *copyDest, CopyShardState *shardState,
+						TupleTableSlot *slot, StringInfo rowData)
+{
+	CopyStmt *copyStatement = copyDest->copyStatement;
+	CopyOutState copyOutState = copyDest->copyOutState;
+	int64 shardId = shardState->shardId;
+	ListCell *placementStateCell = NULL;
 
 	foreach(placementStateCell, shardState->placementStateList)
 	{
@@ -2374,13 +2586,9 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 		else if (currentPlacementState != activePlacementState)
 		{
 			/* buffer data */
-			StringInfo copyBuffer = copyOutState->fe_msgbuf;
-			resetStringInfo(copyBuffer);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions,
-							  columnCoercionPaths);
-			appendBinaryStringInfo(currentPlacementState->data, copyBuffer->data,
-								   copyBuffer->len);
+			StringInfo copyRowData = SerializeCopyRow(copyDest, slot, rowData);
+			appendBinaryStringInfo(currentPlacementState->data, copyRowData->data,
+								   copyRowData->len);
 		}
 		else
 		{
@@ -2390,27 +2598,35 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 
 		if (sendTupleOverConnection)
 		{
-			resetStringInfo(copyOutState->fe_msgbuf);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions, columnCoercionPaths);
-			SendCopyDataToPlacement(copyOutState->fe_msgbuf, shardId,
-									connectionState->connection);
+			StringInfo copyRowData = SerializeCopyRow(copyDest, slot, rowData);
+			SendCopyDataToPlacement(copyRowData, shardId, connectionState->connection);
 		}
 	}
+}
 
-	MemoryContextSwitchTo(oldContext);
 
-	copyDest->tuplesSent++;
+/*
+ * SerializeCopyRow returns the given row data if the row is already
+ * serialized, and otherwise serializes the tuple in the given slot into the
+ * COPY buffer of the destination and returns the buffer.
+ */
+static StringInfo
+SerializeCopyRow(CitusCopyDestReceiver *copyDest, TupleTableSlot *slot,
+				 StringInfo rowData)
+{
+	if (rowData != NULL)
+	{
+		return rowData;
+	}
 
-	/*
-	 * Release per tuple memory allocated in this function. If we're writing
-	 * the results of an INSERT ... SELECT then the SELECT execution will use
-	 * its own executor state and reset the per tuple expression context
-	 * separately.
-	 */
-	ResetPerTupleExprContext(executorState);
+	CopyOutState copyOutState = copyDest->copyOutState;
 
-	return true;
+	resetStringInfo(copyOutState->fe_msgbuf);
+	AppendCopyRowData(slot->tts_values, slot->tts_isnull, copyDest->tupleDescriptor,
+					  copyOutState, copyDest->columnOutputFunctions,
+					  copyDest->columnCoercionPaths);
+
+	return copyOutState->fe_msgbuf;
 }
 
 
@@ -2522,7 +2738,7 @@ ContainsLocalPlacement(int64 shardId)
 /*
  * ShardIdForTuple returns id of the shard to which the given tuple belongs to.
  */
-static uint64
+uint64
 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues, bool *columnNulls)
 {
 	int partitionColumnIndex = copyDest->partitionColumnIndex;
@@ -2909,7 +3125,14 @@ ProcessCopyStmt(CopyStmt *copyStatement, QueryCompletion *completionTag, const
 
 		if (copyStatement->is_from)
 		{
-			ReceiveQueryResultViaCopy(resultId);
+			uint64 nodeCount = ReceiveQueryResultViaCopy(resultId,
+														 copyStatement->options);
+
+			/* report the number of nodes that stored the result to relaying nodes */
+			if (completionTag != NULL)
+			{
+				CompleteCopyQueryTagCompat(completionTag, nodeCount);
+			}
 		}
 		else
 		{
@@ -2972,6 +3195,16 @@ ProcessCopyStmt(CopyStmt *copyStatement, QueryCompletion *completionTag, const
 				CitusCopyFrom(copyStatement, completionTag);
 				return NULL;
 			}
+			else if (copyStatement->filename == NULL && !copyStatement->is_program &&
+					 CanUseParallelCopyTo(copyStatement))
+			{
+				/*
+				 * COPY table TO STDOUT can stream all shards concurrently and
+				 * forward their data as is, also in binary format.
+				 */
+				CitusParallelCopyTo(copyStatement, completionTag);
+				return NULL;
+			}
 			else if (copyStatement->filename == NULL && !copyStatement->is_program &&
 					 !CopyStatementHasFormat(copyStatement, "binary"))
 			{
@@ -3195,6 +3428,673 @@ ForwardCopyDataFromConnection(CopyOutState copyOutState, MultiConnection *connec
 }
 
 
+/*
+ * CanUseParallelCopyTo returns whether COPY ... TO STDOUT of the given
+ * statement can export the shards of the table concurrently, which is the
+ * case for distributed tables when citus.enable_parallel_copy_to is set. A
+ * header is only sent by one of the shards, so it requires exporting them one
+ * by one. Binary output of the shards is only forwarded as is when it does not
+ * depend on the OIDs of types, which may differ between nodes.
+ */
+static bool
+CanUseParallelCopyTo(CopyStmt *copyStatement)
+{
+	if (!EnableParallelCopyTo)
+	{
+		return false;
+	}
+
+	Oid relationId = RangeVarGetRelid(copyStatement->relation, NoLock, false);
+	if (!IsCitusTableType(relationId, DISTRIBUTED_TABLE))
+	{
+		return false;
+	}
+
+	DefElem *copyOption = NULL;
+	foreach_declared_ptr(copyOption, copyStatement->options)
+	{
+		if (strcmp(copyOption->defname, "header") == 0)
+		{
+			return false;
+		}
+	}
+
+	if (CopyStatementHasFormat(copyStatement, "binary"))
+	{
+		Relation distributedRelation = table_open(relationId, AccessShareLock);
+		bool binaryOutputIsPortable =
+			BinaryCopyOutputIsPortable(RelationGetDescr(distributedRelation));
+		table_close(distributedRelation, NoLock);
+
+		if (!binaryOutputIsPortable)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * BinaryCopyOutputIsPortable returns whether the binary COPY output of rows
+ * with the given tuple descriptor is the same on all nodes. Besides the types
+ * that cannot be copied in binary format between nodes at all, this excludes
+ * arrays of types that are not built-in, since the binary format of an array
+ * contains the OID of its element type.
+ */
+static bool
+BinaryCopyOutputIsPortable(TupleDesc tupleDescriptor)
+{
+	if (!CanUseBinaryCopyFormat(tupleDescriptor))
+	{
+		return false;
+	}
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (column->attisdropped)
+		{
+			continue;
+		}
+
+		Oid elementTypeId = get_element_type(getBaseType(column->atttypid));
+		if (elementTypeId >= FirstNormalObjectId)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CitusParallelCopyTo implements COPY table TO STDOUT for distributed tables
+ * by running COPY shard TO STDOUT for all shards concurrently, spread over up
+ * to citus.max_adaptive_executor_pool_size connections per node. The data that
+ * the shards send is forwarded to the client as is, interleaved at row
+ * boundaries, so rows are not parsed on the coordinator. In binary format, the
+ * headers and trailers of the shards are replaced by a single header and
+ * trailer.
+ */
+static void
+CitusParallelCopyTo(CopyStmt *copyStatement, QueryCompletion *completionTag)
+{
+	Relation distributedRelation = table_openrv(copyStatement->relation, AccessShareLock);
+	Oid relationId = RelationGetRelid(distributedRelation);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->binary = CopyStatementHasFormat(copyStatement, "binary");
+	copyOutState->rowcontext = CurrentMemoryContext;
+	copyOutState->attnumlist = CopyGetAttnums(tupleDescriptor, distributedRelation,
+											  copyStatement->attlist);
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	List *streamList = OpenCopyToShardStreams(shardIntervalList);
+
+	SendCopyBegin(copyOutState);
+
+	if (copyOutState->binary)
+	{
+		bool includeEndOfLine = false;
+
+		AppendCopyBinaryHeaders(copyOutState);
+		CopySendEndOfRow(copyOutState, includeEndOfLine);
+	}
+
+	int64 tuplesSent = ForwardCopyDataFromShardStreams(copyOutState, copyStatement,
+													   streamList);
+
+	if (copyOutState->binary)
+	{
+		bool includeEndOfLine = false;
+
+		AppendCopyBinaryFooters(copyOutState);
+		CopySendEndOfRow(copyOutState, includeEndOfLine);
+	}
+
+	SendCopyEnd(copyOutState);
+
+	table_close(distributedRelation, AccessShareLock);
+
+	if (completionTag != NULL)
+	{
+		CompleteCopyQueryTagCompat(completionTag, tuplesSent);
+	}
+}
+
+
+/*
+ * OpenCopyToShardStreams assigns the first active placement of each of the
+ * given shards to a connection, and returns the connections as a list of
+ * CopyToShardStreams. Placements that were accessed earlier in the transaction
+ * use the connection that accessed them. The other placements are spread over
+ * up to citus.max_adaptive_executor_pool_size connections per node, where only
+ * the first connection to a node is required and the others are skipped when
+ * they would exceed the shared connection limit or fail to connect.
+ */
+static List *
+OpenCopyToShardStreams(List *shardIntervalList)
+{
+	List *streamList = NIL;
+	List *nodePlacementLists = NIL;
+	List *nodeConnectionLists = NIL;
+	List *newConnectionList = NIL;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_declared_ptr(shardInterval, shardIntervalList)
+	{
+		List *shardPlacementList = ActiveShardPlacementList(shardInterval->shardId);
+		if (shardPlacementList == NIL)
+		{
+			ereport(ERROR, (errmsg("could not find any active placements for shard "
+								   UINT64_FORMAT, shardInterval->shardId)));
+		}
+
+		ShardPlacement *placement = (ShardPlacement *) linitial(shardPlacementList);
+		ShardPlacementAccess *placementAccess =
+			CreatePlacementAccess(placement, PLACEMENT_ACCESS_SELECT);
+
+		MultiConnection *connection =
+			GetConnectionIfPlacementAccessedInXact(0, list_make1(placementAccess), NULL);
+		if (connection != NULL)
+		{
+			CopyToShardStream *stream =
+				CopyToShardStreamForConnection(&streamList, connection);
+			stream->placementList = lappend(stream->placementList, placement);
+			continue;
+		}
+
+		/* group the remaining placements by node */
+		ListCell *nodePlacementListCell = NULL;
+		foreach(nodePlacementListCell, nodePlacementLists)
+		{
+			List *nodePlacementList = lfirst(nodePlacementListCell);
+			ShardPlacement *nodePlacement = linitial(nodePlacementList);
+
+			if (nodePlacement->groupId == placement->groupId)
+			{
+				lfirst(nodePlacementListCell) = lappend(nodePlacementList, placement);
+				break;
+			}
+		}
+
+		if (nodePlacementListCell == NULL)
+		{
+			nodePlacementLists = lappend(nodePlacementLists, list_make1(placement));
+		}
+	}
+
+	/* start all connections first, such that they are established concurrently */
+	List *nodePlacementList = NIL;
+	foreach_declared_ptr(nodePlacementList, nodePlacementLists)
+	{
+		ShardPlacement *nodePlacement = linitial(nodePlacementList);
+		int connectionCount = Min(MaxAdaptiveExecutorPoolSize,
+								  list_length(nodePlacementList));
+		List *nodeConnectionList = NIL;
+
+		for (int connectionIndex = 0; connectionIndex < connectionCount;
+			 connectionIndex++)
+		{
+			int connectionFlags = 0;
+
+			if (connectionIndex > 0)
+			{
+				connectionFlags |= FORCE_NEW_CONNECTION | OPTIONAL_CONNECTION;
+			}
+
+			MultiConnection *connection =
+				StartNodeUserDatabaseConnection(connectionFlags, nodePlacement->nodeName,
+												nodePlacement->nodePort, NULL, NULL);
+			if (connection == NULL)
+			{
+				/* no more connections allowed to this node */
+				break;
+			}
+
+			nodeConnectionList = lappend(nodeConnectionList, connection);
+		}
+
+		nodeConnectionLists = lappend(nodeConnectionLists, nodeConnectionList);
+		newConnectionList = list_concat(newConnectionList, nodeConnectionList);
+	}
+
+	FinishConnectionListEstablishment(newConnectionList);
+
+	List *nodeConnectionList = NIL;
+	forboth_ptr(nodePlacementList, nodePlacementLists,
+				nodeConnectionList, nodeConnectionLists)
+	{
+		List *establishedConnectionList = NIL;
+
+		MultiConnection *connection = NULL;
+		foreach_declared_ptr(connection, nodeConnectionList)
+		{
+			if (PQstatus(connection->pgConn) != CONNECTION_OK)
+			{
+				if (establishedConnectionList == NIL)
+				{
+					ReportConnectionError(connection, ERROR);
+				}
+
+				CloseConnection(connection);
+				continue;
+			}
+
+			establishedConnectionList = lappend(establishedConnectionList, connection);
+		}
+
+		int placementIndex = 0;
+		ShardPlacement *placement = NULL;
+		foreach_declared_ptr(placement, nodePlacementList)
+		{
+			int connectionIndex = placementIndex % list_length(establishedConnectionList);
+			connection = list_nth(establishedConnectionList, connectionIndex);
+
+			/* make sure later commands in the transaction see the access */
+			ShardPlacementAccess *placementAccess =
+				CreatePlacementAccess(placement, PLACEMENT_ACCESS_SELECT);
+			AssignPlacementListToConnection(list_make1(placementAccess), connection);
+
+			CopyToShardStream *stream =
+				CopyToShardStreamForConnection(&streamList, connection);
+			stream->placementList = lappend(stream->placementList, placement);
+
+			placementIndex++;
+		}
+	}
+
+	List *streamConnectionList = NIL;
+	CopyToShardStream *stream = NULL;
+	foreach_declared_ptr(stream, streamList)
+	{
+		/* placements are not retried on other nodes */
+		MarkRemoteTransactionCritical(stream->connection);
+
+		streamConnectionList = lappend(streamConnectionList, stream->connection);
+	}
+
+	RemoteTransactionsBeginIfNecessary(streamConnectionList);
+
+	return streamList;
+}
+
+
+/*
+ * CopyToShardStreamForConnection returns the stream in the given list that
+ * uses the given connection, and adds a new stream to the list if there is
+ * none.
+ */
+static CopyToShardStream *
+CopyToShardStreamForConnection(List **streamList, MultiConnection *connection)
+{
+	CopyToShardStream *stream = NULL;
+	foreach_declared_ptr(stream, *streamList)
+	{
+		if (stream->connection == connection)
+		{
+			return stream;
+		}
+	}
+
+	stream = palloc0(sizeof(CopyToShardStream));
+	stream->connection = connection;
+
+	*streamList = lappend(*streamList, stream);
+
+	return stream;
+}
+
+
+/*
+ * ForwardCopyDataFromShardStreams exports the shards of all given streams
+ * concurrently, and forwards the data that they send to the client as soon as
+ * it is received. Each stream exports its shards one after another. The
+ * function returns the number of rows that were forwarded.
+ */
+static int64
+ForwardCopyDataFromShardStreams(CopyOutState copyOutState, CopyStmt *copyStatement,
+								List *streamList)
+{
+	int eventSetSize = list_length(streamList) + 2;
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	WaitEventSet *volatile waitEventSet = NULL;
+	int64 tuplesSent = 0;
+
+	PG_TRY();
+	{
+		int activeStreamCount = 0;
+
+		waitEventSet = CreateWaitEventSet(WaitEventSetTracker_compat, eventSetSize);
+
+		CopyToShardStream *stream = NULL;
+		foreach_declared_ptr(stream, streamList)
+		{
+			int sock = PQsocket(stream->connection->pgConn);
+
+			stream->waitEventSetIndex =
+				CitusAddWaitEventSetToSet(waitEventSet, WL_SOCKET_READABLE, sock,
+										  NULL, (void *) stream);
+			if (stream->waitEventSetIndex == WAIT_EVENT_SET_INDEX_FAILED)
+			{
+				ReportConnectionError(stream->connection, ERROR);
+			}
+		}
+
+		AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL,
+						  NULL);
+		AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+		foreach_declared_ptr(stream, streamList)
+		{
+			StartCopyToShardStream(stream, copyStatement, waitEventSet);
+			activeStreamCount++;
+		}
+
+		while (activeStreamCount > 0)
+		{
+			long timeout = -1;
+
+			int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
+											  eventSetSize, PG_WAIT_EXTENSION);
+
+			for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+			{
+				WaitEvent *event = &events[eventIndex];
+
+				if (event->events & WL_POSTMASTER_DEATH)
+				{
+					ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+				}
+
+				if (event->events & WL_LATCH_SET)
+				{
+					ResetLatch(MyLatch);
+					CHECK_FOR_INTERRUPTS();
+					continue;
+				}
+
+				stream = (CopyToShardStream *) event->user_data;
+				if (stream->currentPlacement == NULL)
+				{
+					/* consume notices that the remote node might send */
+					if (PQconsumeInput(stream->connection->pgConn) == 0)
+					{
+						ReportConnectionError(stream->connection, ERROR);
+					}
+
+					continue;
+				}
+
+				if (!ContinueCopyToShardStream(stream, copyOutState, waitEventSet,
+											   &tuplesSent))
+				{
+					continue;
+				}
+
+				if (stream->nextPlacementIndex < list_length(stream->placementList))
+				{
+					StartCopyToShardStream(stream, copyStatement, waitEventSet);
+				}
+				else
+				{
+					activeStreamCount--;
+				}
+			}
+		}
+
+		FreeWaitEventSet(waitEventSet);
+		waitEventSet = NULL;
+	}
+	PG_CATCH();
+	{
+		/* make sure the epoll file descriptor is always closed */
+		if (waitEventSet != NULL)
+		{
+			FreeWaitEventSet(waitEventSet);
+			waitEventSet = NULL;
+		}
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pfree(events);
+
+	return tuplesSent;
+}
+
+
+/*
+ * StartCopyToShardStream sends the COPY command for the next shard of the
+ * given stream, without waiting for the remote node to respond.
+ */
+static void
+StartCopyToShardStream(CopyToShardStream *stream, CopyStmt *copyStatement,
+					   WaitEventSet *waitEventSet)
+{
+	MultiConnection *connection = stream->connection;
+	ShardPlacement *placement = list_nth(stream->placementList,
+										 stream->nextPlacementIndex);
+
+	StringInfo copyCommand = ConstructCopyStatement(copyStatement, placement->shardId);
+
+	if (!SendRemoteCommand(connection, copyCommand->data))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	stream->currentPlacement = placement;
+	stream->nextPlacementIndex++;
+	stream->copyStarted = false;
+	stream->copyFinished = false;
+	stream->binaryHeaderSkipped = false;
+
+	int sendStatus = PQflush(connection->pgConn);
+	if (sendStatus == -1)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	stream->sendPending = (sendStatus == 1);
+	if (stream->sendPending)
+	{
+		/* wait until the socket accepts the rest of the command */
+		uint32 eventMask = WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE;
+		if (!CitusModifyWaitEvent(waitEventSet, stream->waitEventSetIndex,
+								  eventMask, NULL))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+}
+
+
+/*
+ * ContinueCopyToShardStream processes the data that became available on the
+ * connection of the given stream without blocking, and forwards the received
+ * COPY data to the client. The function returns true when the current shard
+ * has been exported completely, and the connection can export the next shard.
+ */
+static bool
+ContinueCopyToShardStream(CopyToShardStream *stream, CopyOutState copyOutState,
+						  WaitEventSet *waitEventSet, int64 *tuplesSent)
+{
+	MultiConnection *connection = stream->connection;
+	PGconn *pgConn = connection->pgConn;
+	bool raiseErrors = true;
+
+	if (stream->sendPending)
+	{
+		int sendStatus = PQflush(pgConn);
+		if (sendStatus == -1)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+		else if (sendStatus == 1)
+		{
+			return false;
+		}
+
+		/* done writing, only wait for read events */
+		if (!CitusModifyWaitEvent(waitEventSet, stream->waitEventSetIndex,
+								  WL_SOCKET_READABLE, NULL))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		stream->sendPending = false;
+	}
+
+	if (PQconsumeInput(pgConn) == 0)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	if (!stream->copyStarted)
+	{
+		if (PQisBusy(pgConn))
+		{
+			/* the remote node did not start sending the shard yet */
+			return false;
+		}
+
+		PGresult *result = PQgetResult(pgConn);
+		if (PQresultStatus(result) != PGRES_COPY_OUT)
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+
+		stream->copyStarted = true;
+	}
+
+	if (!stream->copyFinished)
+	{
+		char *receiveBuffer = NULL;
+		const int useAsync = 1;
+
+		/* forward all rows that were received, they cannot be waited for again */
+		int receiveLength = PQgetCopyData(pgConn, &receiveBuffer, useAsync);
+		while (receiveLength > 0)
+		{
+			ForwardShardCopyData(stream, copyOutState, receiveBuffer, receiveLength,
+								 tuplesSent);
+
+			PQfreemem(receiveBuffer);
+
+			receiveLength = PQgetCopyData(pgConn, &receiveBuffer, useAsync);
+		}
+
+		if (receiveLength == 0)
+		{
+			return false;
+		}
+		else if (receiveLength != -1)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		stream->copyFinished = true;
+	}
+
+	if (PQisBusy(pgConn))
+	{
+		return false;
+	}
+
+	PGresult *result = PQgetResult(pgConn);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	stream->currentPlacement = NULL;
+
+	return true;
+}
+
+
+/*
+ * ForwardShardCopyData forwards a row that a shard sent to the client. In
+ * binary format, the header that precedes the first row of a shard and the
+ * trailer that follows its last row are left out.
+ */
+static void
+ForwardShardCopyData(CopyToShardStream *stream, CopyOutState copyOutState,
+					 char *data, int length, int64 *tuplesSent)
+{
+	bool includeEndOfLine = false;
+
+	if (copyOutState->binary)
+	{
+		if (!stream->binaryHeaderSkipped)
+		{
+			int headerLength = BinaryCopyHeaderLength(data, length);
+
+			data += headerLength;
+			length -= headerLength;
+			stream->binaryHeaderSkipped = true;
+		}
+
+		/* rows start with their field count, the trailer is a field count of -1 */
+		if (length == 0 ||
+			(length == sizeof(int16) && (uint8) data[0] == 0xFF &&
+			 (uint8) data[1] == 0xFF))
+		{
+			return;
+		}
+	}
+
+	CopySendData(copyOutState, data, length);
+	CopySendEndOfRow(copyOutState, includeEndOfLine);
+
+	(*tuplesSent)++;
+}
+
+
+/*
+ * BinaryCopyHeaderLength returns the length of the binary COPY header at the
+ * start of the given data, including its header extension.
+ */
+static int
+BinaryCopyHeaderLength(char *data, int length)
+{
+	const int signatureLength = sizeof(BinarySignature);
+	const int fixedHeaderLength = signatureLength + 2 * sizeof(uint32);
+	uint32 extensionLength = 0;
+
+	if (length < fixedHeaderLength ||
+		memcmp(data, BinarySignature, signatureLength) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unexpected binary COPY header from shard")));
+	}
+
+	memcpy(&extensionLength, data + signatureLength + sizeof(uint32),
+		   sizeof(uint32));
+	extensionLength = ntohl(extensionLength);
+
+	if (extensionLength > (uint32) (length - fixedHeaderLength))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unexpected binary COPY header from shard")));
+	}
+
+	return fixedHeaderLength + extensionLength;
+}
+
+
 /*
  * Check whether the current user has the permission to execute a COPY
  * statement, raise ERROR if not. In some cases we have to do this separately
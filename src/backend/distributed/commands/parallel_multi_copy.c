@@ -0,0 +1,1059 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_multi_copy.c
+ *    Parses the input of COPY into distributed tables in parallel workers.
+ *
+ * COPY ... FROM normally parses every row, evaluates column defaults, finds
+ * the shard of the row and serializes it for the shard in the backend that
+ * runs the COPY, which limits ingestion to what a single core can parse. When
+ * citus.max_parallel_copy_workers is set, the backend instead splits text or
+ * CSV input into chunks at line boundaries and hands the chunks to parallel
+ * workers through shared memory queues. Each worker parses the rows in its
+ * chunks, finds their shards, serializes them, and sends them back to the
+ * backend in batches.
+ *
+ * The backend itself only passes the serialized rows on to the placement
+ * connections of the CitusCopyDestReceiver. That way all rows are still
+ * written over the connections of the backend, and the COPY keeps a single
+ * distributed transaction.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/parallel.h"
+#include "access/table.h"
+#include "catalog/pg_proc.h"
+#include "commands/copy.h"
+#include "commands/copyfrom_internal.h"
+#include "commands/defrem.h"
+#include "commands/progress.h"
+#include "executor/executor.h"
+#include "mb/pg_wchar.h"
+#include "optimizer/optimizer.h"
+#include "rewrite/rewriteHandler.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+#include "distributed/commands/multi_copy.h"
+#include "distributed/listutils.h"
+#include "distributed/parallel_multi_copy.h"
+#include "distributed/transmit.h"
+
+
+/* keys of the parallel COPY state in the table of contents of the DSM segment */
+#define PARALLEL_COPY_KEY_SHARED UINT64CONST(0xC17C000000000001)
+#define PARALLEL_COPY_KEY_COPY_STATEMENT UINT64CONST(0xC17C000000000002)
+#define PARALLEL_COPY_KEY_INPUT_QUEUES UINT64CONST(0xC17C000000000003)
+#define PARALLEL_COPY_KEY_OUTPUT_QUEUES UINT64CONST(0xC17C000000000004)
+
+/* size of the queues that carry input to and rows from each worker */
+#define PARALLEL_COPY_QUEUE_SIZE (256 * 1024)
+
+/* minimum size of the chunks of input that are sent to workers */
+#define PARALLEL_COPY_CHUNK_SIZE (64 * 1024)
+
+/* size of the batches of rows that workers send back */
+#define PARALLEL_COPY_BATCH_SIZE (64 * 1024)
+
+
+/*
+ * ParallelCopyShared contains the fixed-size state that the leader shares with
+ * parallel COPY workers.
+ */
+typedef struct ParallelCopyShared
+{
+	Oid relationId;
+	int partitionColumnIndex;
+	uint64 appendShardId;
+
+	/* whether rows are serialized in binary COPY format */
+	bool binaryOutput;
+} ParallelCopyShared;
+
+
+/*
+ * ParallelCopyChunkHeader precedes every chunk of input that the leader sends
+ * to a worker, such that the worker can report line numbers of the input as
+ * a whole in errors.
+ */
+typedef struct ParallelCopyChunkHeader
+{
+	/* line number of the first line of the chunk in the input of the COPY */
+	uint64 firstLineNumber;
+
+	/* number of lines in the chunk, counted in the same way as COPY does */
+	uint64 lineCount;
+} ParallelCopyChunkHeader;
+
+
+/*
+ * ParallelCopyChunkStart records the line number at which a chunk that a
+ * worker received starts, both in the input of the worker and in the input
+ * of the COPY.
+ */
+typedef struct ParallelCopyChunkStart
+{
+	uint64 workerLineNumber;
+	uint64 lineNumber;
+} ParallelCopyChunkStart;
+
+
+/*
+ * ParallelCopyRowHeader precedes every row in the batches that workers send
+ * to the leader, and is followed by the serialized row.
+ */
+typedef struct ParallelCopyRowHeader
+{
+	int64 shardId;
+	uint32 rowLength;
+} ParallelCopyRowHeader;
+
+
+/*
+ * ParallelCopyState is the state of the leader of a parallel COPY.
+ */
+typedef struct ParallelCopyState
+{
+	ParallelContext *parallelContext;
+	int workerCount;
+
+	/* queues for sending input to, and receiving rows from each worker */
+	shm_mq_handle **inputQueues;
+	shm_mq_handle **outputQueues;
+	int activeOutputCount;
+	int nextWorkerIndex;
+
+	/* whether all input was sent to the workers */
+	bool inputFinished;
+
+	/* input that was received, but not yet sent to a worker */
+	StringInfo pendingInput;
+
+	/* how far the pending input was scanned, and where its last line starts */
+	int scanOffset;
+	int lineStart;
+
+	/*
+	 * Number of lines before lineStart, and of line breaks in quoted fields
+	 * after it, which COPY counts as lines as well.
+	 */
+	uint64 completeLineCount;
+	uint64 partialLineCount;
+
+	/* number of lines that were sent to workers */
+	uint64 sentLineCount;
+
+	/* state of the scan for line boundaries */
+	bool csvFormat;
+	char quoteCharacter;
+	bool inQuotes;
+	bool escapePending;
+
+	/* whether the end-of-copy marker was found in the input */
+	bool endOfData;
+
+	CitusCopyDestReceiver *copyDest;
+	uint64 processedRowCount;
+} ParallelCopyState;
+
+
+/* GUC, number of parallel workers that parse the input of COPY FROM */
+int MaxParallelCopyWorkers = 0;
+
+/* input queue of a parallel COPY worker, and the input message it reads from */
+static shm_mq_handle *ParallelCopyInputQueue = NULL;
+static char *ParallelCopyInputData = NULL;
+static Size ParallelCopyInputLength = 0;
+static Size ParallelCopyInputOffset = 0;
+
+/* starts of the chunks that a parallel COPY worker received, and their lines */
+static List *ParallelCopyChunkStartList = NIL;
+static uint64 ParallelCopyWorkerLineCount = 0;
+
+
+static bool ParallelCopyOptionsSupported(List *copyOptions, bool *csvFormat,
+										 char *quoteCharacter);
+static bool ColumnsCanBeParsedInParallel(Relation copiedDistributedRelation,
+										 bool binaryOutput);
+static void AddParallelCopyInput(StringInfo copyData, void *context);
+static void ScanParallelCopyInput(ParallelCopyState *copyState);
+static bool IsEndOfCopyMarker(const char *line, int lineLength);
+static void FinishParallelCopyInput(ParallelCopyState *copyState);
+static void SendParallelCopyChunk(ParallelCopyState *copyState, int chunkLength,
+								  uint64 lineCount);
+static bool ReceiveParallelCopyRows(ParallelCopyState *copyState);
+static void SendParallelCopyRows(ParallelCopyState *copyState, char *rowBatch,
+								 Size batchLength);
+static void ParallelCopyWorkerFailed(ParallelCopyState *copyState);
+static int ReadParallelCopyInput(void *outbuf, int minread, int maxread);
+static void ParallelCopyErrorCallback(void *arg);
+static void SendParallelCopyRowBatch(shm_mq_handle *outputQueue, StringInfo rowBatch);
+
+
+/*
+ * CanUseParallelCopyFrom returns whether the input of the given COPY statement
+ * can be parsed by parallel workers. That requires text or CSV input that can
+ * be split at line boundaries without parsing it, and column defaults and
+ * type input and output functions that are safe to run in parallel workers.
+ */
+bool
+CanUseParallelCopyFrom(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+					   Relation copiedDistributedRelation)
+{
+	bool csvFormat = false;
+	char quoteCharacter = '"';
+
+	if (MaxParallelCopyWorkers == 0 || IsInParallelMode())
+	{
+		return false;
+	}
+
+	/* local copy writes to the shards, which is not allowed in parallel mode */
+	if (copyDest->shouldUseLocalCopy)
+	{
+		return false;
+	}
+
+	if (!ParallelCopyOptionsSupported(copyStatement->options, &csvFormat,
+									  &quoteCharacter))
+	{
+		return false;
+	}
+
+	return ColumnsCanBeParsedInParallel(copiedDistributedRelation,
+										copyDest->copyOutState->binary);
+}
+
+
+/*
+ * ParallelCopyOptionsSupported returns whether COPY input with the given
+ * options can be split at line boundaries by only looking at quotes and
+ * escapes, and sets csvFormat and quoteCharacter accordingly. Options such as
+ * HEADER that apply to the input as a whole are not supported.
+ */
+static bool
+ParallelCopyOptionsSupported(List *copyOptions, bool *csvFormat, char *quoteCharacter)
+{
+	char *escapeString = NULL;
+	int fileEncoding = pg_get_client_encoding();
+	DefElem *copyOption = NULL;
+
+	foreach_declared_ptr(copyOption, copyOptions)
+	{
+		char *optionName = copyOption->defname;
+
+		if (strcmp(optionName, "format") == 0)
+		{
+			char *formatName = defGetString(copyOption);
+
+			if (strcmp(formatName, "csv") == 0)
+			{
+				*csvFormat = true;
+			}
+			else if (strcmp(formatName, "text") != 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(optionName, "quote") == 0)
+		{
+			*quoteCharacter = defGetString(copyOption)[0];
+		}
+		else if (strcmp(optionName, "escape") == 0)
+		{
+			escapeString = defGetString(copyOption);
+		}
+		else if (strcmp(optionName, "encoding") == 0)
+		{
+			fileEncoding = pg_char_to_encoding(defGetString(copyOption));
+			if (fileEncoding < 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(optionName, "delimiter") != 0 &&
+				 strcmp(optionName, "null") != 0 &&
+				 strcmp(optionName, "default") != 0 &&
+				 strcmp(optionName, "force_not_null") != 0 &&
+				 strcmp(optionName, "force_null") != 0)
+		{
+			return false;
+		}
+	}
+
+	/* an escape that differs from the quote would need to be tracked as well */
+	if (*csvFormat && escapeString != NULL && escapeString[0] != *quoteCharacter)
+	{
+		return false;
+	}
+
+	/* in these encodings, bytes of multibyte characters can look like quotes */
+	if (PG_ENCODING_IS_CLIENT_ONLY(fileEncoding))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ColumnsCanBeParsedInParallel returns whether the column defaults and the
+ * type input and output functions of the given relation can run in parallel
+ * workers.
+ */
+static bool
+ColumnsCanBeParsedInParallel(Relation copiedDistributedRelation, bool binaryOutput)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(copiedDistributedRelation);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid inputFunctionId = InvalidOid;
+		Oid outputFunctionId = InvalidOid;
+		Oid typeIOParam = InvalidOid;
+		bool typeIsVarlena = false;
+
+		if (column->attisdropped ||
+			column->attgenerated == ATTRIBUTE_GENERATED_STORED)
+		{
+			continue;
+		}
+
+		if (column->atthasdef)
+		{
+			/* in particular, nextval() cannot be called by parallel workers */
+			Node *defaultExpression = build_column_default(copiedDistributedRelation,
+														   column->attnum);
+			if (defaultExpression != NULL &&
+				contain_volatile_functions(defaultExpression))
+			{
+				return false;
+			}
+		}
+
+		getTypeInputInfo(column->atttypid, &inputFunctionId, &typeIOParam);
+
+		if (binaryOutput)
+		{
+			getTypeBinaryOutputInfo(column->atttypid, &outputFunctionId,
+									&typeIsVarlena);
+		}
+		else
+		{
+			getTypeOutputInfo(column->atttypid, &outputFunctionId, &typeIsVarlena);
+		}
+
+		if (func_parallel(inputFunctionId) != PROPARALLEL_SAFE ||
+			func_parallel(outputFunctionId) != PROPARALLEL_SAFE)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ParallelCopyFrom copies the rows in the input of the given COPY statement to
+ * the given destination, using parallel workers to parse them. It returns false
+ * without reading any input when no workers could be started, and otherwise
+ * sets processedRowCount to the number of rows that were copied.
+ */
+bool
+ParallelCopyFrom(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+				 uint64 *processedRowCount)
+{
+	ParallelCopyState *copyState = palloc0(sizeof(ParallelCopyState));
+	copyState->copyDest = copyDest;
+	copyState->pendingInput = makeStringInfo();
+	copyState->quoteCharacter = '"';
+
+	ParallelCopyOptionsSupported(copyStatement->options, &copyState->csvFormat,
+								 &copyState->quoteCharacter);
+
+	/* workers only need the parsing options, the input is read by the leader */
+	CopyStmt *workerCopyStatement = copyObject(copyStatement);
+	workerCopyStatement->filename = NULL;
+	workerCopyStatement->is_program = false;
+
+	char *copyStatementString = nodeToString(workerCopyStatement);
+	Size copyStatementSize = strlen(copyStatementString) + 1;
+	Size queueSpaceSize = mul_size(PARALLEL_COPY_QUEUE_SIZE, MaxParallelCopyWorkers);
+
+	EnterParallelMode();
+
+	ParallelContext *parallelContext =
+		CreateParallelContext("citus", "ParallelCopyFromWorkerMain",
+							  MaxParallelCopyWorkers);
+
+	shm_toc_estimate_chunk(&parallelContext->estimator, sizeof(ParallelCopyShared));
+	shm_toc_estimate_chunk(&parallelContext->estimator, copyStatementSize);
+	shm_toc_estimate_chunk(&parallelContext->estimator, queueSpaceSize);
+	shm_toc_estimate_chunk(&parallelContext->estimator, queueSpaceSize);
+	shm_toc_estimate_keys(&parallelContext->estimator, 4);
+
+	InitializeParallelDSM(parallelContext);
+
+	shm_toc *toc = parallelContext->toc;
+
+	ParallelCopyShared *shared = shm_toc_allocate(toc, sizeof(ParallelCopyShared));
+	shared->relationId = copyDest->distributedRelationId;
+	shared->partitionColumnIndex = copyDest->partitionColumnIndex;
+	shared->appendShardId = copyDest->appendShardId;
+	shared->binaryOutput = copyDest->copyOutState->binary;
+	shm_toc_insert(toc, PARALLEL_COPY_KEY_SHARED, shared);
+
+	char *copyStatementSpace = shm_toc_allocate(toc, copyStatementSize);
+	memcpy(copyStatementSpace, copyStatementString, copyStatementSize);
+	shm_toc_insert(toc, PARALLEL_COPY_KEY_COPY_STATEMENT, copyStatementSpace);
+
+	char *inputQueueSpace = shm_toc_allocate(toc, queueSpaceSize);
+	char *outputQueueSpace = shm_toc_allocate(toc, queueSpaceSize);
+	shm_toc_insert(toc, PARALLEL_COPY_KEY_INPUT_QUEUES, inputQueueSpace);
+	shm_toc_insert(toc, PARALLEL_COPY_KEY_OUTPUT_QUEUES, outputQueueSpace);
+
+	shm_mq **inputQueues = palloc0(parallelContext->nworkers * sizeof(shm_mq *));
+	shm_mq **outputQueues = palloc0(parallelContext->nworkers * sizeof(shm_mq *));
+
+	for (int workerIndex = 0; workerIndex < parallelContext->nworkers; workerIndex++)
+	{
+		Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerIndex);
+
+		inputQueues[workerIndex] = shm_mq_create(inputQueueSpace + queueOffset,
+												 PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_sender(inputQueues[workerIndex], MyProc);
+
+		outputQueues[workerIndex] = shm_mq_create(outputQueueSpace + queueOffset,
+												  PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_receiver(outputQueues[workerIndex], MyProc);
+	}
+
+	LaunchParallelWorkers(parallelContext);
+
+	if (parallelContext->nworkers_launched == 0)
+	{
+		DestroyParallelContext(parallelContext);
+		ExitParallelMode();
+
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("parsing the input of COPY in %d parallel workers",
+							parallelContext->nworkers_launched)));
+
+	copyState->parallelContext = parallelContext;
+	copyState->workerCount = parallelContext->nworkers_launched;
+	copyState->activeOutputCount = copyState->workerCount;
+	copyState->inputQueues = palloc0(copyState->workerCount * sizeof(shm_mq_handle *));
+	copyState->outputQueues = palloc0(copyState->workerCount * sizeof(shm_mq_handle *));
+
+	for (int workerIndex = 0; workerIndex < copyState->workerCount; workerIndex++)
+	{
+		BackgroundWorkerHandle *workerHandle =
+			parallelContext->worker[workerIndex].bgwhandle;
+
+		copyState->inputQueues[workerIndex] =
+			shm_mq_attach(inputQueues[workerIndex], parallelContext->seg, workerHandle);
+		copyState->outputQueues[workerIndex] =
+			shm_mq_attach(outputQueues[workerIndex], parallelContext->seg, workerHandle);
+	}
+
+	List *inputColumnList = copyStatement->attlist;
+	if (inputColumnList == NIL)
+	{
+		inputColumnList = copyDest->columnNameList;
+	}
+
+	RelayCopyFromInput(copyStatement->filename, copyStatement->is_program,
+					   list_length(inputColumnList), AddParallelCopyInput, copyState);
+	FinishParallelCopyInput(copyState);
+
+	/* throws the error of any worker that failed */
+	WaitForParallelWorkersToFinish(parallelContext);
+
+	DestroyParallelContext(parallelContext);
+	ExitParallelMode();
+
+	*processedRowCount = copyState->processedRowCount;
+
+	return true;
+}
+
+
+/*
+ * AddParallelCopyInput adds the given COPY data to the pending input, and
+ * sends the complete lines in it to a worker once there are enough of them.
+ */
+static void
+AddParallelCopyInput(StringInfo copyData, void *context)
+{
+	ParallelCopyState *copyState = (ParallelCopyState *) context;
+
+	/* input after the end-of-copy marker is ignored */
+	if (copyState->endOfData)
+	{
+		return;
+	}
+
+	appendBinaryStringInfo(copyState->pendingInput, copyData->data, copyData->len);
+
+	ScanParallelCopyInput(copyState);
+
+	if (copyState->endOfData || copyState->lineStart >= PARALLEL_COPY_CHUNK_SIZE)
+	{
+		SendParallelCopyChunk(copyState, copyState->lineStart,
+							  copyState->completeLineCount);
+		copyState->completeLineCount = 0;
+	}
+
+	/* pass on rows that workers sent in the meantime */
+	ReceiveParallelCopyRows(copyState);
+}
+
+
+/*
+ * ScanParallelCopyInput scans the pending input that was not scanned yet for
+ * line boundaries, and advances lineStart past the last complete line. Line
+ * breaks within quoted CSV fields and escaped line breaks in text format do
+ * not end a line. Scanning stops at the end-of-copy marker.
+ *
+ * It also counts lines like COPY does for reporting errors, which includes
+ * the line breaks within quoted CSV fields.
+ */
+static void
+ScanParallelCopyInput(ParallelCopyState *copyState)
+{
+	StringInfo pendingInput = copyState->pendingInput;
+	int offset = copyState->scanOffset;
+
+	while (offset < pendingInput->len)
+	{
+		char currentCharacter = pendingInput->data[offset];
+
+		if (copyState->csvFormat)
+		{
+			/* an escaped quote is a doubled quote, which toggles twice */
+			if (currentCharacter == copyState->quoteCharacter)
+			{
+				copyState->inQuotes = !copyState->inQuotes;
+			}
+		}
+		else if (copyState->escapePending)
+		{
+			copyState->escapePending = false;
+			offset++;
+			continue;
+		}
+		else if (currentCharacter == '\\')
+		{
+			copyState->escapePending = true;
+		}
+
+		if (currentCharacter == '\n' && copyState->inQuotes)
+		{
+			copyState->partialLineCount++;
+		}
+		else if (currentCharacter == '\n')
+		{
+			char *line = pendingInput->data + copyState->lineStart;
+
+			if (IsEndOfCopyMarker(line, offset - copyState->lineStart))
+			{
+				copyState->endOfData = true;
+				break;
+			}
+
+			copyState->lineStart = offset + 1;
+			copyState->completeLineCount += copyState->partialLineCount + 1;
+			copyState->partialLineCount = 0;
+		}
+
+		offset++;
+	}
+
+	copyState->scanOffset = offset;
+}
+
+
+/*
+ * IsEndOfCopyMarker returns whether the given line, without its line break, is
+ * the \. marker that ends COPY data.
+ */
+static bool
+IsEndOfCopyMarker(const char *line, int lineLength)
+{
+	if (lineLength > 0 && line[lineLength - 1] == '\r')
+	{
+		lineLength--;
+	}
+
+	return lineLength == 2 && line[0] == '\\' && line[1] == '.';
+}
+
+
+/*
+ * FinishParallelCopyInput sends the remaining input to a worker, signals the
+ * end of the input to all workers, and passes on the rows that the workers
+ * send until all of them are done.
+ */
+static void
+FinishParallelCopyInput(ParallelCopyState *copyState)
+{
+	StringInfo pendingInput = copyState->pendingInput;
+	int chunkLength = copyState->lineStart;
+	uint64 lineCount = copyState->completeLineCount;
+
+	/* the input may end in a line without a line break */
+	if (!copyState->endOfData &&
+		!IsEndOfCopyMarker(pendingInput->data + copyState->lineStart,
+						   pendingInput->len - copyState->lineStart))
+	{
+		chunkLength = pendingInput->len;
+		lineCount += copyState->partialLineCount + 1;
+	}
+
+	SendParallelCopyChunk(copyState, chunkLength, lineCount);
+
+	/* workers see the end of their input once we detach from their queues */
+	for (int workerIndex = 0; workerIndex < copyState->workerCount; workerIndex++)
+	{
+		shm_mq_detach(copyState->inputQueues[workerIndex]);
+	}
+
+	copyState->inputFinished = true;
+
+	while (copyState->activeOutputCount > 0)
+	{
+		if (!ReceiveParallelCopyRows(copyState))
+		{
+			int waitResult = WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, -1L,
+									   WAIT_EVENT_MQ_RECEIVE);
+			if (waitResult & WL_LATCH_SET)
+			{
+				ResetLatch(MyLatch);
+			}
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+
+/*
+ * SendParallelCopyChunk sends the first chunkLength bytes of the pending input,
+ * which contain lineCount lines, to the next worker and removes them from the
+ * pending input. While the queue of the worker is full, it passes on rows that
+ * workers sent in the meantime.
+ */
+static void
+SendParallelCopyChunk(ParallelCopyState *copyState, int chunkLength, uint64 lineCount)
+{
+	StringInfo pendingInput = copyState->pendingInput;
+	ParallelCopyChunkHeader chunkHeader;
+	shm_mq_iovec chunkParts[2];
+
+	if (chunkLength == 0)
+	{
+		return;
+	}
+
+	chunkHeader.firstLineNumber = copyState->sentLineCount + 1;
+	chunkHeader.lineCount = lineCount;
+
+	chunkParts[0].data = (char *) &chunkHeader;
+	chunkParts[0].len = sizeof(chunkHeader);
+	chunkParts[1].data = pendingInput->data;
+	chunkParts[1].len = chunkLength;
+
+	shm_mq_handle *inputQueue = copyState->inputQueues[copyState->nextWorkerIndex];
+	copyState->nextWorkerIndex = (copyState->nextWorkerIndex + 1) %
+								 copyState->workerCount;
+
+	while (true)
+	{
+		/* a partially sent chunk is continued by the next call with the same data */
+		shm_mq_result sendResult = shm_mq_sendv(inputQueue, chunkParts, 2, true, true);
+		if (sendResult == SHM_MQ_SUCCESS)
+		{
+			break;
+		}
+		else if (sendResult == SHM_MQ_DETACHED)
+		{
+			ParallelCopyWorkerFailed(copyState);
+		}
+
+		if (!ReceiveParallelCopyRows(copyState))
+		{
+			int waitResult = WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, -1L,
+									   WAIT_EVENT_MQ_SEND);
+			if (waitResult & WL_LATCH_SET)
+			{
+				ResetLatch(MyLatch);
+			}
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	int remainingLength = pendingInput->len - chunkLength;
+	memmove(pendingInput->data, pendingInput->data + chunkLength, remainingLength);
+	pendingInput->len = remainingLength;
+	pendingInput->data[remainingLength] = '\0';
+
+	copyState->scanOffset -= chunkLength;
+	copyState->lineStart -= chunkLength;
+	copyState->sentLineCount += lineCount;
+}
+
+
+/*
+ * ReceiveParallelCopyRows passes on the batches of rows that are available in
+ * the output queues of the workers without waiting, and returns whether there
+ * were any.
+ */
+static bool
+ReceiveParallelCopyRows(ParallelCopyState *copyState)
+{
+	bool rowsReceived = false;
+
+	for (int workerIndex = 0; workerIndex < copyState->workerCount; workerIndex++)
+	{
+		shm_mq_handle *outputQueue = copyState->outputQueues[workerIndex];
+		Size batchLength = 0;
+		void *rowBatch = NULL;
+
+		if (outputQueue == NULL)
+		{
+			/* the worker is done */
+			continue;
+		}
+
+		shm_mq_result receiveResult = shm_mq_receive(outputQueue, &batchLength,
+													 &rowBatch, true);
+		if (receiveResult == SHM_MQ_SUCCESS)
+		{
+			SendParallelCopyRows(copyState, (char *) rowBatch, batchLength);
+			rowsReceived = true;
+		}
+		else if (receiveResult == SHM_MQ_DETACHED)
+		{
+			/* workers only detach once they parsed all of their input */
+			if (!copyState->inputFinished)
+			{
+				ParallelCopyWorkerFailed(copyState);
+			}
+
+			shm_mq_detach(outputQueue);
+			copyState->outputQueues[workerIndex] = NULL;
+			copyState->activeOutputCount--;
+		}
+	}
+
+	return rowsReceived;
+}
+
+
+/*
+ * SendParallelCopyRows sends the rows in a batch from a worker to the
+ * placements of their shards.
+ */
+static void
+SendParallelCopyRows(ParallelCopyState *copyState, char *rowBatch, Size batchLength)
+{
+	StringInfoData rowData = { NULL, 0, 0, 0 };
+	ParallelCopyRowHeader rowHeader;
+	Size batchOffset = 0;
+
+	while (batchOffset < batchLength)
+	{
+		memcpy(&rowHeader, rowBatch + batchOffset, sizeof(rowHeader));
+		batchOffset += sizeof(rowHeader);
+
+		/* point the row into the batch, the receiver only reads it */
+		rowData.data = rowBatch + batchOffset;
+		rowData.len = rowHeader.rowLength;
+		rowData.maxlen = rowHeader.rowLength;
+
+		CitusCopyDestReceiverSendRowData(copyState->copyDest, rowHeader.shardId,
+										 &rowData);
+
+		batchOffset += rowHeader.rowLength;
+		copyState->processedRowCount++;
+	}
+
+	pgstat_progress_update_param(PROGRESS_COPY_TUPLES_PROCESSED,
+								 copyState->processedRowCount);
+}
+
+
+/*
+ * ParallelCopyWorkerFailed throws the error of a worker that stopped before
+ * parsing all of its input.
+ */
+static void
+ParallelCopyWorkerFailed(ParallelCopyState *copyState)
+{
+	/* the error of the worker is thrown while waiting for the workers */
+	WaitForParallelWorkersToFinish(copyState->parallelContext);
+
+	ereport(ERROR, (errmsg("parallel COPY worker exited unexpectedly")));
+}
+
+
+/*
+ * ParallelCopyFromWorkerMain is the entry point of parallel COPY workers. It
+ * parses the rows in the input that the leader sends, finds the shard of each
+ * row, and sends the rows back serialized in the COPY format of the shards.
+ */
+void
+ParallelCopyFromWorkerMain(dsm_segment *segment, shm_toc *toc)
+{
+	ParallelCopyShared *shared = shm_toc_lookup(toc, PARALLEL_COPY_KEY_SHARED, false);
+	char *copyStatementString = shm_toc_lookup(toc, PARALLEL_COPY_KEY_COPY_STATEMENT,
+											   false);
+	char *inputQueueSpace = shm_toc_lookup(toc, PARALLEL_COPY_KEY_INPUT_QUEUES, false);
+	char *outputQueueSpace = shm_toc_lookup(toc, PARALLEL_COPY_KEY_OUTPUT_QUEUES,
+											false);
+	Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, ParallelWorkerNumber);
+
+	shm_mq *inputQueue = (shm_mq *) (inputQueueSpace + queueOffset);
+	shm_mq_set_receiver(inputQueue, MyProc);
+	ParallelCopyInputQueue = shm_mq_attach(inputQueue, segment, NULL);
+
+	shm_mq *outputQueue = (shm_mq *) (outputQueueSpace + queueOffset);
+	shm_mq_set_sender(outputQueue, MyProc);
+	shm_mq_handle *outputQueueHandle = shm_mq_attach(outputQueue, segment, NULL);
+
+	CopyStmt *copyStatement = (CopyStmt *) stringToNode(copyStatementString);
+
+	Relation distributedRelation = table_open(shared->relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	uint32 columnCount = tupleDescriptor->natts;
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+
+	EState *executorState = CreateExecutorState();
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+
+	/* serialize rows in the same way as CitusCopyDestReceiver */
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->delim = (char *) "\t";
+	copyOutState->null_print = (char *) "\\N";
+	copyOutState->null_print_client = (char *) "\\N";
+	copyOutState->binary = shared->binaryOutput;
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->rowcontext = executorTupleContext;
+
+	FmgrInfo *columnOutputFunctions = ColumnOutputFunctions(tupleDescriptor,
+															copyOutState->binary);
+	Relation copiedDistributedRelation =
+		CopyFromInputRelation(distributedRelation, copyStatement,
+							  shared->partitionColumnIndex, copyOutState,
+							  columnOutputFunctions);
+
+	/* the receiver is only used to find the shards of rows */
+	CitusCopyDestReceiver *copyDest =
+		CreateCitusCopyDestReceiver(shared->relationId, NIL,
+									shared->partitionColumnIndex, executorState,
+									NULL, false);
+	copyDest->appendShardId = shared->appendShardId;
+
+	/* rows are parsed with the column types of the relation */
+	copyDest->skipCoercions = true;
+
+	CopyFromState copyState = BeginCopyFrom(NULL, copiedDistributedRelation, NULL,
+											NULL, false, ReadParallelCopyInput,
+											copyStatement->attlist,
+											copyStatement->options);
+
+	/* rows are serialized directly into the batch for the leader */
+	StringInfo rowBatch = copyOutState->fe_msgbuf;
+	ParallelCopyRowHeader rowHeader;
+
+	/* set up callback to identify error line number */
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = ParallelCopyErrorCallback;
+	errorCallback.arg = (void *) copyState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	while (true)
+	{
+		ResetPerTupleExprContext(executorState);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		bool nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
+										 columnValues, columnNulls);
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (!nextRowFound)
+		{
+			break;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		rowHeader.shardId = ShardIdForTuple(copyDest, columnValues, columnNulls);
+		rowHeader.rowLength = 0;
+
+		/* reserve space for the row header, which we fill in below */
+		int headerOffset = rowBatch->len;
+		appendBinaryStringInfo(rowBatch, (char *) &rowHeader, sizeof(rowHeader));
+
+		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor, copyOutState,
+						  columnOutputFunctions, NULL);
+
+		rowHeader.rowLength = rowBatch->len - headerOffset - sizeof(rowHeader);
+		memcpy(rowBatch->data + headerOffset, &rowHeader, sizeof(rowHeader));
+
+		if (rowBatch->len >= PARALLEL_COPY_BATCH_SIZE)
+		{
+			SendParallelCopyRowBatch(outputQueueHandle, rowBatch);
+		}
+	}
+
+	if (rowBatch->len > 0)
+	{
+		SendParallelCopyRowBatch(outputQueueHandle, rowBatch);
+	}
+
+	EndCopyFrom(copyState);
+
+	/* all lines have been parsed, stop showing line number in errors */
+	error_context_stack = errorCallback.previous;
+
+	/* tells the leader that we are done */
+	shm_mq_detach(outputQueueHandle);
+
+	FreeExecutorState(executorState);
+	table_close(distributedRelation, AccessShareLock);
+}
+
+
+/*
+ * ReadParallelCopyInput is the data source callback of the COPY in a parallel
+ * COPY worker, which reads the chunks of input that the leader sends. The
+ * chunks end at line boundaries, so they form one stream of rows. It records
+ * where each chunk starts for reporting line numbers in errors.
+ */
+static int
+ReadParallelCopyInput(void *outbuf, int minread, int maxread)
+{
+	int bytesRead = 0;
+
+	while (bytesRead < minread)
+	{
+		if (ParallelCopyInputOffset == ParallelCopyInputLength)
+		{
+			Size inputLength = 0;
+			void *inputData = NULL;
+
+			shm_mq_result receiveResult = shm_mq_receive(ParallelCopyInputQueue,
+														 &inputLength, &inputData,
+														 false);
+			if (receiveResult == SHM_MQ_DETACHED)
+			{
+				/* the leader sent all input */
+				break;
+			}
+
+			ParallelCopyChunkHeader chunkHeader;
+			memcpy(&chunkHeader, inputData, sizeof(chunkHeader));
+
+			MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+			ParallelCopyChunkStart *chunkStart = palloc0(sizeof(ParallelCopyChunkStart));
+			chunkStart->workerLineNumber = ParallelCopyWorkerLineCount + 1;
+			chunkStart->lineNumber = chunkHeader.firstLineNumber;
+			ParallelCopyChunkStartList = lappend(ParallelCopyChunkStartList,
+												 chunkStart);
+
+			MemoryContextSwitchTo(oldContext);
+
+			ParallelCopyWorkerLineCount += chunkHeader.lineCount;
+
+			ParallelCopyInputData = (char *) inputData + sizeof(chunkHeader);
+			ParallelCopyInputLength = inputLength - sizeof(chunkHeader);
+			ParallelCopyInputOffset = 0;
+			continue;
+		}
+
+		int copyLength = Min(maxread - bytesRead,
+							 ParallelCopyInputLength - ParallelCopyInputOffset);
+
+		memcpy((char *) outbuf + bytesRead,
+			   ParallelCopyInputData + ParallelCopyInputOffset, copyLength);
+
+		bytesRead += copyLength;
+		ParallelCopyInputOffset += copyLength;
+	}
+
+	return bytesRead;
+}
+
+
+/*
+ * ParallelCopyErrorCallback reports the relation, line and column of the row
+ * that a parallel COPY worker failed to parse, like CopyFromErrorCallback. The
+ * line number in the input of the worker is translated to the line number in
+ * the input of the COPY, using the chunk that the line is in.
+ */
+static void
+ParallelCopyErrorCallback(void *arg)
+{
+	CopyFromState copyState = (CopyFromState) arg;
+	uint64 workerLineNumber = copyState->cur_lineno;
+
+	ParallelCopyChunkStart *chunkStart = NULL;
+	foreach_declared_ptr(chunkStart, ParallelCopyChunkStartList)
+	{
+		if (chunkStart->workerLineNumber > workerLineNumber)
+		{
+			break;
+		}
+
+		copyState->cur_lineno = chunkStart->lineNumber + workerLineNumber -
+								chunkStart->workerLineNumber;
+	}
+
+	CopyFromErrorCallback(copyState);
+
+	copyState->cur_lineno = workerLineNumber;
+}
+
+
+/*
+ * SendParallelCopyRowBatch sends the given batch of rows to the leader, and
+ * resets it for the next batch.
+ */
+static void
+SendParallelCopyRowBatch(shm_mq_handle *outputQueue, StringInfo rowBatch)
+{
+	shm_mq_result sendResult = shm_mq_send(outputQueue, rowBatch->len, rowBatch->data,
+										   false, true);
+	if (sendResult != SHM_MQ_SUCCESS)
+	{
+		ereport(ERROR, (errcode(ERRCODE_ADMIN_SHUTDOWN),
+						errmsg("could not send rows to the parallel COPY leader")));
+	}
+
+	resetStringInfo(rowBatch);
+}
@@ -0,0 +1,972 @@
+/*-------------------------------------------------------------------------
+ *
+ * pass_through_multi_copy.c
+ *    Routes the input of COPY into hash-distributed tables by only parsing
+ *    the distribution column.
+ *
+ * COPY ... FROM normally parses all columns of every row on the coordinator,
+ * and then serializes all of them again to send the row to its shard. For
+ * wide rows, most of that work is wasted, since only the distribution column
+ * is needed to find the shard. When citus.enable_pass_through_copy is set,
+ * text and CSV input into hash-distributed tables is instead only split into
+ * lines and fields, the distribution column of each line is parsed to find
+ * its shard, and the original bytes of the line are forwarded to the COPY on
+ * the shard placements.
+ *
+ * The other columns are then parsed by the shards, which also evaluate the
+ * defaults of the columns that are not in the input. That is only done when
+ * those defaults are immutable, since evaluating for instance nextval() on
+ * the shards would give different results than on the coordinator.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "pgstat.h"
+
+#include "commands/copy.h"
+#include "commands/defrem.h"
+#include "commands/progress.h"
+#include "executor/executor.h"
+#include "mb/pg_wchar.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/optimizer.h"
+#include "rewrite/rewriteHandler.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+
+#include "distributed/commands/multi_copy.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/pass_through_multi_copy.h"
+#include "distributed/transmit.h"
+
+
+/*
+ * PassThroughCopyState is the state of a COPY that forwards input lines to
+ * the shards without parsing all columns.
+ */
+typedef struct PassThroughCopyState
+{
+	CitusCopyDestReceiver *copyDest;
+	char *relationName;
+
+	/* format of the input */
+	bool csvFormat;
+	char delimiterCharacter;
+	char quoteCharacter;
+	char escapeCharacter;
+	int fileEncoding;
+
+	/* null string, in the encoding of the input */
+	char *nullString;
+	int nullStringLength;
+
+	/* position of the distribution column in the input lines */
+	int partitionFieldIndex;
+	char *partitionColumnName;
+
+	/* input function of the distribution column */
+	FmgrInfo partitionColumnInputFunction;
+	Oid partitionColumnTypeIOParam;
+	int32 partitionColumnTypeMod;
+
+	/* column values that are passed to ShardIdForTuple */
+	Datum *columnValues;
+	bool *columnNulls;
+
+	/* input that was received, but not yet forwarded */
+	StringInfo pendingInput;
+
+	/* how far the pending input was scanned, and where the current line starts */
+	int scanOffset;
+	int lineStart;
+
+	/* fields of the current line, as offsets from the start of the line */
+	int fieldIndex;
+	int fieldStart;
+	int partitionFieldStart;
+	int partitionFieldEnd;
+	bool inQuotes;
+
+	/* line break of the input, which is added to a last line without one */
+	const char *lineBreak;
+
+	/* whether the end-of-copy marker was found in the input */
+	bool endOfData;
+
+	/* number of the current line, and whether its distribution column is parsed */
+	uint64 lineNumber;
+	bool parsingPartitionField;
+
+	uint64 processedRowCount;
+} PassThroughCopyState;
+
+
+/* GUC, whether COPY forwards input lines without parsing all columns */
+bool EnablePassThroughCopy = false;
+
+
+static bool PassThroughCopyOptionsSupported(List *copyOptions);
+static List * InputColumnNameList(CopyStmt *copyStatement,
+								  CitusCopyDestReceiver *copyDest);
+static int InputFieldIndex(List *inputColumnNameList, char *columnName);
+static bool ColumnDefaultsCanBeEvaluatedOnShards(Relation distributedRelation,
+												 List *inputColumnNameList);
+static void UsePassThroughCopyFormat(CitusCopyDestReceiver *copyDest,
+									 CopyStmt *copyStatement,
+									 List *inputColumnNameList, int fileEncoding);
+static void AddPassThroughCopyInput(StringInfo copyData, void *context);
+static void ScanPassThroughCopyInput(PassThroughCopyState *copyState,
+									 bool endOfInput);
+static void EndPassThroughCopyField(PassThroughCopyState *copyState, int fieldEnd);
+static void FinishPassThroughCopyLine(PassThroughCopyState *copyState, int lineEnd,
+									  int lineBreakLength);
+static void ForwardPassThroughCopyLine(PassThroughCopyState *copyState, char *line,
+									   int lineLength);
+static void FinishPassThroughCopyInput(PassThroughCopyState *copyState);
+static char * DecodeCsvField(PassThroughCopyState *copyState, char *field,
+							 int fieldLength);
+static char * DecodeTextField(PassThroughCopyState *copyState, char *field,
+							  int fieldLength);
+static int HexDigitValue(char hexDigit);
+static void PassThroughCopyErrorCallback(void *arg);
+
+
+/*
+ * CanUsePassThroughCopyFrom returns whether the input of the given COPY
+ * statement can be forwarded to the shards line by line. That requires text
+ * or CSV input into a hash-distributed table that contains the distribution
+ * column, and immutable defaults for the columns that are not in the input.
+ */
+bool
+CanUsePassThroughCopyFrom(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
+{
+	if (!EnablePassThroughCopy)
+	{
+		return false;
+	}
+
+	CitusTableCacheEntry *cacheEntry =
+		GetCitusTableCacheEntry(copyDest->distributedRelationId);
+	if (!IsCitusTableTypeCacheEntry(cacheEntry, HASH_DISTRIBUTED))
+	{
+		return false;
+	}
+
+	if (!PassThroughCopyOptionsSupported(copyStatement->options))
+	{
+		return false;
+	}
+
+	Relation distributedRelation = copyDest->distributedRelation;
+	Form_pg_attribute partitionColumn =
+		TupleDescAttr(RelationGetDescr(distributedRelation),
+					  copyDest->partitionColumnIndex);
+	List *inputColumnNameList = InputColumnNameList(copyStatement, copyDest);
+
+	if (InputFieldIndex(inputColumnNameList, NameStr(partitionColumn->attname)) < 0)
+	{
+		return false;
+	}
+
+	return ColumnDefaultsCanBeEvaluatedOnShards(distributedRelation,
+												inputColumnNameList);
+}
+
+
+/*
+ * PassThroughCopyOptionsSupported returns whether COPY input with the given
+ * options can be split into lines and fields by only looking at delimiters,
+ * quotes and escapes. Options such as HEADER or FORCE_NULL that change how
+ * lines or fields are interpreted are not supported.
+ */
+static bool
+PassThroughCopyOptionsSupported(List *copyOptions)
+{
+	int fileEncoding = pg_get_client_encoding();
+	DefElem *copyOption = NULL;
+
+	foreach_declared_ptr(copyOption, copyOptions)
+	{
+		char *optionName = copyOption->defname;
+
+		if (strcmp(optionName, "format") == 0)
+		{
+			char *formatName = defGetString(copyOption);
+
+			if (strcmp(formatName, "csv") != 0 && strcmp(formatName, "text") != 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(optionName, "encoding") == 0)
+		{
+			fileEncoding = pg_char_to_encoding(defGetString(copyOption));
+			if (fileEncoding < 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(optionName, "delimiter") != 0 &&
+				 strcmp(optionName, "null") != 0 &&
+				 strcmp(optionName, "quote") != 0 &&
+				 strcmp(optionName, "escape") != 0)
+		{
+			return false;
+		}
+	}
+
+	/* in these encodings, bytes of multibyte characters can look like delimiters */
+	if (PG_ENCODING_IS_CLIENT_ONLY(fileEncoding))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * InputColumnNameList returns the names of the columns in the input of the
+ * given COPY statement, in the order in which they appear in the input.
+ */
+static List *
+InputColumnNameList(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
+{
+	List *inputColumnNameList = NIL;
+
+	if (copyStatement->attlist == NIL)
+	{
+		return copyDest->columnNameList;
+	}
+
+	String *columnNameValue = NULL;
+	foreach_declared_ptr(columnNameValue, copyStatement->attlist)
+	{
+		inputColumnNameList = lappend(inputColumnNameList, strVal(columnNameValue));
+	}
+
+	return inputColumnNameList;
+}
+
+
+/*
+ * InputFieldIndex returns the position of the given column in the input
+ * lines, or -1 if the column is not in the input.
+ */
+static int
+InputFieldIndex(List *inputColumnNameList, char *columnName)
+{
+	int fieldIndex = 0;
+
+	char *inputColumnName = NULL;
+	foreach_declared_ptr(inputColumnName, inputColumnNameList)
+	{
+		if (strcmp(inputColumnName, columnName) == 0)
+		{
+			return fieldIndex;
+		}
+
+		fieldIndex++;
+	}
+
+	return -1;
+}
+
+
+/*
+ * ColumnDefaultsCanBeEvaluatedOnShards returns whether the shards give the
+ * same values as the coordinator for the columns of the given relation that
+ * are not in the input, which is the case when their defaults are immutable.
+ */
+static bool
+ColumnDefaultsCanBeEvaluatedOnShards(Relation distributedRelation,
+									 List *inputColumnNameList)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (column->attisdropped ||
+			column->attgenerated == ATTRIBUTE_GENERATED_STORED ||
+			InputFieldIndex(inputColumnNameList, NameStr(column->attname)) >= 0)
+		{
+			continue;
+		}
+
+		/* also covers identity columns and defaults of domains */
+		Node *defaultExpression = build_column_default(distributedRelation,
+													   column->attnum);
+		if (defaultExpression != NULL && contain_mutable_functions(defaultExpression))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * PassThroughCopyFrom forwards the lines in the input of the given COPY
+ * statement to the shards that the given destination writes to, and returns
+ * the number of lines that were copied.
+ */
+uint64
+PassThroughCopyFrom(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
+{
+	CopyFormatOptions formatOptions;
+	ErrorContextCallback errorCallback;
+
+	/* validates the options in the same way as a regular COPY */
+	memset(&formatOptions, 0, sizeof(CopyFormatOptions));
+	ProcessCopyOptions(NULL, &formatOptions, true, copyStatement->options);
+
+	int fileEncoding = formatOptions.file_encoding;
+	if (fileEncoding < 0)
+	{
+		fileEncoding = pg_get_client_encoding();
+	}
+
+	TupleDesc tupleDescriptor = RelationGetDescr(copyDest->distributedRelation);
+	Form_pg_attribute partitionColumn =
+		TupleDescAttr(tupleDescriptor, copyDest->partitionColumnIndex);
+	List *inputColumnNameList = InputColumnNameList(copyStatement, copyDest);
+	Oid inputFunctionId = InvalidOid;
+
+	PassThroughCopyState *copyState = palloc0(sizeof(PassThroughCopyState));
+	copyState->copyDest = copyDest;
+	copyState->relationName = copyStatement->relation->relname;
+	copyState->csvFormat = formatOptions.csv_mode;
+	copyState->delimiterCharacter = formatOptions.delim[0];
+	copyState->fileEncoding = fileEncoding;
+	copyState->nullString = formatOptions.null_print;
+	copyState->nullStringLength = formatOptions.null_print_len;
+	copyState->partitionColumnName = NameStr(partitionColumn->attname);
+	copyState->partitionFieldIndex = InputFieldIndex(inputColumnNameList,
+													 copyState->partitionColumnName);
+	copyState->partitionFieldStart = -1;
+	copyState->columnValues = palloc0(tupleDescriptor->natts * sizeof(Datum));
+	copyState->columnNulls = palloc0(tupleDescriptor->natts * sizeof(bool));
+	copyState->pendingInput = makeStringInfo();
+	copyState->lineBreak = "\n";
+
+	if (copyState->csvFormat)
+	{
+		copyState->quoteCharacter = formatOptions.quote[0];
+		copyState->escapeCharacter = formatOptions.escape[0];
+	}
+
+	/* fields are compared to the null string before they are converted */
+	if (fileEncoding != GetDatabaseEncoding())
+	{
+		copyState->nullString = pg_server_to_any(copyState->nullString,
+												 copyState->nullStringLength,
+												 fileEncoding);
+		copyState->nullStringLength = strlen(copyState->nullString);
+	}
+
+	getTypeInputInfo(partitionColumn->atttypid, &inputFunctionId,
+					 &copyState->partitionColumnTypeIOParam);
+	fmgr_info(inputFunctionId, &copyState->partitionColumnInputFunction);
+	copyState->partitionColumnTypeMod = partitionColumn->atttypmod;
+
+	UsePassThroughCopyFormat(copyDest, copyStatement, inputColumnNameList,
+							 fileEncoding);
+
+	ereport(DEBUG1, (errmsg("routing the input of COPY by parsing only the "
+							"distribution column")));
+
+	/* set up callback to identify error line number */
+	errorCallback.callback = PassThroughCopyErrorCallback;
+	errorCallback.arg = (void *) copyState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	RelayCopyFromInput(copyStatement->filename, copyStatement->is_program,
+					   list_length(inputColumnNameList), AddPassThroughCopyInput,
+					   copyState);
+	FinishPassThroughCopyInput(copyState);
+
+	error_context_stack = errorCallback.previous;
+
+	return copyState->processedRowCount;
+}
+
+
+/*
+ * UsePassThroughCopyFormat changes the COPY that the given destination sends
+ * to the shards to take lines in the format of the input of the given COPY
+ * statement, rather than the format in which the destination serializes rows.
+ */
+static void
+UsePassThroughCopyFormat(CitusCopyDestReceiver *copyDest, CopyStmt *copyStatement,
+						 List *inputColumnNameList, int fileEncoding)
+{
+	CopyStmt *shardCopyStatement = copyDest->copyStatement;
+	List *shardCopyOptions = NIL;
+	List *shardColumnNameList = NIL;
+
+	DefElem *copyOption = NULL;
+	foreach_declared_ptr(copyOption, copyStatement->options)
+	{
+		if (strcmp(copyOption->defname, "encoding") != 0)
+		{
+			shardCopyOptions = lappend(shardCopyOptions, copyOption);
+		}
+	}
+
+	/* the shards convert the lines from the encoding of the input */
+	char *encodingName = pstrdup(pg_encoding_to_char(fileEncoding));
+	DefElem *encodingOption = makeDefElem("encoding", (Node *) makeString(encodingName),
+										  -1);
+	shardCopyOptions = lappend(shardCopyOptions, encodingOption);
+
+	char *columnName = NULL;
+	foreach_declared_ptr(columnName, inputColumnNameList)
+	{
+		shardColumnNameList = lappend(shardColumnNameList, makeString(columnName));
+	}
+
+	shardCopyStatement->options = shardCopyOptions;
+	shardCopyStatement->attlist = shardColumnNameList;
+
+	/* no COPY was started yet, so the binary headers were not sent either */
+	copyDest->copyOutState->binary = false;
+}
+
+
+/*
+ * AddPassThroughCopyInput adds the given COPY data to the pending input, and
+ * forwards the complete lines in it.
+ */
+static void
+AddPassThroughCopyInput(StringInfo copyData, void *context)
+{
+	PassThroughCopyState *copyState = (PassThroughCopyState *) context;
+	StringInfo pendingInput = copyState->pendingInput;
+
+	/* input after the end-of-copy marker is ignored */
+	if (copyState->endOfData)
+	{
+		return;
+	}
+
+	appendBinaryStringInfo(pendingInput, copyData->data, copyData->len);
+
+	ScanPassThroughCopyInput(copyState, false);
+
+	/* only keep the incomplete last line */
+	if (copyState->lineStart > 0)
+	{
+		int remainingLength = pendingInput->len - copyState->lineStart;
+
+		memmove(pendingInput->data, pendingInput->data + copyState->lineStart,
+				remainingLength);
+		pendingInput->len = remainingLength;
+		pendingInput->data[remainingLength] = '\0';
+
+		copyState->scanOffset -= copyState->lineStart;
+		copyState->lineStart = 0;
+	}
+}
+
+
+/*
+ * ScanPassThroughCopyInput scans the pending input that was not scanned yet
+ * for the boundaries of fields and lines, and forwards every line it finds.
+ * Delimiters and line breaks within quoted CSV fields and escaped characters
+ * in text format do not end a field or line. When a character can only be
+ * interpreted together with the next one, and the next one was not received
+ * yet, scanning stops until more input arrives or endOfInput is set.
+ */
+static void
+ScanPassThroughCopyInput(PassThroughCopyState *copyState, bool endOfInput)
+{
+	StringInfo pendingInput = copyState->pendingInput;
+	int offset = copyState->scanOffset;
+
+	while (offset < pendingInput->len && !copyState->endOfData)
+	{
+		char currentCharacter = pendingInput->data[offset];
+		bool nextCharacterReceived = offset + 1 < pendingInput->len;
+		char nextCharacter = '\0';
+
+		if (nextCharacterReceived)
+		{
+			nextCharacter = pendingInput->data[offset + 1];
+		}
+
+		if (copyState->csvFormat && copyState->inQuotes)
+		{
+			/* a doubled quote toggles twice, other escapes are skipped */
+			if (currentCharacter == copyState->escapeCharacter &&
+				copyState->escapeCharacter != copyState->quoteCharacter)
+			{
+				if (!nextCharacterReceived && !endOfInput)
+				{
+					break;
+				}
+
+				if (nextCharacter == copyState->quoteCharacter ||
+					nextCharacter == copyState->escapeCharacter)
+				{
+					offset += 2;
+					continue;
+				}
+			}
+
+			if (currentCharacter == copyState->quoteCharacter)
+			{
+				copyState->inQuotes = false;
+			}
+
+			offset++;
+		}
+		else if (copyState->csvFormat && currentCharacter == copyState->quoteCharacter)
+		{
+			copyState->inQuotes = true;
+			offset++;
+		}
+		else if (!copyState->csvFormat && currentCharacter == '\\')
+		{
+			if (!nextCharacterReceived && !endOfInput)
+			{
+				break;
+			}
+
+			/* the escaped character is never a delimiter or line break */
+			offset = Min(offset + 2, pendingInput->len);
+		}
+		else if (currentCharacter == copyState->delimiterCharacter)
+		{
+			EndPassThroughCopyField(copyState, offset);
+			offset++;
+		}
+		else if (currentCharacter == '\n' || currentCharacter == '\r')
+		{
+			int lineBreakLength = 1;
+
+			if (currentCharacter == '\r')
+			{
+				if (!nextCharacterReceived && !endOfInput)
+				{
+					break;
+				}
+
+				if (nextCharacter == '\n')
+				{
+					lineBreakLength = 2;
+				}
+			}
+
+			FinishPassThroughCopyLine(copyState, offset, lineBreakLength);
+			offset += lineBreakLength;
+		}
+		else
+		{
+			offset++;
+		}
+	}
+
+	copyState->scanOffset = offset;
+}
+
+
+/*
+ * EndPassThroughCopyField records where the current field ends if it is the
+ * distribution column, and moves on to the next field.
+ */
+static void
+EndPassThroughCopyField(PassThroughCopyState *copyState, int fieldEnd)
+{
+	if (copyState->fieldIndex == copyState->partitionFieldIndex)
+	{
+		copyState->partitionFieldStart = copyState->fieldStart;
+		copyState->partitionFieldEnd = fieldEnd - copyState->lineStart;
+	}
+
+	copyState->fieldIndex++;
+	copyState->fieldStart = fieldEnd + 1 - copyState->lineStart;
+}
+
+
+/*
+ * FinishPassThroughCopyLine forwards the current line, which ends at the line
+ * break at lineEnd, and moves on to the next line. It stops the COPY instead
+ * if the line is the end-of-copy marker.
+ */
+static void
+FinishPassThroughCopyLine(PassThroughCopyState *copyState, int lineEnd,
+						  int lineBreakLength)
+{
+	char *line = copyState->pendingInput->data + copyState->lineStart;
+	int lineLength = lineEnd - copyState->lineStart;
+
+	if (lineLength == 2 && line[0] == '\\' && line[1] == '.')
+	{
+		copyState->endOfData = true;
+		return;
+	}
+
+	EndPassThroughCopyField(copyState, lineEnd);
+
+	if (lineBreakLength == 2)
+	{
+		copyState->lineBreak = "\r\n";
+	}
+	else
+	{
+		copyState->lineBreak = (line[lineLength] == '\r') ? "\r" : "\n";
+	}
+
+	copyState->lineNumber++;
+
+	ForwardPassThroughCopyLine(copyState, line, lineLength + lineBreakLength);
+
+	copyState->lineStart = lineEnd + lineBreakLength;
+	copyState->fieldIndex = 0;
+	copyState->fieldStart = 0;
+	copyState->partitionFieldStart = -1;
+}
+
+
+/*
+ * ForwardPassThroughCopyLine parses the distribution column of the given line
+ * to find its shard, and sends the line including its line break to the
+ * placements of the shard.
+ */
+static void
+ForwardPassThroughCopyLine(PassThroughCopyState *copyState, char *line,
+						   int lineLength)
+{
+	CitusCopyDestReceiver *copyDest = copyState->copyDest;
+	EState *executorState = copyDest->executorState;
+	int partitionColumnIndex = copyDest->partitionColumnIndex;
+	char *partitionValueString = NULL;
+
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(GetPerTupleMemoryContext(executorState));
+
+	copyState->parsingPartitionField = true;
+
+	if (copyState->partitionFieldStart < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("missing data for column \"%s\"",
+							   copyState->partitionColumnName)));
+	}
+
+	char *partitionField = line + copyState->partitionFieldStart;
+	int partitionFieldLength = copyState->partitionFieldEnd -
+							   copyState->partitionFieldStart;
+
+	if (copyState->csvFormat)
+	{
+		partitionValueString = DecodeCsvField(copyState, partitionField,
+											  partitionFieldLength);
+	}
+	else
+	{
+		partitionValueString = DecodeTextField(copyState, partitionField,
+											   partitionFieldLength);
+	}
+
+	copyState->columnNulls[partitionColumnIndex] = (partitionValueString == NULL);
+	copyState->columnValues[partitionColumnIndex] =
+		InputFunctionCall(&copyState->partitionColumnInputFunction,
+						  partitionValueString,
+						  copyState->partitionColumnTypeIOParam,
+						  copyState->partitionColumnTypeMod);
+
+	int64 shardId = ShardIdForTuple(copyDest, copyState->columnValues,
+									copyState->columnNulls);
+
+	copyState->parsingPartitionField = false;
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* point into the pending input, the line is only read */
+	StringInfoData lineData = { NULL, 0, 0, 0 };
+	lineData.data = line;
+	lineData.len = lineLength;
+
+	CitusCopyDestReceiverSendRowData(copyDest, shardId, &lineData);
+
+	ResetPerTupleExprContext(executorState);
+
+	copyState->processedRowCount++;
+
+	pgstat_progress_update_param(PROGRESS_COPY_TUPLES_PROCESSED,
+								 copyState->processedRowCount);
+}
+
+
+/*
+ * FinishPassThroughCopyInput forwards the last line of the input, which may
+ * not end in a line break.
+ */
+static void
+FinishPassThroughCopyInput(PassThroughCopyState *copyState)
+{
+	StringInfo pendingInput = copyState->pendingInput;
+
+	ScanPassThroughCopyInput(copyState, true);
+
+	if (copyState->endOfData || pendingInput->len == copyState->lineStart)
+	{
+		return;
+	}
+
+	if (copyState->inQuotes)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unterminated CSV quoted field")));
+	}
+
+	/* the shards see the line followed by other lines, so it needs a line break */
+	int lineEnd = pendingInput->len;
+	appendStringInfoString(pendingInput, copyState->lineBreak);
+
+	FinishPassThroughCopyLine(copyState, lineEnd, strlen(copyState->lineBreak));
+}
+
+
+/*
+ * DecodeCsvField returns the value of the given CSV field in the server
+ * encoding, or NULL if the field is an unquoted null string.
+ */
+static char *
+DecodeCsvField(PassThroughCopyState *copyState, char *field, int fieldLength)
+{
+	StringInfo fieldValue = makeStringInfo();
+	bool quotedField = false;
+	bool inQuotes = false;
+
+	for (int fieldOffset = 0; fieldOffset < fieldLength; fieldOffset++)
+	{
+		char currentCharacter = field[fieldOffset];
+
+		if (!inQuotes)
+		{
+			if (currentCharacter == copyState->quoteCharacter)
+			{
+				inQuotes = true;
+				quotedField = true;
+				continue;
+			}
+		}
+		else if (currentCharacter == copyState->escapeCharacter &&
+				 fieldOffset + 1 < fieldLength &&
+				 (field[fieldOffset + 1] == copyState->quoteCharacter ||
+				  field[fieldOffset + 1] == copyState->escapeCharacter))
+		{
+			fieldOffset++;
+			currentCharacter = field[fieldOffset];
+		}
+		else if (currentCharacter == copyState->quoteCharacter)
+		{
+			inQuotes = false;
+			continue;
+		}
+
+		appendStringInfoChar(fieldValue, currentCharacter);
+	}
+
+	if (!quotedField && fieldLength == copyState->nullStringLength &&
+		strncmp(field, copyState->nullString, fieldLength) == 0)
+	{
+		return NULL;
+	}
+
+	return pg_any_to_server(fieldValue->data, fieldValue->len,
+							copyState->fileEncoding);
+}
+
+
+/*
+ * DecodeTextField returns the value of the given field in text format in the
+ * server encoding, or NULL if the field is the null string. Like COPY, it
+ * converts the field to the server encoding before interpreting escapes, since
+ * escapes stand for bytes in the server encoding.
+ */
+static char *
+DecodeTextField(PassThroughCopyState *copyState, char *field, int fieldLength)
+{
+	StringInfo fieldValue = makeStringInfo();
+
+	if (fieldLength == copyState->nullStringLength &&
+		strncmp(field, copyState->nullString, fieldLength) == 0)
+	{
+		return NULL;
+	}
+
+	char *serverField = pg_any_to_server(field, fieldLength, copyState->fileEncoding);
+	if (serverField != field)
+	{
+		field = serverField;
+		fieldLength = strlen(serverField);
+	}
+
+	for (int fieldOffset = 0; fieldOffset < fieldLength; fieldOffset++)
+	{
+		char currentCharacter = field[fieldOffset];
+
+		if (currentCharacter != '\\' || fieldOffset + 1 == fieldLength)
+		{
+			appendStringInfoChar(fieldValue, currentCharacter);
+			continue;
+		}
+
+		fieldOffset++;
+		currentCharacter = field[fieldOffset];
+
+		switch (currentCharacter)
+		{
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			{
+				/* up to three octal digits */
+				int characterValue = currentCharacter - '0';
+
+				for (int digitCount = 1; digitCount < 3 &&
+					 fieldOffset + 1 < fieldLength &&
+					 field[fieldOffset + 1] >= '0' && field[fieldOffset + 1] <= '7';
+					 digitCount++)
+				{
+					fieldOffset++;
+					characterValue = (characterValue << 3) + (field[fieldOffset] - '0');
+				}
+
+				currentCharacter = (char) (characterValue & 0377);
+				break;
+			}
+
+			case 'x':
+			{
+				/* up to two hexadecimal digits, a lone x is taken literally */
+				if (fieldOffset + 1 < fieldLength &&
+					HexDigitValue(field[fieldOffset + 1]) >= 0)
+				{
+					fieldOffset++;
+					int characterValue = HexDigitValue(field[fieldOffset]);
+
+					if (fieldOffset + 1 < fieldLength &&
+						HexDigitValue(field[fieldOffset + 1]) >= 0)
+					{
+						fieldOffset++;
+						characterValue = (characterValue << 4) +
+										 HexDigitValue(field[fieldOffset]);
+					}
+
+					currentCharacter = (char) (characterValue & 0xff);
+				}
+				break;
+			}
+
+			case 'b':
+			{
+				currentCharacter = '\b';
+				break;
+			}
+
+			case 'f':
+			{
+				currentCharacter = '\f';
+				break;
+			}
+
+			case 'n':
+			{
+				currentCharacter = '\n';
+				break;
+			}
+
+			case 'r':
+			{
+				currentCharacter = '\r';
+				break;
+			}
+
+			case 't':
+			{
+				currentCharacter = '\t';
+				break;
+			}
+
+			case 'v':
+			{
+				currentCharacter = '\v';
+				break;
+			}
+
+			default:
+			{
+				/* any other character stands for itself */
+				break;
+			}
+		}
+
+		appendStringInfoChar(fieldValue, currentCharacter);
+	}
+
+	/* escapes may have produced invalid characters */
+	pg_verifymbstr(fieldValue->data, fieldValue->len, false);
+
+	return fieldValue->data;
+}
+
+
+/*
+ * HexDigitValue returns the value of the given hexadecimal digit, or -1 if
+ * the character is not a hexadecimal digit.
+ */
+static int
+HexDigitValue(char hexDigit)
+{
+	if (hexDigit >= '0' && hexDigit <= '9')
+	{
+		return hexDigit - '0';
+	}
+	else if (hexDigit >= 'a' && hexDigit <= 'f')
+	{
+		return hexDigit - 'a' + 10;
+	}
+	else if (hexDigit >= 'A' && hexDigit <= 'F')
+	{
+		return hexDigit - 'A' + 10;
+	}
+
+	return -1;
+}
+
+
+/*
+ * PassThroughCopyErrorCallback adds the line number to errors that occur while
+ * parsing the distribution column. Errors in other columns are reported by the
+ * shards.
+ */
+static void
+PassThroughCopyErrorCallback(void *arg)
+{
+	PassThroughCopyState *copyState = (PassThroughCopyState *) arg;
+
+	if (copyState->parsingPartitionField)
+	{
+		errcontext("COPY %s, line " UINT64_FORMAT ", column %s",
+				   copyState->relationName, copyState->lineNumber,
+				   copyState->partitionColumnName);
+	}
+}
@@ -82,6 +82,7 @@
 #include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
 #include "distributed/string_utils.h"
+#include "distributed/subplan_execution.h"
 #include "distributed/transaction_management.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_shard_visibility.h"
@@ -113,6 +114,7 @@ static void IncrementUtilityHookCountersIfNecessary(Node *parsetree);
 static void PostStandardProcessUtility(Node *parsetree);
 static void DecrementUtilityHookCountersIfNecessary(Node *parsetree);
 static bool IsDropSchemaOrDB(Node *parsetree);
+static bool UtilityStatementCanModifyData(Node *parsetree);
 static bool ShouldCheckUndistributeCitusLocalTables(void);
 
 
@@ -198,6 +200,15 @@ citus_ProcessUtility(PlannedStmt *pstmt,
 		return;
 	}
 
+	if (UtilityStatementCanModifyData(parsetree))
+	{
+		/*
+		 * Utility commands such as DDL, TRUNCATE, COPY and CALL may modify
+		 * the tables that reusable subplan results were computed from.
+		 */
+		InvalidateSubPlanResults(InvalidOid);
+	}
+
 	bool isCreateAlterExtensionUpdateCitusStmt = IsCreateAlterExtensionUpdateCitusStmt(
 		parsetree);
 
@@ -1116,6 +1127,47 @@ IsDropSchemaOrDB(Node *parsetree)
 }
 
 
+/*
+ * UtilityStatementCanModifyData returns false for utility statements that do
+ * not modify tables themselves. Statements such as EXECUTE and EXPLAIN run
+ * their query through the executor, which invalidates reusable subplan
+ * results when the query modifies tables. Rolling back to a savepoint resets
+ * the results when the subtransaction aborts.
+ */
+static bool
+UtilityStatementCanModifyData(Node *parsetree)
+{
+	switch (nodeTag(parsetree))
+	{
+		case T_VariableSetStmt:
+		case T_VariableShowStmt:
+		case T_TransactionStmt:
+		case T_ExecuteStmt:
+		case T_ExplainStmt:
+		case T_PrepareStmt:
+		case T_DeallocateStmt:
+		case T_DeclareCursorStmt:
+		case T_FetchStmt:
+		case T_ClosePortalStmt:
+		{
+			return false;
+		}
+
+		case T_CopyStmt:
+		{
+			/* COPY (query) TO may run a modifying query through the utility path */
+			CopyStmt *copyStatement = (CopyStmt *) parsetree;
+			return copyStatement->is_from || copyStatement->query != NULL;
+		}
+
+		default:
+		{
+			return true;
+		}
+	}
+}
+
+
 /*
  * ExecuteDistributedDDLJob simply executes a provided DDLJob in a distributed trans-
  * action, including metadata sync if needed. If the multi shard commit protocol is
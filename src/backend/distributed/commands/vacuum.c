@@ -24,6 +24,7 @@
 #include "distributed/commands.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_statistics.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
@@ -104,6 +105,10 @@ PostprocessVacuumStmt(Node *node, const char *vacuumCommand)
 		/* no table is specified (unqualified vacuum) */
 
 		ExecuteUnqualifiedVacuumTasks(vacuumStmt, vacuumParams);
+
+		RefreshDistributedTableStatistics(
+			list_concat(CitusTableTypeIdList(DISTRIBUTED_TABLE),
+						CitusTableTypeIdList(REFERENCE_TABLE)));
 	}
 	else if (IsDistributedVacuumStmt(relationIdList))
 	{
@@ -111,6 +116,8 @@ PostprocessVacuumStmt(Node *node, const char *vacuumCommand)
 
 		ExecuteVacuumOnDistributedTables(vacuumStmt, relationIdList,
 										 vacuumParams);
+
+		RefreshDistributedTableStatistics(relationIdList);
 	}
 
 	/* else only local tables are specified */
@@ -43,6 +43,8 @@ char *GrepRemoteCommands = "";
 static bool ClearResultsInternal(MultiConnection *connection, bool raiseErrors,
 								 bool discardWarnings);
 static bool FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts);
+static MultiConnection * FinishConnectionListIO(List *connectionList,
+												bool raiseInterrupts);
 static WaitEventSet * BuildWaitEventSet(MultiConnection **allConnections,
 										int totalConnectionCount,
 										int pendingConnectionsStartIndex);
@@ -778,6 +780,79 @@ PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg)
 }
 
 
+/*
+ * PutRemoteCopyDataToConnectionList is a wrapper around PQputCopyData() that
+ * sends the same data to all connections in the list. Like PutRemoteCopyData()
+ * it provides back pressure once the connections buffered more than
+ * citus.remote_copy_flush_threshold bytes, but it flushes the connections at
+ * the same time, such that a slow node does not hold up sending to the others.
+ *
+ * Returns NULL if the data was sent on all connections, or otherwise the
+ * connection on which sending failed.
+ */
+MultiConnection *
+PutRemoteCopyDataToConnectionList(List *connectionList, const char *buffer, int nbytes)
+{
+	List *flushConnectionList = NIL;
+	bool allowInterrupts = true;
+
+	MultiConnection *connection = NULL;
+	foreach_declared_ptr(connection, connectionList)
+	{
+		PGconn *pgConn = connection->pgConn;
+
+		if (PQstatus(pgConn) != CONNECTION_OK)
+		{
+			return connection;
+		}
+
+		Assert(PQisnonblocking(pgConn));
+
+		int copyState = PQputCopyData(pgConn, buffer, nbytes);
+		if (copyState <= 0)
+		{
+			return connection;
+		}
+
+		connection->copyBytesWrittenSinceLastFlush += nbytes;
+		if (connection->copyBytesWrittenSinceLastFlush > RemoteCopyFlushThreshold)
+		{
+			connection->copyBytesWrittenSinceLastFlush = 0;
+			flushConnectionList = lappend(flushConnectionList, connection);
+		}
+	}
+
+	return FinishConnectionListIO(flushConnectionList, allowInterrupts);
+}
+
+
+/*
+ * FlushRemoteCopyData sends the COPY data that libpq buffered for the given
+ * connections to the remote nodes, and waits until it is sent.
+ *
+ * Returns NULL if the data was sent on all connections, or otherwise the
+ * connection on which sending failed.
+ */
+MultiConnection *
+FlushRemoteCopyData(List *connectionList)
+{
+	bool allowInterrupts = true;
+
+	MultiConnection *connection = NULL;
+	foreach_declared_ptr(connection, connectionList)
+	{
+		if (PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			return connection;
+		}
+
+		connection->copyBytesWrittenSinceLastFlush = 0;
+	}
+
+	return FinishConnectionListIO(connectionList, allowInterrupts);
+}
+
+
 /*
  * FinishConnectionIO performs pending IO for the connection, while accepting
  * interrupts.
@@ -868,6 +943,193 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
 }
 
 
+/*
+ * FinishConnectionListIO sends the pending output of all connections in the
+ * list, while waiting for whichever connection is ready to receive more data.
+ *
+ * Returns NULL if all output was sent, or otherwise the connection on which
+ * sending failed.
+ */
+static MultiConnection *
+FinishConnectionListIO(List *connectionList, bool raiseInterrupts)
+{
+	List *pendingConnectionList = NIL;
+
+	if (raiseInterrupts)
+	{
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	/* try to send all pending data without waiting first */
+	MultiConnection *connection = NULL;
+	foreach_declared_ptr(connection, connectionList)
+	{
+		int sendStatus = PQflush(connection->pgConn);
+		if (sendStatus == -1)
+		{
+			return connection;
+		}
+		else if (sendStatus == 1)
+		{
+			pendingConnectionList = lappend(pendingConnectionList, connection);
+		}
+	}
+
+	int pendingConnectionCount = list_length(pendingConnectionList);
+	if (pendingConnectionCount == 0)
+	{
+		return NULL;
+	}
+	else if (pendingConnectionCount == 1 || pendingConnectionCount > FD_SETSIZE - 3)
+	{
+		/* no need for a wait event set, or too many connections to use one */
+		foreach_declared_ptr(connection, pendingConnectionList)
+		{
+			if (!FinishConnectionIO(connection, raiseInterrupts))
+			{
+				return connection;
+			}
+		}
+
+		return NULL;
+	}
+
+	MultiConnection **pendingConnections =
+		palloc(pendingConnectionCount * sizeof(MultiConnection *));
+	bool *connectionFlushed = palloc0(pendingConnectionCount * sizeof(bool));
+	WaitEvent *events = palloc(pendingConnectionCount * sizeof(WaitEvent));
+	WaitEventSet *volatile waitEventSet = NULL;
+	MultiConnection *volatile failedConnection = NULL;
+	int connectionIndex = 0;
+
+	foreach_declared_ptr(connection, pendingConnectionList)
+	{
+		pendingConnections[connectionIndex] = connection;
+		connectionIndex++;
+	}
+
+	PG_TRY();
+	{
+		int flushedConnectionCount = 0;
+
+		waitEventSet = BuildWaitEventSet(pendingConnections, pendingConnectionCount, 0);
+
+		while (flushedConnectionCount < pendingConnectionCount &&
+			   failedConnection == NULL)
+		{
+			long timeout = -1;
+
+			int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
+											  pendingConnectionCount,
+											  WAIT_EVENT_CLIENT_WRITE);
+
+			for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+			{
+				WaitEvent *event = &events[eventIndex];
+
+				if (event->events & WL_POSTMASTER_DEATH)
+				{
+					ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+				}
+
+				if (event->events & WL_LATCH_SET)
+				{
+					ResetLatch(MyLatch);
+
+					if (raiseInterrupts)
+					{
+						CHECK_FOR_INTERRUPTS();
+					}
+
+					if (IsHoldOffCancellationReceived())
+					{
+						/* mark the transaction of an unfinished connection as failed */
+						for (connectionIndex = 0;
+							 connectionIndex < pendingConnectionCount;
+							 connectionIndex++)
+						{
+							if (!connectionFlushed[connectionIndex])
+							{
+								failedConnection = pendingConnections[connectionIndex];
+								failedConnection->remoteTransaction.transactionFailed =
+									true;
+								break;
+							}
+						}
+
+						break;
+					}
+
+					continue;
+				}
+
+				connection = (MultiConnection *) event->user_data;
+
+				/* consume notices and errors that the remote node might send */
+				if ((event->events & WL_SOCKET_READABLE) &&
+					PQconsumeInput(connection->pgConn) == 0)
+				{
+					failedConnection = connection;
+					break;
+				}
+
+				if (connectionFlushed[event->pos] ||
+					!(event->events & WL_SOCKET_WRITEABLE))
+				{
+					continue;
+				}
+
+				int sendStatus = PQflush(connection->pgConn);
+				if (sendStatus == -1)
+				{
+					failedConnection = connection;
+					break;
+				}
+				else if (sendStatus == 0)
+				{
+					/* done writing, only wait for read events */
+					bool success = CitusModifyWaitEvent(waitEventSet, event->pos,
+														WL_SOCKET_READABLE, NULL);
+					if (!success)
+					{
+						failedConnection = connection;
+						break;
+					}
+
+					connectionFlushed[event->pos] = true;
+					flushedConnectionCount++;
+				}
+			}
+		}
+
+		FreeWaitEventSet(waitEventSet);
+		waitEventSet = NULL;
+
+		pfree(pendingConnections);
+		pfree(connectionFlushed);
+		pfree(events);
+	}
+	PG_CATCH();
+	{
+		/* make sure the epoll file descriptor is always closed */
+		if (waitEventSet != NULL)
+		{
+			FreeWaitEventSet(waitEventSet);
+			waitEventSet = NULL;
+		}
+
+		pfree(pendingConnections);
+		pfree(connectionFlushed);
+		pfree(events);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	return failedConnection;
+}
+
+
 /*
  * WaitForAllConnections blocks until all connections in the list are no
  * longer busy, meaning the pending command has either finished or failed.
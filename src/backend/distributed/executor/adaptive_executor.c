@@ -171,6 +171,7 @@
 #include "distributed/repartition_join_execution.h"
 #include "distributed/resource_lock.h"
 #include "distributed/shared_connection_stats.h"
+#include "distributed/shared_worker_pool_stats.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/transaction_identifier.h"
 #include "distributed/transaction_management.h"
@@ -314,6 +315,22 @@ typedef struct DistributedExecution
 	 * fail, such as CREATE INDEX CONCURRENTLY.
 	 */
 	bool localExecutionSupported;
+
+	/*
+	 * Scan state of a read-only execution whose local tasks can run once all
+	 * the remote tasks are sent, rather than after the remote tasks finish.
+	 * NULL when the local tasks should run after the distributed execution.
+	 */
+	CitusScanState *localExecutionScanState;
+
+	/*
+	 * Shard command executions that we may also send to a second placement
+	 * when the first placement takes too long, see citus.enable_hedged_reads.
+	 */
+	List *hedgedReadCandidateList;
+
+	/* number of cancelled placement executions whose results are still pending */
+	int cancelledPlacementExecutionCount;
 } DistributedExecution;
 
 
@@ -436,6 +453,35 @@ typedef struct WorkerPool
 	/* execution statistics per pool, in microseconds */
 	uint64 totalTaskExecutionTime;
 	int totalExecutedTasks;
+
+	/*
+	 * Maximum number of connections to the node as learned by the earlier
+	 * executions, see shared_worker_pool_stats.c. It is never larger than
+	 * citus.max_adaptive_executor_pool_size.
+	 */
+	int adaptivePoolSizeLimit;
+
+	/*
+	 * Set to true when the pool would have opened more connections if
+	 * adaptivePoolSizeLimit allowed it.
+	 */
+	bool limitedByAdaptivePoolSize;
+
+	/*
+	 * Number of milliseconds after which a read task that is running on the
+	 * node is also sent to another placement, or -1 if we do not hedge reads
+	 * on the node.
+	 */
+	long hedgedReadDelayMs;
+
+	/* execution times of the read tasks on the node, in microseconds */
+	List *readTaskExecutionTimeList;
+
+	/*
+	 * Number of placement executions of this execution that are counted in the
+	 * in-flight tasks of the node, for the latency-aware task assignment policy.
+	 */
+	int inFlightTaskCount;
 } WorkerPool;
 
 struct TaskPlacementExecution;
@@ -502,6 +548,9 @@ int ExecutorSlowStartInterval = 10;
 bool EnableCostBasedConnectionEstablishment = true;
 bool PreventIncompleteConnectionEstablishment = true;
 
+/* GUC, maximum number of read tasks for the same node combined into one query */
+int MaxTasksPerBatch = 1;
+
 
 /*
  * TaskExecutionState indicates whether or not a command on a shard
@@ -566,6 +615,15 @@ typedef struct ShardCommandExecution
 	 * placements. Normally determined by DistributedExecution's same field.
 	 */
 	bool localExecutionSupported;
+
+	/* indicates whether the command was also sent to a second placement */
+	bool hedgedReadStarted;
+
+	/*
+	 * The placement execution whose rows were stored first. For hedged reads,
+	 * the other placement executions are cancelled and their results ignored.
+	 */
+	struct TaskPlacementExecution *resultPlacementExecution;
 } ShardCommandExecution;
 
 /*
@@ -627,6 +685,18 @@ typedef struct TaskPlacementExecution
 	/* execution time statistics for this placement execution */
 	instr_time startTime;
 	instr_time endTime;
+
+	/*
+	 * Set when another placement execution of a hedged read returned results
+	 * first and we sent a cancellation request for this one.
+	 */
+	bool cancelled;
+
+	/*
+	 * Set when the placement execution is counted in the in-flight tasks of
+	 * its node, for the latency-aware task assignment policy.
+	 */
+	bool countedAsInFlight;
 } TaskPlacementExecution;
 
 
@@ -646,12 +716,28 @@ static TransactionProperties DecideTransactionPropertiesForTaskList(RowModifyLev
 																	List *taskList,
 																	bool
 																	exludeFromTransaction);
+static void BatchRemoteReadTasksPerNode(DistributedExecution *execution);
+static bool TaskCanBeBatched(Task *task);
+static Task * CreateBatchTask(List *batchedTaskList);
 static void StartDistributedExecution(DistributedExecution *execution);
 static void RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution);
 static void RunDistributedExecution(DistributedExecution *execution);
+static bool AllRemoteTasksSent(DistributedExecution *execution);
 static void SequentialRunDistributedExecution(DistributedExecution *execution);
 static void FinishDistributedExecution(DistributedExecution *execution);
 static void CleanUpSessions(DistributedExecution *execution);
+static void ReportWorkerPoolStats(DistributedExecution *execution);
+static void ReleaseInFlightTasks(DistributedExecution *execution);
+static bool ShouldHedgeShardCommandExecution(DistributedExecution *execution,
+											 ShardCommandExecution *shardCommandExecution);
+static void StartHedgedReads(DistributedExecution *execution);
+static TaskPlacementExecution * FindHedgedReadPlacementExecution(
+	ShardCommandExecution *shardCommandExecution,
+	TaskPlacementExecution **runningPlacementExecution);
+static bool HasActivePlacementExecution(ShardCommandExecution *shardCommandExecution);
+static bool ClaimHedgedReadResults(TaskPlacementExecution *placementExecution);
+static void CancelPlacementExecution(TaskPlacementExecution *placementExecution);
+static bool DrainCancelledPlacementExecution(WorkerSession *session);
 
 static bool DistributedExecutionModifiesDatabase(DistributedExecution *execution);
 static void AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution);
@@ -872,6 +958,16 @@ AdaptiveExecutor(CitusScanState *scanState)
 	 */
 	StartDistributedExecution(execution);
 
+	/*
+	 * For read-only executions, we do not have to wait for the remote tasks to
+	 * finish before running the local tasks. Instead, we run the local tasks
+	 * while the worker nodes are busy with the remote tasks.
+	 */
+	if (!DistributedExecutionModifiesDatabase(execution))
+	{
+		execution->localExecutionScanState = scanState;
+	}
+
 	if (ShouldRunTasksSequentially(execution->remoteTaskList))
 	{
 		SequentialRunDistributedExecution(execution);
@@ -1243,6 +1339,11 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 		execution->remoteTaskList = list_copy(execution->remoteAndLocalTaskList);
 	}
 
+	if (MaxTasksPerBatch > 1)
+	{
+		BatchRemoteReadTasksPerNode(execution);
+	}
+
 	execution->totalTaskCount = list_length(execution->remoteTaskList);
 	execution->unfinishedTaskCount = list_length(execution->remoteTaskList);
 
@@ -1250,6 +1351,168 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 }
 
 
+/*
+ * BatchRemoteReadTasksPerNode combines the small read tasks in the remote task
+ * list that go to the same node into tasks of at most citus.max_tasks_per_batch
+ * shards, such that each combined task needs a single round trip. The shard
+ * queries are combined via UNION ALL, so their results arrive as one result
+ * set and are processed in the same way as the results of the original tasks.
+ *
+ * The original tasks are kept in remoteAndLocalTaskList, which we use for
+ * locking and relation access tracking.
+ */
+static void
+BatchRemoteReadTasksPerNode(DistributedExecution *execution)
+{
+	if (list_length(execution->remoteTaskList) < 2)
+	{
+		return;
+	}
+
+	/*
+	 * Within a transaction block, later commands may rely on the connection
+	 * each placement was accessed over, so keep a 1:1 mapping of tasks there.
+	 */
+	if (execution->transactionProperties->useRemoteTransactionBlocks ==
+		TRANSACTION_BLOCKS_REQUIRED ||
+		IsMultiStatementTransaction() || InCoordinatedTransaction())
+	{
+		return;
+	}
+
+	List *batchedTaskListPerNode = NIL;
+	List *newRemoteTaskList = NIL;
+
+	Task *task = NULL;
+	foreach_declared_ptr(task, execution->remoteTaskList)
+	{
+		if (!TaskCanBeBatched(task))
+		{
+			newRemoteTaskList = lappend(newRemoteTaskList, task);
+			continue;
+		}
+
+		ShardPlacement *taskPlacement = linitial(task->taskPlacementList);
+		List *nodeBatch = NIL;
+		ListCell *batchCell = NULL;
+
+		foreach(batchCell, batchedTaskListPerNode)
+		{
+			List *candidateBatch = lfirst(batchCell);
+			Task *batchHeadTask = linitial(candidateBatch);
+			ShardPlacement *batchPlacement = linitial(batchHeadTask->taskPlacementList);
+
+			if (batchPlacement->nodeId == taskPlacement->nodeId &&
+				batchHeadTask->parametersInQueryStringResolved ==
+				task->parametersInQueryStringResolved &&
+				list_length(candidateBatch) < MaxTasksPerBatch)
+			{
+				nodeBatch = candidateBatch;
+				break;
+			}
+		}
+
+		if (nodeBatch != NIL)
+		{
+			lfirst(batchCell) = lappend(nodeBatch, task);
+		}
+		else
+		{
+			batchedTaskListPerNode = lappend(batchedTaskListPerNode, list_make1(task));
+		}
+	}
+
+	List *batchedTaskList = NIL;
+	foreach_declared_ptr(batchedTaskList, batchedTaskListPerNode)
+	{
+		if (list_length(batchedTaskList) == 1)
+		{
+			newRemoteTaskList = lappend(newRemoteTaskList, linitial(batchedTaskList));
+		}
+		else
+		{
+			newRemoteTaskList = lappend(newRemoteTaskList,
+										CreateBatchTask(batchedTaskList));
+		}
+	}
+
+	execution->remoteTaskList = newRemoteTaskList;
+}
+
+
+/*
+ * TaskCanBeBatched returns whether the given task is a plain read task on a
+ * single remote placement whose query can be combined with the queries of
+ * other tasks.
+ */
+static bool
+TaskCanBeBatched(Task *task)
+{
+	if (task->taskType != READ_TASK || task->queryCount != 1)
+	{
+		return false;
+	}
+
+	/* batching replicated tasks would limit the placements we can fail over to */
+	if (list_length(task->taskPlacementList) != 1)
+	{
+		return false;
+	}
+
+	/* tasks with a custom destination expect their own result set */
+	if (task->tupleDest != NULL)
+	{
+		return false;
+	}
+
+	if (task->relationRowLockList != NIL || task->partiallyLocalOrRemote)
+	{
+		return false;
+	}
+
+	/* local placements may fail over to local execution, keep them intact */
+	ShardPlacement *taskPlacement = linitial(task->taskPlacementList);
+	if (taskPlacement->groupId == GetLocalGroupId())
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CreateBatchTask creates a single read task that runs the queries of all
+ * the given tasks, which are on the same placement, via UNION ALL.
+ */
+static Task *
+CreateBatchTask(List *batchedTaskList)
+{
+	Task *firstTask = linitial(batchedTaskList);
+	Task *batchTask = copyObject(firstTask);
+	StringInfo batchQueryString = makeStringInfo();
+	List *relationShardList = NIL;
+
+	Task *task = NULL;
+	foreach_declared_ptr(task, batchedTaskList)
+	{
+		if (batchQueryString->len > 0)
+		{
+			appendStringInfoString(batchQueryString, " UNION ALL ");
+		}
+
+		appendStringInfo(batchQueryString, "(%s)", TaskQueryString(task));
+		relationShardList = list_concat(relationShardList,
+										list_copy(task->relationShardList));
+	}
+
+	SetTaskQueryString(batchTask, batchQueryString->data);
+	batchTask->relationShardList = relationShardList;
+
+	return batchTask;
+}
+
+
 /*
  * DecideTransactionPropertiesForTaskList decides whether to use remote transaction
  * blocks, whether to use 2PC for the given task list, and whether to error on any
@@ -1573,6 +1836,12 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 				placementExecutionReady = false;
 			}
 		}
+
+		if (ShouldHedgeShardCommandExecution(execution, shardCommandExecution))
+		{
+			execution->hedgedReadCandidateList =
+				lappend(execution->hedgedReadCandidateList, shardCommandExecution);
+		}
 	}
 
 	/*
@@ -1743,6 +2012,9 @@ FindOrCreateWorkerPool(DistributedExecution *execution, char *nodeName, int node
 	int nodeConnectionCount = MaxCachedConnectionsPerWorker;
 	workerPool->maxNewConnectionsPerCycle = Max(1, nodeConnectionCount);
 
+	workerPool->adaptivePoolSizeLimit = GetAdaptivePoolSizeLimit(nodeName, nodePort);
+	workerPool->hedgedReadDelayMs = GetHedgedReadDelay(nodeName, nodePort);
+
 	dlist_init(&workerPool->pendingTaskQueue);
 	dlist_init(&workerPool->readyTaskQueue);
 
@@ -1925,20 +2197,42 @@ RunDistributedExecution(DistributedExecution *execution)
 		 * to finish. But, the execution might finish before the new connections
 		 * are established.
 		 *
+		 * Similarly, we wait for the placement executions that we cancelled
+		 * because another placement of a hedged read was faster, such that
+		 * the connections are ready to use once the execution finishes.
+		 *
 		 * Note that the rules explained above could be overriden by any
 		 * cancellation to the query. In that case, we terminate the execution
 		 * irrespective of the current status of the tasks or the connections.
 		 */
 		while (!cancellationReceived &&
 			   (execution->unfinishedTaskCount > 0 ||
-				HasIncompleteConnectionEstablishment(execution)))
+				HasIncompleteConnectionEstablishment(execution) ||
+				execution->cancelledPlacementExecutionCount > 0))
 		{
+			if (execution->hedgedReadCandidateList != NIL)
+			{
+				StartHedgedReads(execution);
+			}
+
 			WorkerPool *workerPool = NULL;
 			foreach_declared_ptr(workerPool, execution->workerList)
 			{
 				ManageWorkerPool(workerPool);
 			}
 
+			if (execution->localExecutionScanState != NULL &&
+				execution->localTaskList != NIL &&
+				AllRemoteTasksSent(execution))
+			{
+				/*
+				 * Remote tasks make progress on the worker nodes while we run
+				 * the local tasks, we collect their results afterwards.
+				 */
+				RunLocalExecution(execution->localExecutionScanState, execution);
+				execution->localTaskList = NIL;
+			}
+
 			bool skipWaitEvents = false;
 			if (execution->remoteTaskList == NIL)
 			{
@@ -1988,6 +2282,8 @@ RunDistributedExecution(DistributedExecution *execution)
 		FreeExecutionWaitEvents(execution);
 
 		CleanUpSessions(execution);
+
+		ReportWorkerPoolStats(execution);
 	}
 	PG_CATCH();
 	{
@@ -1999,12 +2295,406 @@ RunDistributedExecution(DistributedExecution *execution)
 
 		FreeExecutionWaitEvents(execution);
 
+		/* the tasks that are still running will not be finished */
+		ReleaseInFlightTasks(execution);
+
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
 }
 
 
+/*
+ * ReportWorkerPoolStats feeds the task execution times and connection failures
+ * observed by the execution into the per node pool size controller, the read
+ * latency samples and the response time estimates, such that the subsequent
+ * executions on any backend can adapt their pool sizes, decide when to hedge
+ * reads and which placements to read from.
+ */
+static void
+ReportWorkerPoolStats(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_declared_ptr(workerPool, execution->workerList)
+	{
+		RecordTaskExecutionTimes(workerPool->nodeName, workerPool->nodePort,
+								 workerPool->readTaskExecutionTimeList);
+
+		if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LATENCY_AWARE &&
+			workerPool->totalExecutedTasks > 0)
+		{
+			double avgResponseTime = (double) workerPool->totalTaskExecutionTime /
+									 workerPool->totalExecutedTasks;
+
+			UpdateNodeResponseTime(workerPool->nodeName, workerPool->nodePort,
+								   avgResponseTime);
+		}
+
+		if (!EnableAdaptivePoolSizeControl || UseConnectionPerPlacement())
+		{
+			/* connection per placement ignores the pool size anyway */
+			continue;
+		}
+
+		bool hadConnectionFailure = workerPool->failedConnectionCount > 0;
+
+		/*
+		 * A single task does not tell much about the load on the node, and it
+		 * could not have benefited from a larger pool anyway.
+		 */
+		if (workerPool->totalExecutedTasks < 2 && !hadConnectionFailure)
+		{
+			continue;
+		}
+
+		double avgTaskExecutionTime = 0;
+		if (workerPool->totalExecutedTasks > 0)
+		{
+			avgTaskExecutionTime = (double) workerPool->totalTaskExecutionTime /
+								   workerPool->totalExecutedTasks;
+		}
+
+		UpdateAdaptivePoolSizeLimit(workerPool->nodeName, workerPool->nodePort,
+									avgTaskExecutionTime, hadConnectionFailure,
+									workerPool->limitedByAdaptivePoolSize);
+	}
+}
+
+
+/*
+ * ReleaseInFlightTasks subtracts the placement executions of the given execution
+ * that are still running from the in-flight tasks of their nodes. It is called
+ * when the execution fails, in which case the placement executions are never
+ * finished. Other executions of the backend, such as the outer execution of a
+ * nested one, keep their in-flight tasks.
+ */
+static void
+ReleaseInFlightTasks(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_declared_ptr(workerPool, execution->workerList)
+	{
+		if (workerPool->inFlightTaskCount > 0)
+		{
+			AdjustInFlightTaskCount(workerPool->nodeName, workerPool->nodePort,
+									-workerPool->inFlightTaskCount);
+			workerPool->inFlightTaskCount = 0;
+		}
+	}
+}
+
+
+/*
+ * ShouldHedgeShardCommandExecution returns true if the shard command execution
+ * may be sent to a second placement when the first placement takes longer than
+ * usual, and the results of whichever placement answers first can be used.
+ *
+ * We only do that for read-only tasks outside of transaction blocks, such that
+ * cancelling the slower placement execution does not affect anything else.
+ */
+static bool
+ShouldHedgeShardCommandExecution(DistributedExecution *execution,
+								 ShardCommandExecution *shardCommandExecution)
+{
+	Task *task = shardCommandExecution->task;
+
+	if (!EnableHedgedReads)
+	{
+		return false;
+	}
+
+	if (task->taskType != READ_TASK ||
+		shardCommandExecution->executionOrder != EXECUTION_ORDER_ANY ||
+		shardCommandExecution->placementExecutionCount < 2)
+	{
+		/* only reads on replicated shards can be hedged */
+		return false;
+	}
+
+	if (task->queryCount != 1 || task->partiallyLocalOrRemote ||
+		task->tupleDest != NULL)
+	{
+		/* e.g., EXPLAIN ANALYZE needs the results of a particular placement */
+		return false;
+	}
+
+	if (execution->transactionProperties->useRemoteTransactionBlocks ==
+		TRANSACTION_BLOCKS_REQUIRED ||
+		IsMultiStatementTransaction() || InCoordinatedTransaction())
+	{
+		/* cancelling a command in a transaction block aborts the transaction */
+		return false;
+	}
+
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+		if (placementExecution->assignedSession != NULL)
+		{
+			/* the task has to use a particular connection */
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * StartHedgedReads goes over the shard command executions that can be hedged
+ * and makes the next placement execution ready for the ones that have been
+ * running for longer than the configured percentile of the recent task
+ * execution times on their node.
+ */
+static void
+StartHedgedReads(DistributedExecution *execution)
+{
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
+
+	ShardCommandExecution *shardCommandExecution = NULL;
+	foreach_declared_ptr(shardCommandExecution, execution->hedgedReadCandidateList)
+	{
+		TaskPlacementExecution *runningPlacementExecution = NULL;
+		TaskPlacementExecution *hedgedPlacementExecution =
+			FindHedgedReadPlacementExecution(shardCommandExecution,
+											 &runningPlacementExecution);
+		if (hedgedPlacementExecution == NULL)
+		{
+			continue;
+		}
+
+		WorkerPool *runningWorkerPool = runningPlacementExecution->workerPool;
+		long runningTimeMs =
+			MillisecondsBetweenTimestamps(runningPlacementExecution->startTime, now);
+		if (runningTimeMs < runningWorkerPool->hedgedReadDelayMs)
+		{
+			continue;
+		}
+
+		WorkerPool *hedgedWorkerPool = hedgedPlacementExecution->workerPool;
+		ereport(DEBUG1, (errmsg("read of shard " UINT64_FORMAT " on node %s:%d is "
+								"taking longer than usual, also sending it to "
+								"node %s:%d",
+								shardCommandExecution->task->anchorShardId,
+								runningWorkerPool->nodeName,
+								runningWorkerPool->nodePort,
+								hedgedWorkerPool->nodeName,
+								hedgedWorkerPool->nodePort)));
+
+		shardCommandExecution->hedgedReadStarted = true;
+
+		PlacementExecutionReady(hedgedPlacementExecution);
+	}
+}
+
+
+/*
+ * FindHedgedReadPlacementExecution returns the placement execution to which the
+ * given shard command execution can be sent in addition to the one that is
+ * currently running, which is returned via runningPlacementExecution. Returns
+ * NULL if the shard command execution cannot be hedged at the moment, which
+ * includes when the running placement execution already stored some rows.
+ */
+static TaskPlacementExecution *
+FindHedgedReadPlacementExecution(ShardCommandExecution *shardCommandExecution,
+								 TaskPlacementExecution **runningPlacementExecution)
+{
+	TaskPlacementExecution *hedgedPlacementExecution = NULL;
+
+	*runningPlacementExecution = NULL;
+
+	if (shardCommandExecution->hedgedReadStarted ||
+		shardCommandExecution->resultPlacementExecution != NULL ||
+		shardCommandExecution->executionState != TASK_EXECUTION_NOT_FINISHED)
+	{
+		return NULL;
+	}
+
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+		WorkerPool *workerPool = placementExecution->workerPool;
+
+		if (placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
+		{
+			*runningPlacementExecution = placementExecution;
+		}
+		else if (placementExecution->executionState == PLACEMENT_EXECUTION_READY)
+		{
+			/* still waiting for a connection, a second placement would not help */
+			return NULL;
+		}
+		else if (placementExecution->executionState == PLACEMENT_EXECUTION_NOT_READY &&
+				 hedgedPlacementExecution == NULL &&
+				 workerPool->failureState == WORKER_POOL_NOT_FAILED &&
+				 !workerPool->poolToLocalNode)
+		{
+			/*
+			 * We skip the local node to not interfere with failing over to local
+			 * execution, reads on the local node are normally executed locally
+			 * anyway.
+			 */
+			hedgedPlacementExecution = placementExecution;
+		}
+	}
+
+	if (*runningPlacementExecution == NULL ||
+		(*runningPlacementExecution)->workerPool->hedgedReadDelayMs < 0)
+	{
+		return NULL;
+	}
+
+	return hedgedPlacementExecution;
+}
+
+
+/*
+ * HasActivePlacementExecution returns true if any of the placement executions
+ * of the given shard command execution is ready to start or running.
+ */
+static bool
+HasActivePlacementExecution(ShardCommandExecution *shardCommandExecution)
+{
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+		if (placementExecution->executionState == PLACEMENT_EXECUTION_READY ||
+			placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ClaimHedgedReadResults is called when a placement execution of a hedged read
+ * has results available. If no other placement execution returned results yet,
+ * the given placement execution becomes the one whose results we use, and the
+ * other placement executions are cancelled. The function returns whether the
+ * results of the given placement execution should be used.
+ */
+static bool
+ClaimHedgedReadResults(TaskPlacementExecution *placementExecution)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+
+	if (shardCommandExecution->resultPlacementExecution != NULL)
+	{
+		return shardCommandExecution->resultPlacementExecution == placementExecution;
+	}
+
+	shardCommandExecution->resultPlacementExecution = placementExecution;
+
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *otherPlacementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+		if (otherPlacementExecution != placementExecution)
+		{
+			CancelPlacementExecution(otherPlacementExecution);
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CancelPlacementExecution stops the given placement execution of a hedged read.
+ * If it is still waiting for a connection, we remove it from the ready queue of
+ * the worker pool. If it is running, we send a cancellation request and drain
+ * the results in the connection state machine.
+ */
+static void
+CancelPlacementExecution(TaskPlacementExecution *placementExecution)
+{
+	WorkerPool *workerPool = placementExecution->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+
+	/* hedged reads are never assigned to particular sessions */
+	Assert(placementExecution->assignedSession == NULL);
+
+	if (placementExecution->executionState == PLACEMENT_EXECUTION_READY ||
+		placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
+	{
+		Task *task = placementExecution->shardCommandExecution->task;
+
+		ereport(DEBUG1, (errmsg("cancelling the read of shard " UINT64_FORMAT
+								" on node %s:%d, another placement was faster",
+								task->anchorShardId, workerPool->nodeName,
+								workerPool->nodePort)));
+	}
+
+	if (placementExecution->executionState == PLACEMENT_EXECUTION_READY)
+	{
+		dlist_delete(&placementExecution->workerReadyQueueNode);
+		workerPool->readyTaskCount--;
+
+		placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+	}
+	else if (placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
+	{
+		WorkerSession *session = NULL;
+		foreach_declared_ptr(session, workerPool->sessionList)
+		{
+			if (session->currentTask == placementExecution)
+			{
+				SendCancelationRequest(session->connection);
+				break;
+			}
+		}
+
+		placementExecution->cancelled = true;
+		execution->cancelledPlacementExecutionCount++;
+	}
+}
+
+
+/*
+ * DrainCancelledPlacementExecution discards the results of a cancelled placement
+ * execution on the given session. It returns true once all the results are
+ * consumed.
+ */
+static bool
+DrainCancelledPlacementExecution(WorkerSession *session)
+{
+	PGconn *pgConn = session->connection->pgConn;
+
+	while (!PQisBusy(pgConn))
+	{
+		PGresult *result = PQgetResult(pgConn);
+		if (result == NULL)
+		{
+			return true;
+		}
+
+		/* we expect a cancellation error, but do not care about the outcome */
+		PQclear(result);
+	}
+
+	return false;
+}
+
+
 /*
  * ProcessSessionsWithFailedWaitEventSetOperations goes over the session list
  * and processes sessions with failed wait event set operations.
@@ -2050,6 +2740,36 @@ ProcessSessionsWithFailedWaitEventSetOperations(DistributedExecution *execution)
 }
 
 
+/*
+ * AllRemoteTasksSent returns true if none of the worker pools and sessions in
+ * the execution have tasks that are ready to be sent, meaning that we are only
+ * waiting for results of the remote tasks.
+ */
+static bool
+AllRemoteTasksSent(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_declared_ptr(workerPool, execution->workerList)
+	{
+		if (workerPool->readyTaskCount > 0)
+		{
+			return false;
+		}
+	}
+
+	WorkerSession *session = NULL;
+	foreach_declared_ptr(session, execution->sessionList)
+	{
+		if (!dlist_is_empty(&session->readyTaskQueue))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * HasIncompleteConnectionEstablishment returns true if any of the connections
  * that has been initiated by the executor is in initialization stage.
@@ -2418,6 +3138,24 @@ CalculateNewConnectionCount(WorkerPool *workerPool)
 		 */
 		int newConnectionsForReadyTasks = Max(0, readyTaskCount - usableConnectionCount);
 
+		/*
+		 * The earlier executions might have observed that the node is saturated,
+		 * in which case we do not want to open as many connections as we could.
+		 */
+		if (workerPool->adaptivePoolSizeLimit < targetPoolSize)
+		{
+			int maxAdaptiveConnectionCount =
+				workerPool->adaptivePoolSizeLimit - initiatedConnectionCount;
+
+			if (newConnectionsForReadyTasks > maxAdaptiveConnectionCount)
+			{
+				workerPool->limitedByAdaptivePoolSize = true;
+			}
+
+			maxNewConnectionCount = Min(maxNewConnectionCount,
+										maxAdaptiveConnectionCount);
+		}
+
 		/* If Slow start is enabled we need to update the maxNewConnection to the current cycle's maximum.*/
 		if (ExecutorSlowStartInterval != SLOW_START_DISABLED)
 		{
@@ -2932,7 +3670,8 @@ NextEventTimeout(DistributedExecution *execution)
 		 * current slow start interval.
 		 */
 		if (workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
-			initiatedConnectionCount < execution->targetPoolSize)
+			initiatedConnectionCount < execution->targetPoolSize &&
+			initiatedConnectionCount < workerPool->adaptivePoolSizeLimit)
 		{
 			long timeSinceLastConnectMs =
 				MillisecondsBetweenTimestamps(workerPool->lastConnectionOpenTime, now);
@@ -2946,6 +3685,28 @@ NextEventTimeout(DistributedExecution *execution)
 		}
 	}
 
+	/* wake up in time to send slow reads to another placement */
+	ShardCommandExecution *shardCommandExecution = NULL;
+	foreach_declared_ptr(shardCommandExecution, execution->hedgedReadCandidateList)
+	{
+		TaskPlacementExecution *runningPlacementExecution = NULL;
+		if (FindHedgedReadPlacementExecution(shardCommandExecution,
+											 &runningPlacementExecution) == NULL)
+		{
+			continue;
+		}
+
+		long runningTimeMs =
+			MillisecondsBetweenTimestamps(runningPlacementExecution->startTime, now);
+		long timeUntilHedgedRead =
+			runningPlacementExecution->workerPool->hedgedReadDelayMs - runningTimeMs;
+
+		if (timeUntilHedgedRead < eventTimeout)
+		{
+			eventTimeout = timeUntilHedgedRead;
+		}
+	}
+
 	return Max(1, eventTimeout);
 }
 
@@ -3569,6 +4330,20 @@ TransactionStateMachine(WorkerSession *session)
 					placementExecution->shardCommandExecution;
 				Task *task = shardCommandExecution->task;
 
+				if (shardCommandExecution->hedgedReadStarted &&
+					!ClaimHedgedReadResults(placementExecution))
+				{
+					/* another placement answered first, ignore the results */
+					bool drainDone = DrainCancelledPlacementExecution(session);
+					if (!drainDone)
+					{
+						break;
+					}
+
+					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+					break;
+				}
+
 				/*
 				 * In EXPLAIN ANALYZE we need to store results except for multiple placements,
 				 * regardless of query type. In other cases, doing the same doesn't seem to have
@@ -3859,6 +4634,13 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 	 */
 	INSTR_TIME_SET_CURRENT(placementExecution->startTime);
 
+	if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LATENCY_AWARE)
+	{
+		AdjustInFlightTaskCount(workerPool->nodeName, workerPool->nodePort, 1);
+		placementExecution->countedAsInFlight = true;
+		workerPool->inFlightTaskCount++;
+	}
+
 	bool querySent = SendNextQuery(placementExecution, session);
 	if (querySent)
 	{
@@ -4065,6 +4847,12 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			continue;
 		}
 
+		if (shardCommandExecution->resultPlacementExecution == NULL)
+		{
+			/* rows from another placement would be stored in addition to these */
+			shardCommandExecution->resultPlacementExecution = placementExecution;
+		}
+
 		rowsProcessed = PQntuples(result);
 		uint32 columnCount = PQnfields(result);
 		uint32 expectedColumnCount = tupleDescriptor->natts;
@@ -4335,6 +5123,35 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		return;
 	}
 
+	if (placementExecution->countedAsInFlight)
+	{
+		AdjustInFlightTaskCount(workerPool->nodeName, workerPool->nodePort, -1);
+		placementExecution->countedAsInFlight = false;
+		workerPool->inFlightTaskCount--;
+	}
+
+	if (placementExecution->cancelled)
+	{
+		/* we are done with the placement execution that we cancelled earlier */
+		placementExecution->cancelled = false;
+		execution->cancelledPlacementExecutionCount--;
+
+		succeeded = false;
+	}
+	else if (!succeeded && shardCommandExecution->hedgedReadStarted &&
+			 shardCommandExecution->resultPlacementExecution == placementExecution)
+	{
+		/*
+		 * We may have already stored some of the rows returned by this placement
+		 * execution of a hedged read, and the other placement executions have
+		 * been cancelled.
+		 */
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("could not receive all results of a hedged read "
+							   "from %s:%d", workerPool->nodeName,
+							   workerPool->nodePort)));
+	}
+
 	if (succeeded)
 	{
 		/* mark the placement execution as finished */
@@ -4348,6 +5165,13 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		workerPool->totalTaskExecutionTime += durationMicrosecs;
 		workerPool->totalExecutedTasks += 1;
 
+		if (EnableHedgedReads && shardCommandExecution->task->taskType == READ_TASK)
+		{
+			workerPool->readTaskExecutionTimeList =
+				lappend_int(workerPool->readTaskExecutionTimeList,
+							(int) Min(durationMicrosecs, PG_INT32_MAX));
+		}
+
 		if (IsLoggableLevel(DEBUG4))
 		{
 			ereport(DEBUG4, (errmsg("task execution (%d) for placement (%ld) on anchor "
@@ -4518,6 +5342,13 @@ ScheduleNextPlacementExecution(TaskPlacementExecution *placementExecution, bool
 		placementExecution->shardCommandExecution;
 	PlacementExecutionOrder executionOrder = shardCommandExecution->executionOrder;
 
+	if (shardCommandExecution->hedgedReadStarted &&
+		HasActivePlacementExecution(shardCommandExecution))
+	{
+		/* the other placement execution of the hedged read may still succeed */
+		return;
+	}
+
 	if ((executionOrder == EXECUTION_ORDER_ANY && !succeeded) ||
 		executionOrder == EXECUTION_ORDER_SEQUENTIAL)
 	{
@@ -32,6 +32,7 @@
 #include "distributed/connection_management.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
+#include "distributed/fast_path_query_cache.h"
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
@@ -203,6 +204,10 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 	node->ss.ps.qual = ExecInitQual(node->ss.ps.plan->qual, (PlanState *) node);
 
 	DistributedPlan *distributedPlan = scanState->distributedPlan;
+
+	/* forget reusable subplan results that this plan might change */
+	InvalidateSubPlanResultsForPlan(distributedPlan);
+
 	if (distributedPlan->modifyQueryViaCoordinatorOrRepartition != NULL)
 	{
 		/*
@@ -326,6 +331,11 @@ CitusBeginReadOnlyScan(CustomScanState *node, EState *estate, int eflags)
 	/* job query no longer has parameters, so we should not send any */
 	workerJob->parametersInJobQueryResolved = true;
 
+	/* other backends may already have deparsed the query for the same values */
+	workerJob->queryStringCacheKey =
+		FastPathQueryCacheKey(jobQuery, estate->es_param_list_info,
+							  estate->es_sourceText);
+
 	/* parameters are filled in, so we can generate a task for this execution */
 	RegenerateTaskForFasthPathQuery(workerJob);
 
@@ -0,0 +1,1347 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_compression.c
+ *   Functions for writing and reading compressed intermediate result files.
+ *
+ * A compressed intermediate result starts with a header that contains a
+ * signature and the compression method, followed by blocks of compressed
+ * COPY data. The same bytes are sent over the wire and stored on disk, such
+ * that the data is only compressed once by the node that writes the result
+ * and decompressed while it is read.
+ *
+ * Binary results can also be stored in a columnar layout, which uses the same
+ * header with a flag in the compression method. The rows are then stored in
+ * groups, in which the binary COPY fields of each column are stored as a
+ * separate, optionally compressed, block. Readers that only need some of the
+ * columns skip the blocks of the other columns, which are then read as NULL.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "nodes/makefuncs.h"
+#include "port/pg_bswap.h"
+#include "storage/fd.h"
+#include "utils/memutils.h"
+
+#include "citus_version.h"
+
+#include "distributed/intermediate_result_compression.h"
+#include "distributed/intermediate_result_memory.h"
+
+#if HAVE_CITUS_LIBLZ4
+#include <lz4.h>
+#endif
+
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+
+/*
+ * Compressed intermediate results start with this signature. Its first byte
+ * is a zero byte, which cannot appear in text or csv COPY data and differs
+ * from the signature of binary COPY data, such that readers can tell them
+ * apart from regular intermediate results.
+ */
+static const char CompressedResultSignature[] = "\0CitusIR";
+#define COMPRESSED_RESULT_SIGNATURE_LENGTH 8
+
+/* the signature is followed by a byte for the compression method */
+#define COMPRESSED_RESULT_HEADER_LENGTH (COMPRESSED_RESULT_SIGNATURE_LENGTH + 1)
+
+/* flag in the compression method byte of results in the columnar layout */
+#define COLUMNAR_RESULT_FLAG 0x80
+
+/* the end of a result consists of a block or group header and the raw size */
+#define RESULT_END_MARKER_LENGTH (sizeof(CompressedResultBlockHeader) + sizeof(uint64))
+
+/* binary COPY data starts with this signature, followed by flags and extension */
+static const char BinaryCopySignature[] = "PGCOPY\n\377\r\n\0";
+#define BINARY_COPY_SIGNATURE_LENGTH 11
+#define BINARY_COPY_HEADER_LENGTH (BINARY_COPY_SIGNATURE_LENGTH + 2 * sizeof(uint32))
+
+/* compression level used for zstd, favouring speed over compression ratio */
+#define INTERMEDIATE_RESULT_ZSTD_LEVEL 1
+
+
+/*
+ * CompressedResultBlockHeader precedes each block of a compressed intermediate
+ * result, and its fields are stored in network byte order. A block is stored
+ * as is when compressing it does not make it smaller, in which case the stored
+ * length equals the raw length. The last block has a raw length of 0 and
+ * contains the total number of raw bytes in the result.
+ */
+typedef struct CompressedResultBlockHeader
+{
+	uint32 rawLength;
+	uint32 storedLength;
+} CompressedResultBlockHeader;
+
+
+/*
+ * ColumnarResultGroupHeader precedes each group of rows of a columnar
+ * intermediate result, and its fields are stored in network byte order. It is
+ * followed by a block header for each column, and then the blocks themselves.
+ * The last group has a row and column count of 0 and is followed by the total
+ * number of raw bytes in the result, like the last block of a compressed
+ * result.
+ */
+typedef struct ColumnarResultGroupHeader
+{
+	uint32 rowCount;
+	uint32 columnCount;
+} ColumnarResultGroupHeader;
+
+
+/*
+ * IntermediateResultReadState keeps the state of reading a compressed
+ * intermediate result file, or an intermediate result in memory, in the data
+ * source callback of COPY.
+ */
+typedef struct IntermediateResultReadState
+{
+	FILE *file;
+	IntermediateResultCompressionType compressionType;
+
+	/* whether the result is in the columnar layout, and columns to read as NULL */
+	bool columnar;
+	Bitmapset *skippedColumns;
+
+	/* contents of the result if it is kept in memory, and how much was read */
+	IntermediateResultMemory *resultMemory;
+	Size memoryOffset;
+
+	/* compressed data of the current block */
+	StringInfo compressedBlock;
+
+	/* decompressed data of the current block, and how much of it was read */
+	StringInfo rawBlock;
+	int rawBlockOffset;
+
+	/* total number of raw bytes read so far */
+	uint64 rawBytes;
+
+	/* fields of each column in the current group of a columnar result */
+	int columnCount;
+	StringInfo *columnData;
+
+	/* whether the binary COPY header and end marker of a columnar result were read */
+	bool copyHeaderRead;
+	bool copyEndRead;
+} IntermediateResultReadState;
+
+
+/* GUC, compression method for the intermediate results written by this node */
+int IntermediateResultCompression = INTERMEDIATE_RESULT_COMPRESSION_NONE;
+
+/* GUC, whether binary intermediate results are written in the columnar layout */
+bool EnableColumnarIntermediateResults = false;
+
+/* state of the intermediate result that COPY is reading through the callback */
+static IntermediateResultReadState *CurrentReadState = NULL;
+
+
+static void CompressColumnarResultData(IntermediateResultCompressor *compressor,
+									   StringInfo copyData);
+static void AppendColumnarResultGroup(IntermediateResultCompressor *compressor,
+									  uint32 rowCount);
+static void AppendResultBlock(IntermediateResultCompressionType compressionType,
+							  StringInfo rawData, StringInfo outputBuffer,
+							  CompressedResultBlockHeader *blockHeader);
+static int CompressBlock(IntermediateResultCompressionType compressionType,
+						 StringInfo copyData, StringInfo outputBuffer);
+static void DecompressBlock(IntermediateResultCompressionType compressionType,
+							StringInfo compressedBlock, StringInfo rawBlock,
+							uint32 rawLength);
+static bool CompressionTypeSupported(IntermediateResultCompressionType compressionType);
+static bool ReadCompressedResultHeader(FILE *file,
+									   IntermediateResultCompressionType *compressionType,
+									   bool *columnar);
+static bool ParseCompressedResultHeader(const char *header, Size length,
+										IntermediateResultCompressionType *
+										compressionType, bool *columnar);
+static bool ParseResultEndMarker(const char *endMarker, bool columnar,
+								 uint64 *rawBytes);
+static CopyFromState BeginCopyFromResultMemory(Relation relation, char *fileName,
+											   IntermediateResultMemory *resultMemory,
+											   List *copyOptions,
+											   Bitmapset *skippedColumns);
+static List * ColumnarResultCopyOptions(void);
+static int ReadIntermediateResultData(void *outbuf, int minread, int maxread);
+static bool ReadNextCompressedResultBlock(IntermediateResultReadState *readState);
+static bool ReadNextColumnarResultGroup(IntermediateResultReadState *readState);
+static void AppendColumnarResultRows(IntermediateResultReadState *readState,
+									 uint32 rowCount);
+static void ReadResultBlock(IntermediateResultReadState *readState, uint32 rawLength,
+							uint32 storedLength, StringInfo rawData);
+static void ReadFromIntermediateResult(IntermediateResultReadState *readState,
+									   char *buffer, size_t length);
+static void SkipIntermediateResultData(IntermediateResultReadState *readState,
+									   size_t length);
+static uint16 ReadNetworkUInt16(const char *data);
+static uint32 ReadNetworkUInt32(const char *data);
+
+
+/*
+ * CreateIntermediateResultCompressor creates a compressor for an intermediate
+ * result, whose output buffer starts with the header of the compressed result.
+ * When columnar is true, the compressor expects binary COPY data and stores it
+ * in the columnar layout, in which case the compression method may be none.
+ */
+IntermediateResultCompressor *
+CreateIntermediateResultCompressor(IntermediateResultCompressionType compressionType,
+								   bool columnar)
+{
+	if (compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE &&
+		!CompressionTypeSupported(compressionType))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("intermediate result compression method is not "
+							   "supported by this build of Citus")));
+	}
+
+	IntermediateResultCompressor *compressor =
+		palloc0(sizeof(IntermediateResultCompressor));
+	compressor->compressionType = compressionType;
+	compressor->columnar = columnar;
+	compressor->outputBuffer = makeStringInfo();
+
+	uint8 methodByte = (uint8) compressionType;
+	if (columnar)
+	{
+		methodByte |= COLUMNAR_RESULT_FLAG;
+	}
+
+	appendBinaryStringInfo(compressor->outputBuffer, CompressedResultSignature,
+						   COMPRESSED_RESULT_SIGNATURE_LENGTH);
+	appendStringInfoChar(compressor->outputBuffer, (char) methodByte);
+
+	return compressor;
+}
+
+
+/*
+ * CompressIntermediateResultData compresses the given COPY data as one block
+ * and appends the block to the output buffer of the compressor. Columnar
+ * compressors append the rows in the COPY data as one group instead.
+ */
+void
+CompressIntermediateResultData(IntermediateResultCompressor *compressor,
+							   StringInfo copyData)
+{
+	StringInfo outputBuffer = compressor->outputBuffer;
+	CompressedResultBlockHeader blockHeader = { 0, 0 };
+
+	if (copyData->len == 0)
+	{
+		return;
+	}
+
+	if (compressor->columnar)
+	{
+		CompressColumnarResultData(compressor, copyData);
+		return;
+	}
+
+	/* reserve space for the block header, which we fill in below */
+	int headerOffset = outputBuffer->len;
+	appendBinaryStringInfo(outputBuffer, (char *) &blockHeader, sizeof(blockHeader));
+
+	AppendResultBlock(compressor->compressionType, copyData, outputBuffer,
+					  &blockHeader);
+
+	memcpy(outputBuffer->data + headerOffset, &blockHeader, sizeof(blockHeader));
+
+	compressor->rawBytes += copyData->len;
+}
+
+
+/*
+ * FinishIntermediateResultCompression appends the block that marks the end of
+ * the compressed result to the output buffer of the compressor.
+ */
+void
+FinishIntermediateResultCompression(IntermediateResultCompressor *compressor)
+{
+	CompressedResultBlockHeader blockHeader = { 0, 0 };
+	uint64 rawBytes = pg_hton64(compressor->rawBytes);
+
+	/* the end of a columnar result is a group header with a row count of 0 */
+	blockHeader.rawLength = 0;
+	blockHeader.storedLength = compressor->columnar ? 0 : pg_hton32(sizeof(rawBytes));
+
+	appendBinaryStringInfo(compressor->outputBuffer, (char *) &blockHeader,
+						   sizeof(blockHeader));
+	appendBinaryStringInfo(compressor->outputBuffer, (char *) &rawBytes,
+						   sizeof(rawBytes));
+}
+
+
+/*
+ * CompressColumnarResultData splits the rows in the given binary COPY data into
+ * the fields of each column, and appends them to the output buffer of the
+ * compressor as one group. The binary COPY header and end marker are left out,
+ * since readers add them back.
+ */
+static void
+CompressColumnarResultData(IntermediateResultCompressor *compressor,
+						   StringInfo copyData)
+{
+	const char *data = copyData->data;
+	int dataLength = copyData->len;
+	int offset = 0;
+	uint32 rowCount = 0;
+
+	if (!compressor->copyHeaderSkipped)
+	{
+		if (dataLength < BINARY_COPY_HEADER_LENGTH ||
+			memcmp(data, BinaryCopySignature, BINARY_COPY_SIGNATURE_LENGTH) != 0)
+		{
+			ereport(ERROR, (errmsg("columnar intermediate results require binary "
+								   "COPY data")));
+		}
+
+		uint32 extensionLength = ReadNetworkUInt32(data + BINARY_COPY_SIGNATURE_LENGTH +
+												   sizeof(uint32));
+
+		offset = BINARY_COPY_HEADER_LENGTH + extensionLength;
+		compressor->copyHeaderSkipped = true;
+	}
+
+	while (offset + (int) sizeof(uint16) <= dataLength)
+	{
+		int16 fieldCount = (int16) ReadNetworkUInt16(data + offset);
+		offset += sizeof(uint16);
+
+		if (fieldCount == -1)
+		{
+			/* end of the binary COPY data */
+			break;
+		}
+
+		if (compressor->columnData == NULL)
+		{
+			compressor->columnCount = fieldCount;
+			compressor->columnData = palloc0(fieldCount * sizeof(StringInfo));
+
+			for (int columnIndex = 0; columnIndex < fieldCount; columnIndex++)
+			{
+				compressor->columnData[columnIndex] = makeStringInfo();
+			}
+		}
+		else if (fieldCount != compressor->columnCount)
+		{
+			ereport(ERROR, (errmsg("row field count is %d, expected %d",
+								   (int) fieldCount, compressor->columnCount)));
+		}
+
+		for (int columnIndex = 0; columnIndex < fieldCount; columnIndex++)
+		{
+			if (offset + (int) sizeof(uint32) > dataLength)
+			{
+				ereport(ERROR, (errmsg("unexpected end of binary COPY data")));
+			}
+
+			int32 fieldLength = (int32) ReadNetworkUInt32(data + offset);
+			int fieldSize = sizeof(uint32) + Max(fieldLength, 0);
+
+			if (fieldSize > dataLength - offset)
+			{
+				ereport(ERROR, (errmsg("unexpected end of binary COPY data")));
+			}
+
+			appendBinaryStringInfo(compressor->columnData[columnIndex], data + offset,
+								   fieldSize);
+			offset += fieldSize;
+		}
+
+		rowCount++;
+	}
+
+	if (rowCount > 0)
+	{
+		AppendColumnarResultGroup(compressor, rowCount);
+	}
+
+	compressor->rawBytes += dataLength;
+}
+
+
+/*
+ * AppendColumnarResultGroup appends the fields of each column that were
+ * collected by the compressor to its output buffer as a group of rowCount rows,
+ * and resets them for the next group.
+ */
+static void
+AppendColumnarResultGroup(IntermediateResultCompressor *compressor, uint32 rowCount)
+{
+	StringInfo outputBuffer = compressor->outputBuffer;
+	int columnCount = compressor->columnCount;
+	ColumnarResultGroupHeader groupHeader = { 0, 0 };
+	CompressedResultBlockHeader blockHeader = { 0, 0 };
+
+	groupHeader.rowCount = pg_hton32(rowCount);
+	groupHeader.columnCount = pg_hton32((uint32) columnCount);
+	appendBinaryStringInfo(outputBuffer, (char *) &groupHeader, sizeof(groupHeader));
+
+	/* reserve space for the block headers, which we fill in below */
+	int headerOffset = outputBuffer->len;
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		appendBinaryStringInfo(outputBuffer, (char *) &blockHeader,
+							   sizeof(blockHeader));
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		StringInfo columnData = compressor->columnData[columnIndex];
+
+		AppendResultBlock(compressor->compressionType, columnData, outputBuffer,
+						  &blockHeader);
+
+		memcpy(outputBuffer->data + headerOffset + columnIndex * sizeof(blockHeader),
+			   &blockHeader, sizeof(blockHeader));
+
+		resetStringInfo(columnData);
+	}
+}
+
+
+/*
+ * AppendResultBlock appends the given data to the output buffer in compressed
+ * form, or as is when compressing it does not make it smaller, and sets the
+ * fields of the block header accordingly.
+ */
+static void
+AppendResultBlock(IntermediateResultCompressionType compressionType,
+				  StringInfo rawData, StringInfo outputBuffer,
+				  CompressedResultBlockHeader *blockHeader)
+{
+	int blockOffset = outputBuffer->len;
+
+	int storedLength = CompressBlock(compressionType, rawData, outputBuffer);
+	if (storedLength < 0 || storedLength >= rawData->len)
+	{
+		/* store the block as is when compression does not make it smaller */
+		outputBuffer->len = blockOffset;
+		appendBinaryStringInfo(outputBuffer, rawData->data, rawData->len);
+		storedLength = rawData->len;
+	}
+
+	blockHeader->rawLength = pg_hton32((uint32) rawData->len);
+	blockHeader->storedLength = pg_hton32((uint32) storedLength);
+}
+
+
+/*
+ * CompressBlock appends the given COPY data to the output buffer in compressed
+ * form and returns the compressed size, or -1 if the data was not compressed.
+ */
+static int
+CompressBlock(IntermediateResultCompressionType compressionType, StringInfo copyData,
+			  StringInfo outputBuffer)
+{
+	int compressedSize = -1;
+
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			int maximumLength = LZ4_compressBound(copyData->len);
+
+			enlargeStringInfo(outputBuffer, maximumLength);
+
+			compressedSize = LZ4_compress_default(copyData->data,
+												  outputBuffer->data +
+												  outputBuffer->len,
+												  copyData->len, maximumLength);
+			if (compressedSize <= 0)
+			{
+				return -1;
+			}
+
+			break;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			size_t maximumLength = ZSTD_compressBound(copyData->len);
+
+			enlargeStringInfo(outputBuffer, maximumLength);
+
+			size_t zstdCompressedSize = ZSTD_compress(outputBuffer->data +
+													  outputBuffer->len,
+													  maximumLength,
+													  copyData->data, copyData->len,
+													  INTERMEDIATE_RESULT_ZSTD_LEVEL);
+			if (ZSTD_isError(zstdCompressedSize))
+			{
+				return -1;
+			}
+
+			compressedSize = (int) zstdCompressedSize;
+			break;
+		}
+#endif
+
+		default:
+		{
+			return -1;
+		}
+	}
+
+	outputBuffer->len += compressedSize;
+	outputBuffer->data[outputBuffer->len] = '\0';
+
+	return compressedSize;
+}
+
+
+/*
+ * DecompressBlock decompresses the given block into rawBlock and errors out if
+ * the block does not decompress into rawLength bytes.
+ */
+static void
+DecompressBlock(IntermediateResultCompressionType compressionType,
+				StringInfo compressedBlock, StringInfo rawBlock, uint32 rawLength)
+{
+	resetStringInfo(rawBlock);
+	enlargeStringInfo(rawBlock, rawLength);
+
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			int decompressedSize = LZ4_decompress_safe(compressedBlock->data,
+													   rawBlock->data,
+													   compressedBlock->len,
+													   rawLength);
+			if (decompressedSize != (int) rawLength)
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+								errmsg("could not decompress intermediate result"),
+								errdetail("Expected %u bytes, but received %d bytes",
+										  rawLength, decompressedSize)));
+			}
+
+			break;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			size_t decompressedSize = ZSTD_decompress(rawBlock->data, rawLength,
+													  compressedBlock->data,
+													  compressedBlock->len);
+			if (ZSTD_isError(decompressedSize))
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+								errmsg("could not decompress intermediate result"),
+								errdetail("%s", ZSTD_getErrorName(decompressedSize))));
+			}
+
+			if (decompressedSize != rawLength)
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+								errmsg("could not decompress intermediate result"),
+								errdetail("Expected %u bytes, but received %zu bytes",
+										  rawLength, decompressedSize)));
+			}
+
+			break;
+		}
+#endif
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unexpected intermediate result compression "
+								   "method: %d", compressionType)));
+		}
+	}
+
+	rawBlock->len = rawLength;
+	rawBlock->data[rawLength] = '\0';
+}
+
+
+/*
+ * CompressionTypeSupported returns whether this build supports the given
+ * compression method.
+ */
+static bool
+CompressionTypeSupported(IntermediateResultCompressionType compressionType)
+{
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			return true;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			return true;
+		}
+#endif
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * BeginCopyFromIntermediateResult starts a COPY from the given intermediate
+ * result file. Compressed results are decompressed while COPY reads them, and
+ * other files are read by COPY directly. Results that are kept in memory are
+ * read from memory instead of the file.
+ *
+ * The columns in skippedColumns, given as 0-based indexes, are not needed by
+ * the caller. They are not decoded from results in the columnar layout, and
+ * COPY then reads them as NULL.
+ */
+CopyFromState
+BeginCopyFromIntermediateResult(Relation relation, char *fileName, List *copyOptions,
+								Bitmapset *skippedColumns)
+{
+	IntermediateResultCompressionType compressionType =
+		INTERMEDIATE_RESULT_COMPRESSION_NONE;
+	bool columnar = false;
+
+	/* the state of a previous COPY might be left behind by an error */
+	CurrentReadState = NULL;
+
+	IntermediateResultMemory *resultMemory = AttachIntermediateResultMemory(fileName);
+	if (resultMemory != NULL)
+	{
+		return BeginCopyFromResultMemory(relation, fileName, resultMemory,
+										 copyOptions, skippedColumns);
+	}
+
+	FILE *file = AllocateFile(fileName, PG_BINARY_R);
+	if (file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\" for reading: %m",
+							   fileName)));
+	}
+
+	if (!ReadCompressedResultHeader(file, &compressionType, &columnar))
+	{
+		FreeFile(file);
+
+		return BeginCopyFrom(NULL, relation, NULL, fileName, false, NULL, NULL,
+							 copyOptions);
+	}
+
+	if (compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE &&
+		!CompressionTypeSupported(compressionType))
+	{
+		FreeFile(file);
+
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("intermediate result file \"%s\" is compressed with "
+							   "a method that is not supported by this build of "
+							   "Citus", fileName)));
+	}
+
+	IntermediateResultReadState *readState = palloc0(sizeof(IntermediateResultReadState));
+	readState->file = file;
+	readState->compressionType = compressionType;
+	readState->columnar = columnar;
+	readState->skippedColumns = skippedColumns;
+	readState->compressedBlock = makeStringInfo();
+	readState->rawBlock = makeStringInfo();
+
+	CurrentReadState = readState;
+
+	if (columnar)
+	{
+		copyOptions = ColumnarResultCopyOptions();
+	}
+
+	return BeginCopyFrom(NULL, relation, NULL, NULL, false, ReadIntermediateResultData,
+						 NULL, copyOptions);
+}
+
+
+/*
+ * BeginCopyFromResultMemory starts a COPY from an intermediate result that is
+ * kept in memory, which COPY reads through the data source callback.
+ */
+static CopyFromState
+BeginCopyFromResultMemory(Relation relation, char *fileName,
+						  IntermediateResultMemory *resultMemory, List *copyOptions,
+						  Bitmapset *skippedColumns)
+{
+	IntermediateResultCompressionType compressionType =
+		INTERMEDIATE_RESULT_COMPRESSION_NONE;
+	bool columnar = false;
+	Size memoryOffset = 0;
+
+	if (ParseCompressedResultHeader(resultMemory->data, resultMemory->length,
+									&compressionType, &columnar))
+	{
+		if (compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE &&
+			!CompressionTypeSupported(compressionType))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("intermediate result \"%s\" is compressed with "
+								   "a method that is not supported by this build of "
+								   "Citus", fileName)));
+		}
+
+		memoryOffset = COMPRESSED_RESULT_HEADER_LENGTH;
+	}
+
+	IntermediateResultReadState *readState =
+		palloc0(sizeof(IntermediateResultReadState));
+	readState->compressionType = compressionType;
+	readState->columnar = columnar;
+	readState->skippedColumns = skippedColumns;
+	readState->resultMemory = resultMemory;
+	readState->memoryOffset = memoryOffset;
+	readState->compressedBlock = makeStringInfo();
+	readState->rawBlock = makeStringInfo();
+
+	CurrentReadState = readState;
+
+	if (columnar)
+	{
+		copyOptions = ColumnarResultCopyOptions();
+	}
+
+	return BeginCopyFrom(NULL, relation, NULL, NULL, false, ReadIntermediateResultData,
+						 NULL, copyOptions);
+}
+
+
+/*
+ * ColumnarResultCopyOptions returns the COPY options for reading a result in
+ * the columnar layout, which is decoded into binary COPY data regardless of
+ * the format that the caller asked for.
+ */
+static List *
+ColumnarResultCopyOptions(void)
+{
+	int location = -1; /* "unknown" token location */
+	DefElem *copyOption = makeDefElem("format", (Node *) makeString("binary"),
+									  location);
+
+	return list_make1(copyOption);
+}
+
+
+/*
+ * EndCopyFromIntermediateResult ends a COPY that was started by
+ * BeginCopyFromIntermediateResult.
+ */
+void
+EndCopyFromIntermediateResult(CopyFromState copyState)
+{
+	EndCopyFrom(copyState);
+
+	if (CurrentReadState != NULL)
+	{
+		if (CurrentReadState->file != NULL)
+		{
+			FreeFile(CurrentReadState->file);
+		}
+
+		if (CurrentReadState->resultMemory != NULL)
+		{
+			DetachIntermediateResultMemory(CurrentReadState->resultMemory);
+		}
+
+		for (int columnIndex = 0; columnIndex < CurrentReadState->columnCount;
+			 columnIndex++)
+		{
+			pfree(CurrentReadState->columnData[columnIndex]->data);
+		}
+
+		pfree(CurrentReadState->compressedBlock->data);
+		pfree(CurrentReadState->rawBlock->data);
+		pfree(CurrentReadState);
+
+		CurrentReadState = NULL;
+	}
+}
+
+
+/*
+ * IntermediateResultFileRawSize returns the size of the COPY data in the given
+ * intermediate result file, which is the file size unless the file is
+ * compressed or in the columnar layout.
+ */
+int64
+IntermediateResultFileRawSize(const char *fileName, int64 fileSize)
+{
+	IntermediateResultCompressionType compressionType =
+		INTERMEDIATE_RESULT_COMPRESSION_NONE;
+	bool columnar = false;
+	char endMarker[RESULT_END_MARKER_LENGTH];
+	uint64 rawBytes = 0;
+	int64 rawSize = fileSize;
+
+	FILE *file = AllocateFile(fileName, PG_BINARY_R);
+	if (file == NULL)
+	{
+		return fileSize;
+	}
+
+	off_t endMarkerOffset = fileSize - RESULT_END_MARKER_LENGTH;
+
+	/* the total raw size is stored at the end */
+	if (ReadCompressedResultHeader(file, &compressionType, &columnar) &&
+		endMarkerOffset >= COMPRESSED_RESULT_HEADER_LENGTH &&
+		fseeko(file, endMarkerOffset, SEEK_SET) == 0 &&
+		fread(endMarker, sizeof(endMarker), 1, file) == 1 &&
+		ParseResultEndMarker(endMarker, columnar, &rawBytes))
+	{
+		rawSize = (int64) rawBytes;
+	}
+
+	FreeFile(file);
+
+	return rawSize;
+}
+
+
+/*
+ * IntermediateResultDataRawSize returns the size of the COPY data in the given
+ * intermediate result that is kept in memory, which is its length unless the
+ * result is compressed or in the columnar layout.
+ */
+int64
+IntermediateResultDataRawSize(const char *data, int64 length)
+{
+	IntermediateResultCompressionType compressionType =
+		INTERMEDIATE_RESULT_COMPRESSION_NONE;
+	bool columnar = false;
+	uint64 rawBytes = 0;
+
+	int64 endMarkerOffset = length - RESULT_END_MARKER_LENGTH;
+
+	if (!ParseCompressedResultHeader(data, length, &compressionType, &columnar) ||
+		endMarkerOffset < COMPRESSED_RESULT_HEADER_LENGTH)
+	{
+		return length;
+	}
+
+	/* the total raw size is stored at the end */
+	if (!ParseResultEndMarker(data + endMarkerOffset, columnar, &rawBytes))
+	{
+		return length;
+	}
+
+	return (int64) rawBytes;
+}
+
+
+/*
+ * ReadCompressedResultHeader reads the header at the start of the given file
+ * and returns whether it is a compressed intermediate result, in which case
+ * compressionType is set to its compression method and columnar to whether it
+ * is in the columnar layout.
+ */
+static bool
+ReadCompressedResultHeader(FILE *file, IntermediateResultCompressionType *compressionType,
+						   bool *columnar)
+{
+	char header[COMPRESSED_RESULT_HEADER_LENGTH];
+
+	size_t headerLength = fread(header, 1, sizeof(header), file);
+
+	return ParseCompressedResultHeader(header, headerLength, compressionType, columnar);
+}
+
+
+/*
+ * ParseCompressedResultHeader returns whether the given data starts with the
+ * header of a compressed intermediate result, in which case compressionType is
+ * set to its compression method and columnar to whether it is in the columnar
+ * layout.
+ */
+static bool
+ParseCompressedResultHeader(const char *header, Size length,
+							IntermediateResultCompressionType *compressionType,
+							bool *columnar)
+{
+	if (length < COMPRESSED_RESULT_HEADER_LENGTH)
+	{
+		return false;
+	}
+
+	if (memcmp(header, CompressedResultSignature,
+			   COMPRESSED_RESULT_SIGNATURE_LENGTH) != 0)
+	{
+		return false;
+	}
+
+	uint8 methodByte = (uint8) header[COMPRESSED_RESULT_SIGNATURE_LENGTH];
+
+	*columnar = (methodByte & COLUMNAR_RESULT_FLAG) != 0;
+	*compressionType =
+		(IntermediateResultCompressionType) (methodByte & ~COLUMNAR_RESULT_FLAG);
+
+	return true;
+}
+
+
+/*
+ * ParseResultEndMarker returns whether the given data is the end marker of a
+ * compressed or columnar intermediate result, in which case rawBytes is set to
+ * the total number of raw bytes in the result.
+ */
+static bool
+ParseResultEndMarker(const char *endMarker, bool columnar, uint64 *rawBytes)
+{
+	CompressedResultBlockHeader blockHeader = { 0, 0 };
+	uint64 rawBytesData = 0;
+
+	memcpy(&blockHeader, endMarker, sizeof(blockHeader));
+	memcpy(&rawBytesData, endMarker + sizeof(blockHeader), sizeof(rawBytesData));
+
+	/* columnar results end with a group header of 0 rows and 0 columns */
+	uint32 expectedLength = columnar ? 0 : sizeof(rawBytesData);
+
+	if (blockHeader.rawLength != 0 ||
+		pg_ntoh32(blockHeader.storedLength) != expectedLength)
+	{
+		return false;
+	}
+
+	*rawBytes = pg_ntoh64(rawBytesData);
+
+	return true;
+}
+
+
+/*
+ * ReadIntermediateResultData implements the data source callback of COPY for
+ * compressed intermediate results and results in memory. It copies between
+ * minread and maxread bytes of decompressed data to outbuf, or less at the end
+ * of the result.
+ */
+static int
+ReadIntermediateResultData(void *outbuf, int minread, int maxread)
+{
+	IntermediateResultReadState *readState = CurrentReadState;
+	char *outputPointer = (char *) outbuf;
+	int bytesRead = 0;
+
+	Assert(readState != NULL);
+
+	if (readState->compressionType == INTERMEDIATE_RESULT_COMPRESSION_NONE &&
+		!readState->columnar)
+	{
+		/* uncompressed results are only read through the callback from memory */
+		IntermediateResultMemory *resultMemory = readState->resultMemory;
+		Size remaining = resultMemory->length - readState->memoryOffset;
+
+		bytesRead = (int) Min((Size) maxread, remaining);
+		memcpy(outputPointer, resultMemory->data + readState->memoryOffset, bytesRead);
+		readState->memoryOffset += bytesRead;
+
+		return bytesRead;
+	}
+
+	while (bytesRead < maxread)
+	{
+		StringInfo rawBlock = readState->rawBlock;
+
+		if (readState->rawBlockOffset == rawBlock->len)
+		{
+			/* only read the next block when we need more data */
+			if (bytesRead >= minread)
+			{
+				break;
+			}
+
+			bool blockRead = readState->columnar ?
+							 ReadNextColumnarResultGroup(readState) :
+							 ReadNextCompressedResultBlock(readState);
+			if (!blockRead)
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		int copyLength = Min(maxread - bytesRead,
+							 rawBlock->len - readState->rawBlockOffset);
+
+		memcpy(outputPointer + bytesRead, rawBlock->data + readState->rawBlockOffset,
+			   copyLength);
+
+		readState->rawBlockOffset += copyLength;
+		bytesRead += copyLength;
+	}
+
+	return bytesRead;
+}
+
+
+/*
+ * ReadNextCompressedResultBlock reads the next block of a compressed
+ * intermediate result into the raw block of the read state, and returns false
+ * when it reaches the end of the result.
+ */
+static bool
+ReadNextCompressedResultBlock(IntermediateResultReadState *readState)
+{
+	CompressedResultBlockHeader blockHeader = { 0, 0 };
+
+	ReadFromIntermediateResult(readState, (char *) &blockHeader, sizeof(blockHeader));
+
+	uint32 rawLength = pg_ntoh32(blockHeader.rawLength);
+	uint32 storedLength = pg_ntoh32(blockHeader.storedLength);
+
+	if (rawLength == 0)
+	{
+		uint64 rawBytes = 0;
+
+		if (storedLength != sizeof(rawBytes))
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("intermediate result file is corrupted")));
+		}
+
+		ReadFromIntermediateResult(readState, (char *) &rawBytes, sizeof(rawBytes));
+
+		if (pg_ntoh64(rawBytes) != readState->rawBytes)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("intermediate result file is corrupted"),
+							errdetail("Expected " UINT64_FORMAT " bytes, but read "
+									  UINT64_FORMAT " bytes", pg_ntoh64(rawBytes),
+									  readState->rawBytes)));
+		}
+
+		return false;
+	}
+
+	ReadResultBlock(readState, rawLength, storedLength, readState->rawBlock);
+
+	readState->rawBlockOffset = 0;
+	readState->rawBytes += rawLength;
+
+	return true;
+}
+
+
+/*
+ * ReadNextColumnarResultGroup reads the next group of rows of a columnar
+ * intermediate result, and stores its rows as binary COPY data in the raw
+ * block of the read state. The binary COPY header is added before the first
+ * group, and the end marker after the last one. Returns false once the end
+ * marker was read.
+ */
+static bool
+ReadNextColumnarResultGroup(IntermediateResultReadState *readState)
+{
+	StringInfo rawBlock = readState->rawBlock;
+	ColumnarResultGroupHeader groupHeader = { 0, 0 };
+
+	if (readState->copyEndRead)
+	{
+		return false;
+	}
+
+	resetStringInfo(rawBlock);
+	readState->rawBlockOffset = 0;
+
+	if (!readState->copyHeaderRead)
+	{
+		uint32 zero = 0;
+
+		/* binary COPY header without flags and header extension */
+		appendBinaryStringInfo(rawBlock, BinaryCopySignature,
+							   BINARY_COPY_SIGNATURE_LENGTH);
+		appendBinaryStringInfo(rawBlock, (char *) &zero, sizeof(zero));
+		appendBinaryStringInfo(rawBlock, (char *) &zero, sizeof(zero));
+
+		readState->copyHeaderRead = true;
+	}
+
+	ReadFromIntermediateResult(readState, (char *) &groupHeader, sizeof(groupHeader));
+
+	uint32 rowCount = pg_ntoh32(groupHeader.rowCount);
+	uint32 columnCount = pg_ntoh32(groupHeader.columnCount);
+
+	if (rowCount == 0)
+	{
+		uint64 rawBytes = 0;
+		uint16 endMarker = pg_hton16((uint16) -1);
+
+		if (columnCount != 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("intermediate result file is corrupted")));
+		}
+
+		/* the raw size is only used for size estimates */
+		ReadFromIntermediateResult(readState, (char *) &rawBytes, sizeof(rawBytes));
+
+		appendBinaryStringInfo(rawBlock, (char *) &endMarker, sizeof(endMarker));
+		readState->copyEndRead = true;
+
+		return true;
+	}
+
+	/* results without columns, such as SELECT FROM t, have groups of 0 columns */
+	if (columnCount > MaxTupleAttributeNumber ||
+		(readState->columnData != NULL && columnCount != readState->columnCount))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("intermediate result file is corrupted")));
+	}
+
+	if (readState->columnData == NULL)
+	{
+		readState->columnCount = columnCount;
+		readState->columnData = palloc0(columnCount * sizeof(StringInfo));
+
+		for (int columnIndex = 0; columnIndex < (int) columnCount; columnIndex++)
+		{
+			readState->columnData[columnIndex] = makeStringInfo();
+		}
+	}
+
+	CompressedResultBlockHeader *blockHeaders =
+		palloc(columnCount * sizeof(CompressedResultBlockHeader));
+	ReadFromIntermediateResult(readState, (char *) blockHeaders,
+							   columnCount * sizeof(CompressedResultBlockHeader));
+
+	for (int columnIndex = 0; columnIndex < (int) columnCount; columnIndex++)
+	{
+		uint32 rawLength = pg_ntoh32(blockHeaders[columnIndex].rawLength);
+		uint32 storedLength = pg_ntoh32(blockHeaders[columnIndex].storedLength);
+
+		if (bms_is_member(columnIndex, readState->skippedColumns))
+		{
+			/* the column is not needed, so we do not even decompress it */
+			SkipIntermediateResultData(readState, storedLength);
+			continue;
+		}
+
+		ReadResultBlock(readState, rawLength, storedLength,
+						readState->columnData[columnIndex]);
+	}
+
+	pfree(blockHeaders);
+
+	AppendColumnarResultRows(readState, rowCount);
+
+	return true;
+}
+
+
+/*
+ * AppendColumnarResultRows appends rowCount rows to the raw block of the read
+ * state in binary COPY format, taking the fields of each column from the
+ * column data of the current group. Skipped columns are appended as NULL.
+ */
+static void
+AppendColumnarResultRows(IntermediateResultReadState *readState, uint32 rowCount)
+{
+	StringInfo rawBlock = readState->rawBlock;
+	int columnCount = readState->columnCount;
+	int *columnOffsets = palloc0(columnCount * sizeof(int));
+	uint16 fieldCount = pg_hton16((uint16) columnCount);
+	uint32 nullField = pg_hton32((uint32) -1);
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		appendBinaryStringInfo(rawBlock, (char *) &fieldCount, sizeof(fieldCount));
+
+		for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			StringInfo columnData = readState->columnData[columnIndex];
+			int columnOffset = columnOffsets[columnIndex];
+
+			if (bms_is_member(columnIndex, readState->skippedColumns))
+			{
+				appendBinaryStringInfo(rawBlock, (char *) &nullField,
+									   sizeof(nullField));
+				continue;
+			}
+
+			if (columnOffset + (int) sizeof(uint32) > columnData->len)
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+								errmsg("intermediate result file is corrupted")));
+			}
+
+			int32 fieldLength = (int32) ReadNetworkUInt32(columnData->data +
+														  columnOffset);
+			int fieldSize = sizeof(uint32) + Max(fieldLength, 0);
+
+			if (fieldSize > columnData->len - columnOffset)
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+								errmsg("intermediate result file is corrupted")));
+			}
+
+			appendBinaryStringInfo(rawBlock, columnData->data + columnOffset,
+								   fieldSize);
+			columnOffsets[columnIndex] += fieldSize;
+		}
+	}
+
+	pfree(columnOffsets);
+}
+
+
+/*
+ * ReadResultBlock reads a block with the given raw and stored length from the
+ * intermediate result into rawData, and decompresses it if needed.
+ */
+static void
+ReadResultBlock(IntermediateResultReadState *readState, uint32 rawLength,
+				uint32 storedLength, StringInfo rawData)
+{
+	if (rawLength >= MaxAllocSize || storedLength > rawLength)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("intermediate result file is corrupted")));
+	}
+
+	if (storedLength == rawLength)
+	{
+		/* the block was stored as is */
+		resetStringInfo(rawData);
+		enlargeStringInfo(rawData, rawLength);
+		ReadFromIntermediateResult(readState, rawData->data, rawLength);
+
+		rawData->len = rawLength;
+		rawData->data[rawLength] = '\0';
+	}
+	else
+	{
+		StringInfo compressedBlock = readState->compressedBlock;
+
+		resetStringInfo(compressedBlock);
+		enlargeStringInfo(compressedBlock, storedLength);
+		ReadFromIntermediateResult(readState, compressedBlock->data, storedLength);
+		compressedBlock->len = storedLength;
+
+		DecompressBlock(readState->compressionType, compressedBlock, rawData,
+						rawLength);
+	}
+}
+
+
+/*
+ * ReadFromIntermediateResult reads exactly length bytes from the file or memory
+ * of the read state into buffer, and errors out if the result ends before that.
+ */
+static void
+ReadFromIntermediateResult(IntermediateResultReadState *readState, char *buffer,
+						   size_t length)
+{
+	IntermediateResultMemory *resultMemory = readState->resultMemory;
+
+	if (resultMemory != NULL)
+	{
+		if (length > resultMemory->length - readState->memoryOffset)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("intermediate result is truncated")));
+		}
+
+		memcpy(buffer, resultMemory->data + readState->memoryOffset, length);
+		readState->memoryOffset += length;
+
+		return;
+	}
+
+	if (fread(buffer, 1, length, readState->file) != length)
+	{
+		if (ferror(readState->file))
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read intermediate result file: %m")));
+		}
+
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("intermediate result file is truncated")));
+	}
+}
+
+
+/*
+ * SkipIntermediateResultData moves past the next length bytes of the file or
+ * memory of the read state without reading them.
+ */
+static void
+SkipIntermediateResultData(IntermediateResultReadState *readState, size_t length)
+{
+	IntermediateResultMemory *resultMemory = readState->resultMemory;
+
+	if (resultMemory != NULL)
+	{
+		if (length > resultMemory->length - readState->memoryOffset)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("intermediate result is truncated")));
+		}
+
+		readState->memoryOffset += length;
+
+		return;
+	}
+
+	/* a truncated file is detected when reading the data that follows */
+	if (fseeko(readState->file, (off_t) length, SEEK_CUR) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not seek in intermediate result file: %m")));
+	}
+}
+
+
+/*
+ * ReadNetworkUInt16 returns the 16-bit integer in network byte order at the
+ * given, possibly unaligned, position.
+ */
+static uint16
+ReadNetworkUInt16(const char *data)
+{
+	uint16 value = 0;
+
+	memcpy(&value, data, sizeof(value));
+
+	return pg_ntoh16(value);
+}
+
+
+/*
+ * ReadNetworkUInt32 returns the 32-bit integer in network byte order at the
+ * given, possibly unaligned, position.
+ */
+static uint32
+ReadNetworkUInt32(const char *data)
+{
+	uint32 value = 0;
+
+	memcpy(&value, data, sizeof(value));
+
+	return pg_ntoh32(value);
+}
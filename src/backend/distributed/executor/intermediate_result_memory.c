@@ -0,0 +1,667 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_memory.c
+ *   Functions for keeping intermediate results in dynamic shared memory.
+ *
+ * When an intermediate result is written on a node that also reads it, for
+ * instance when the coordinator holds shards, the result would normally be
+ * written to a file and read back from it by local execution or by the
+ * backends of connections to the local node. Results that are small enough are
+ * instead copied into a dynamic shared memory segment, which is registered in
+ * a shared hash under the name of the file that would otherwise hold the
+ * result. Readers look up the result in the hash before opening the file.
+ *
+ * The contents of the segment are the same as those of the file, such that
+ * compressed results and binary COPY data are read in the same way.
+ *
+ * The backend that stores a result keeps the segment mapped until the end of
+ * the transaction, when the results directory is removed as well. Readers
+ * keep the segment alive while they have it attached.
+ *
+ * The total size of the results in memory is tracked in shared memory and
+ * limited by citus.max_intermediate_result_memory_per_node. Results that do
+ * not fit, or for which no segment can be created, are written to the file.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+
+#include "distributed/intermediate_result_memory.h"
+#include "distributed/listutils.h"
+
+
+/* results with longer file names are always written to files */
+#define MAX_RESULT_FILE_NAME_LENGTH (NAMEDATALEN * 4)
+
+/* number of results that can be kept in memory per allowed connection */
+#define RESULTS_IN_MEMORY_PER_CONNECTION 4
+
+
+/*
+ * IntermediateResultMemorySharedData is stored in shared memory and contains
+ * the lock that protects the hash of intermediate results in memory, and the
+ * total size of those results.
+ */
+typedef struct IntermediateResultMemorySharedData
+{
+	int trancheId;
+	char *trancheName;
+
+	LWLock lock;
+
+	/* sum of the sizes of the results in the hash, and of those being stored */
+	Size usedMemory;
+} IntermediateResultMemorySharedData;
+
+
+/* hash entry for an intermediate result in memory */
+typedef struct IntermediateResultMemoryEntry
+{
+	/* hash key, the name of the file that would otherwise hold the result */
+	char fileName[MAX_RESULT_FILE_NAME_LENGTH];
+
+	dsm_handle segmentHandle;
+	Size dataLength;
+} IntermediateResultMemoryEntry;
+
+
+/*
+ * MappedResultSegment is a dynamic shared memory segment of an intermediate
+ * result that the current backend has mapped, either because it stored the
+ * result or because it is reading it.
+ */
+typedef struct MappedResultSegment
+{
+	dsm_handle segmentHandle;
+	dsm_segment *segment;
+
+	/* name under which the segment is registered, if this backend created it */
+	char *ownedFileName;
+
+	/* number of readers in this backend that have the segment attached */
+	int readerCount;
+} MappedResultSegment;
+
+
+/* GUC, maximum size in kB of intermediate results that are kept in memory */
+int MaxIntermediateResultMemorySize = 0;
+
+/* GUC, maximum size in kB of all intermediate results in memory on the node */
+int MaxIntermediateResultMemoryPerNode = 64 * 1024;
+
+static HTAB *IntermediateResultMemoryHash = NULL;
+static IntermediateResultMemorySharedData *IntermediateResultMemoryState = NULL;
+
+/* segments mapped by this backend, allocated in TopMemoryContext */
+static List *MappedResultSegmentList = NIL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+static int MaxIntermediateResultsInMemory(void);
+static void IntermediateResultMemoryShmemInit(void);
+static bool ReserveIntermediateResultMemory(Size length);
+static void ReleaseIntermediateResultMemory(Size length);
+static dsm_segment * CreateResultSegment(Size size);
+static MappedResultSegment * FindMappedResultSegment(dsm_handle segmentHandle);
+static void UnmapResultSegment(MappedResultSegment *mappedSegment);
+
+
+/*
+ * InitializeIntermediateResultMemory sets up the shared memory startup hook
+ * for the hash of intermediate results in memory.
+ */
+void
+InitializeIntermediateResultMemory(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = IntermediateResultMemoryShmemInit;
+}
+
+
+/*
+ * MaxIntermediateResultsInMemory returns the number of intermediate results
+ * that can be kept in memory at once on this node.
+ */
+static int
+MaxIntermediateResultsInMemory(void)
+{
+	return MaxConnections * RESULTS_IN_MEMORY_PER_CONNECTION;
+}
+
+
+/*
+ * IntermediateResultMemoryShmemSize returns the size of the shared memory
+ * that is needed for the hash of intermediate results in memory. The results
+ * themselves are stored in dynamic shared memory.
+ */
+size_t
+IntermediateResultMemoryShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(IntermediateResultMemorySharedData));
+
+	Size hashSize = hash_estimate_size(MaxIntermediateResultsInMemory(),
+									   sizeof(IntermediateResultMemoryEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * IntermediateResultMemoryShmemInit initializes the shared memory for the
+ * hash of intermediate results in memory.
+ */
+static void
+IntermediateResultMemoryShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = MAX_RESULT_FILE_NAME_LENGTH;
+	info.entrysize = sizeof(IntermediateResultMemoryEntry);
+	uint32 hashFlags = (HASH_ELEM | HASH_STRINGS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	IntermediateResultMemoryState =
+		(IntermediateResultMemorySharedData *) ShmemInitStruct(
+			"Intermediate Result Memory Data",
+			sizeof(IntermediateResultMemorySharedData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		IntermediateResultMemoryState->trancheId = LWLockNewTrancheId();
+		IntermediateResultMemoryState->trancheName =
+			"Intermediate Result Memory Hash Tranche";
+		LWLockRegisterTranche(IntermediateResultMemoryState->trancheId,
+							  IntermediateResultMemoryState->trancheName);
+
+		LWLockInitialize(&IntermediateResultMemoryState->lock,
+						 IntermediateResultMemoryState->trancheId);
+
+		IntermediateResultMemoryState->usedMemory = 0;
+	}
+
+	IntermediateResultMemoryHash =
+		ShmemInitHash("Intermediate Result Memory Hash",
+					  MaxIntermediateResultsInMemory(),
+					  MaxIntermediateResultsInMemory(), &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(IntermediateResultMemoryHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * StoreIntermediateResultInMemory copies the contents of an intermediate result
+ * into a new dynamic shared memory segment and registers it under the given
+ * file name, replacing an earlier result with the same name. Returns false if
+ * the result cannot be kept in memory, in which case the caller should write
+ * it to the file.
+ */
+bool
+StoreIntermediateResultInMemory(const char *fileName, const char *data, Size length)
+{
+	bool found = false;
+
+	if (strlen(fileName) >= MAX_RESULT_FILE_NAME_LENGTH)
+	{
+		return false;
+	}
+
+	if (!ReserveIntermediateResultMemory(length))
+	{
+		return false;
+	}
+
+	dsm_segment *segment = CreateResultSegment(Max(length, 1));
+	if (segment == NULL)
+	{
+		ReleaseIntermediateResultMemory(length);
+		return false;
+	}
+
+	memcpy(dsm_segment_address(segment), data, length);
+
+	dsm_handle segmentHandle = dsm_segment_handle(segment);
+
+	LWLockAcquire(&IntermediateResultMemoryState->lock, LW_EXCLUSIVE);
+
+	IntermediateResultMemoryEntry *entry =
+		hash_search(IntermediateResultMemoryHash, fileName, HASH_ENTER_NULL, &found);
+	if (entry == NULL)
+	{
+		/* too many results in memory already */
+		IntermediateResultMemoryState->usedMemory -= length;
+
+		LWLockRelease(&IntermediateResultMemoryState->lock);
+
+		dsm_detach(segment);
+		return false;
+	}
+
+	dsm_handle replacedHandle = DSM_HANDLE_INVALID;
+	if (found)
+	{
+		replacedHandle = entry->segmentHandle;
+		IntermediateResultMemoryState->usedMemory -= entry->dataLength;
+	}
+
+	entry->segmentHandle = segmentHandle;
+	entry->dataLength = length;
+
+	LWLockRelease(&IntermediateResultMemoryState->lock);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	MappedResultSegment *mappedSegment = palloc0(sizeof(MappedResultSegment));
+	mappedSegment->segmentHandle = segmentHandle;
+	mappedSegment->segment = segment;
+	mappedSegment->ownedFileName = pstrdup(fileName);
+	MappedResultSegmentList = lappend(MappedResultSegmentList, mappedSegment);
+
+	MemoryContextSwitchTo(oldContext);
+
+	MappedResultSegment *replacedSegment = FindMappedResultSegment(replacedHandle);
+	if (replacedSegment != NULL && replacedSegment->ownedFileName != NULL)
+	{
+		pfree(replacedSegment->ownedFileName);
+		replacedSegment->ownedFileName = NULL;
+
+		if (replacedSegment->readerCount == 0)
+		{
+			UnmapResultSegment(replacedSegment);
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ReserveIntermediateResultMemory adds the given length to the memory that is
+ * used by intermediate results on this node, unless that would exceed
+ * citus.max_intermediate_result_memory_per_node, in which case it returns
+ * false.
+ */
+static bool
+ReserveIntermediateResultMemory(Size length)
+{
+	Size memoryLimit = (Size) MaxIntermediateResultMemoryPerNode * 1024;
+	bool reserved = false;
+
+	LWLockAcquire(&IntermediateResultMemoryState->lock, LW_EXCLUSIVE);
+
+	if (length <= memoryLimit &&
+		IntermediateResultMemoryState->usedMemory <= memoryLimit - length)
+	{
+		IntermediateResultMemoryState->usedMemory += length;
+		reserved = true;
+	}
+
+	LWLockRelease(&IntermediateResultMemoryState->lock);
+
+	return reserved;
+}
+
+
+/*
+ * ReleaseIntermediateResultMemory subtracts the given length from the memory
+ * that is used by intermediate results on this node, for a reservation that
+ * is not used after all.
+ */
+static void
+ReleaseIntermediateResultMemory(Size length)
+{
+	LWLockAcquire(&IntermediateResultMemoryState->lock, LW_EXCLUSIVE);
+
+	IntermediateResultMemoryState->usedMemory -= length;
+
+	LWLockRelease(&IntermediateResultMemoryState->lock);
+}
+
+
+/*
+ * CreateResultSegment creates a dynamic shared memory segment of the given
+ * size and keeps it mapped until the end of the transaction, also on abort.
+ * Returns NULL if the maximum number of segments is reached or the system is
+ * out of shared memory, such that the caller can write the result to a file.
+ *
+ * dsm_create errors out when it cannot allocate the memory, for instance when
+ * /dev/shm is full. It runs under a resource owner of its own, which releases
+ * the partially created segment in that case.
+ */
+static dsm_segment *
+CreateResultSegment(Size size)
+{
+	MemoryContext savedContext = CurrentMemoryContext;
+	ResourceOwner savedResourceOwner = CurrentResourceOwner;
+	ResourceOwner segmentResourceOwner =
+		ResourceOwnerCreate(savedResourceOwner, "intermediate result segment");
+	dsm_segment *volatile segment = NULL;
+
+	CurrentResourceOwner = segmentResourceOwner;
+
+	PG_TRY();
+	{
+		segment = dsm_create(size, DSM_CREATE_NULL_IF_MAXSEGMENTS);
+		if (segment != NULL)
+		{
+			/* this also removes the segment from the resource owner */
+			dsm_pin_mapping(segment);
+		}
+	}
+	PG_CATCH();
+	{
+		CurrentResourceOwner = savedResourceOwner;
+		MemoryContextSwitchTo(savedContext);
+
+		ErrorData *edata = CopyErrorData();
+		if (edata->sqlerrcode != ERRCODE_OUT_OF_MEMORY)
+		{
+			PG_RE_THROW();
+		}
+
+		FlushErrorState();
+
+		ereport(DEBUG1, (errmsg("could not create a shared memory segment for an "
+								"intermediate result: %s", edata->message)));
+
+		FreeErrorData(edata);
+	}
+	PG_END_TRY();
+
+	CurrentResourceOwner = savedResourceOwner;
+
+	ResourceOwnerRelease(segmentResourceOwner, RESOURCE_RELEASE_BEFORE_LOCKS,
+						 false, false);
+	ResourceOwnerRelease(segmentResourceOwner, RESOURCE_RELEASE_LOCKS, false, false);
+	ResourceOwnerRelease(segmentResourceOwner, RESOURCE_RELEASE_AFTER_LOCKS,
+						 false, false);
+	ResourceOwnerDelete(segmentResourceOwner);
+
+	return segment;
+}
+
+
+/*
+ * IntermediateResultInMemory returns whether the intermediate result with the
+ * given file name is kept in memory, and sets length to its size if so.
+ */
+bool
+IntermediateResultInMemory(const char *fileName, Size *length)
+{
+	bool found = false;
+
+	if (strlen(fileName) >= MAX_RESULT_FILE_NAME_LENGTH)
+	{
+		return false;
+	}
+
+	LWLockAcquire(&IntermediateResultMemoryState->lock, LW_SHARED);
+
+	IntermediateResultMemoryEntry *entry =
+		hash_search(IntermediateResultMemoryHash, fileName, HASH_FIND, &found);
+	if (found && length != NULL)
+	{
+		*length = entry->dataLength;
+	}
+
+	LWLockRelease(&IntermediateResultMemoryState->lock);
+
+	return found;
+}
+
+
+/*
+ * AttachIntermediateResultMemory maps the intermediate result with the given
+ * file name, if it is kept in memory, and returns its contents. Returns NULL
+ * when the result is not in memory. The caller should call
+ * DetachIntermediateResultMemory when done reading.
+ */
+IntermediateResultMemory *
+AttachIntermediateResultMemory(const char *fileName)
+{
+	bool found = false;
+	dsm_handle segmentHandle = DSM_HANDLE_INVALID;
+	Size dataLength = 0;
+
+	if (strlen(fileName) >= MAX_RESULT_FILE_NAME_LENGTH)
+	{
+		return NULL;
+	}
+
+	LWLockAcquire(&IntermediateResultMemoryState->lock, LW_SHARED);
+
+	IntermediateResultMemoryEntry *entry =
+		hash_search(IntermediateResultMemoryHash, fileName, HASH_FIND, &found);
+	if (found)
+	{
+		segmentHandle = entry->segmentHandle;
+		dataLength = entry->dataLength;
+	}
+
+	LWLockRelease(&IntermediateResultMemoryState->lock);
+
+	if (!found)
+	{
+		return NULL;
+	}
+
+	/* a segment can only be attached once per backend */
+	MappedResultSegment *mappedSegment = FindMappedResultSegment(segmentHandle);
+	if (mappedSegment == NULL)
+	{
+		dsm_segment *segment = dsm_attach(segmentHandle);
+		if (segment == NULL)
+		{
+			/* the transaction that stored the result ended in the meantime */
+			return NULL;
+		}
+
+		dsm_pin_mapping(segment);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+		mappedSegment = palloc0(sizeof(MappedResultSegment));
+		mappedSegment->segmentHandle = segmentHandle;
+		mappedSegment->segment = segment;
+		MappedResultSegmentList = lappend(MappedResultSegmentList, mappedSegment);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	mappedSegment->readerCount++;
+
+	IntermediateResultMemory *resultMemory = palloc0(sizeof(IntermediateResultMemory));
+	resultMemory->segmentHandle = segmentHandle;
+	resultMemory->data = dsm_segment_address(mappedSegment->segment);
+	resultMemory->length = dataLength;
+
+	return resultMemory;
+}
+
+
+/*
+ * DetachIntermediateResultMemory releases an intermediate result that was
+ * attached by AttachIntermediateResultMemory, and unmaps its segment if no
+ * one else in this backend uses it.
+ */
+void
+DetachIntermediateResultMemory(IntermediateResultMemory *resultMemory)
+{
+	MappedResultSegment *mappedSegment =
+		FindMappedResultSegment(resultMemory->segmentHandle);
+
+	/* segments are only unmapped early by readers, so it should still be there */
+	if (mappedSegment != NULL)
+	{
+		mappedSegment->readerCount--;
+
+		if (mappedSegment->readerCount == 0 && mappedSegment->ownedFileName == NULL)
+		{
+			UnmapResultSegment(mappedSegment);
+		}
+	}
+
+	pfree(resultMemory);
+}
+
+
+/*
+ * RemoveIntermediateResultFromMemory removes the intermediate result with the
+ * given file name from memory, if it is there. This is used when the result
+ * is written to the file instead, such that readers do not find an older
+ * version in memory.
+ */
+void
+RemoveIntermediateResultFromMemory(const char *fileName)
+{
+	bool found = false;
+	dsm_handle segmentHandle = DSM_HANDLE_INVALID;
+
+	if (strlen(fileName) >= MAX_RESULT_FILE_NAME_LENGTH)
+	{
+		return;
+	}
+
+	LWLockAcquire(&IntermediateResultMemoryState->lock, LW_EXCLUSIVE);
+
+	IntermediateResultMemoryEntry *entry =
+		hash_search(IntermediateResultMemoryHash, fileName, HASH_FIND, &found);
+	if (found)
+	{
+		segmentHandle = entry->segmentHandle;
+		IntermediateResultMemoryState->usedMemory -= entry->dataLength;
+		hash_search(IntermediateResultMemoryHash, fileName, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&IntermediateResultMemoryState->lock);
+
+	MappedResultSegment *mappedSegment = FindMappedResultSegment(segmentHandle);
+	if (mappedSegment != NULL && mappedSegment->ownedFileName != NULL)
+	{
+		pfree(mappedSegment->ownedFileName);
+		mappedSegment->ownedFileName = NULL;
+
+		if (mappedSegment->readerCount == 0)
+		{
+			UnmapResultSegment(mappedSegment);
+		}
+	}
+}
+
+
+/*
+ * ReleaseIntermediateResultsInMemory removes the intermediate results that
+ * this backend stored in memory and unmaps all segments at the end of the
+ * transaction. Segments that other backends still read stay around until
+ * they detach.
+ */
+void
+ReleaseIntermediateResultsInMemory(void)
+{
+	if (MappedResultSegmentList == NIL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&IntermediateResultMemoryState->lock, LW_EXCLUSIVE);
+
+	MappedResultSegment *mappedSegment = NULL;
+	foreach_declared_ptr(mappedSegment, MappedResultSegmentList)
+	{
+		bool found = false;
+
+		if (mappedSegment->ownedFileName == NULL)
+		{
+			continue;
+		}
+
+		IntermediateResultMemoryEntry *entry =
+			hash_search(IntermediateResultMemoryHash, mappedSegment->ownedFileName,
+						HASH_FIND, &found);
+
+		/* the entry might have been replaced by another backend */
+		if (found && entry->segmentHandle == mappedSegment->segmentHandle)
+		{
+			IntermediateResultMemoryState->usedMemory -= entry->dataLength;
+			hash_search(IntermediateResultMemoryHash, mappedSegment->ownedFileName,
+						HASH_REMOVE, NULL);
+		}
+	}
+
+	LWLockRelease(&IntermediateResultMemoryState->lock);
+
+	foreach_declared_ptr(mappedSegment, MappedResultSegmentList)
+	{
+		dsm_detach(mappedSegment->segment);
+
+		if (mappedSegment->ownedFileName != NULL)
+		{
+			pfree(mappedSegment->ownedFileName);
+		}
+	}
+
+	list_free_deep(MappedResultSegmentList);
+	MappedResultSegmentList = NIL;
+}
+
+
+/*
+ * FindMappedResultSegment returns the segment with the given handle if this
+ * backend has it mapped, or NULL otherwise.
+ */
+static MappedResultSegment *
+FindMappedResultSegment(dsm_handle segmentHandle)
+{
+	MappedResultSegment *mappedSegment = NULL;
+	foreach_declared_ptr(mappedSegment, MappedResultSegmentList)
+	{
+		if (mappedSegment->segmentHandle == segmentHandle)
+		{
+			return mappedSegment;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * UnmapResultSegment detaches a segment that is no longer used by this
+ * backend.
+ */
+static void
+UnmapResultSegment(MappedResultSegment *mappedSegment)
+{
+	MappedResultSegmentList = list_delete_ptr(MappedResultSegmentList, mappedSegment);
+
+	dsm_detach(mappedSegment->segment);
+	pfree(mappedSegment);
+}
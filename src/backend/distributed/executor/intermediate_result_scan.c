@@ -0,0 +1,1013 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_scan.c
+ *
+ * Custom scan that replaces function scans on read_intermediate_result and
+ * read_intermediate_results in binary format. The function scan parses the
+ * files with COPY and materializes all rows in a tuple store before returning
+ * the first one. The custom scan instead maps the files into memory and decodes
+ * one row at a time directly into the scan slot.
+ *
+ * Results that are kept in shared memory are decoded from there instead of
+ * the file. Files that are not plain binary COPY data (e.g. compressed
+ * results) are still read through COPY into a tuple store.
+ *
+ * Columns that the query does not use are not decoded, and are left NULL in
+ * the scan slot. For results in the columnar layout, COPY then also skips the
+ * data of those columns.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "postgres.h"
+
+#include "fmgr.h"
+
+#include "access/sysattr.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "nodes/extensible.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/restrictinfo.h"
+#include "port/pg_bswap.h"
+#include "storage/fd.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+#include "distributed/intermediate_result_memory.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+
+
+/* length of the signature, flags and header extension length of binary COPY data */
+#define BINARY_SIGNATURE_LENGTH 11
+#define BINARY_HEADER_LENGTH (BINARY_SIGNATURE_LENGTH + 2 * sizeof(uint32))
+
+/* the flag in the binary COPY header that signals OIDs are included */
+#define BINARY_HEADER_OIDS_FLAG (1 << 16)
+
+
+/*
+ * IntermediateResultScanState is the execution state of a scan on one or more
+ * intermediate result files.
+ */
+typedef struct IntermediateResultScanState
+{
+	CustomScanState customScanState; /* must be first field */
+
+	/* IDs of the results to read, as String nodes */
+	List *resultIdList;
+	int nextResultIndex;
+
+	/* 0-based indexes of the columns that the query does not use */
+	Bitmapset *skippedColumns;
+
+	/* memory mapped binary COPY data of the current file */
+	char *mappedData;
+	size_t mappedSize;
+	size_t readOffset;
+
+	/* shared memory of the current result, in which case mappedData points into it */
+	IntermediateResultMemory *resultMemory;
+
+	/* rows of the current file if it cannot be decoded from memory */
+	Tuplestorestate *tupleStore;
+	TupleTableSlot *tupleStoreSlot;
+
+	/* state for calling the binary receive functions, set up on first use */
+	FmgrInfo *receiveFunctions;
+	Oid *typeIOParams;
+	StringInfoData fieldBuffer;
+
+	/* unmaps the current file when the query memory is released on abort */
+	MemoryContextCallback unmapCallback;
+} IntermediateResultScanState;
+
+
+static Plan * IntermediateResultScanPathPlan(PlannerInfo *root, RelOptInfo *rel,
+											 struct CustomPath *best_path,
+											 List *tlist, List *clauses,
+											 List *custom_plans);
+static List * IntermediateResultIdList(FuncExpr *funcExpression);
+static List * UnusedColumnList(RelOptInfo *relOptInfo, int columnCount);
+static Node * IntermediateResultCreateScan(CustomScan *scan);
+static void IntermediateResultBeginScan(CustomScanState *node, EState *estate,
+										int eflags);
+static TupleTableSlot * IntermediateResultExecScan(CustomScanState *node);
+static TupleTableSlot * IntermediateResultScanNext(ScanState *node);
+static bool IntermediateResultScanRecheck(ScanState *node, TupleTableSlot *slot);
+static bool OpenNextResultFile(IntermediateResultScanState *scanState);
+static bool MapResultFile(IntermediateResultScanState *scanState, char *fileName);
+static bool AttachResultMemory(IntermediateResultScanState *scanState, char *fileName);
+static bool BinaryCopyDataOffset(char *data, size_t size, size_t *dataOffset);
+static bool ReadNextMappedRow(IntermediateResultScanState *scanState,
+							  TupleTableSlot *slot);
+static char * ReadMappedBytes(IntermediateResultScanState *scanState, size_t length);
+static bool DecodeFixedWidthValue(Oid typeId, char *fieldData, int32 fieldLength,
+								  Datum *value);
+static void InitializeReceiveFunctions(IntermediateResultScanState *scanState,
+									   TupleDesc tupleDescriptor);
+static void CloseResultFile(IntermediateResultScanState *scanState);
+static void UnmapResultFileCallback(void *arg);
+static void IntermediateResultEndScan(CustomScanState *node);
+static void IntermediateResultReScan(CustomScanState *node);
+
+
+/* GUC, whether to scan binary intermediate results without a tuple store */
+bool EnableIntermediateResultScan = false;
+
+static CustomPathMethods IntermediateResultScanPathMethods = {
+	.CustomName = "IntermediateResultScanPath",
+	.PlanCustomPath = IntermediateResultScanPathPlan,
+};
+
+static CustomScanMethods IntermediateResultCustomScanMethods = {
+	"Citus Intermediate Result",
+	IntermediateResultCreateScan
+};
+
+static CustomExecMethods IntermediateResultCustomExecMethods = {
+	.CustomName = "IntermediateResultScan",
+	.BeginCustomScan = IntermediateResultBeginScan,
+	.ExecCustomScan = IntermediateResultExecScan,
+	.EndCustomScan = IntermediateResultEndScan,
+	.ReScanCustomScan = IntermediateResultReScan
+};
+
+
+/*
+ * RegisterIntermediateResultScanMethods lets PostgreSQL know about the
+ * intermediate result custom scan, such that plans containing it can be
+ * serialized.
+ */
+void
+RegisterIntermediateResultScanMethods(void)
+{
+	RegisterCustomScanMethods(&IntermediateResultCustomScanMethods);
+}
+
+
+/*
+ * ReplaceReadIntermediateResultPath replaces the function scan path of a
+ * read_intermediate_result(s) call in binary format with a path for the
+ * intermediate result custom scan, when the result IDs are constants. The
+ * cost and row estimate of the function scan path are kept. The path keeps
+ * the result IDs and the columns that the scan does not need to decode.
+ */
+void
+ReplaceReadIntermediateResultPath(RangeTblEntry *rangeTableEntry,
+								  RelOptInfo *relOptInfo)
+{
+	if (!EnableIntermediateResultScan)
+	{
+		return;
+	}
+
+	if (rangeTableEntry->rtekind != RTE_FUNCTION ||
+		list_length(rangeTableEntry->functions) != 1 ||
+		rangeTableEntry->funcordinality)
+	{
+		/* avoid more expensive checks below for non-functions */
+		return;
+	}
+
+	if (!bms_is_empty(relOptInfo->lateral_relids) || relOptInfo->pathlist == NIL)
+	{
+		/* the scan cannot depend on other relations */
+		return;
+	}
+
+	if (!CitusHasBeenLoaded() || !CheckCitusVersion(DEBUG5))
+	{
+		/* read_intermediate_result may not exist */
+		return;
+	}
+
+	RangeTblFunction *rangeTableFunction =
+		(RangeTblFunction *) linitial(rangeTableEntry->functions);
+	FuncExpr *funcExpression = (FuncExpr *) rangeTableFunction->funcexpr;
+	if (!IsA(funcExpression, FuncExpr) ||
+		(funcExpression->funcid != CitusReadIntermediateResultFuncId() &&
+		 funcExpression->funcid != CitusReadIntermediateResultArrayFuncId()))
+	{
+		return;
+	}
+
+	Const *resultIdConst = (Const *) linitial(funcExpression->args);
+	Const *resultFormatConst = (Const *) lsecond(funcExpression->args);
+	if (!IsA(resultIdConst, Const) || resultIdConst->constisnull ||
+		!IsA(resultFormatConst, Const) || resultFormatConst->constisnull)
+	{
+		/* not sure how to interpret non-const */
+		return;
+	}
+
+	if (DatumGetObjectId(resultFormatConst->constvalue) != BinaryCopyFormatId())
+	{
+		/* text results still need the COPY parser */
+		return;
+	}
+
+	Path *functionScanPath = (Path *) linitial(relOptInfo->pathlist);
+
+	CustomPath *path = makeNode(CustomPath);
+	path->methods = &IntermediateResultScanPathMethods;
+	path->path.pathtype = T_CustomScan;
+	path->path.parent = relOptInfo;
+	path->path.pathtarget = relOptInfo->reltarget;
+	path->path.rows = functionScanPath->rows;
+	path->path.startup_cost = functionScanPath->startup_cost;
+	path->path.total_cost = functionScanPath->total_cost;
+
+	/* result files are only visible to the backend of the distributed transaction */
+	path->path.parallel_safe = false;
+
+	/* necessary to avoid extra Result node in PG15 */
+	path->flags = CUSTOMPATH_SUPPORT_PROJECTION;
+
+	List *resultIdList = IntermediateResultIdList(funcExpression);
+	int columnCount = list_length(rangeTableEntry->eref->colnames);
+	List *unusedColumnList = UnusedColumnList(relOptInfo, columnCount);
+
+	path->custom_private = list_make2(resultIdList, unusedColumnList);
+
+	/* replace the function scan, the planner picks the cheapest path afterwards */
+	relOptInfo->pathlist = list_make1(path);
+}
+
+
+/*
+ * IntermediateResultIdList returns the result IDs passed to a call of
+ * read_intermediate_result or read_intermediate_results as a list of String
+ * nodes.
+ */
+static List *
+IntermediateResultIdList(FuncExpr *funcExpression)
+{
+	Const *resultIdConst = (Const *) linitial(funcExpression->args);
+	List *resultIdList = NIL;
+
+	if (funcExpression->funcid == CitusReadIntermediateResultFuncId())
+	{
+		char *resultId = TextDatumGetCString(resultIdConst->constvalue);
+		return list_make1(makeString(resultId));
+	}
+
+	Datum *resultIdArray = NULL;
+	bool *resultIdNulls = NULL;
+	int resultIdCount = 0;
+
+	deconstruct_array(DatumGetArrayTypeP(resultIdConst->constvalue), TEXTOID, -1,
+					  false, 'i', &resultIdArray, &resultIdNulls, &resultIdCount);
+
+	for (int resultIndex = 0; resultIndex < resultIdCount; resultIndex++)
+	{
+		if (resultIdNulls[resultIndex])
+		{
+			continue;
+		}
+
+		char *resultId = TextDatumGetCString(resultIdArray[resultIndex]);
+		resultIdList = lappend(resultIdList, makeString(resultId));
+	}
+
+	return resultIdList;
+}
+
+
+/*
+ * UnusedColumnList returns the 0-based indexes of the columns of the function
+ * scan that are neither needed above the scan nor used by its quals.
+ */
+static List *
+UnusedColumnList(RelOptInfo *relOptInfo, int columnCount)
+{
+	Bitmapset *usedAttributes = NULL;
+	List *unusedColumnList = NIL;
+
+	pull_varattnos((Node *) relOptInfo->reltarget->exprs, relOptInfo->relid,
+				   &usedAttributes);
+
+	RestrictInfo *restrictInfo = NULL;
+	foreach_declared_ptr(restrictInfo, relOptInfo->baserestrictinfo)
+	{
+		pull_varattnos((Node *) restrictInfo->clause, relOptInfo->relid,
+					   &usedAttributes);
+	}
+
+	if (bms_is_member(InvalidAttrNumber - FirstLowInvalidHeapAttributeNumber,
+					  usedAttributes))
+	{
+		/* whole-row references use all columns */
+		return NIL;
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		AttrNumber columnNumber = columnIndex + 1;
+
+		if (!bms_is_member(columnNumber - FirstLowInvalidHeapAttributeNumber,
+						   usedAttributes))
+		{
+			unusedColumnList = lappend_int(unusedColumnList, columnIndex);
+		}
+	}
+
+	return unusedColumnList;
+}
+
+
+/*
+ * IntermediateResultScanPathPlan creates the CustomScan for an intermediate
+ * result scan path. The scan has no relation to open, so the columns of the
+ * function are described by the custom scan target list, which the target list
+ * and quals reference after set_plan_references.
+ */
+static Plan *
+IntermediateResultScanPathPlan(PlannerInfo *root, RelOptInfo *rel,
+							   struct CustomPath *best_path, List *tlist,
+							   List *clauses, List *custom_plans)
+{
+	RangeTblEntry *rangeTableEntry = planner_rt_fetch(rel->relid, root);
+	RangeTblFunction *rangeTableFunction =
+		(RangeTblFunction *) linitial(rangeTableEntry->functions);
+	List *columnNameList = rangeTableEntry->eref->colnames;
+	List *scanTargetList = NIL;
+
+	for (int columnIndex = 0; columnIndex < list_length(columnNameList); columnIndex++)
+	{
+		AttrNumber columnNumber = columnIndex + 1;
+		Var *column = makeVar(rel->relid, columnNumber,
+							  list_nth_oid(rangeTableFunction->funccoltypes,
+										   columnIndex),
+							  list_nth_int(rangeTableFunction->funccoltypmods,
+										   columnIndex),
+							  list_nth_oid(rangeTableFunction->funccolcollations,
+										   columnIndex),
+							  0);
+		char *columnName = strVal(list_nth(columnNameList, columnIndex));
+
+		scanTargetList = lappend(scanTargetList,
+								 makeTargetEntry((Expr *) column, columnNumber,
+												 pstrdup(columnName), false));
+	}
+
+	CustomScan *customScan = makeNode(CustomScan);
+	customScan->methods = &IntermediateResultCustomScanMethods;
+	customScan->flags = best_path->flags;
+	customScan->scan.scanrelid = 0;
+	customScan->scan.plan.targetlist = tlist;
+	customScan->scan.plan.qual = extract_actual_clauses(clauses, false);
+	customScan->custom_scan_tlist = scanTargetList;
+	customScan->custom_private = best_path->custom_private;
+
+	return (Plan *) customScan;
+}
+
+
+/*
+ * IntermediateResultCreateScan creates the scan state for an intermediate
+ * result scan.
+ */
+static Node *
+IntermediateResultCreateScan(CustomScan *scan)
+{
+	IntermediateResultScanState *scanState = palloc0(
+		sizeof(IntermediateResultScanState));
+
+	scanState->customScanState.ss.ps.type = T_CustomScanState;
+	scanState->customScanState.methods = &IntermediateResultCustomExecMethods;
+	scanState->resultIdList = linitial(scan->custom_private);
+
+	List *unusedColumnList = lsecond(scan->custom_private);
+	int columnIndex = 0;
+	foreach_declared_int(columnIndex, unusedColumnList)
+	{
+		scanState->skippedColumns = bms_add_member(scanState->skippedColumns,
+												   columnIndex);
+	}
+
+	return (Node *) scanState;
+}
+
+
+/*
+ * IntermediateResultBeginScan prepares the scan state. Files are only opened
+ * once the first row is requested.
+ */
+static void
+IntermediateResultBeginScan(CustomScanState *node, EState *estate, int eflags)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	scanState->nextResultIndex = 0;
+
+	/* munmap on abort, since mappings are not released with the query memory */
+	scanState->unmapCallback.func = UnmapResultFileCallback;
+	scanState->unmapCallback.arg = scanState;
+	MemoryContextRegisterResetCallback(estate->es_query_cxt,
+									   &scanState->unmapCallback);
+}
+
+
+/*
+ * IntermediateResultExecScan returns the next row that passes the quals,
+ * projected to the target list.
+ */
+static TupleTableSlot *
+IntermediateResultExecScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss, IntermediateResultScanNext,
+					IntermediateResultScanRecheck);
+}
+
+
+/*
+ * IntermediateResultScanNext stores the next row of the intermediate results
+ * in the scan slot, moving on to the next file when the current one is done.
+ * Returns an empty slot once all files have been read.
+ */
+static TupleTableSlot *
+IntermediateResultScanNext(ScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	TupleTableSlot *scanSlot = node->ss_ScanTupleSlot;
+
+	while (true)
+	{
+		if (scanState->mappedData != NULL)
+		{
+			if (ReadNextMappedRow(scanState, scanSlot))
+			{
+				return scanSlot;
+			}
+		}
+		else if (scanState->tupleStore != NULL)
+		{
+			if (tuplestore_gettupleslot(scanState->tupleStore, true, false,
+										scanState->tupleStoreSlot))
+			{
+				return ExecCopySlot(scanSlot, scanState->tupleStoreSlot);
+			}
+		}
+
+		CloseResultFile(scanState);
+
+		if (!OpenNextResultFile(scanState))
+		{
+			return ExecClearTuple(scanSlot);
+		}
+	}
+}
+
+
+/*
+ * IntermediateResultScanRecheck is never called since the scan has no
+ * EvalPlanQual support, but ExecScan requires it.
+ */
+static bool
+IntermediateResultScanRecheck(ScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+/*
+ * OpenNextResultFile prepares reading the next intermediate result file that
+ * exists. Plain binary COPY files are mapped into memory, other files are read
+ * into a tuple store. Returns false when there are no more files.
+ */
+static bool
+OpenNextResultFile(IntermediateResultScanState *scanState)
+{
+	ScanState *scan = &scanState->customScanState.ss;
+	TupleDesc tupleDescriptor = scan->ss_ScanTupleSlot->tts_tupleDescriptor;
+
+	while (scanState->nextResultIndex < list_length(scanState->resultIdList))
+	{
+		char *resultId = strVal(list_nth(scanState->resultIdList,
+										 scanState->nextResultIndex));
+		scanState->nextResultIndex++;
+
+		char *fileName = FindIntermediateResultFile(resultId);
+		if (fileName == NULL)
+		{
+			continue;
+		}
+
+		if (MapResultFile(scanState, fileName))
+		{
+			InitializeReceiveFunctions(scanState, tupleDescriptor);
+			return true;
+		}
+
+		MemoryContext queryContext = scan->ps.state->es_query_cxt;
+		MemoryContext oldContext = MemoryContextSwitchTo(queryContext);
+
+		if (scanState->tupleStoreSlot == NULL)
+		{
+			scanState->tupleStoreSlot =
+				MakeSingleTupleTableSlot(tupleDescriptor, &TTSOpsMinimalTuple);
+		}
+
+		scanState->tupleStore = tuplestore_begin_heap(false, false, work_mem);
+		ReadFileIntoTupleStore(fileName, "binary", tupleDescriptor,
+							   scanState->skippedColumns, scanState->tupleStore);
+
+		MemoryContextSwitchTo(oldContext);
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * MapResultFile maps the given file into memory and positions the scan after
+ * the binary COPY header. Returns false if the file does not start with a
+ * binary COPY header that we can read, such as compressed files.
+ */
+static bool
+MapResultFile(IntermediateResultScanState *scanState, char *fileName)
+{
+	struct stat fileStat;
+	size_t dataOffset = 0;
+
+	if (IntermediateResultInMemory(fileName, NULL))
+	{
+		return AttachResultMemory(scanState, fileName);
+	}
+
+	int fileDescriptor = OpenTransientFile(fileName, O_RDONLY | PG_BINARY);
+	if (fileDescriptor < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", fileName)));
+	}
+
+	if (fstat(fileDescriptor, &fileStat) < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not stat file \"%s\": %m", fileName)));
+	}
+
+	size_t fileSize = (size_t) fileStat.st_size;
+	if (fileSize < BINARY_HEADER_LENGTH)
+	{
+		CloseTransientFile(fileDescriptor);
+		return false;
+	}
+
+	/* the mapping stays valid after closing the file */
+	char *mappedData = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	CloseTransientFile(fileDescriptor);
+
+	if (mappedData == MAP_FAILED)
+	{
+		/* fall back to reading the file */
+		return false;
+	}
+
+	if (!BinaryCopyDataOffset(mappedData, fileSize, &dataOffset))
+	{
+		/* let COPY handle the file, or error out */
+		munmap(mappedData, fileSize);
+		return false;
+	}
+
+	(void) posix_madvise(mappedData, fileSize, POSIX_MADV_SEQUENTIAL);
+
+	scanState->mappedData = mappedData;
+	scanState->mappedSize = fileSize;
+	scanState->readOffset = dataOffset;
+
+	return true;
+}
+
+
+/*
+ * AttachResultMemory positions the scan after the binary COPY header of the
+ * given result that is kept in shared memory. Returns false if the result is
+ * no longer in memory, or if it is not plain binary COPY data.
+ */
+static bool
+AttachResultMemory(IntermediateResultScanState *scanState, char *fileName)
+{
+	size_t dataOffset = 0;
+
+	IntermediateResultMemory *resultMemory = AttachIntermediateResultMemory(fileName);
+	if (resultMemory == NULL)
+	{
+		return false;
+	}
+
+	if (!BinaryCopyDataOffset(resultMemory->data, resultMemory->length, &dataOffset))
+	{
+		/* COPY reads the result from memory as well */
+		DetachIntermediateResultMemory(resultMemory);
+		return false;
+	}
+
+	scanState->resultMemory = resultMemory;
+	scanState->mappedData = resultMemory->data;
+	scanState->mappedSize = resultMemory->length;
+	scanState->readOffset = dataOffset;
+
+	return true;
+}
+
+
+/*
+ * BinaryCopyDataOffset returns whether the given data starts with a binary COPY
+ * header that we can read, in which case dataOffset is set to the offset of the
+ * first row.
+ */
+static bool
+BinaryCopyDataOffset(char *data, size_t size, size_t *dataOffset)
+{
+	static const char BinarySignature[BINARY_SIGNATURE_LENGTH] = "PGCOPY\n\377\r\n\0";
+	uint32 headerFlags = 0;
+	uint32 headerExtensionLength = 0;
+
+	if (size < BINARY_HEADER_LENGTH)
+	{
+		return false;
+	}
+
+	memcpy(&headerFlags, data + BINARY_SIGNATURE_LENGTH, sizeof(uint32));
+	memcpy(&headerExtensionLength, data + BINARY_SIGNATURE_LENGTH +
+		   sizeof(uint32), sizeof(uint32));
+	headerFlags = pg_ntoh32(headerFlags);
+	headerExtensionLength = pg_ntoh32(headerExtensionLength);
+
+	if (memcmp(data, BinarySignature, BINARY_SIGNATURE_LENGTH) != 0 ||
+		(headerFlags & BINARY_HEADER_OIDS_FLAG) != 0 ||
+		headerExtensionLength > size - BINARY_HEADER_LENGTH)
+	{
+		return false;
+	}
+
+	*dataOffset = BINARY_HEADER_LENGTH + headerExtensionLength;
+
+	return true;
+}
+
+
+/*
+ * ReadNextMappedRow decodes the next row of the mapped binary COPY data into
+ * the given slot. Fields of common fixed-width types are decoded in place,
+ * other fields are passed to the receive function of their type. Returns false
+ * at the end of the data.
+ */
+static bool
+ReadNextMappedRow(IntermediateResultScanState *scanState, TupleTableSlot *slot)
+{
+	TupleDesc tupleDescriptor = slot->tts_tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+	uint16 fieldCountData = 0;
+
+	if (scanState->readOffset == scanState->mappedSize)
+	{
+		/* data without the end marker is read as COPY does */
+		return false;
+	}
+
+	memcpy(&fieldCountData, ReadMappedBytes(scanState, sizeof(uint16)),
+		   sizeof(uint16));
+	int16 fieldCount = (int16) pg_ntoh16(fieldCountData);
+
+	if (fieldCount == -1)
+	{
+		return false;
+	}
+
+	if (fieldCount != columnCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("row field count is %d, expected %d",
+							   (int) fieldCount, columnCount)));
+	}
+
+	ExecClearTuple(slot);
+
+	/* decoded values live until ExecScan resets the per-tuple memory */
+	ExprContext *expressionContext = scanState->customScanState.ss.ps.ps_ExprContext;
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(expressionContext->ecxt_per_tuple_memory);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		FmgrInfo *receiveFunction = &scanState->receiveFunctions[columnIndex];
+		Oid typeIOParam = scanState->typeIOParams[columnIndex];
+		uint32 fieldLengthData = 0;
+
+		memcpy(&fieldLengthData, ReadMappedBytes(scanState, sizeof(uint32)),
+			   sizeof(uint32));
+		int32 fieldLength = (int32) pg_ntoh32(fieldLengthData);
+
+		if (bms_is_member(columnIndex, scanState->skippedColumns))
+		{
+			/* the query does not use this column */
+			if (fieldLength > 0)
+			{
+				ReadMappedBytes(scanState, fieldLength);
+			}
+
+			slot->tts_values[columnIndex] = (Datum) 0;
+			slot->tts_isnull[columnIndex] = true;
+			continue;
+		}
+
+		if (fieldLength == -1)
+		{
+			/* receive functions are called for NULLs to check domain constraints */
+			slot->tts_values[columnIndex] =
+				ReceiveFunctionCall(receiveFunction, NULL, typeIOParam,
+									attribute->atttypmod);
+			slot->tts_isnull[columnIndex] = true;
+			continue;
+		}
+
+		if (fieldLength < 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("invalid field size")));
+		}
+
+		char *fieldData = ReadMappedBytes(scanState, fieldLength);
+		slot->tts_isnull[columnIndex] = false;
+
+		if (DecodeFixedWidthValue(attribute->atttypid, fieldData, fieldLength,
+								  &slot->tts_values[columnIndex]))
+		{
+			continue;
+		}
+
+		/* receive functions expect a null-terminated buffer */
+		StringInfo fieldBuffer = &scanState->fieldBuffer;
+		resetStringInfo(fieldBuffer);
+		appendBinaryStringInfo(fieldBuffer, fieldData, fieldLength);
+
+		slot->tts_values[columnIndex] =
+			ReceiveFunctionCall(receiveFunction, fieldBuffer, typeIOParam,
+								attribute->atttypmod);
+
+		if (fieldBuffer->cursor != fieldBuffer->len)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("incorrect binary data format")));
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	ExecStoreVirtualTuple(slot);
+
+	return true;
+}
+
+
+/*
+ * ReadMappedBytes returns a pointer to the next length bytes of the mapped
+ * file and moves past them, or errors out if the file ends before that.
+ */
+static char *
+ReadMappedBytes(IntermediateResultScanState *scanState, size_t length)
+{
+	if (length > scanState->mappedSize - scanState->readOffset)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unexpected EOF in COPY data")));
+	}
+
+	char *data = scanState->mappedData + scanState->readOffset;
+	scanState->readOffset += length;
+
+	return data;
+}
+
+
+/*
+ * DecodeFixedWidthValue decodes a field of a common fixed-width type straight
+ * from the mapped file, which is equivalent to calling the receive function of
+ * the type. Returns false for other types, and for fields with an unexpected
+ * length to let the receive function report the error.
+ */
+static bool
+DecodeFixedWidthValue(Oid typeId, char *fieldData, int32 fieldLength, Datum *value)
+{
+	switch (typeId)
+	{
+		case BOOLOID:
+		{
+			if (fieldLength != 1)
+			{
+				return false;
+			}
+
+			*value = BoolGetDatum(fieldData[0] != 0);
+			return true;
+		}
+
+		case INT2OID:
+		{
+			uint16 intValue = 0;
+
+			if (fieldLength != sizeof(uint16))
+			{
+				return false;
+			}
+
+			memcpy(&intValue, fieldData, sizeof(uint16));
+			*value = Int16GetDatum((int16) pg_ntoh16(intValue));
+			return true;
+		}
+
+		case INT4OID:
+		case FLOAT4OID:
+		{
+			union
+			{
+				uint32 intValue;
+				int32 signedValue;
+				float4 floatValue;
+			} fieldValue;
+
+			if (fieldLength != sizeof(uint32))
+			{
+				return false;
+			}
+
+			memcpy(&fieldValue.intValue, fieldData, sizeof(uint32));
+			fieldValue.intValue = pg_ntoh32(fieldValue.intValue);
+
+			*value = (typeId == INT4OID) ?
+					 Int32GetDatum(fieldValue.signedValue) :
+					 Float4GetDatum(fieldValue.floatValue);
+			return true;
+		}
+
+		case INT8OID:
+		case FLOAT8OID:
+		{
+			union
+			{
+				uint64 intValue;
+				int64 signedValue;
+				float8 floatValue;
+			} fieldValue;
+
+			if (fieldLength != sizeof(uint64))
+			{
+				return false;
+			}
+
+			memcpy(&fieldValue.intValue, fieldData, sizeof(uint64));
+			fieldValue.intValue = pg_ntoh64(fieldValue.intValue);
+
+			*value = (typeId == INT8OID) ?
+					 Int64GetDatum(fieldValue.signedValue) :
+					 Float8GetDatum(fieldValue.floatValue);
+			return true;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * InitializeReceiveFunctions looks up the binary receive functions of the
+ * columns the first time a file is decoded from memory.
+ */
+static void
+InitializeReceiveFunctions(IntermediateResultScanState *scanState,
+						   TupleDesc tupleDescriptor)
+{
+	if (scanState->receiveFunctions != NULL)
+	{
+		return;
+	}
+
+	MemoryContext queryContext =
+		scanState->customScanState.ss.ps.state->es_query_cxt;
+	MemoryContext oldContext = MemoryContextSwitchTo(queryContext);
+	int columnCount = tupleDescriptor->natts;
+
+	scanState->receiveFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	scanState->typeIOParams = palloc0(columnCount * sizeof(Oid));
+	initStringInfo(&scanState->fieldBuffer);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid receiveFunctionId = InvalidOid;
+
+		getTypeBinaryInputInfo(attribute->atttypid, &receiveFunctionId,
+							   &scanState->typeIOParams[columnIndex]);
+		fmgr_info(receiveFunctionId, &scanState->receiveFunctions[columnIndex]);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * CloseResultFile releases the mapping, shared memory or tuple store of the
+ * current file.
+ */
+static void
+CloseResultFile(IntermediateResultScanState *scanState)
+{
+	if (scanState->resultMemory != NULL)
+	{
+		DetachIntermediateResultMemory(scanState->resultMemory);
+		scanState->resultMemory = NULL;
+		scanState->mappedData = NULL;
+		scanState->mappedSize = 0;
+		scanState->readOffset = 0;
+	}
+	else if (scanState->mappedData != NULL)
+	{
+		munmap(scanState->mappedData, scanState->mappedSize);
+		scanState->mappedData = NULL;
+		scanState->mappedSize = 0;
+		scanState->readOffset = 0;
+	}
+
+	if (scanState->tupleStore != NULL)
+	{
+		ExecClearTuple(scanState->tupleStoreSlot);
+		tuplestore_end(scanState->tupleStore);
+		scanState->tupleStore = NULL;
+	}
+}
+
+
+/*
+ * UnmapResultFileCallback unmaps the current file when the memory of the
+ * query is released without ending the scan, which happens on abort. Shared
+ * memory is detached at the end of the transaction instead.
+ */
+static void
+UnmapResultFileCallback(void *arg)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) arg;
+
+	if (scanState->mappedData != NULL && scanState->resultMemory == NULL)
+	{
+		munmap(scanState->mappedData, scanState->mappedSize);
+		scanState->mappedData = NULL;
+	}
+}
+
+
+/*
+ * IntermediateResultEndScan releases the current file.
+ */
+static void
+IntermediateResultEndScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	CloseResultFile(scanState);
+
+	if (scanState->tupleStoreSlot != NULL)
+	{
+		ExecDropSingleTupleTableSlot(scanState->tupleStoreSlot);
+		scanState->tupleStoreSlot = NULL;
+	}
+}
+
+
+/*
+ * IntermediateResultReScan restarts the scan from the first file.
+ */
+static void
+IntermediateResultReScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	CloseResultFile(scanState);
+	scanState->nextResultIndex = 0;
+
+	ExecScanReScan(&node->ss);
+}
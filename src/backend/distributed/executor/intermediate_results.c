@@ -20,6 +20,7 @@
 #include "catalog/pg_enum.h"
 #include "catalog/pg_type.h"
 #include "commands/copy.h"
+#include "commands/defrem.h"
 #include "nodes/makefuncs.h"
 #include "nodes/parsenodes.h"
 #include "nodes/primnodes.h"
@@ -33,6 +34,8 @@
 #include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
 #include "distributed/error_codes.h"
+#include "distributed/intermediate_result_compression.h"
+#include "distributed/intermediate_result_memory.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
@@ -40,14 +43,36 @@
 #include "distributed/multi_executor.h"
 #include "distributed/remote_commands.h"
 #include "distributed/transaction_identifier.h"
+#include "distributed/transaction_management.h"
 #include "distributed/transmit.h"
 #include "distributed/tuplestore.h"
 #include "distributed/utils/array_type.h"
 #include "distributed/utils/directory.h"
 #include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 
 
+/*
+ * Rows are buffered until the buffer reaches this size, and then sent to all
+ * nodes and written to the local file at once. Compressed results are also
+ * compressed in blocks of this size.
+ */
+#define REMOTE_FILE_BUFFER_SIZE (256 * 1024)
+
+
+/*
+ * GUC, number of nodes to which broadcast results are sent directly, and which
+ * relay them to the other nodes. 0 sends the results to all nodes directly.
+ */
+int IntermediateResultRelayFanout = 0;
+
+/*
+ * GUC, maximum number of connections over which fetch_intermediate_results
+ * fetches results from a single node concurrently.
+ */
+int MaxIntermediateResultFetchConnections = 4;
+
 static List *CreatedResultsDirectories = NIL;
 
 
@@ -72,19 +97,69 @@ typedef struct RemoteFileDestReceiver
 	List *initialNodeList;
 	List *connectionList;
 
+	/*
+	 * Groups of worker nodes in the order of connectionList when the result is
+	 * relayed, in which the first node relays the result to the others.
+	 */
+	List *relayGroupList;
+
 	/* whether to write to a local file */
 	bool writeLocalFile;
+	bool localFileOpened;
 	FileCompat fileCompat;
 
+	/* local data that is kept in memory until it exceeds the memory limit */
+	StringInfo localData;
+
 	/* state on how to copy out data types */
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* compresses the COPY data when intermediate result compression is enabled */
+	IntermediateResultCompressor *compressor;
+
 	/* statistics */
 	uint64 tuplesSent;
 	uint64 bytesSent;
 } RemoteFileDestReceiver;
 
+/*
+ * ResultRelay is a connection over which a node that receives an intermediate
+ * result relays it to a group of other nodes.
+ */
+typedef struct ResultRelay
+{
+	MultiConnection *connection;
+
+	/* nodes that the result is relayed to, of which the first one is connected */
+	List *nodeGroup;
+
+	/* whether relaying failed, in which case the connection is no longer used */
+	bool failed;
+} ResultRelay;
+
+/*
+ * ResultFetch is a connection over which fetch_intermediate_results fetches
+ * one intermediate result at a time into a local file.
+ */
+typedef struct ResultFetch
+{
+	MultiConnection *connection;
+	int waitEventSetIndex;
+
+	/* result that is currently fetched, or NULL if the connection is idle */
+	char *resultId;
+
+	/* whether part of the COPY command still needs to be sent */
+	bool sendPending;
+
+	/* whether the remote node started sending the result */
+	bool copyStarted;
+
+	File fileDesc;
+	FileCompat fileCompat;
+} ResultFetch;
+
 /* Enumeration to track one copy query's status on the client */
 typedef enum CopyStatus
 {
@@ -98,20 +173,44 @@ typedef enum CopyStatus
 static void RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 										  TupleDesc inputTupleDescriptor);
 static void PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest);
-static StringInfo ConstructCopyResultStatement(const char *resultId);
+static List * StartResultCopy(const char *resultId, List *nodeGroupList,
+							  int relayFanout);
+static StringInfo ConstructCopyResultStatement(const char *resultId,
+											   List *relayNodeList, int relayFanout);
+static List * SplitNodeListIntoGroups(List *nodeList, int groupCount);
+static char * RelayNodeListString(List *nodeList);
+static List * ParseRelayNodeList(char *relayNodesString);
+static List * EndRelayedResultCopy(List *connectionList, List *relayGroupList);
+static void SendLocalResultToNodes(RemoteFileDestReceiver *resultDest, List *nodeList);
 static bool RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void FlushCopyData(RemoteFileDestReceiver *resultDest, bool lastFlush);
 static void BroadcastCopyData(StringInfo dataBuffer, List *connectionList);
-static void SendCopyDataOverConnection(StringInfo dataBuffer,
-									   MultiConnection *connection);
+static void WriteLocalResultData(RemoteFileDestReceiver *resultDest,
+								 StringInfo copyData);
+static void OpenLocalResultFile(RemoteFileDestReceiver *resultDest);
 static void RemoteFileDestReceiverShutdown(DestReceiver *destReceiver);
 static void RemoteFileDestReceiverDestroy(DestReceiver *destReceiver);
+static uint64 RelayQueryResultViaCopy(const char *resultId, List *relayNodeList,
+									  int relayFanout);
+static void StartResultRelay(ResultRelay *relay, const char *resultId, int relayFanout);
+static void RelayCopyData(StringInfo copyData, void *relayContext);
+static uint64 EndResultRelay(ResultRelay *relay);
 
 static char * IntermediateResultsDirectory(void);
 static void ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo,
 												  char *copyFormat,
 												  Datum *resultIdArray,
-												  int resultCount);
-static uint64 FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId);
+												  int resultCount,
+												  ArrayType *columnNumberObject);
+static Bitmapset * SkippedColumnSet(ArrayType *columnNumberObject, int columnCount);
+static bool LocalIntermediateResultSize(char *resultId, uint64 *resultSize);
+static List * OpenResultFetchConnections(char *remoteHost, int remotePort,
+										 int connectionCount);
+static uint64 FetchRemoteIntermediateResults(List *connectionList, List *resultIdList);
+static void StartResultFetch(ResultFetch *fetch, char *resultId,
+							 WaitEventSet *waitEventSet);
+static bool ContinueResultFetch(ResultFetch *fetch, WaitEventSet *waitEventSet,
+								uint64 *bytesReceived);
 static CopyStatus CopyDataFromConnection(MultiConnection *connection,
 										 FileCompat *fileCompat,
 										 uint64 *bytesReceived);
@@ -276,6 +375,15 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 
 	resultDest->columnOutputFunctions = ColumnOutputFunctions(inputTupleDescriptor,
 															  copyOutState->binary);
+
+	bool columnar = EnableColumnarIntermediateResults && copyOutState->binary;
+	if (IntermediateResultCompression != INTERMEDIATE_RESULT_COMPRESSION_NONE ||
+		columnar)
+	{
+		resultDest->compressor = CreateIntermediateResultCompressor(
+			(IntermediateResultCompressionType) IntermediateResultCompression,
+			columnar);
+	}
 }
 
 
@@ -283,33 +391,84 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
  * PrepareIntermediateResultBroadcast gets a RemoteFileDestReceiver and does
  * the necessary initializations including initiating the remote connections
  * and creating the local file, which is necessary (it might be both).
+ *
+ * When citus.intermediate_result_relay_fanout is set and there are more nodes
+ * than that, the result is only sent to that many nodes, which relay it to the
+ * others while writing it locally. A local copy is then kept to send the result
+ * directly to the nodes that the relays did not reach.
  */
 static void
 PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest)
 {
 	List *initialNodeList = resultDest->initialNodeList;
 	const char *resultId = resultDest->resultId;
-	List *connectionList = NIL;
 	CopyOutState copyOutState = resultDest->copyOutState;
+	int relayFanout = 0;
+	List *nodeGroupList = NIL;
 
-	if (resultDest->writeLocalFile)
+	if (IntermediateResultRelayFanout > 0 &&
+		list_length(initialNodeList) > IntermediateResultRelayFanout)
 	{
-		const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
+		relayFanout = IntermediateResultRelayFanout;
+		nodeGroupList = SplitNodeListIntoGroups(initialNodeList, relayFanout);
+
+		resultDest->relayGroupList = nodeGroupList;
+		resultDest->writeLocalFile = true;
+	}
+	else
+	{
+		/* send the result to each node directly */
+		nodeGroupList = SplitNodeListIntoGroups(initialNodeList,
+												list_length(initialNodeList));
+	}
 
+	if (resultDest->writeLocalFile)
+	{
 		/* make sure the directory exists */
 		CreateIntermediateResultsDirectory();
 
-		const char *fileName = QueryResultFileName(resultId);
+		if (MaxIntermediateResultMemorySize > 0)
+		{
+			/* keep the result in memory, unless it turns out to be too large */
+			MemoryContext oldContext = MemoryContextSwitchTo(resultDest->memoryContext);
+			resultDest->localData = makeStringInfo();
+			MemoryContextSwitchTo(oldContext);
+		}
+		else
+		{
+			OpenLocalResultFile(resultDest);
+		}
+	}
+
+	resultDest->connectionList = StartResultCopy(resultId, nodeGroupList, relayFanout);
+
+	resetStringInfo(copyOutState->fe_msgbuf);
 
-		resultDest->fileCompat = FileCompatFromFileStart(FileOpenForTransmit(fileName,
-																			 fileFlags));
+	if (copyOutState->binary)
+	{
+		/* headers are sent along with the first rows when using binary encoding */
+		AppendCopyBinaryHeaders(copyOutState);
 	}
+}
 
-	WorkerNode *workerNode = NULL;
-	foreach_declared_ptr(workerNode, initialNodeList)
+
+/*
+ * StartResultCopy opens connections to the first node of each of the given
+ * groups of nodes, and starts a COPY of the result on them in which the first
+ * node relays the result to the other nodes of its group. Returns the list of
+ * connections.
+ */
+static List *
+StartResultCopy(const char *resultId, List *nodeGroupList, int relayFanout)
+{
+	List *connectionList = NIL;
+
+	List *nodeGroup = NIL;
+	foreach_declared_ptr(nodeGroup, nodeGroupList)
 	{
 		int flags = 0;
 
+		WorkerNode *workerNode = (WorkerNode *) linitial(nodeGroup);
 		const char *nodeName = workerNode->workerName;
 		int nodePort = workerNode->workerPort;
 
@@ -326,9 +485,11 @@ PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest)
 	RemoteTransactionsBeginIfNecessary(connectionList);
 
 	MultiConnection *connection = NULL;
-	foreach_declared_ptr(connection, connectionList)
+	forboth_ptr(connection, connectionList, nodeGroup, nodeGroupList)
 	{
-		StringInfo copyCommand = ConstructCopyResultStatement(resultId);
+		List *relayNodeList = list_copy_tail(nodeGroup, 1);
+		StringInfo copyCommand = ConstructCopyResultStatement(resultId, relayNodeList,
+															  relayFanout);
 
 		bool querySent = SendRemoteCommand(connection, copyCommand->data);
 		if (!querySent)
@@ -350,36 +511,127 @@ PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest)
 		PQclear(result);
 	}
 
-	if (copyOutState->binary)
+	return connectionList;
+}
+
+
+/*
+ * ConstructCopyResultStatement constructs the text of a COPY statement
+ * for copying into a result file, which also relays the result to the given
+ * nodes if there are any.
+ */
+static StringInfo
+ConstructCopyResultStatement(const char *resultId, List *relayNodeList,
+							 int relayFanout)
+{
+	StringInfo command = makeStringInfo();
+
+	appendStringInfo(command, "COPY \"%s\" FROM STDIN WITH (format result",
+					 resultId);
+
+	if (relayNodeList != NIL)
 	{
-		/* send headers when using binary encoding */
-		resetStringInfo(copyOutState->fe_msgbuf);
-		AppendCopyBinaryHeaders(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+		appendStringInfo(command, ", relay_nodes %s, relay_fanout %d",
+						 quote_literal_cstr(RelayNodeListString(relayNodeList)),
+						 relayFanout);
+	}
+
+	appendStringInfoChar(command, ')');
 
-		if (resultDest->writeLocalFile)
+	return command;
+}
+
+
+/*
+ * SplitNodeListIntoGroups splits the given list of worker nodes into at most
+ * groupCount groups of consecutive nodes that differ at most one in size.
+ */
+static List *
+SplitNodeListIntoGroups(List *nodeList, int groupCount)
+{
+	List *nodeGroupList = NIL;
+	int nodeCount = list_length(nodeList);
+
+	groupCount = Min(groupCount, nodeCount);
+
+	for (int groupIndex = 0; groupIndex < groupCount; groupIndex++)
+	{
+		int startIndex = groupIndex * nodeCount / groupCount;
+		int endIndex = (groupIndex + 1) * nodeCount / groupCount;
+		List *nodeGroup = NIL;
+
+		for (int nodeIndex = startIndex; nodeIndex < endIndex; nodeIndex++)
 		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+			nodeGroup = lappend(nodeGroup, list_nth(nodeList, nodeIndex));
 		}
+
+		nodeGroupList = lappend(nodeGroupList, nodeGroup);
 	}
 
-	resultDest->connectionList = connectionList;
+	return nodeGroupList;
 }
 
 
 /*
- * ConstructCopyResultStatement constructs the text of a COPY statement
- * for copying into a result file.
+ * RelayNodeListString returns the IDs of the given worker nodes as a comma
+ * separated list, which is how the relay_nodes option of COPY passes them.
  */
-static StringInfo
-ConstructCopyResultStatement(const char *resultId)
+static char *
+RelayNodeListString(List *nodeList)
 {
-	StringInfo command = makeStringInfo();
+	StringInfo relayNodesString = makeStringInfo();
 
-	appendStringInfo(command, "COPY \"%s\" FROM STDIN WITH (format result)",
-					 resultId);
+	WorkerNode *workerNode = NULL;
+	foreach_declared_ptr(workerNode, nodeList)
+	{
+		if (relayNodesString->len > 0)
+		{
+			appendStringInfoChar(relayNodesString, ',');
+		}
 
-	return command;
+		appendStringInfo(relayNodesString, "%u", workerNode->nodeId);
+	}
+
+	return relayNodesString->data;
+}
+
+
+/*
+ * ParseRelayNodeList returns the worker nodes with the IDs in the given comma
+ * separated list. Nodes that are not in the metadata of this node are left out,
+ * which the node that sent the result notices from the number of nodes that
+ * received it.
+ */
+static List *
+ParseRelayNodeList(char *relayNodesString)
+{
+	List *relayNodeList = NIL;
+	char *nodeIdString = relayNodesString;
+
+	while (*nodeIdString != '\0')
+	{
+		char *endPointer = NULL;
+
+		errno = 0;
+		unsigned long nodeId = strtoul(nodeIdString, &endPointer, 10);
+		if (errno != 0 || endPointer == nodeIdString || nodeId > PG_UINT32_MAX ||
+			(*endPointer != ',' && *endPointer != '\0'))
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("invalid relay_nodes value \"%s\"",
+								   relayNodesString)));
+		}
+
+		WorkerNode *workerNode = LookupNodeByNodeId((uint32) nodeId);
+		if (workerNode != NULL)
+		{
+			relayNodeList = lappend(relayNodeList, workerNode);
+		}
+
+		nodeIdString = (*endPointer == ',') ? endPointer + 1 : endPointer;
+	}
+
+	return relayNodeList;
 }
 
 
@@ -404,7 +656,6 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	TupleDesc tupleDescriptor = resultDest->tupleDescriptor;
 
-	List *connectionList = resultDest->connectionList;
 	CopyOutState copyOutState = resultDest->copyOutState;
 	FmgrInfo *columnOutputFunctions = resultDest->columnOutputFunctions;
 
@@ -419,25 +670,23 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 	Datum *columnValues = slot->tts_values;
 	bool *columnNulls = slot->tts_isnull;
 
-	resetStringInfo(copyData);
+	int previousLength = copyData->len;
 
 	/* construct row in COPY format */
 	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
 					  copyOutState, columnOutputFunctions, NULL);
 
-	/* send row to nodes */
-	BroadcastCopyData(copyData, connectionList);
+	resultDest->bytesSent += copyData->len - previousLength;
 
-	/* write to local file (if applicable) */
-	if (resultDest->writeLocalFile)
+	/* send the rows in batches to avoid the overhead of sending each row */
+	if (copyData->len >= REMOTE_FILE_BUFFER_SIZE)
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		FlushCopyData(resultDest, false);
 	}
 
 	MemoryContextSwitchTo(oldContext);
 
 	resultDest->tuplesSent++;
-	resultDest->bytesSent += copyData->len;
 
 	ResetPerTupleExprContext(executorState);
 
@@ -489,121 +738,601 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 	if (copyOutState->binary)
 	{
 		/* send footers when using binary encoding */
-		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryFooters(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+	}
 
-		if (resultDest->writeLocalFile)
-		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
-		}
+	/* send the remaining COPY data */
+	FlushCopyData(resultDest, true);
+
+	/* wait for the data to reach all nodes at once, rather than one by one */
+	MultiConnection *failedConnection = FlushRemoteCopyData(connectionList);
+	if (failedConnection != NULL)
+	{
+		ReportConnectionError(failedConnection, ERROR);
 	}
 
 	/* close the COPY input */
-	EndRemoteCopy(0, connectionList);
+	List *unreachedNodeList = NIL;
+	if (resultDest->relayGroupList != NIL)
+	{
+		unreachedNodeList = EndRelayedResultCopy(connectionList,
+												 resultDest->relayGroupList);
+	}
+	else
+	{
+		EndRemoteCopy(0, connectionList);
+	}
 
-	if (resultDest->writeLocalFile)
+	StringInfo localData = resultDest->localData;
+	if (localData != NULL)
+	{
+		const char *fileName = QueryResultFileName(resultDest->resultId);
+
+		if (StoreIntermediateResultInMemory(fileName, localData->data,
+											localData->len))
+		{
+			ereport(DEBUG1, (errmsg("keeping intermediate result %s in shared memory",
+									resultDest->resultId)));
+		}
+		else
+		{
+			ereport(DEBUG1, (errmsg("not enough shared memory for intermediate "
+									"result %s, writing it to a file",
+									resultDest->resultId)));
+
+			OpenLocalResultFile(resultDest);
+			WriteToLocalFile(localData, &resultDest->fileCompat);
+		}
+	}
+
+	if (resultDest->localFileOpened)
 	{
 		FileClose(resultDest->fileCompat.fd);
+		resultDest->localFileOpened = false;
+	}
+
+	if (unreachedNodeList != NIL)
+	{
+		SendLocalResultToNodes(resultDest, unreachedNodeList);
 	}
 }
 
 
 /*
- * BroadcastCopyData sends copy data to all connections in a list.
+ * EndRelayedResultCopy ends the COPY input on the connections to the nodes that
+ * relay the result, like EndRemoteCopy does. Relaying nodes report how many
+ * nodes stored the result, and the function returns the nodes of the groups
+ * that were not fully reached, apart from the relaying nodes themselves.
  */
-static void
-BroadcastCopyData(StringInfo dataBuffer, List *connectionList)
+static List *
+EndRelayedResultCopy(List *connectionList, List *relayGroupList)
 {
+	List *unreachedNodeList = NIL;
+
 	MultiConnection *connection = NULL;
-	foreach_declared_ptr(connection, connectionList)
+	List *nodeGroup = NIL;
+	forboth_ptr(connection, connectionList, nodeGroup, relayGroupList)
 	{
-		SendCopyDataOverConnection(dataBuffer, connection);
+		bool raiseInterrupts = true;
+
+		/* end the COPY input */
+		if (!PutRemoteCopyEnd(connection, NULL))
+		{
+			ereport(ERROR, (errcode(ERRCODE_IO_ERROR),
+							errmsg("failed to COPY intermediate result to %s:%d",
+								   connection->hostname, connection->port)));
+		}
+
+		/* check whether there were any COPY errors */
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (PQresultStatus(result) != PGRES_COMMAND_OK)
+		{
+			ReportCopyError(connection, result);
+		}
+
+		/* nodes that do not support relaying report no nodes at all */
+		uint64 nodeCount = strtoull(PQcmdTuples(result), NULL, 10);
+		if (list_length(nodeGroup) > 1 && nodeCount < (uint64) list_length(nodeGroup))
+		{
+			ereport(NOTICE, (errmsg("could not relay intermediate result through "
+									"%s:%d, sending it directly instead",
+									connection->hostname, connection->port),
+							 errdetail("The result reached " UINT64_FORMAT " of %d "
+									   "nodes.", nodeCount, list_length(nodeGroup))));
+
+			unreachedNodeList = list_concat(unreachedNodeList,
+											list_copy_tail(nodeGroup, 1));
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+		UnclaimConnection(connection);
 	}
+
+	return unreachedNodeList;
 }
 
 
 /*
- * SendCopyDataOverConnection sends serialized COPY data over the given
- * connection.
+ * SendLocalResultToNodes sends the local copy of the result to the given nodes
+ * directly, which is used when relaying the result to them failed.
  */
 static void
-SendCopyDataOverConnection(StringInfo dataBuffer, MultiConnection *connection)
+SendLocalResultToNodes(RemoteFileDestReceiver *resultDest, List *nodeList)
 {
-	if (!PutRemoteCopyData(connection, dataBuffer->data, dataBuffer->len))
+	const char *fileName = QueryResultFileName(resultDest->resultId);
+	int relayFanout = 0;
+
+	List *nodeGroupList = SplitNodeListIntoGroups(nodeList, list_length(nodeList));
+	List *connectionList = StartResultCopy(resultDest->resultId, nodeGroupList,
+										   relayFanout);
+
+	IntermediateResultMemory *resultMemory = AttachIntermediateResultMemory(fileName);
+	if (resultMemory != NULL)
 	{
-		ReportConnectionError(connection, ERROR);
+		StringInfoData dataBuffer = { NULL, 0, 0, 0 };
+
+		for (Size offset = 0; offset < resultMemory->length;
+			 offset += REMOTE_FILE_BUFFER_SIZE)
+		{
+			/* point the buffer into the result, it is only read */
+			dataBuffer.data = resultMemory->data + offset;
+			dataBuffer.len = (int) Min(REMOTE_FILE_BUFFER_SIZE,
+									 resultMemory->length - offset);
+
+			BroadcastCopyData(&dataBuffer, connectionList);
+		}
+
+		DetachIntermediateResultMemory(resultMemory);
+	}
+	else
+	{
+		const int fileFlags = (O_RDONLY | PG_BINARY);
+		const int fileMode = 0;
+
+		File fileDesc = FileOpenForTransmitPerm(fileName, fileFlags, fileMode);
+		FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
+
+		StringInfo dataBuffer = makeStringInfo();
+		enlargeStringInfo(dataBuffer, REMOTE_FILE_BUFFER_SIZE);
+
+		int readBytes = FileReadCompat(&fileCompat, dataBuffer->data,
+									   REMOTE_FILE_BUFFER_SIZE, PG_WAIT_IO);
+		while (readBytes > 0)
+		{
+			dataBuffer->len = readBytes;
+			BroadcastCopyData(dataBuffer, connectionList);
+
+			readBytes = FileReadCompat(&fileCompat, dataBuffer->data,
+									   REMOTE_FILE_BUFFER_SIZE, PG_WAIT_IO);
+		}
+
+		if (readBytes < 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read file \"%s\": %m", fileName)));
+		}
+
+		FileClose(fileDesc);
 	}
+
+	MultiConnection *failedConnection = FlushRemoteCopyData(connectionList);
+	if (failedConnection != NULL)
+	{
+		ReportConnectionError(failedConnection, ERROR);
+	}
+
+	EndRemoteCopy(0, connectionList);
 }
 
 
 /*
- * RemoteFileDestReceiverDestroy frees memory allocated as part of the
- * RemoteFileDestReceiver and closes file descriptors.
+ * FlushCopyData sends the COPY data in the buffer of the RemoteFileDestReceiver
+ * to all nodes and writes it to the local file, if applicable. When the result
+ * is compressed, the data is compressed as one block first, and the last flush
+ * also marks the end of the compressed result.
  */
 static void
-RemoteFileDestReceiverDestroy(DestReceiver *destReceiver)
+FlushCopyData(RemoteFileDestReceiver *resultDest, bool lastFlush)
 {
-	RemoteFileDestReceiver *resultDest = (RemoteFileDestReceiver *) destReceiver;
+	StringInfo copyData = resultDest->copyOutState->fe_msgbuf;
+	IntermediateResultCompressor *compressor = resultDest->compressor;
 
-	if (resultDest->copyOutState)
+	if (compressor != NULL)
 	{
-		pfree(resultDest->copyOutState);
+		CompressIntermediateResultData(compressor, copyData);
+		resetStringInfo(copyData);
+
+		if (lastFlush)
+		{
+			FinishIntermediateResultCompression(compressor);
+		}
+
+		copyData = compressor->outputBuffer;
 	}
 
-	if (resultDest->columnOutputFunctions)
+	if (copyData->len == 0)
 	{
-		pfree(resultDest->columnOutputFunctions);
+		return;
 	}
 
-	pfree(resultDest);
+	BroadcastCopyData(copyData, resultDest->connectionList);
+
+	if (resultDest->writeLocalFile)
+	{
+		WriteLocalResultData(resultDest, copyData);
+	}
+
+	resetStringInfo(copyData);
 }
 
 
 /*
- * SendQueryResultViaCopy is called when a COPY "resultid" TO STDOUT
- * WITH (format result) command is received from the client. The
- * contents of the file are sent directly to the client.
+ * WriteLocalResultData adds COPY data to the local copy of the result. The data
+ * is kept in memory while the result does not exceed the memory limit, and
+ * otherwise written to the local file.
  */
-void
-SendQueryResultViaCopy(const char *resultId)
+static void
+WriteLocalResultData(RemoteFileDestReceiver *resultDest, StringInfo copyData)
 {
-	const char *resultFileName = QueryResultFileName(resultId);
+	StringInfo localData = resultDest->localData;
 
-	SendRegularFile(resultFileName);
+	if (localData != NULL)
+	{
+		int64 memoryLimit = (int64) MaxIntermediateResultMemorySize * 1024;
+
+		if (localData->len + copyData->len <= memoryLimit)
+		{
+			appendBinaryStringInfo(localData, copyData->data, copyData->len);
+			return;
+		}
+
+		/* the result is too large to keep in memory, move it to the file */
+		ereport(DEBUG1, (errmsg("intermediate result %s exceeds "
+								"citus.max_intermediate_result_memory_size, "
+								"writing it to a file", resultDest->resultId)));
+
+		OpenLocalResultFile(resultDest);
+		WriteToLocalFile(localData, &resultDest->fileCompat);
+
+		pfree(localData->data);
+		pfree(localData);
+		resultDest->localData = NULL;
+	}
+
+	WriteToLocalFile(copyData, &resultDest->fileCompat);
 }
 
 
 /*
- * ReceiveQueryResultViaCopy is called when a COPY "resultid" FROM
- * STDIN WITH (format result) command is received from the client.
- * The command is followed by the raw copy data stream, which is
- * redirected to a file.
- *
- * File names are automatically prefixed with the user OID. Users
- * are only allowed to read query results from their own directory.
+ * OpenLocalResultFile creates the local file of the result, and removes an
+ * earlier result with the same ID from memory, since readers look there first.
  */
-void
-ReceiveQueryResultViaCopy(const char *resultId)
+static void
+OpenLocalResultFile(RemoteFileDestReceiver *resultDest)
 {
-	CreateIntermediateResultsDirectory();
+	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
+	const char *fileName = QueryResultFileName(resultDest->resultId);
 
-	const char *resultFileName = QueryResultFileName(resultId);
+	RemoveIntermediateResultFromMemory(fileName);
 
-	RedirectCopyDataToRegularFile(resultFileName);
+	resultDest->fileCompat = FileCompatFromFileStart(FileOpenForTransmit(fileName,
+																		 fileFlags));
+	resultDest->localFileOpened = true;
 }
 
 
 /*
- * CreateIntermediateResultsDirectory creates the intermediate result
- * directory for the current transaction if it does not exist and ensures
- * that the directory is removed at the end of the transaction.
+ * BroadcastCopyData sends copy data to all connections in a list.
  */
-char *
-CreateIntermediateResultsDirectory(void)
+static void
+BroadcastCopyData(StringInfo dataBuffer, List *connectionList)
 {
-	char *resultDirectory = IntermediateResultsDirectory();
-
+	MultiConnection *failedConnection =
+		PutRemoteCopyDataToConnectionList(connectionList, dataBuffer->data,
+										  dataBuffer->len);
+	if (failedConnection != NULL)
+	{
+		ReportConnectionError(failedConnection, ERROR);
+	}
+}
+
+
+/*
+ * RemoteFileDestReceiverDestroy frees memory allocated as part of the
+ * RemoteFileDestReceiver and closes file descriptors.
+ */
+static void
+RemoteFileDestReceiverDestroy(DestReceiver *destReceiver)
+{
+	RemoteFileDestReceiver *resultDest = (RemoteFileDestReceiver *) destReceiver;
+
+	if (resultDest->copyOutState)
+	{
+		pfree(resultDest->copyOutState);
+	}
+
+	if (resultDest->columnOutputFunctions)
+	{
+		pfree(resultDest->columnOutputFunctions);
+	}
+
+	if (resultDest->compressor)
+	{
+		pfree(resultDest->compressor->outputBuffer->data);
+		pfree(resultDest->compressor);
+	}
+
+	if (resultDest->localData != NULL)
+	{
+		pfree(resultDest->localData->data);
+		pfree(resultDest->localData);
+	}
+
+	pfree(resultDest);
+}
+
+
+/*
+ * SendQueryResultViaCopy is called when a COPY "resultid" TO STDOUT
+ * WITH (format result) command is received from the client. The
+ * contents of the file are sent directly to the client.
+ */
+void
+SendQueryResultViaCopy(const char *resultId)
+{
+	const char *resultFileName = QueryResultFileName(resultId);
+
+	IntermediateResultMemory *resultMemory =
+		AttachIntermediateResultMemory(resultFileName);
+	if (resultMemory != NULL)
+	{
+		SendRegularBuffer(resultMemory->data, resultMemory->length);
+		DetachIntermediateResultMemory(resultMemory);
+		return;
+	}
+
+	SendRegularFile(resultFileName);
+}
+
+
+/*
+ * ReceiveQueryResultViaCopy is called when a COPY "resultid" FROM
+ * STDIN WITH (format result) command is received from the client.
+ * The command is followed by the raw copy data stream, which is
+ * redirected to a file.
+ *
+ * When the relay_nodes and relay_fanout options are given, the data is also
+ * relayed to the nodes with the given IDs. The function returns the number of
+ * nodes that stored the result, including this one.
+ *
+ * File names are automatically prefixed with the user OID. Users
+ * are only allowed to read query results from their own directory.
+ */
+uint64
+ReceiveQueryResultViaCopy(const char *resultId, List *copyOptions)
+{
+	List *relayNodeList = NIL;
+	int relayFanout = 0;
+
+	DefElem *option = NULL;
+	foreach_declared_ptr(option, copyOptions)
+	{
+		if (strcmp(option->defname, "relay_nodes") == 0)
+		{
+			relayNodeList = ParseRelayNodeList(defGetString(option));
+		}
+		else if (strcmp(option->defname, "relay_fanout") == 0)
+		{
+			relayFanout = defGetInt32(option);
+
+			if (relayFanout < 1)
+			{
+				ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+								errmsg("relay_fanout must be at least 1")));
+			}
+		}
+	}
+
+	CreateIntermediateResultsDirectory();
+
+	if (relayNodeList != NIL && relayFanout > 0)
+	{
+		return RelayQueryResultViaCopy(resultId, relayNodeList, relayFanout);
+	}
+
+	const char *resultFileName = QueryResultFileName(resultId);
+
+	RedirectCopyDataToRegularFile(resultFileName);
+
+	return 1;
+}
+
+
+/*
+ * RelayQueryResultViaCopy receives the result into a file like
+ * ReceiveQueryResultViaCopy does, and at the same time relays it to at most
+ * relayFanout groups of the given nodes, of which the first node relays the
+ * result to the others in turn. Nodes that cannot be reached are skipped,
+ * and the function returns the number of nodes that stored the result.
+ */
+static uint64
+RelayQueryResultViaCopy(const char *resultId, List *relayNodeList, int relayFanout)
+{
+	const char *resultFileName = QueryResultFileName(resultId);
+	List *relayList = NIL;
+	List *connectionList = NIL;
+	uint64 nodeCount = 1;
+
+	List *nodeGroupList = SplitNodeListIntoGroups(relayNodeList, relayFanout);
+
+	List *nodeGroup = NIL;
+	foreach_declared_ptr(nodeGroup, nodeGroupList)
+	{
+		int flags = 0;
+
+		WorkerNode *workerNode = (WorkerNode *) linitial(nodeGroup);
+
+		MultiConnection *connection = StartNodeConnection(flags, workerNode->workerName,
+														  workerNode->workerPort);
+		ClaimConnectionExclusively(connection);
+
+		ResultRelay *relay = palloc0(sizeof(ResultRelay));
+		relay->connection = connection;
+		relay->nodeGroup = nodeGroup;
+
+		relayList = lappend(relayList, relay);
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	/* the relay connections are committed along with this transaction */
+	UseCoordinatedTransaction();
+
+	ResultRelay *relay = NULL;
+	foreach_declared_ptr(relay, relayList)
+	{
+		StartResultRelay(relay, resultId, relayFanout);
+	}
+
+	RelayCopyDataToRegularFile(resultFileName, RelayCopyData, relayList);
+
+	foreach_declared_ptr(relay, relayList)
+	{
+		nodeCount += EndResultRelay(relay);
+	}
+
+	return nodeCount;
+}
+
+
+/*
+ * StartResultRelay starts a COPY of the result on the connection of the relay,
+ * or marks the relay as failed. The remote transaction is part of the
+ * coordinated transaction and uses its distributed transaction ID, such that
+ * the result is stored in the same directory as on the other nodes, and stays
+ * there until the transaction ends. Later relays in the same transaction reuse
+ * the remote transaction.
+ */
+static void
+StartResultRelay(ResultRelay *relay, const char *resultId, int relayFanout)
+{
+	MultiConnection *connection = relay->connection;
+	bool raiseInterrupts = true;
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		HandleRemoteTransactionConnectionError(connection, false);
+		relay->failed = true;
+		return;
+	}
+
+	RemoteTransactionBeginIfNecessary(connection);
+	if (connection->remoteTransaction.transactionFailed)
+	{
+		relay->failed = true;
+		return;
+	}
+
+	List *relayNodeList = list_copy_tail(relay->nodeGroup, 1);
+	StringInfo copyCommand = ConstructCopyResultStatement(resultId, relayNodeList,
+														  relayFanout);
+
+	if (!SendRemoteCommand(connection, copyCommand->data))
+	{
+		HandleRemoteTransactionConnectionError(connection, false);
+		relay->failed = true;
+		return;
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COPY_IN)
+	{
+		HandleRemoteTransactionResultError(connection, result, false);
+		relay->failed = true;
+	}
+
+	PQclear(result);
+}
+
+
+/*
+ * RelayCopyData implements the relay function of RelayCopyDataToRegularFile,
+ * and sends the received COPY data to the relays that did not fail.
+ */
+static void
+RelayCopyData(StringInfo copyData, void *relayContext)
+{
+	List *relayList = (List *) relayContext;
+
+	ResultRelay *relay = NULL;
+	foreach_declared_ptr(relay, relayList)
+	{
+		if (relay->failed)
+		{
+			continue;
+		}
+
+		if (!PutRemoteCopyData(relay->connection, copyData->data, copyData->len))
+		{
+			HandleRemoteTransactionConnectionError(relay->connection, false);
+			relay->failed = true;
+		}
+	}
+}
+
+
+/*
+ * EndResultRelay ends the COPY on the connection of the relay, and returns the
+ * number of nodes that stored the result through it.
+ */
+static uint64
+EndResultRelay(ResultRelay *relay)
+{
+	MultiConnection *connection = relay->connection;
+	bool raiseInterrupts = true;
+	uint64 nodeCount = 0;
+
+	if (!relay->failed)
+	{
+		if (!PutRemoteCopyEnd(connection, NULL))
+		{
+			HandleRemoteTransactionConnectionError(connection, false);
+		}
+		else
+		{
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (PQresultStatus(result) == PGRES_COMMAND_OK)
+			{
+				nodeCount = strtoull(PQcmdTuples(result), NULL, 10);
+			}
+			else
+			{
+				HandleRemoteTransactionResultError(connection, result, false);
+			}
+
+			PQclear(result);
+		}
+	}
+
+	ForgetResults(connection);
+	UnclaimConnection(connection);
+
+	return nodeCount;
+}
+
+
+/*
+ * CreateIntermediateResultsDirectory creates the intermediate result
+ * directory for the current transaction if it does not exist and ensures
+ * that the directory is removed at the end of the transaction.
+ */
+char *
+CreateIntermediateResultsDirectory(void)
+{
+	char *resultDirectory = IntermediateResultsDirectory();
+
 	int makeOK = MakePGDirectory(resultDirectory);
 	if (makeOK != 0)
 	{
@@ -747,12 +1476,15 @@ RemoveIntermediateResultsDirectories(void)
 	list_free_deep(CreatedResultsDirectories);
 
 	CreatedResultsDirectories = NIL;
+
+	ReleaseIntermediateResultsInMemory();
 }
 
 
 /*
- * IntermediateResultSize returns the file size of the intermediate result
- * or -1 if the file does not exist.
+ * IntermediateResultSize returns the size of the COPY data in the intermediate
+ * result, which differs from the file size when the result is compressed, or -1
+ * if the file does not exist.
  */
 int64
 IntermediateResultSize(const char *resultId)
@@ -760,13 +1492,25 @@ IntermediateResultSize(const char *resultId)
 	struct stat fileStat;
 
 	char *resultFileName = QueryResultFileName(resultId);
+
+	IntermediateResultMemory *resultMemory =
+		AttachIntermediateResultMemory(resultFileName);
+	if (resultMemory != NULL)
+	{
+		int64 resultSize = IntermediateResultDataRawSize(resultMemory->data,
+														 resultMemory->length);
+		DetachIntermediateResultMemory(resultMemory);
+
+		return resultSize;
+	}
+
 	int statOK = stat(resultFileName, &fileStat);
 	if (statOK < 0)
 	{
 		return -1;
 	}
 
-	return (int64) fileStat.st_size;
+	return IntermediateResultFileRawSize(resultFileName, (int64) fileStat.st_size);
 }
 
 
@@ -777,6 +1521,10 @@ IntermediateResultSize(const char *resultId)
  *
  * SELECT * FROM read_intermediate_result('foo', 'csv') AS (a int, b int)
  *
+ * An optional array of column numbers limits the columns that are read, and
+ * the other columns are returned as NULL. Results in the columnar layout then
+ * do not decode the other columns at all.
+ *
  * The file is read from the directory returned by IntermediateResultsDirectory,
  * which includes the user ID.
  *
@@ -794,8 +1542,15 @@ read_intermediate_result(PG_FUNCTION_ARGS)
 	Datum copyFormatOidDatum = PG_GETARG_DATUM(1);
 	Datum copyFormatLabelDatum = DirectFunctionCall1(enum_out, copyFormatOidDatum);
 	char *copyFormatLabel = DatumGetCString(copyFormatLabelDatum);
+	ArrayType *columnNumberObject = NULL;
 
-	ReadIntermediateResultsIntoFuncOutput(fcinfo, copyFormatLabel, &resultId, 1);
+	if (PG_NARGS() > 2)
+	{
+		columnNumberObject = PG_GETARG_ARRAYTYPE_P(2);
+	}
+
+	ReadIntermediateResultsIntoFuncOutput(fcinfo, copyFormatLabel, &resultId, 1,
+										  columnNumberObject);
 
 	PG_RETURN_DATUM(0);
 }
@@ -824,7 +1579,7 @@ read_intermediate_result_array(PG_FUNCTION_ARGS)
 	Datum *resultIdArray = DeconstructArrayObject(resultIdObject);
 
 	ReadIntermediateResultsIntoFuncOutput(fcinfo, copyFormatLabel,
-										  resultIdArray, resultCount);
+										  resultIdArray, resultCount, NULL);
 
 	PG_RETURN_DATUM(0);
 }
@@ -833,51 +1588,110 @@ read_intermediate_result_array(PG_FUNCTION_ARGS)
 /*
  * ReadIntermediateResultsIntoFuncOutput reads the given result files and stores
  * them at the function's output tuple store. Errors out if any of the result files
- * don't exist.
+ * don't exist. When columnNumberObject is not NULL, only the columns with the
+ * given numbers are read.
  */
 static void
 ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo, char *copyFormat,
-									  Datum *resultIdArray, int resultCount)
+									  Datum *resultIdArray, int resultCount,
+									  ArrayType *columnNumberObject)
 {
 	TupleDesc tupleDescriptor = NULL;
 	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+	Bitmapset *skippedColumns = NULL;
+
+	if (columnNumberObject != NULL)
+	{
+		skippedColumns = SkippedColumnSet(columnNumberObject, tupleDescriptor->natts);
+	}
 
 	for (int resultIndex = 0; resultIndex < resultCount; resultIndex++)
 	{
 		char *resultId = TextDatumGetCString(resultIdArray[resultIndex]);
-		char *resultFileName = QueryResultFileName(resultId);
-		struct stat fileStat;
-
-		int statOK = stat(resultFileName, &fileStat);
-		if (statOK != 0)
+		char *resultFileName = FindIntermediateResultFile(resultId);
+		if (resultFileName != NULL)
 		{
-			/*
-			 * When the file does not exist, it could mean two different things.
-			 * First -- and a lot more common -- case is that a failure happened
-			 * in a concurrent backend on the same distributed transaction. And,
-			 * one of the backends in that transaction has already been roll
-			 * backed, which has already removed the file. If we throw an error
-			 * here, the user might see this error instead of the actual error
-			 * message. Instead, we prefer to WARN the user and pretend that the
-			 * file has no data in it. In the end, the user would see the actual
-			 * error message for the failure.
-			 *
-			 * Second, in case of any bugs in intermediate result broadcasts,
-			 * we could try to read a non-existing file. That is most likely
-			 * to happen during development.
-			 */
-			ereport(WARNING, (errcode(ERRCODE_CITUS_INTERMEDIATE_RESULT_NOT_FOUND),
-							  errmsg("Query could not find the intermediate result file "
-									 "\"%s\", it was mostly likely deleted due to an "
-									 "error in a parallel process within the same "
-									 "distributed transaction", resultId)));
+			ReadFileIntoTupleStore(resultFileName, copyFormat, tupleDescriptor,
+								   skippedColumns, tupleStore);
 		}
-		else
+	}
+}
+
+
+/*
+ * SkippedColumnSet returns the 0-based indexes of the columns that are not in
+ * the given array of 1-based column numbers.
+ */
+static Bitmapset *
+SkippedColumnSet(ArrayType *columnNumberObject, int columnCount)
+{
+	List *columnNumberList = IntegerArrayTypeToList(columnNumberObject);
+	Bitmapset *skippedColumns = NULL;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		skippedColumns = bms_add_member(skippedColumns, columnIndex);
+	}
+
+	int columnNumber = 0;
+	foreach_declared_int(columnNumber, columnNumberList)
+	{
+		if (columnNumber < 1 || columnNumber > columnCount)
 		{
-			ReadFileIntoTupleStore(resultFileName, copyFormat, tupleDescriptor,
-								   tupleStore);
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("column number %d is out of range", columnNumber)));
 		}
+
+		skippedColumns = bms_del_member(skippedColumns, columnNumber - 1);
+	}
+
+	return skippedColumns;
+}
+
+
+/*
+ * FindIntermediateResultFile returns the name of the file that stores the
+ * intermediate result with the given ID, or NULL after warning the user if the
+ * file does not exist.
+ */
+char *
+FindIntermediateResultFile(const char *resultId)
+{
+	char *resultFileName = QueryResultFileName(resultId);
+	struct stat fileStat;
+
+	if (IntermediateResultInMemory(resultFileName, NULL))
+	{
+		return resultFileName;
 	}
+
+	int statOK = stat(resultFileName, &fileStat);
+	if (statOK != 0)
+	{
+		/*
+		 * When the file does not exist, it could mean two different things.
+		 * First -- and a lot more common -- case is that a failure happened
+		 * in a concurrent backend on the same distributed transaction. And,
+		 * one of the backends in that transaction has already been roll
+		 * backed, which has already removed the file. If we throw an error
+		 * here, the user might see this error instead of the actual error
+		 * message. Instead, we prefer to WARN the user and pretend that the
+		 * file has no data in it. In the end, the user would see the actual
+		 * error message for the failure.
+		 *
+		 * Second, in case of any bugs in intermediate result broadcasts,
+		 * we could try to read a non-existing file. That is most likely
+		 * to happen during development.
+		 */
+		ereport(WARNING, (errcode(ERRCODE_CITUS_INTERMEDIATE_RESULT_NOT_FOUND),
+						  errmsg("Query could not find the intermediate result file "
+								 "\"%s\", it was mostly likely deleted due to an "
+								 "error in a parallel process within the same "
+								 "distributed transaction", resultId)));
+		return NULL;
+	}
+
+	return resultFileName;
 }
 
 
@@ -898,7 +1712,7 @@ fetch_intermediate_results(PG_FUNCTION_ARGS)
 	char *remoteHost = text_to_cstring(remoteHostText);
 	int remotePort = PG_GETARG_INT32(2);
 
-	int connectionFlags = FORCE_NEW_CONNECTION;
+	List *fetchResultIdList = NIL;
 	int resultIndex = 0;
 	int64 totalBytesWritten = 0L;
 
@@ -921,43 +1735,63 @@ fetch_intermediate_results(PG_FUNCTION_ARGS)
 	 */
 	EnsureDistributedTransactionId();
 
-	MultiConnection *connection = GetNodeConnection(connectionFlags, remoteHost,
-													remotePort);
+	for (resultIndex = 0; resultIndex < resultCount; resultIndex++)
+	{
+		char *resultId = TextDatumGetCString(resultIdArray[resultIndex]);
+		uint64 resultSize = 0;
 
-	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+		if (LocalIntermediateResultSize(resultId, &resultSize))
+		{
+			totalBytesWritten += resultSize;
+			continue;
+		}
+
+		fetchResultIdList = lappend(fetchResultIdList, resultId);
+	}
+
+	if (fetchResultIdList == NIL)
 	{
-		ereport(ERROR, (errmsg("cannot connect to %s:%d to fetch intermediate results",
-							   remoteHost, remotePort)));
+		PG_RETURN_INT64(totalBytesWritten);
 	}
 
-	StringInfo beginAndSetXactId = BeginAndSetDistributedTransactionIdCommand();
-	ExecuteCriticalRemoteCommand(connection, beginAndSetXactId->data);
+	int connectionCount = Min(MaxIntermediateResultFetchConnections,
+							  list_length(fetchResultIdList));
+	List *connectionList = OpenResultFetchConnections(remoteHost, remotePort,
+													  connectionCount);
 
 	CreateIntermediateResultsDirectory();
 
-	for (resultIndex = 0; resultIndex < resultCount; resultIndex++)
+	totalBytesWritten += FetchRemoteIntermediateResults(connectionList,
+														fetchResultIdList);
+
+	MultiConnection *connection = NULL;
+	foreach_declared_ptr(connection, connectionList)
 	{
-		char *resultId = TextDatumGetCString(resultIdArray[resultIndex]);
+		ExecuteCriticalRemoteCommand(connection, "END");
 
-		totalBytesWritten += FetchRemoteIntermediateResult(connection, resultId);
+		CloseConnection(connection);
 	}
 
-	ExecuteCriticalRemoteCommand(connection, "END");
-
-	CloseConnection(connection);
-
 	PG_RETURN_INT64(totalBytesWritten);
 }
 
 
 /*
- * FetchRemoteIntermediateResult fetches a remote intermediate result over
- * the given connection.
+ * LocalIntermediateResultSize returns whether the intermediate result with the
+ * given ID already exists on this node, and if so sets resultSize to its size.
  */
-static uint64
-FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
+static bool
+LocalIntermediateResultSize(char *resultId, uint64 *resultSize)
 {
 	char *localPath = QueryResultFileName(resultId);
+	Size resultLength = 0;
+
+	if (IntermediateResultInMemory(localPath, &resultLength))
+	{
+		/* the result was kept in memory by a backend on this node */
+		*resultSize = resultLength;
+		return true;
+	}
 
 	struct stat fileStat;
 	int statOK = stat(localPath, &fileStat);
@@ -967,17 +1801,225 @@ FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
 		 * File exists, most likely because we are trying to fetch a
 		 * a file from a node to itself. Skip doing work.
 		 */
-		return fileStat.st_size;
+		*resultSize = fileStat.st_size;
+		return true;
 	}
 
+	return false;
+}
+
+
+/*
+ * OpenResultFetchConnections opens up to connectionCount new connections to
+ * the given node, and begins a transaction with the distributed transaction ID
+ * of the current transaction on each of them. Only the first connection is
+ * required, the others are skipped when they would exceed the shared
+ * connection limit or fail to connect.
+ */
+static List *
+OpenResultFetchConnections(char *remoteHost, int remotePort, int connectionCount)
+{
+	List *connectionList = NIL;
+
+	for (int connectionIndex = 0; connectionIndex < connectionCount; connectionIndex++)
+	{
+		int connectionFlags = FORCE_NEW_CONNECTION;
+
+		if (connectionIndex > 0)
+		{
+			connectionFlags |= OPTIONAL_CONNECTION;
+		}
+
+		MultiConnection *connection = StartNodeConnection(connectionFlags, remoteHost,
+														  remotePort);
+		if (connection == NULL)
+		{
+			/* no more connections allowed to this node */
+			break;
+		}
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	List *establishedConnectionList = NIL;
+	StringInfo beginAndSetXactId = BeginAndSetDistributedTransactionIdCommand();
+
+	MultiConnection *connection = NULL;
+	foreach_declared_ptr(connection, connectionList)
+	{
+		if (PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			if (establishedConnectionList == NIL)
+			{
+				ereport(ERROR, (errmsg("cannot connect to %s:%d to fetch intermediate "
+									   "results", remoteHost, remotePort)));
+			}
+
+			CloseConnection(connection);
+			continue;
+		}
+
+		ExecuteCriticalRemoteCommand(connection, beginAndSetXactId->data);
+
+		establishedConnectionList = lappend(establishedConnectionList, connection);
+	}
+
+	return establishedConnectionList;
+}
+
+
+/*
+ * FetchRemoteIntermediateResults fetches the remote intermediate results with
+ * the given IDs over the given connections, which are all connected to the
+ * same node. Each connection fetches one result at a time and moves on to the
+ * next result that is not yet fetched, such that the results are received and
+ * written to local files concurrently. The function returns the total number
+ * of bytes written.
+ */
+static uint64
+FetchRemoteIntermediateResults(List *connectionList, List *resultIdList)
+{
+	int fetchCount = list_length(connectionList);
+	int eventSetSize = fetchCount + 2;
+	ResultFetch *fetches = palloc0(fetchCount * sizeof(ResultFetch));
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	WaitEventSet *volatile waitEventSet = NULL;
+	ListCell *nextResultIdCell = list_head(resultIdList);
 	uint64 totalBytesWritten = 0;
+	int fetchIndex = 0;
 
-	StringInfo copyCommand = makeStringInfo();
-	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
+	MultiConnection *connection = NULL;
+	foreach_declared_ptr(connection, connectionList)
+	{
+		fetches[fetchIndex].connection = connection;
+		fetchIndex++;
+	}
 
-	PGconn *pgConn = connection->pgConn;
-	int socket = PQsocket(pgConn);
-	bool raiseErrors = true;
+	PG_TRY();
+	{
+		int activeFetchCount = 0;
+
+		waitEventSet = CreateWaitEventSet(WaitEventSetTracker_compat, eventSetSize);
+
+		for (fetchIndex = 0; fetchIndex < fetchCount; fetchIndex++)
+		{
+			ResultFetch *fetch = &fetches[fetchIndex];
+			int sock = PQsocket(fetch->connection->pgConn);
+
+			fetch->waitEventSetIndex =
+				CitusAddWaitEventSetToSet(waitEventSet, WL_SOCKET_READABLE, sock,
+										  NULL, (void *) fetch);
+			if (fetch->waitEventSetIndex == WAIT_EVENT_SET_INDEX_FAILED)
+			{
+				ReportConnectionError(fetch->connection, ERROR);
+			}
+		}
+
+		AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL,
+						  NULL);
+		AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+		for (fetchIndex = 0; fetchIndex < fetchCount && nextResultIdCell != NULL;
+			 fetchIndex++)
+		{
+			char *resultId = lfirst(nextResultIdCell);
+
+			StartResultFetch(&fetches[fetchIndex], resultId, waitEventSet);
+
+			nextResultIdCell = lnext(resultIdList, nextResultIdCell);
+			activeFetchCount++;
+		}
+
+		while (activeFetchCount > 0)
+		{
+			long timeout = -1;
+
+			int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
+											  eventSetSize, PG_WAIT_EXTENSION);
+
+			for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+			{
+				WaitEvent *event = &events[eventIndex];
+
+				if (event->events & WL_POSTMASTER_DEATH)
+				{
+					ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+				}
+
+				if (event->events & WL_LATCH_SET)
+				{
+					ResetLatch(MyLatch);
+					CHECK_FOR_INTERRUPTS();
+					continue;
+				}
+
+				ResultFetch *fetch = (ResultFetch *) event->user_data;
+				if (fetch->resultId == NULL)
+				{
+					/* consume notices that the remote node might send */
+					if (PQconsumeInput(fetch->connection->pgConn) == 0)
+					{
+						ReportConnectionError(fetch->connection, ERROR);
+					}
+
+					continue;
+				}
+
+				if (!ContinueResultFetch(fetch, waitEventSet, &totalBytesWritten))
+				{
+					continue;
+				}
+
+				if (nextResultIdCell != NULL)
+				{
+					char *resultId = lfirst(nextResultIdCell);
+
+					StartResultFetch(fetch, resultId, waitEventSet);
+
+					nextResultIdCell = lnext(resultIdList, nextResultIdCell);
+				}
+				else
+				{
+					activeFetchCount--;
+				}
+			}
+		}
+
+		FreeWaitEventSet(waitEventSet);
+		waitEventSet = NULL;
+	}
+	PG_CATCH();
+	{
+		/* make sure the epoll file descriptor is always closed */
+		if (waitEventSet != NULL)
+		{
+			FreeWaitEventSet(waitEventSet);
+			waitEventSet = NULL;
+		}
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pfree(fetches);
+	pfree(events);
+
+	return totalBytesWritten;
+}
+
+
+/*
+ * StartResultFetch sends the command to fetch the intermediate result with the
+ * given ID over the connection of the given fetch, without waiting for the
+ * remote node to respond.
+ */
+static void
+StartResultFetch(ResultFetch *fetch, char *resultId, WaitEventSet *waitEventSet)
+{
+	MultiConnection *connection = fetch->connection;
+	StringInfo copyCommand = makeStringInfo();
 
 	appendStringInfo(copyCommand, "COPY \"%s\" TO STDOUT WITH (format result)",
 					 resultId);
@@ -987,53 +2029,118 @@ FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
 		ReportConnectionError(connection, ERROR);
 	}
 
-	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
-	if (PQresultStatus(result) != PGRES_COPY_OUT)
+	fetch->resultId = resultId;
+	fetch->copyStarted = false;
+
+	int sendStatus = PQflush(connection->pgConn);
+	if (sendStatus == -1)
 	{
-		ReportResultError(connection, result, ERROR);
+		ReportConnectionError(connection, ERROR);
 	}
 
-	PQclear(result);
+	fetch->sendPending = (sendStatus == 1);
+	if (fetch->sendPending)
+	{
+		/* wait until the socket accepts the rest of the command */
+		uint32 eventMask = WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE;
+		if (!CitusModifyWaitEvent(waitEventSet, fetch->waitEventSetIndex,
+								  eventMask, NULL))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+}
 
-	File fileDesc = FileOpenForTransmit(localPath, fileFlags);
-	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
 
-	while (true)
-	{
-		int waitFlags = WL_SOCKET_READABLE | WL_POSTMASTER_DEATH;
+/*
+ * ContinueResultFetch processes the data that became available on the
+ * connection of the given fetch without blocking, and appends the received
+ * result data to the local file of the result. The function returns true when
+ * the result has been fetched completely, and the connection can be used to
+ * fetch the next result.
+ */
+static bool
+ContinueResultFetch(ResultFetch *fetch, WaitEventSet *waitEventSet,
+					uint64 *bytesReceived)
+{
+	MultiConnection *connection = fetch->connection;
+	PGconn *pgConn = connection->pgConn;
+	bool raiseErrors = true;
 
-		CopyStatus copyStatus = CopyDataFromConnection(connection, &fileCompat,
-													   &totalBytesWritten);
-		if (copyStatus == CLIENT_COPY_FAILED)
+	if (fetch->sendPending)
+	{
+		int sendStatus = PQflush(pgConn);
+		if (sendStatus == -1)
 		{
-			ereport(ERROR, (errmsg("failed to read result \"%s\" from node %s:%d",
-								   resultId, connection->hostname, connection->port)));
+			ReportConnectionError(connection, ERROR);
 		}
-		else if (copyStatus == CLIENT_COPY_DONE)
+		else if (sendStatus == 1)
 		{
-			break;
+			return false;
 		}
 
-		Assert(copyStatus == CLIENT_COPY_MORE);
+		/* done writing, only wait for read events */
+		if (!CitusModifyWaitEvent(waitEventSet, fetch->waitEventSetIndex,
+								  WL_SOCKET_READABLE, NULL))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		fetch->sendPending = false;
+	}
+
+	if (!fetch->copyStarted)
+	{
+		if (PQconsumeInput(pgConn) == 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
 
-		int rc = WaitLatchOrSocket(MyLatch, waitFlags, socket, 0, PG_WAIT_EXTENSION);
-		if (rc & WL_POSTMASTER_DEATH)
+		if (PQisBusy(pgConn))
 		{
-			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+			/* the remote node did not start sending the result yet */
+			return false;
 		}
 
-		if (rc & WL_LATCH_SET)
+		PGresult *result = PQgetResult(pgConn);
+		if (PQresultStatus(result) != PGRES_COPY_OUT)
 		{
-			ResetLatch(MyLatch);
-			CHECK_FOR_INTERRUPTS();
+			ReportResultError(connection, result, ERROR);
 		}
+
+		PQclear(result);
+
+		const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
+		char *localPath = QueryResultFileName(fetch->resultId);
+
+		fetch->fileDesc = FileOpenForTransmit(localPath, fileFlags);
+		fetch->fileCompat = FileCompatFromFileStart(fetch->fileDesc);
+		fetch->copyStarted = true;
 	}
 
-	FileClose(fileDesc);
+	CopyStatus copyStatus = CopyDataFromConnection(connection, &fetch->fileCompat,
+												   bytesReceived);
+	if (copyStatus == CLIENT_COPY_FAILED)
+	{
+		ereport(ERROR, (errmsg("failed to read result \"%s\" from node %s:%d",
+							   fetch->resultId, connection->hostname,
+							   connection->port)));
+	}
+	else if (copyStatus == CLIENT_COPY_MORE)
+	{
+		return false;
+	}
+
+	Assert(copyStatus == CLIENT_COPY_DONE);
+
+	FileClose(fetch->fileDesc);
 
 	ClearResults(connection, raiseErrors);
 
-	return totalBytesWritten;
+	fetch->resultId = NULL;
+	fetch->copyStarted = false;
+
+	return true;
 }
 
 
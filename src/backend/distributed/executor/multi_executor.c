@@ -16,6 +16,7 @@
 #include "catalog/dependency.h"
 #include "catalog/namespace.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
 #include "commands/copy.h"
 #include "executor/execdebug.h"
 #include "nodes/execnodes.h"
@@ -28,6 +29,7 @@
 #include "tcop/pquery.h"
 #include "tcop/utility.h"
 #include "utils/fmgrprotos.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
 
@@ -43,6 +45,7 @@
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/multi_executor.h"
@@ -429,10 +432,14 @@ ReturnTupleFromTuplestore(CitusScanState *scanState)
  * ReadFileIntoTupleStore parses the records in a COPY-formatted file according
  * according to the given tuple descriptor and stores the records in a tuple
  * store.
+ *
+ * The columns in skippedColumns, given as 0-based indexes, are stored as NULL.
+ * Results in the columnar layout do not decode those columns at all, except
+ * for domains, whose constraints COPY checks for NULLs as well.
  */
 void
 ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescriptor,
-					   Tuplestorestate *tupstore)
+					   Bitmapset *skippedColumns, Tuplestorestate *tupstore)
 {
 	/*
 	 * Trick BeginCopyFrom into using our tuple descriptor by pretending it belongs
@@ -455,9 +462,21 @@ ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescript
 									  location);
 	copyOptions = lappend(copyOptions, copyOption);
 
-	CopyFromState copyState = BeginCopyFrom(NULL, stubRelation, NULL,
-											fileName, false, NULL,
-											NULL, copyOptions);
+	Bitmapset *undecodedColumns = NULL;
+	int skippedColumn = -1;
+	while ((skippedColumn = bms_next_member(skippedColumns, skippedColumn)) >= 0)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, skippedColumn);
+
+		if (get_typtype(attribute->atttypid) != TYPTYPE_DOMAIN)
+		{
+			undecodedColumns = bms_add_member(undecodedColumns, skippedColumn);
+		}
+	}
+
+	CopyFromState copyState = BeginCopyFromIntermediateResult(stubRelation, fileName,
+															  copyOptions,
+															  undecodedColumns);
 
 	while (true)
 	{
@@ -472,11 +491,18 @@ ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescript
 			break;
 		}
 
+		skippedColumn = -1;
+		while ((skippedColumn = bms_next_member(skippedColumns, skippedColumn)) >= 0)
+		{
+			columnValues[skippedColumn] = (Datum) 0;
+			columnNulls[skippedColumn] = true;
+		}
+
 		tuplestore_putvalues(tupstore, tupleDescriptor, columnValues, columnNulls);
 		MemoryContextSwitchTo(oldContext);
 	}
 
-	EndCopyFrom(copyState);
+	EndCopyFromIntermediateResult(copyState);
 	pfree(columnValues);
 	pfree(columnNulls);
 }
@@ -18,13 +18,16 @@
 #include "port.h"
 
 #include "access/hash.h"
+#include "access/htup_details.h"
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_type.h"
+#include "common/hashfn.h"
 #include "nodes/makefuncs.h"
 #include "nodes/primnodes.h"
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
+#include "utils/tuplestore.h"
 #include "utils/typcache.h"
 
 #include "distributed/intermediate_results.h"
@@ -94,18 +97,59 @@ typedef struct PartitionedResultDestReceiver
 
 	/* whether NULL partition column values are allowed */
 	bool allowNullPartitionColumnValues;
+
+	/* if set, tuples whose partition column value is not in the filter are skipped */
+	bytea *joinKeyFilter;
 } PartitionedResultDestReceiver;
 
+
+/*
+ * JoinKeyBloomFilterDestReceiver is used for adding the partition column values
+ * of streamed tuples to a join key bloom filter.
+ */
+typedef struct JoinKeyBloomFilterDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	/* which column of streamed tuples to add to the filter */
+	int partitionColumnIndex;
+
+	/* hash function and collation of the partition column */
+	FmgrInfo *hashFunction;
+	Oid collation;
+
+	/* the bloom filter that is being built */
+	bytea *joinKeyFilter;
+
+	/* number of tuples streamed into the DestReceiver */
+	uint64 rowsRead;
+} JoinKeyBloomFilterDestReceiver;
+
 static Portal StartPortalForQueryExecution(const char *queryString);
+static bytea * ReadJoinKeyFilter(char *resultId);
 static void PartitionedResultDestReceiverStartup(DestReceiver *dest, int operation,
 												 TupleDesc inputTupleDescriptor);
 static bool PartitionedResultDestReceiverReceive(TupleTableSlot *slot,
 												 DestReceiver *dest);
 static void PartitionedResultDestReceiverShutdown(DestReceiver *dest);
 static void PartitionedResultDestReceiverDestroy(DestReceiver *copyDest);
+static bool PartitionedResultDestReceiverSkipTuple(PartitionedResultDestReceiver *self,
+												   Datum *columnValues,
+												   bool *columnNulls);
+static void JoinKeyBloomFilterDestReceiverStartup(DestReceiver *dest, int operation,
+												  TupleDesc inputTupleDescriptor);
+static bool JoinKeyBloomFilterDestReceiverReceive(TupleTableSlot *slot,
+												  DestReceiver *dest);
+static void JoinKeyBloomFilterDestReceiverShutdown(DestReceiver *dest);
+static void JoinKeyBloomFilterDestReceiverDestroy(DestReceiver *dest);
+static uint32 JoinKeyBloomFilterBit(uint32 hashValue, int hashIndex);
+static void JoinKeyBloomFilterAdd(bytea *joinKeyFilter, uint32 hashValue);
+static bool JoinKeyBloomFilterLacks(bytea *joinKeyFilter, uint32 hashValue);
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(worker_partition_query_result);
+PG_FUNCTION_INFO_V1(worker_join_key_bloom_filter);
 
 
 /*
@@ -148,6 +192,20 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 	bool allowNullPartitionColumnValues = PG_GETARG_BOOL(7);
 	bool generateEmptyResults = PG_GETARG_BOOL(8);
 
+	/* the join key filter argument is missing before the 13.1-1 upgrade script ran */
+	char *joinKeyFilterResultId = "";
+	if (PG_NARGS() > 9)
+	{
+		joinKeyFilterResultId = text_to_cstring(PG_GETARG_TEXT_P(9));
+	}
+
+	if (joinKeyFilterResultId[0] != '\0' && partitionMethod != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("join key filters are only supported for hash "
+							   "partitioning")));
+	}
+
 	if (!IsMultiStatementTransaction())
 	{
 		ereport(ERROR, (errmsg("worker_partition_query_result can only be used in a "
@@ -179,6 +237,13 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 						errmsg("number of partitions cannot be 0")));
 	}
 
+	/* the filter is optional, so we do not filter if the result is missing */
+	bytea *joinKeyFilter = NULL;
+	if (joinKeyFilterResultId[0] != '\0')
+	{
+		joinKeyFilter = ReadJoinKeyFilter(joinKeyFilterResultId);
+	}
+
 	/* start execution early in order to extract the tuple descriptor */
 	Portal portal = StartPortalForQueryExecution(queryString);
 
@@ -239,7 +304,8 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 		shardSearchInfo,
 		dests,
 		lazyStartup,
-		allowNullPartitionColumnValues);
+		allowNullPartitionColumnValues,
+		joinKeyFilter);
 
 	/* execute the query */
 	PortalRun(portal, FETCH_ALL, false, true, dest, dest, NULL);
@@ -278,6 +344,158 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * worker_join_key_bloom_filter executes a query and returns a bloom filter of
+ * the hashes of the non-NULL values in the partition column, along with the
+ * number of rows returned by the query. The hashes are computed in the same way
+ * worker_partition_query_result hash partitions the results, such that the
+ * filter can be passed to worker_partition_query_result to skip the rows that
+ * cannot join with the results of the query.
+ */
+Datum
+worker_join_key_bloom_filter(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	text *queryText = PG_GETARG_TEXT_P(0);
+	char *queryString = text_to_cstring(queryText);
+
+	int partitionColumnIndex = PG_GETARG_INT32(1);
+
+	TupleDesc returnTupleDesc = NULL;
+	if (get_call_result_type(fcinfo, NULL, &returnTupleDesc) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errmsg("return type must be a row type")));
+	}
+
+	Portal portal = StartPortalForQueryExecution(queryString);
+
+	TupleDesc tupleDescriptor = portal->tupDesc;
+	if (tupleDescriptor == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("query must generate a set of rows")));
+	}
+
+	if (partitionColumnIndex < 0 || partitionColumnIndex >= tupleDescriptor->natts)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("partition column index must be between 0 and %d",
+							   tupleDescriptor->natts - 1)));
+	}
+
+	FormData_pg_attribute *partitionColumnAttr = TupleDescAttr(tupleDescriptor,
+															   partitionColumnIndex);
+	TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumnAttr->atttypid,
+												  TYPECACHE_HASH_PROC_FINFO);
+	if (!OidIsValid(typeEntry->hash_proc_finfo.fn_oid))
+	{
+		ereport(ERROR, (errmsg("no hash function defined for type %s",
+							   format_type_be(partitionColumnAttr->atttypid))));
+	}
+
+	JoinKeyBloomFilterDestReceiver *dest =
+		palloc0(sizeof(JoinKeyBloomFilterDestReceiver));
+	dest->pub.receiveSlot = JoinKeyBloomFilterDestReceiverReceive;
+	dest->pub.rStartup = JoinKeyBloomFilterDestReceiverStartup;
+	dest->pub.rShutdown = JoinKeyBloomFilterDestReceiverShutdown;
+	dest->pub.rDestroy = JoinKeyBloomFilterDestReceiverDestroy;
+	dest->pub.mydest = DestCopyOut;
+	dest->partitionColumnIndex = partitionColumnIndex;
+	dest->hashFunction = palloc0(sizeof(FmgrInfo));
+	fmgr_info_copy(dest->hashFunction, &(typeEntry->hash_proc_finfo),
+				   CurrentMemoryContext);
+
+	/* hash in the same way as PartitionedResultDestReceiverSkipTuple */
+	dest->collation = partitionColumnAttr->attcollation;
+	dest->joinKeyFilter = palloc0(VARHDRSZ + JOIN_KEY_BLOOM_FILTER_SIZE);
+	SET_VARSIZE(dest->joinKeyFilter, VARHDRSZ + JOIN_KEY_BLOOM_FILTER_SIZE);
+
+	/* execute the query */
+	PortalRun(portal, FETCH_ALL, false, true, (DestReceiver *) dest,
+			  (DestReceiver *) dest, NULL);
+
+	PortalDrop(portal, false);
+
+	Datum values[2];
+	bool nulls[2];
+
+	memset(nulls, 0, sizeof(nulls));
+
+	values[0] = PointerGetDatum(dest->joinKeyFilter);
+	values[1] = UInt64GetDatum(dest->rowsRead);
+
+	HeapTuple returnTuple = heap_form_tuple(returnTupleDesc, values, nulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(returnTuple));
+}
+
+
+/*
+ * ReadJoinKeyFilter reads the join key bloom filter that the coordinator sent as
+ * the intermediate result with the given ID, or returns NULL if the result does
+ * not exist.
+ */
+static bytea *
+ReadJoinKeyFilter(char *resultId)
+{
+	char *resultFileName = FindIntermediateResultFile(resultId);
+	if (resultFileName == NULL)
+	{
+		return NULL;
+	}
+
+	TupleDesc tupleDescriptor = JoinKeyFilterTupleDescriptor();
+	char *copyFormat = CanUseBinaryCopyFormat(tupleDescriptor) ? "binary" : "text";
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+	ReadFileIntoTupleStore(resultFileName, copyFormat, tupleDescriptor, NULL,
+						   tupleStore);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+	if (!tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		ereport(ERROR, (errmsg("join key filter result %s is empty", resultId)));
+	}
+
+	bool isNull = false;
+	Datum joinKeyFilterDatum = slot_getattr(slot, 1, &isNull);
+	if (isNull)
+	{
+		ereport(ERROR, (errmsg("join key filter result %s is NULL", resultId)));
+	}
+
+	bytea *joinKeyFilter = DatumGetByteaPCopy(joinKeyFilterDatum);
+	if (VARSIZE_ANY_EXHDR(joinKeyFilter) != JOIN_KEY_BLOOM_FILTER_SIZE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("join key filter must be %d bytes",
+							   JOIN_KEY_BLOOM_FILTER_SIZE)));
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	return joinKeyFilter;
+}
+
+
+/*
+ * JoinKeyFilterTupleDescriptor returns the tuple descriptor of the intermediate
+ * results in which the coordinator sends join key bloom filters to the workers.
+ */
+TupleDesc
+JoinKeyFilterTupleDescriptor(void)
+{
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(1);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "join_key_filter",
+					   BYTEAOID, -1, 0);
+
+	return tupleDescriptor;
+}
+
+
 /*
  * StartPortalForQueryExecution creates and starts a portal which can be
  * used for running the given query.
@@ -404,7 +622,8 @@ CreatePartitionedResultDestReceiver(int partitionColumnIndex,
 									CitusTableCacheEntry *shardSearchInfo,
 									DestReceiver **partitionedDestReceivers,
 									bool lazyStartup,
-									bool allowNullPartitionColumnValues)
+									bool allowNullPartitionColumnValues,
+									bytea *joinKeyFilter)
 {
 	PartitionedResultDestReceiver *resultDest =
 		palloc0(sizeof(PartitionedResultDestReceiver));
@@ -424,6 +643,7 @@ CreatePartitionedResultDestReceiver(int partitionColumnIndex,
 	resultDest->startedDestReceivers = NULL;
 	resultDest->lazyStartup = lazyStartup;
 	resultDest->allowNullPartitionColumnValues = allowNullPartitionColumnValues;
+	resultDest->joinKeyFilter = joinKeyFilter;
 
 	return (DestReceiver *) resultDest;
 }
@@ -473,6 +693,12 @@ PartitionedResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 	Datum *columnValues = slot->tts_values;
 	bool *columnNulls = slot->tts_isnull;
 
+	if (self->joinKeyFilter != NULL &&
+		PartitionedResultDestReceiverSkipTuple(self, columnValues, columnNulls))
+	{
+		return true;
+	}
+
 	int partitionIndex;
 
 	if (columnNulls[self->partitionColumnIndex])
@@ -526,6 +752,33 @@ PartitionedResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 }
 
 
+/*
+ * PartitionedResultDestReceiverSkipTuple returns whether the tuple cannot join
+ * with any of the tuples that the join key filter was built from. NULL values
+ * never match in a join, so they are always skipped.
+ */
+static bool
+PartitionedResultDestReceiverSkipTuple(PartitionedResultDestReceiver *self,
+									   Datum *columnValues, bool *columnNulls)
+{
+	if (columnNulls[self->partitionColumnIndex])
+	{
+		return true;
+	}
+
+	/*
+	 * The partition column is built from the attribute of the query results, so
+	 * its collation is the one worker_join_key_bloom_filter hashes with as well.
+	 */
+	CitusTableCacheEntry *shardSearchInfo = self->shardSearchInfo;
+	Datum hashDatum = FunctionCall1Coll(shardSearchInfo->hashFunction,
+										shardSearchInfo->partitionColumn->varcollid,
+										columnValues[self->partitionColumnIndex]);
+
+	return JoinKeyBloomFilterLacks(self->joinKeyFilter, DatumGetUInt32(hashDatum));
+}
+
+
 /*
  * PartitionedResultDestReceiverShutdown implements the rShutdown interface of
  * PartitionedResultDestReceiver by calling rShutdown on all started
@@ -568,3 +821,122 @@ PartitionedResultDestReceiverDestroy(DestReceiver *dest)
 		}
 	}
 }
+
+
+/*
+ * JoinKeyBloomFilterDestReceiverStartup implements the rStartup interface of
+ * JoinKeyBloomFilterDestReceiver.
+ */
+static void
+JoinKeyBloomFilterDestReceiverStartup(DestReceiver *dest, int operation,
+									  TupleDesc inputTupleDescriptor)
+{
+	/* nothing to do */
+}
+
+
+/*
+ * JoinKeyBloomFilterDestReceiverReceive implements the receiveSlot interface of
+ * JoinKeyBloomFilterDestReceiver by adding the hash of the partition column
+ * value to the bloom filter.
+ */
+static bool
+JoinKeyBloomFilterDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	JoinKeyBloomFilterDestReceiver *self = (JoinKeyBloomFilterDestReceiver *) dest;
+
+	self->rowsRead++;
+
+	bool isNull = false;
+	Datum partitionColumnValue = slot_getattr(slot, self->partitionColumnIndex + 1,
+											  &isNull);
+	if (isNull)
+	{
+		return true;
+	}
+
+	Datum hashDatum = FunctionCall1Coll(self->hashFunction, self->collation,
+										partitionColumnValue);
+
+	JoinKeyBloomFilterAdd(self->joinKeyFilter, DatumGetUInt32(hashDatum));
+
+	return true;
+}
+
+
+/*
+ * JoinKeyBloomFilterDestReceiverShutdown implements the rShutdown interface of
+ * JoinKeyBloomFilterDestReceiver.
+ */
+static void
+JoinKeyBloomFilterDestReceiverShutdown(DestReceiver *dest)
+{
+	/* nothing to do */
+}
+
+
+/*
+ * JoinKeyBloomFilterDestReceiverDestroy implements the rDestroy interface of
+ * JoinKeyBloomFilterDestReceiver.
+ */
+static void
+JoinKeyBloomFilterDestReceiverDestroy(DestReceiver *dest)
+{
+	/* the filter is returned to the caller, so we do not free it */
+}
+
+
+/*
+ * JoinKeyBloomFilterBit returns the bit of a join key bloom filter that the
+ * given hash function sets for the given hash value. We derive the hash
+ * functions from the partition column hash and a rehash of it, such that the
+ * filter is compatible with hash partitioning.
+ */
+static uint32
+JoinKeyBloomFilterBit(uint32 hashValue, int hashIndex)
+{
+	uint32 secondHashValue = hash_bytes_uint32(hashValue) | 1;
+
+	return (hashValue + hashIndex * secondHashValue) %
+		   (JOIN_KEY_BLOOM_FILTER_SIZE * BITS_PER_BYTE);
+}
+
+
+/*
+ * JoinKeyBloomFilterAdd adds the given hash value to a join key bloom filter.
+ */
+static void
+JoinKeyBloomFilterAdd(bytea *joinKeyFilter, uint32 hashValue)
+{
+	uint8 *filterBytes = (uint8 *) VARDATA_ANY(joinKeyFilter);
+
+	for (int hashIndex = 0; hashIndex < JOIN_KEY_BLOOM_FILTER_HASH_COUNT; hashIndex++)
+	{
+		uint32 bit = JoinKeyBloomFilterBit(hashValue, hashIndex);
+
+		filterBytes[bit / BITS_PER_BYTE] |= (1 << (bit % BITS_PER_BYTE));
+	}
+}
+
+
+/*
+ * JoinKeyBloomFilterLacks returns whether the given hash value was certainly
+ * not added to the join key bloom filter.
+ */
+static bool
+JoinKeyBloomFilterLacks(bytea *joinKeyFilter, uint32 hashValue)
+{
+	uint8 *filterBytes = (uint8 *) VARDATA_ANY(joinKeyFilter);
+
+	for (int hashIndex = 0; hashIndex < JOIN_KEY_BLOOM_FILTER_HASH_COUNT; hashIndex++)
+	{
+		uint32 bit = JoinKeyBloomFilterBit(hashValue, hashIndex);
+
+		if ((filterBytes[bit / BITS_PER_BYTE] & (1 << (bit % BITS_PER_BYTE))) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -11,6 +11,9 @@
  *  gives an error, so if we come to a fetchTask we know for sure that its dependedMapTask is executed in all
  *  replicas.
  * - It creates schemas in each worker in a single transaction to store intermediate results.
+ * - When citus.enable_repartition_join_bloom_filter is set, it builds a bloom filter of the join keys of the
+ *  smaller side of dual hash repartition joins, and passes it to the map tasks of the other side so that they
+ *  do not write the rows that cannot join.
  * - It iterates all tasks and finds the ones whose dependencies are already executed, and executes them with
  *  adaptive executor logic.
  *
@@ -28,26 +31,48 @@
 #include "miscadmin.h"
 
 #include "access/hash.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "port/pg_bitutils.h"
 #include "utils/builtins.h"
+#include "utils/tuplestore.h"
 
 #include "distributed/adaptive_executor.h"
 #include "distributed/directed_acyclic_graph_execution.h"
 #include "distributed/hash_helpers.h"
+#include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/repartition_join_execution.h"
 #include "distributed/task_execution_utils.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transmit.h"
+#include "distributed/tuple_destination.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_transaction.h"
 
 
+/*
+ * We do not use join key bloom filters in which more than half of the bits are
+ * set, since they would let most rows through anyway.
+ */
+#define MAX_JOIN_KEY_BLOOM_FILTER_FILL_RATIO 0.5
+
+
 static List * ExtractJobsInJobTree(Job *job);
 static void TraverseJobTree(Job *curJob, List **jobs);
+static void ApplyJoinKeyBloomFilters(Job *job, List *allTasks);
+static bool CanUseJoinKeyBloomFilter(Job *job);
+static bool JoinTreeHasOnlyInnerJoins(Node *joinTreeNode);
+static void ApplyJoinKeyBloomFilter(MapMergeJob **mapMergeJobs, List *allTasks);
+static List * JoinKeyBloomFilterTaskList(MapMergeJob *mapMergeJob, int sideIndex);
+static ListCell * ExecutedMapTaskCell(List *allTasks, Task *mapTask);
+static void SendJoinKeyFilter(char *resultId, bytea *joinKeyFilter, List *mapTaskList);
 
 
 /*
@@ -61,6 +86,11 @@ ExecuteDependentTasks(List *topLevelTasks, Job *topLevelJob)
 	List *allTasks = CreateTaskListForJobTree(topLevelTasks);
 	List *jobIds = ExtractJobsInJobTree(topLevelJob);
 
+	if (EnableRepartitionJoinBloomFilter)
+	{
+		ApplyJoinKeyBloomFilters(topLevelJob, allTasks);
+	}
+
 	ExecuteTasksInDependencyOrder(allTasks, topLevelTasks, jobIds);
 
 	return jobIds;
@@ -98,3 +128,353 @@ TraverseJobTree(Job *curJob, List **jobIds)
 		TraverseJobTree(childJob, jobIds);
 	}
 }
+
+
+/*
+ * ApplyJoinKeyBloomFilters walks the job tree and applies join key bloom
+ * filters to the dual hash repartition joins that allow it.
+ */
+static void
+ApplyJoinKeyBloomFilters(Job *job, List *allTasks)
+{
+	if (CanUseJoinKeyBloomFilter(job))
+	{
+		MapMergeJob *mapMergeJobs[2] = {
+			(MapMergeJob *) linitial(job->dependentJobList),
+			(MapMergeJob *) lsecond(job->dependentJobList)
+		};
+
+		ApplyJoinKeyBloomFilter(mapMergeJobs, allTasks);
+		return;
+	}
+
+	Job *childJob = NULL;
+	foreach_declared_ptr(childJob, job->dependentJobList)
+	{
+		ApplyJoinKeyBloomFilters(childJob, allTasks);
+	}
+}
+
+
+/*
+ * CanUseJoinKeyBloomFilter returns whether the given job is an inner dual hash
+ * repartition join of two tables. Rows that do not match the join keys of one
+ * side cannot be in the result of such a join, so they can be filtered out
+ * before they are repartitioned. We only consider the map tasks that read from
+ * shards, since the filter queries must be executable before any of the tasks
+ * in the job tree.
+ *
+ * The hashes in the filter of one side are compared to the hashes of the join
+ * keys of the other side, so both sides need to hash with the same type and
+ * collation.
+ */
+static bool
+CanUseJoinKeyBloomFilter(Job *job)
+{
+	if (list_length(job->dependentJobList) != 2)
+	{
+		return false;
+	}
+
+	Job *dependentJob = NULL;
+	foreach_declared_ptr(dependentJob, job->dependentJobList)
+	{
+		if (!CitusIsA(dependentJob, MapMergeJob))
+		{
+			return false;
+		}
+
+		MapMergeJob *mapMergeJob = (MapMergeJob *) dependentJob;
+		if (mapMergeJob->partitionType != DUAL_HASH_PARTITION_TYPE ||
+			mapMergeJob->filterQueryStringList == NIL ||
+			dependentJob->dependentJobList != NIL)
+		{
+			return false;
+		}
+	}
+
+	Var *leftPartitionColumn =
+		((MapMergeJob *) linitial(job->dependentJobList))->partitionColumn;
+	Var *rightPartitionColumn =
+		((MapMergeJob *) lsecond(job->dependentJobList))->partitionColumn;
+	if (leftPartitionColumn->vartype != rightPartitionColumn->vartype ||
+		leftPartitionColumn->varcollid != rightPartitionColumn->varcollid)
+	{
+		return false;
+	}
+
+	return JoinTreeHasOnlyInnerJoins((Node *) job->jobQuery->jointree);
+}
+
+
+/*
+ * JoinTreeHasOnlyInnerJoins returns whether the given join tree does not
+ * contain outer, semi or anti joins.
+ */
+static bool
+JoinTreeHasOnlyInnerJoins(Node *joinTreeNode)
+{
+	if (joinTreeNode == NULL)
+	{
+		return true;
+	}
+
+	if (IsA(joinTreeNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinTreeNode;
+
+		Node *fromNode = NULL;
+		foreach_declared_ptr(fromNode, fromExpr->fromlist)
+		{
+			if (!JoinTreeHasOnlyInnerJoins(fromNode))
+			{
+				return false;
+			}
+		}
+	}
+	else if (IsA(joinTreeNode, JoinExpr))
+	{
+		JoinExpr *joinExpr = (JoinExpr *) joinTreeNode;
+
+		return joinExpr->jointype == JOIN_INNER &&
+			   JoinTreeHasOnlyInnerJoins(joinExpr->larg) &&
+			   JoinTreeHasOnlyInnerJoins(joinExpr->rarg);
+	}
+
+	return true;
+}
+
+
+/*
+ * ApplyJoinKeyBloomFilter builds join key bloom filters on the results of the
+ * filter queries of both sides of a dual hash repartition join. The filters of
+ * the side with fewer rows are OR-merged and sent once as an intermediate
+ * result to the nodes that run the map tasks of the other side, which then skip
+ * the rows whose join key is not in the filter.
+ */
+static void
+ApplyJoinKeyBloomFilter(MapMergeJob **mapMergeJobs, List *allTasks)
+{
+	List *filterTaskList = NIL;
+	for (int sideIndex = 0; sideIndex < 2; sideIndex++)
+	{
+		filterTaskList = list_concat(filterTaskList,
+									 JoinKeyBloomFilterTaskList(mapMergeJobs[sideIndex],
+																sideIndex));
+	}
+
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(3);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "side_index", INT4OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "bloom_filter", BYTEAOID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 3, "rows_read", INT8OID, -1, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
+	TupleDestination *tupleDest = CreateTupleStoreTupleDest(tupleStore,
+															tupleDescriptor);
+
+	bool expectResults = true;
+	ExecuteTaskListIntoTupleDest(ROW_MODIFY_READONLY, filterTaskList, tupleDest,
+								 expectResults);
+
+	bytea *joinKeyFilters[2];
+	uint64 rowsRead[2] = { 0, 0 };
+	for (int sideIndex = 0; sideIndex < 2; sideIndex++)
+	{
+		joinKeyFilters[sideIndex] = palloc0(VARHDRSZ + JOIN_KEY_BLOOM_FILTER_SIZE);
+		SET_VARSIZE(joinKeyFilters[sideIndex], VARHDRSZ + JOIN_KEY_BLOOM_FILTER_SIZE);
+	}
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		int sideIndex = DatumGetInt32(slot_getattr(slot, 1, &isNull));
+		bytea *taskFilter = DatumGetByteaPP(slot_getattr(slot, 2, &isNull));
+		int64 taskRowsRead = DatumGetInt64(slot_getattr(slot, 3, &isNull));
+
+		if (VARSIZE_ANY_EXHDR(taskFilter) != JOIN_KEY_BLOOM_FILTER_SIZE)
+		{
+			/* the worker uses a different filter size, do not filter */
+			ExecDropSingleTupleTableSlot(slot);
+			return;
+		}
+
+		uint8 *taskFilterBytes = (uint8 *) VARDATA_ANY(taskFilter);
+		uint8 *filterBytes = (uint8 *) VARDATA(joinKeyFilters[sideIndex]);
+		for (int byteIndex = 0; byteIndex < JOIN_KEY_BLOOM_FILTER_SIZE; byteIndex++)
+		{
+			filterBytes[byteIndex] |= taskFilterBytes[byteIndex];
+		}
+
+		rowsRead[sideIndex] += taskRowsRead;
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	int buildSideIndex = rowsRead[0] <= rowsRead[1] ? 0 : 1;
+	MapMergeJob *probeMapMergeJob = mapMergeJobs[1 - buildSideIndex];
+	bytea *joinKeyFilter = joinKeyFilters[buildSideIndex];
+
+	uint64 bitsSet = pg_popcount(VARDATA(joinKeyFilter), JOIN_KEY_BLOOM_FILTER_SIZE);
+	double fillRatio = (double) bitsSet / (JOIN_KEY_BLOOM_FILTER_SIZE * BITS_PER_BYTE);
+	if (fillRatio > MAX_JOIN_KEY_BLOOM_FILTER_FILL_RATIO)
+	{
+		ereport(DEBUG2, (errmsg("skipping join key bloom filter of job "
+								UINT64_FORMAT " since %.0f%% of its bits are set",
+								mapMergeJobs[buildSideIndex]->job.jobId,
+								fillRatio * 100)));
+		return;
+	}
+
+	ereport(DEBUG2, (errmsg("filtering the map tasks of job " UINT64_FORMAT
+							" using the join keys of job " UINT64_FORMAT,
+							probeMapMergeJob->job.jobId,
+							mapMergeJobs[buildSideIndex]->job.jobId)));
+
+	StringInfo joinKeyFilterResultId = makeStringInfo();
+	appendStringInfo(joinKeyFilterResultId, "repartition_" UINT64_FORMAT
+					 "_join_key_filter", probeMapMergeJob->job.jobId);
+
+	SendJoinKeyFilter(joinKeyFilterResultId->data, joinKeyFilter,
+					  probeMapMergeJob->mapTaskList);
+
+	/*
+	 * The map tasks in the job tree may be shared with a cached plan, so we
+	 * replace them with copies that filter the rows.
+	 */
+	String *filterQueryString = NULL;
+	Task *mapTask = NULL;
+	forboth_ptr(filterQueryString, probeMapMergeJob->filterQueryStringList,
+				mapTask, probeMapMergeJob->mapTaskList)
+	{
+		ListCell *executedMapTaskCell = ExecutedMapTaskCell(allTasks, mapTask);
+		if (executedMapTaskCell == NULL)
+		{
+			continue;
+		}
+
+		Task *filteredMapTask = copyObject((Task *) lfirst(executedMapTaskCell));
+		SetMapTaskJoinKeyFilter(probeMapMergeJob, filteredMapTask,
+								strVal(filterQueryString),
+								joinKeyFilterResultId->data);
+
+		lfirst(executedMapTaskCell) = filteredMapTask;
+	}
+}
+
+
+/*
+ * JoinKeyBloomFilterTaskList returns a list of tasks that build join key bloom
+ * filters on the results of the filter queries of the given MapMerge job. The
+ * tasks run on the same placements as the map tasks.
+ */
+static List *
+JoinKeyBloomFilterTaskList(MapMergeJob *mapMergeJob, int sideIndex)
+{
+	List *filterTaskList = NIL;
+	int partitionColumnIndex = MapMergeJobPartitionColumnIndex(mapMergeJob);
+
+	String *filterQueryString = NULL;
+	Task *mapTask = NULL;
+	forboth_ptr(filterQueryString, mapMergeJob->filterQueryStringList,
+				mapTask, mapMergeJob->mapTaskList)
+	{
+		StringInfo filterTaskQueryString = makeStringInfo();
+		appendStringInfo(filterTaskQueryString,
+						 "SELECT %d, bloom_filter, rows_read "
+						 "FROM pg_catalog.worker_join_key_bloom_filter(%s,%d)",
+						 sideIndex,
+						 quote_literal_cstr(strVal(filterQueryString)),
+						 partitionColumnIndex);
+
+		Task *filterTask = copyObject(mapTask);
+		filterTask->taskType = READ_TASK;
+		filterTask->dependentTaskList = NIL;
+		SetTaskQueryString(filterTask, filterTaskQueryString->data);
+
+		filterTaskList = lappend(filterTaskList, filterTask);
+	}
+
+	return filterTaskList;
+}
+
+
+/*
+ * ExecutedMapTaskCell returns the cell of the given map task in the list of
+ * tasks that are executed, or NULL if the task is not in the list.
+ */
+static ListCell *
+ExecutedMapTaskCell(List *allTasks, Task *mapTask)
+{
+	ListCell *taskCell = NULL;
+	foreach(taskCell, allTasks)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		if (task->taskType == MAP_TASK && task->jobId == mapTask->jobId &&
+			task->taskId == mapTask->taskId)
+		{
+			return taskCell;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * SendJoinKeyFilter writes the given join key bloom filter as an intermediate
+ * result with the given ID to all nodes that have a placement of one of the
+ * given map tasks, such that the filter is sent only once per node.
+ */
+static void
+SendJoinKeyFilter(char *resultId, bytea *joinKeyFilter, List *mapTaskList)
+{
+	int32 localGroupId = GetLocalGroupId();
+	bool writeLocalFile = false;
+	List *nodeIdList = NIL;
+
+	Task *mapTask = NULL;
+	foreach_declared_ptr(mapTask, mapTaskList)
+	{
+		ShardPlacement *placement = NULL;
+		foreach_declared_ptr(placement, mapTask->taskPlacementList)
+		{
+			if (placement->groupId == localGroupId)
+			{
+				writeLocalFile = true;
+			}
+			else
+			{
+				nodeIdList = list_append_unique_int(nodeIdList, placement->nodeId);
+			}
+		}
+	}
+
+	List *nodeList = NIL;
+	int nodeId = 0;
+	foreach_declared_int(nodeId, nodeIdList)
+	{
+		nodeList = lappend(nodeList, LookupNodeByNodeIdOrError(nodeId));
+	}
+
+	TupleDesc tupleDescriptor = JoinKeyFilterTupleDescriptor();
+	EState *estate = CreateExecutorState();
+	DestReceiver *resultDest = CreateRemoteFileDestReceiver(resultId, estate, nodeList,
+															writeLocalFile);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsVirtual);
+	slot->tts_values[0] = PointerGetDatum(joinKeyFilter);
+	slot->tts_isnull[0] = false;
+	ExecStoreVirtualTuple(slot);
+
+	resultDest->rStartup(resultDest, CMD_SELECT, tupleDescriptor);
+	resultDest->receiveSlot(slot, resultDest);
+	resultDest->rShutdown(resultDest);
+	resultDest->rDestroy(resultDest);
+
+	ExecDropSingleTupleTableSlot(slot);
+	FreeExecutorState(estate);
+}
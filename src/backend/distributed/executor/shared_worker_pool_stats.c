@@ -0,0 +1,844 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_worker_pool_stats.c
+ *   Keeps track of execution feedback about worker nodes across backends.
+ *
+ * The adaptive executor decides on the number of connections it opens per
+ * worker node (WorkerPool) in isolation. When a worker node gets saturated,
+ * every backend keeps opening up to citus.max_adaptive_executor_pool_size
+ * connections to it, which makes the situation worse. To prevent that, we
+ * run an additive-increase/multiplicative-decrease (AIMD) controller per
+ * worker node, whose state lives in shared memory:
+ *
+ *  - When an execution observes that the average task execution time on a
+ *    node increased significantly compared to the moving baseline, or that
+ *    connection establishment failed, the pool size limit of the node is
+ *    halved.
+ *  - When an execution had more ready tasks than the limit allowed it to
+ *    run in parallel and the node was not saturated, the limit is
+ *    increased by one.
+ *
+ * In addition, we keep a sample of the recent task execution times per
+ * worker node, which is used to decide when a read task has been running
+ * for long enough on a node to also send it to another placement (hedged
+ * reads).
+ *
+ * Finally, for the latency-aware task assignment policy, we keep a moving
+ * average of the response times per worker node and the number of tasks
+ * that are currently running on the node across all backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <math.h>
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "common/hashfn.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#include "distributed/adaptive_executor.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/shared_worker_pool_stats.h"
+#include "distributed/worker_manager.h"
+
+
+/* the limit is halved whenever we detect saturation */
+#define POOL_SIZE_DECREASE_FACTOR 0.5
+
+/* the limit is increased by one connection when the pool was the bottleneck */
+#define POOL_SIZE_INCREASE_STEP 1.0
+
+/* weight of the latest observation in the moving baseline task execution time */
+#define BASELINE_SMOOTHING_FACTOR 0.1
+
+/* number of recent task execution times we keep per node for hedged reads */
+#define TASK_EXECUTION_TIME_SAMPLE_COUNT 64
+
+/* we do not hedge reads on a node until we have enough samples */
+#define MIN_TASK_EXECUTION_TIME_SAMPLE_COUNT 16
+
+/* weight of the latest observation in the response time estimate */
+#define RESPONSE_TIME_SMOOTHING_FACTOR 0.2
+
+
+/*
+ * The data structure used to store data in shared memory. Similar to the shared
+ * connection stats, this only stores the lock, the per node state is kept in a
+ * separately allocated hash map.
+ */
+typedef struct WorkerPoolStatsSharedData
+{
+	int sharedWorkerPoolStatsTrancheId;
+	char *sharedWorkerPoolStatsTrancheName;
+
+	LWLock sharedWorkerPoolStatsLock;
+} WorkerPoolStatsSharedData;
+
+
+typedef struct SharedWorkerPoolStatsHashKey
+{
+	/*
+	 * Similar to the shared connection stats, we prefer "hostname/port" over
+	 * nodeId such that the entries survive master_update_node().
+	 */
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} SharedWorkerPoolStatsHashKey;
+
+
+/* hash entry for per worker node execution feedback */
+typedef struct SharedWorkerPoolStatsHashEntry
+{
+	SharedWorkerPoolStatsHashKey key;
+
+	/* maximum number of connections a single execution may open to the node */
+	double poolSizeLimit;
+
+	/* moving average of the task execution times on the node, in microseconds */
+	double baselineTaskExecutionTime;
+
+	/* ring buffer of the recent read task execution times, in microseconds */
+	uint32 taskExecutionTimeSamples[TASK_EXECUTION_TIME_SAMPLE_COUNT];
+	int taskExecutionTimeSampleCount;
+	int nextTaskExecutionTimeSampleIndex;
+
+	/* moving average of the response times of the node, in microseconds */
+	double responseTimeEstimate;
+
+	/*
+	 * Number of tasks running on the node across all backends. This is updated
+	 * without holding the lock, entries are never removed from the hash.
+	 */
+	pg_atomic_uint32 inFlightTaskCount;
+} SharedWorkerPoolStatsHashEntry;
+
+
+/*
+ * LocalInFlightTaskEntry keeps track of the tasks that the current backend
+ * added to the in-flight task count of a node, such that we can subtract
+ * them when the execution fails or the backend exits.
+ */
+typedef struct LocalInFlightTaskEntry
+{
+	SharedWorkerPoolStatsHashKey key;
+
+	/* NULL if the shared hash was full */
+	SharedWorkerPoolStatsHashEntry *sharedEntry;
+
+	int inFlightTaskCount;
+} LocalInFlightTaskEntry;
+
+
+/* GUC, determining whether the executor learns pool sizes per worker node */
+bool EnableAdaptivePoolSizeControl = false;
+
+/* GUC, latency increase (as a ratio) that we consider as worker saturation */
+double AdaptivePoolSizeLatencyThreshold = 2.0;
+
+/* GUC, determining whether read tasks are also sent to a second placement */
+bool EnableHedgedReads = false;
+
+/* GUC, percentile of the recent task execution times after which we hedge */
+double HedgedReadLatencyPercentile = 95.0;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *SharedWorkerPoolStatsHash = NULL;
+static WorkerPoolStatsSharedData *WorkerPoolStatsSharedState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* in-flight tasks the current backend is responsible for, per node */
+static HTAB *LocalInFlightTaskHash = NULL;
+
+
+/* local function declarations */
+static void InitializeSharedWorkerPoolStatsHashKey(SharedWorkerPoolStatsHashKey *key,
+												   const char *hostname, int port);
+static SharedWorkerPoolStatsHashEntry * FindOrCreateSharedWorkerPoolStatsEntry(
+	SharedWorkerPoolStatsHashKey *key);
+static int CompareTaskExecutionTimes(const void *leftElement, const void *rightElement);
+static LocalInFlightTaskEntry * FindOrCreateLocalInFlightTaskEntry(const char *hostname,
+																   int port);
+static void CreateLocalInFlightTaskHash(void);
+static void ReleaseInFlightTaskCountsAtExit(int code, Datum arg);
+static void ReleaseInFlightTaskCounts(void);
+static uint32 SharedWorkerPoolStatsHashHash(const void *key, Size keysize);
+static int SharedWorkerPoolStatsHashCompare(const void *a, const void *b, Size keysize);
+
+
+/*
+ * GetAdaptivePoolSizeLimit returns the maximum number of connections that an
+ * execution is allowed to open to the given node, as learned from the
+ * earlier executions on any backend.
+ */
+int
+GetAdaptivePoolSizeLimit(const char *hostname, int port)
+{
+	int poolSizeLimit = MaxAdaptiveExecutorPoolSize;
+
+	if (!EnableAdaptivePoolSizeControl || WorkerPoolStatsSharedState == NULL)
+	{
+		return poolSizeLimit;
+	}
+
+	SharedWorkerPoolStatsHashKey key;
+	InitializeSharedWorkerPoolStatsHashKey(&key, hostname, port);
+
+	LWLockAcquire(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock, LW_SHARED);
+
+	bool entryFound = false;
+	SharedWorkerPoolStatsHashEntry *entry =
+		hash_search(SharedWorkerPoolStatsHash, &key, HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		poolSizeLimit = Min(poolSizeLimit, (int) entry->poolSizeLimit);
+	}
+
+	LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+
+	/* we always need at least one connection to make progress */
+	return Max(1, poolSizeLimit);
+}
+
+
+/*
+ * UpdateAdaptivePoolSizeLimit feeds the outcome of an execution on the given node
+ * into the AIMD controller of the node.
+ *
+ * avgTaskExecutionTime is the average task execution time observed by the
+ * execution in microseconds, hadConnectionFailure indicates whether any
+ * connection attempt to the node failed and limitedByPoolSize indicates whether
+ * the execution would have opened more connections if the limit allowed it.
+ */
+void
+UpdateAdaptivePoolSizeLimit(const char *hostname, int port, double avgTaskExecutionTime,
+							bool hadConnectionFailure, bool limitedByPoolSize)
+{
+	if (!EnableAdaptivePoolSizeControl || WorkerPoolStatsSharedState == NULL)
+	{
+		return;
+	}
+
+	SharedWorkerPoolStatsHashKey key;
+	InitializeSharedWorkerPoolStatsHashKey(&key, hostname, port);
+
+	LWLockAcquire(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock, LW_EXCLUSIVE);
+
+	SharedWorkerPoolStatsHashEntry *entry = FindOrCreateSharedWorkerPoolStatsEntry(&key);
+	if (entry == NULL)
+	{
+		LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+		return;
+	}
+
+	if (entry->baselineTaskExecutionTime <= 0)
+	{
+		/* first observation of the task execution times on the node */
+		entry->baselineTaskExecutionTime = avgTaskExecutionTime;
+	}
+
+	/*
+	 * The entry might have been created while citus.max_adaptive_executor_pool_size
+	 * was larger, in which case halving the limit would not have any effect.
+	 */
+	entry->poolSizeLimit = Min((double) MaxAdaptiveExecutorPoolSize,
+							   entry->poolSizeLimit);
+
+	double oldPoolSizeLimit = entry->poolSizeLimit;
+	bool nodeSaturated = hadConnectionFailure ||
+						 avgTaskExecutionTime > entry->baselineTaskExecutionTime *
+						 AdaptivePoolSizeLatencyThreshold;
+
+	if (nodeSaturated)
+	{
+		entry->poolSizeLimit = Max(1.0, entry->poolSizeLimit *
+								   POOL_SIZE_DECREASE_FACTOR);
+	}
+	else if (limitedByPoolSize)
+	{
+		entry->poolSizeLimit = Min((double) MaxAdaptiveExecutorPoolSize,
+								   entry->poolSizeLimit + POOL_SIZE_INCREASE_STEP);
+	}
+
+	/*
+	 * We keep following the task execution times even when the node is saturated,
+	 * otherwise a workload that became inherently slower would keep the limit
+	 * at its minimum forever.
+	 */
+	if (avgTaskExecutionTime > 0)
+	{
+		entry->baselineTaskExecutionTime +=
+			BASELINE_SMOOTHING_FACTOR *
+			(avgTaskExecutionTime - entry->baselineTaskExecutionTime);
+	}
+
+	double newPoolSizeLimit = entry->poolSizeLimit;
+
+	LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+
+	if (newPoolSizeLimit != oldPoolSizeLimit)
+	{
+		ereport(DEBUG4, (errmsg("adaptive pool size limit for node %s:%d changed "
+								"from %d to %d", hostname, port,
+								(int) oldPoolSizeLimit, (int) newPoolSizeLimit)));
+	}
+}
+
+
+/*
+ * RecordTaskExecutionTimes adds the given read task execution times (in
+ * microseconds) to the recent samples of the given node.
+ */
+void
+RecordTaskExecutionTimes(const char *hostname, int port, List *taskExecutionTimeList)
+{
+	if (!EnableHedgedReads || WorkerPoolStatsSharedState == NULL ||
+		taskExecutionTimeList == NIL)
+	{
+		return;
+	}
+
+	SharedWorkerPoolStatsHashKey key;
+	InitializeSharedWorkerPoolStatsHashKey(&key, hostname, port);
+
+	LWLockAcquire(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock, LW_EXCLUSIVE);
+
+	SharedWorkerPoolStatsHashEntry *entry = FindOrCreateSharedWorkerPoolStatsEntry(&key);
+	if (entry == NULL)
+	{
+		LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+		return;
+	}
+
+	int taskExecutionTime = 0;
+	foreach_declared_int(taskExecutionTime, taskExecutionTimeList)
+	{
+		int sampleIndex = entry->nextTaskExecutionTimeSampleIndex;
+
+		entry->taskExecutionTimeSamples[sampleIndex] = (uint32) taskExecutionTime;
+		entry->nextTaskExecutionTimeSampleIndex =
+			(sampleIndex + 1) % TASK_EXECUTION_TIME_SAMPLE_COUNT;
+
+		if (entry->taskExecutionTimeSampleCount < TASK_EXECUTION_TIME_SAMPLE_COUNT)
+		{
+			entry->taskExecutionTimeSampleCount++;
+		}
+	}
+
+	LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+}
+
+
+/*
+ * GetHedgedReadDelay returns the number of milliseconds after which a read
+ * task that is still running on the given node should also be sent to another
+ * placement, based on the recent task execution times on the node. It returns
+ * -1 if reads on the node should not be hedged.
+ */
+long
+GetHedgedReadDelay(const char *hostname, int port)
+{
+	uint32 taskExecutionTimeSamples[TASK_EXECUTION_TIME_SAMPLE_COUNT];
+	int sampleCount = 0;
+
+	if (!EnableHedgedReads || WorkerPoolStatsSharedState == NULL)
+	{
+		return -1;
+	}
+
+	SharedWorkerPoolStatsHashKey key;
+	InitializeSharedWorkerPoolStatsHashKey(&key, hostname, port);
+
+	LWLockAcquire(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock, LW_SHARED);
+
+	bool entryFound = false;
+	SharedWorkerPoolStatsHashEntry *entry =
+		hash_search(SharedWorkerPoolStatsHash, &key, HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		sampleCount = entry->taskExecutionTimeSampleCount;
+		memcpy(taskExecutionTimeSamples, entry->taskExecutionTimeSamples,
+			   sampleCount * sizeof(uint32));
+	}
+
+	LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+
+	if (sampleCount < MIN_TASK_EXECUTION_TIME_SAMPLE_COUNT)
+	{
+		/* not enough information to tell what a slow task looks like */
+		return -1;
+	}
+
+	qsort(taskExecutionTimeSamples, sampleCount, sizeof(uint32),
+		  CompareTaskExecutionTimes);
+
+	int percentileIndex =
+		(int) ceil(HedgedReadLatencyPercentile / 100.0 * sampleCount) - 1;
+	percentileIndex = Max(0, Min(percentileIndex, sampleCount - 1));
+
+	long hedgedReadDelayMs = taskExecutionTimeSamples[percentileIndex] / 1000;
+
+	/* do not hedge tasks that we cannot possibly speed up */
+	return Max(1, hedgedReadDelayMs);
+}
+
+
+/*
+ * UpdateNodeResponseTime feeds the average task execution time observed by an
+ * execution on the given node (in microseconds) into the response time
+ * estimate of the node.
+ */
+void
+UpdateNodeResponseTime(const char *hostname, int port, double avgTaskExecutionTime)
+{
+	if (WorkerPoolStatsSharedState == NULL)
+	{
+		return;
+	}
+
+	SharedWorkerPoolStatsHashKey key;
+	InitializeSharedWorkerPoolStatsHashKey(&key, hostname, port);
+
+	LWLockAcquire(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock, LW_EXCLUSIVE);
+
+	SharedWorkerPoolStatsHashEntry *entry = FindOrCreateSharedWorkerPoolStatsEntry(&key);
+	if (entry != NULL)
+	{
+		if (entry->responseTimeEstimate <= 0)
+		{
+			entry->responseTimeEstimate = avgTaskExecutionTime;
+		}
+		else
+		{
+			entry->responseTimeEstimate +=
+				RESPONSE_TIME_SMOOTHING_FACTOR *
+				(avgTaskExecutionTime - entry->responseTimeEstimate);
+		}
+	}
+
+	LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+}
+
+
+/*
+ * GetNodeResponseTime returns the response time estimate of the given node in
+ * microseconds, or 0 if we have not observed any tasks on the node yet. The
+ * number of tasks that currently run on the node is returned via
+ * inFlightTaskCount.
+ */
+double
+GetNodeResponseTime(const char *hostname, int port, int *inFlightTaskCount)
+{
+	double responseTimeEstimate = 0;
+
+	*inFlightTaskCount = 0;
+
+	if (WorkerPoolStatsSharedState == NULL)
+	{
+		return responseTimeEstimate;
+	}
+
+	SharedWorkerPoolStatsHashKey key;
+	InitializeSharedWorkerPoolStatsHashKey(&key, hostname, port);
+
+	LWLockAcquire(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock, LW_SHARED);
+
+	bool entryFound = false;
+	SharedWorkerPoolStatsHashEntry *entry =
+		hash_search(SharedWorkerPoolStatsHash, &key, HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		responseTimeEstimate = entry->responseTimeEstimate;
+		*inFlightTaskCount = (int) pg_atomic_read_u32(&entry->inFlightTaskCount);
+	}
+
+	LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+
+	return responseTimeEstimate;
+}
+
+
+/*
+ * GetMeanNodeResponseTime returns the average of the response time estimates of
+ * all nodes on which we observed tasks, in microseconds, or 0 if we have not
+ * observed any tasks yet.
+ */
+double
+GetMeanNodeResponseTime(void)
+{
+	HASH_SEQ_STATUS status;
+	SharedWorkerPoolStatsHashEntry *entry = NULL;
+	double totalResponseTime = 0;
+	int observedNodeCount = 0;
+
+	if (WorkerPoolStatsSharedState == NULL)
+	{
+		return 0;
+	}
+
+	LWLockAcquire(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock, LW_SHARED);
+
+	hash_seq_init(&status, SharedWorkerPoolStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (entry->responseTimeEstimate > 0)
+		{
+			totalResponseTime += entry->responseTimeEstimate;
+			observedNodeCount++;
+		}
+	}
+
+	LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+
+	if (observedNodeCount == 0)
+	{
+		return 0;
+	}
+
+	return totalResponseTime / observedNodeCount;
+}
+
+
+/*
+ * AdjustInFlightTaskCount adds delta to the number of tasks that are running on
+ * the given node. The current backend never subtracts more tasks than it added
+ * before, such that the count cannot become negative.
+ */
+void
+AdjustInFlightTaskCount(const char *hostname, int port, int delta)
+{
+	if (WorkerPoolStatsSharedState == NULL)
+	{
+		return;
+	}
+
+	LocalInFlightTaskEntry *localEntry =
+		FindOrCreateLocalInFlightTaskEntry(hostname, port);
+	if (localEntry->sharedEntry == NULL)
+	{
+		return;
+	}
+
+	if (delta < 0)
+	{
+		delta = Max(delta, -localEntry->inFlightTaskCount);
+	}
+
+	if (delta == 0)
+	{
+		return;
+	}
+
+	localEntry->inFlightTaskCount += delta;
+
+	if (delta > 0)
+	{
+		pg_atomic_fetch_add_u32(&localEntry->sharedEntry->inFlightTaskCount, delta);
+	}
+	else
+	{
+		pg_atomic_fetch_sub_u32(&localEntry->sharedEntry->inFlightTaskCount, -delta);
+	}
+}
+
+
+/*
+ * ReleaseInFlightTaskCounts subtracts all the tasks that the current backend
+ * added to the in-flight task counts. It is called when the backend exits, in
+ * which case we do not get to finish the individual tasks.
+ */
+static void
+ReleaseInFlightTaskCounts(void)
+{
+	HASH_SEQ_STATUS status;
+	LocalInFlightTaskEntry *localEntry = NULL;
+
+	if (LocalInFlightTaskHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, LocalInFlightTaskHash);
+	while ((localEntry = hash_seq_search(&status)) != NULL)
+	{
+		if (localEntry->sharedEntry != NULL && localEntry->inFlightTaskCount > 0)
+		{
+			pg_atomic_fetch_sub_u32(&localEntry->sharedEntry->inFlightTaskCount,
+									localEntry->inFlightTaskCount);
+		}
+
+		localEntry->inFlightTaskCount = 0;
+	}
+}
+
+
+/*
+ * FindOrCreateLocalInFlightTaskEntry returns the backend-local in-flight task
+ * entry for the given node, which caches the pointer to the shared entry.
+ */
+static LocalInFlightTaskEntry *
+FindOrCreateLocalInFlightTaskEntry(const char *hostname, int port)
+{
+	SharedWorkerPoolStatsHashKey key;
+	InitializeSharedWorkerPoolStatsHashKey(&key, hostname, port);
+
+	if (LocalInFlightTaskHash == NULL)
+	{
+		CreateLocalInFlightTaskHash();
+	}
+
+	bool entryFound = false;
+	LocalInFlightTaskEntry *localEntry =
+		hash_search(LocalInFlightTaskHash, &key, HASH_ENTER, &entryFound);
+	if (!entryFound)
+	{
+		localEntry->inFlightTaskCount = 0;
+
+		LWLockAcquire(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock,
+					  LW_EXCLUSIVE);
+
+		localEntry->sharedEntry = FindOrCreateSharedWorkerPoolStatsEntry(&key);
+
+		LWLockRelease(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock);
+	}
+
+	return localEntry;
+}
+
+
+/*
+ * CreateLocalInFlightTaskHash creates the backend-local hash that keeps track
+ * of the in-flight tasks of the backend, and makes sure that they are released
+ * when the backend exits.
+ */
+static void
+CreateLocalInFlightTaskHash(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedWorkerPoolStatsHashKey);
+	info.entrysize = sizeof(LocalInFlightTaskEntry);
+	info.hash = SharedWorkerPoolStatsHashHash;
+	info.match = SharedWorkerPoolStatsHashCompare;
+	info.hcxt = TopMemoryContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+
+	LocalInFlightTaskHash = hash_create("Local In-flight Task Hash", 32, &info,
+										hashFlags);
+
+	before_shmem_exit(ReleaseInFlightTaskCountsAtExit, 0);
+}
+
+
+/*
+ * ReleaseInFlightTaskCountsAtExit is a before_shmem_exit callback that releases
+ * the in-flight tasks of an exiting backend.
+ */
+static void
+ReleaseInFlightTaskCountsAtExit(int code, Datum arg)
+{
+	ReleaseInFlightTaskCounts();
+}
+
+
+/*
+ * CompareTaskExecutionTimes is a qsort comparator for task execution times.
+ */
+static int
+CompareTaskExecutionTimes(const void *leftElement, const void *rightElement)
+{
+	uint32 left = *((const uint32 *) leftElement);
+	uint32 right = *((const uint32 *) rightElement);
+
+	if (left < right)
+	{
+		return -1;
+	}
+	else if (left > right)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * FindOrCreateSharedWorkerPoolStatsEntry returns the entry for the given key,
+ * creating one if it does not exist yet. The caller should hold the lock in
+ * exclusive mode.
+ *
+ * Similar to the shared connection stats, we could get NULL via HASH_ENTER_NULL
+ * when there is no space left in the shared memory. Everything in this file is
+ * only an optimization, so the callers simply skip the update in that case.
+ */
+static SharedWorkerPoolStatsHashEntry *
+FindOrCreateSharedWorkerPoolStatsEntry(SharedWorkerPoolStatsHashKey *key)
+{
+	bool entryFound = false;
+	SharedWorkerPoolStatsHashEntry *entry =
+		hash_search(SharedWorkerPoolStatsHash, key, HASH_ENTER_NULL, &entryFound);
+	if (entry != NULL && !entryFound)
+	{
+		/* first observation for the node, start without any restrictions */
+		entry->poolSizeLimit = MaxAdaptiveExecutorPoolSize;
+		entry->baselineTaskExecutionTime = 0;
+		entry->taskExecutionTimeSampleCount = 0;
+		entry->nextTaskExecutionTimeSampleIndex = 0;
+		entry->responseTimeEstimate = 0;
+		pg_atomic_init_u32(&entry->inFlightTaskCount, 0);
+	}
+
+	return entry;
+}
+
+
+/*
+ * InitializeSharedWorkerPoolStatsHashKey fills the hash key for the given node.
+ */
+static void
+InitializeSharedWorkerPoolStatsHashKey(SharedWorkerPoolStatsHashKey *key,
+									   const char *hostname, int port)
+{
+	if (strlen(hostname) > MAX_NODE_LENGTH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("hostname exceeds the maximum length of %d",
+							   MAX_NODE_LENGTH)));
+	}
+
+	memset(key, 0, sizeof(SharedWorkerPoolStatsHashKey));
+	strlcpy(key->hostname, hostname, MAX_NODE_LENGTH);
+	key->port = port;
+}
+
+
+/*
+ * InitializeSharedWorkerPoolStats sets up the shared memory startup hook.
+ */
+void
+InitializeSharedWorkerPoolStats(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedWorkerPoolStatsShmemInit;
+}
+
+
+/*
+ * SharedWorkerPoolStatsShmemSize returns the size that should be allocated
+ * on the shared memory for the shared worker pool stats.
+ */
+size_t
+SharedWorkerPoolStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(WorkerPoolStatsSharedData));
+
+	Size hashSize = hash_estimate_size(MaxWorkerNodesTracked,
+									   sizeof(SharedWorkerPoolStatsHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * SharedWorkerPoolStatsShmemInit initializes the shared memory used for
+ * keeping track of the execution feedback about worker nodes.
+ */
+void
+SharedWorkerPoolStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (hostname, port) -> [pool size limit, baseline] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedWorkerPoolStatsHashKey);
+	info.entrysize = sizeof(SharedWorkerPoolStatsHashEntry);
+	info.hash = SharedWorkerPoolStatsHashHash;
+	info.match = SharedWorkerPoolStatsHashCompare;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	WorkerPoolStatsSharedState =
+		(WorkerPoolStatsSharedData *) ShmemInitStruct(
+			"Shared Worker Pool Stats Data",
+			sizeof(WorkerPoolStatsSharedData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		WorkerPoolStatsSharedState->sharedWorkerPoolStatsTrancheId =
+			LWLockNewTrancheId();
+		WorkerPoolStatsSharedState->sharedWorkerPoolStatsTrancheName =
+			"Shared Worker Pool Stats Tranche";
+		LWLockRegisterTranche(WorkerPoolStatsSharedState->sharedWorkerPoolStatsTrancheId,
+							  WorkerPoolStatsSharedState->
+							  sharedWorkerPoolStatsTrancheName);
+
+		LWLockInitialize(&WorkerPoolStatsSharedState->sharedWorkerPoolStatsLock,
+						 WorkerPoolStatsSharedState->sharedWorkerPoolStatsTrancheId);
+	}
+
+	/* allocate hash table */
+	SharedWorkerPoolStatsHash =
+		ShmemInitHash("Shared Worker Pool Stats Hash", MaxWorkerNodesTracked,
+					  MaxWorkerNodesTracked, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(SharedWorkerPoolStatsHash != NULL);
+	Assert(WorkerPoolStatsSharedState->sharedWorkerPoolStatsTrancheId != 0);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+static uint32
+SharedWorkerPoolStatsHashHash(const void *key, Size keysize)
+{
+	SharedWorkerPoolStatsHashKey *entry = (SharedWorkerPoolStatsHashKey *) key;
+
+	uint32 hash = string_hash(entry->hostname, NAMEDATALEN);
+	hash = hash_combine(hash, hash_uint32(entry->port));
+
+	return hash;
+}
+
+
+static int
+SharedWorkerPoolStatsHashCompare(const void *a, const void *b, Size keysize)
+{
+	SharedWorkerPoolStatsHashKey *ca = (SharedWorkerPoolStatsHashKey *) a;
+	SharedWorkerPoolStatsHashKey *cb = (SharedWorkerPoolStatsHashKey *) b;
+
+	if (strncmp(ca->hostname, cb->hostname, MAX_NODE_LENGTH) != 0 ||
+		ca->port != cb->port)
+	{
+		return 1;
+	}
+	else
+	{
+		return 0;
+	}
+}
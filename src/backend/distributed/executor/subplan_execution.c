@@ -10,15 +10,24 @@
 
 #include "postgres.h"
 
+#include "miscadmin.h"
+
+#include "access/xact.h"
 #include "executor/executor.h"
 #include "utils/datetime.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 
+#include "distributed/citus_clauses.h"
+#include "distributed/commands.h"
+#include "distributed/foreign_key_relationship.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
-#include "distributed/recursive_planning.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/transaction_management.h"
 #include "distributed/worker_manager.h"
@@ -30,6 +39,66 @@ int MaxIntermediateResult = 1048576; /* maximum size in KB the intermediate resu
 /* when this is true, we enforce intermediate result size limit in all executors */
 int SubPlanLevel = 0;
 
+/* GUC, whether subplans on reference tables reuse results within a transaction */
+bool EnableSubPlanResultReuse = false;
+
+
+/*
+ * ReusableSubPlanResult describes an intermediate result of a reusable subplan
+ * that was written in the current transaction.
+ */
+typedef struct ReusableSubPlanResult
+{
+	char resultId[NAMEDATALEN];
+
+	/* query text of the subplan, in case of a hash collision in the result ID */
+	char *queryString;
+
+	/* results are stored in a directory of the user */
+	Oid userId;
+
+	/* nodes that received the result, and whether a local file was written */
+	List *nodeIdList;
+	bool writeLocalFile;
+
+	/* reference tables the result was computed from */
+	List *relationIdList;
+
+	/* value of ModificationCounter when the result was written */
+	uint64 modificationVersion;
+} ReusableSubPlanResult;
+
+
+/*
+ * RelationModificationVersion records the value of ModificationCounter when
+ * a relation was last modified in the current transaction.
+ */
+typedef struct RelationModificationVersion
+{
+	Oid relationId;
+	uint64 modificationVersion;
+} RelationModificationVersion;
+
+
+/* reusable results of the current transaction, keyed by result ID */
+static HTAB *ReusableSubPlanResultHash = NULL;
+
+/* modification versions of the relations, keyed by relation ID */
+static HTAB *RelationModificationVersionHash = NULL;
+
+/* incremented on each modification in the current transaction */
+static uint64 ModificationCounter = 0;
+
+
+static bool CanReuseSubPlanResult(DistributedSubPlan *subPlan,
+								  List *remoteWorkerNodeList, bool writeLocalFile);
+static void RecordReusableSubPlanResult(DistributedSubPlan *subPlan,
+										List *remoteWorkerNodeList,
+										bool writeLocalFile);
+static void CreateReusableSubPlanResultHashes(void);
+static uint64 RelationModificationVersionGet(Oid relationId);
+static bool PlanHasModifyingCTE(DistributedPlan *distributedPlan);
+
 
 /*
  * ExecuteSubPlans executes a list of subplans from a distributed plan
@@ -38,7 +107,6 @@ int SubPlanLevel = 0;
 void
 ExecuteSubPlans(DistributedPlan *distributedPlan)
 {
-	uint64 planId = distributedPlan->planId;
 	List *subPlanList = distributedPlan->subPlanList;
 
 	if (subPlanList == NIL)
@@ -62,15 +130,26 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 	foreach_declared_ptr(subPlan, subPlanList)
 	{
 		PlannedStmt *plannedStmt = subPlan->plan;
-		uint32 subPlanId = subPlan->subPlanId;
 		ParamListInfo params = NULL;
-		char *resultId = GenerateResultId(planId, subPlanId);
+		char *resultId = subPlan->resultId;
 		List *remoteWorkerNodeList =
 			FindAllWorkerNodesUsingSubplan(intermediateResultsHash, resultId);
 
 		IntermediateResultsHashEntry *entry =
 			SearchIntermediateResult(intermediateResultsHash, resultId);
 
+		if (CanReuseSubPlanResult(subPlan, remoteWorkerNodeList, entry->writeLocalFile))
+		{
+			ereport(DEBUG1, (errmsg("reusing intermediate result %s", resultId)));
+
+			subPlan->durationMillisecs = 0;
+			subPlan->bytesSentPerWorker = 0;
+			subPlan->remoteWorkerCount = 0;
+			subPlan->writeLocalFile = false;
+
+			continue;
+		}
+
 		SubPlanLevel++;
 		EState *estate = CreateExecutorState();
 		DestReceiver *copyDest =
@@ -99,5 +178,289 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 
 		SubPlanLevel--;
 		FreeExecutorState(estate);
+
+		RecordReusableSubPlanResult(subPlan, remoteWorkerNodeList,
+									entry->writeLocalFile);
+	}
+}
+
+
+/*
+ * CanReuseSubPlanResult returns whether the intermediate result of the given
+ * subplan was already written in the current transaction to all nodes in
+ * remoteWorkerNodeList, and to a local file if writeLocalFile is set, and
+ * none of the tables it was computed from were modified since.
+ *
+ * Results are only reused in transactions that use a single snapshot, since
+ * otherwise a new execution could observe concurrently committed changes.
+ */
+static bool
+CanReuseSubPlanResult(DistributedSubPlan *subPlan, List *remoteWorkerNodeList,
+					  bool writeLocalFile)
+{
+	bool found = false;
+
+	if (!EnableSubPlanResultReuse || subPlan->relationIdList == NIL ||
+		!IsolationUsesXactSnapshot() || ReusableSubPlanResultHash == NULL)
+	{
+		return false;
+	}
+
+	ReusableSubPlanResult *result = hash_search(ReusableSubPlanResultHash,
+												subPlan->resultId, HASH_FIND, &found);
+	if (!found || result->userId != GetUserId() ||
+		strcmp(result->queryString, subPlan->resultQueryString) != 0)
+	{
+		return false;
+	}
+
+	if (writeLocalFile && !result->writeLocalFile)
+	{
+		return false;
+	}
+
+	WorkerNode *workerNode = NULL;
+	foreach_declared_ptr(workerNode, remoteWorkerNodeList)
+	{
+		if (!list_member_int(result->nodeIdList, workerNode->nodeId))
+		{
+			return false;
+		}
+	}
+
+	Oid relationId = InvalidOid;
+	foreach_declared_oid(relationId, result->relationIdList)
+	{
+		if (RelationModificationVersionGet(relationId) > result->modificationVersion)
+		{
+			return false;
+		}
 	}
+
+	return true;
+}
+
+
+/*
+ * RecordReusableSubPlanResult remembers that the intermediate result of the
+ * given reusable subplan was written to the nodes in remoteWorkerNodeList,
+ * and to a local file if writeLocalFile is set. Nodes that received the
+ * result in an earlier execution are forgotten, since their files are stale
+ * if the result was written again due to a modification.
+ */
+static void
+RecordReusableSubPlanResult(DistributedSubPlan *subPlan, List *remoteWorkerNodeList,
+							bool writeLocalFile)
+{
+	bool found = false;
+
+	if (subPlan->relationIdList == NIL || !IsolationUsesXactSnapshot())
+	{
+		return;
+	}
+
+	if (ReusableSubPlanResultHash == NULL)
+	{
+		CreateReusableSubPlanResultHashes();
+	}
+
+	ReusableSubPlanResult *result = hash_search(ReusableSubPlanResultHash,
+												subPlan->resultId, HASH_ENTER, &found);
+	if (found)
+	{
+		pfree(result->queryString);
+		list_free(result->nodeIdList);
+		list_free(result->relationIdList);
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	result->queryString = pstrdup(subPlan->resultQueryString);
+	result->userId = GetUserId();
+	result->nodeIdList = NIL;
+	result->writeLocalFile = writeLocalFile;
+	result->relationIdList = list_copy(subPlan->relationIdList);
+	result->modificationVersion = ModificationCounter;
+
+	WorkerNode *workerNode = NULL;
+	foreach_declared_ptr(workerNode, remoteWorkerNodeList)
+	{
+		result->nodeIdList = lappend_int(result->nodeIdList, workerNode->nodeId);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * CreateReusableSubPlanResultHashes creates the hashes of reusable results and
+ * relation modification versions, which live until the end of the transaction.
+ */
+static void
+CreateReusableSubPlanResultHashes(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = NAMEDATALEN;
+	info.entrysize = sizeof(ReusableSubPlanResult);
+	info.hcxt = TopTransactionContext;
+
+	ReusableSubPlanResultHash = hash_create("Reusable subplan result hash", 32, &info,
+											HASH_ELEM | HASH_STRINGS | HASH_CONTEXT);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(RelationModificationVersion);
+	info.hcxt = TopTransactionContext;
+
+	RelationModificationVersionHash =
+		hash_create("Relation modification version hash", 32, &info,
+					HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+
+/*
+ * RelationModificationVersionGet returns the value of ModificationCounter when
+ * the given relation was last modified in the current transaction, or 0 if it
+ * was not modified since the first reusable result was written.
+ */
+static uint64
+RelationModificationVersionGet(Oid relationId)
+{
+	bool found = false;
+
+	RelationModificationVersion *version =
+		hash_search(RelationModificationVersionHash, &relationId, HASH_FIND, &found);
+
+	return found ? version->modificationVersion : 0;
+}
+
+
+/*
+ * InvalidateSubPlanResultsForPlan invalidates the reusable subplan results
+ * that the given distributed plan might change. Those are the results on the
+ * target table of a modification. All results are invalidated if the plan
+ * pushes down modifying CTEs, which may modify other tables than the target
+ * table, or calls volatile functions on the workers, which may modify any
+ * table.
+ */
+void
+InvalidateSubPlanResultsForPlan(DistributedPlan *distributedPlan)
+{
+	if (ReusableSubPlanResultHash == NULL)
+	{
+		return;
+	}
+
+	if (PlanHasModifyingCTE(distributedPlan))
+	{
+		InvalidateSubPlanResults(InvalidOid);
+		return;
+	}
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY)
+	{
+		InvalidateSubPlanResults(distributedPlan->targetRelationId);
+		return;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob != NULL &&
+		FindNodeMatchingCheckFunction((Node *) workerJob->jobQuery,
+									  CitusIsVolatileFunction))
+	{
+		InvalidateSubPlanResults(InvalidOid);
+	}
+}
+
+
+/*
+ * PlanHasModifyingCTE returns whether the query that the given distributed
+ * plan sends to the workers, or executes via the coordinator, contains
+ * modifying CTEs. Modifying CTEs that are planned recursively are executed
+ * as subplans, which invalidate the results on their own target tables.
+ */
+static bool
+PlanHasModifyingCTE(DistributedPlan *distributedPlan)
+{
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob != NULL && workerJob->jobQuery != NULL &&
+		workerJob->jobQuery->hasModifyingCTE)
+	{
+		return true;
+	}
+
+	Query *modifyQuery = distributedPlan->modifyQueryViaCoordinatorOrRepartition;
+	if (modifyQuery != NULL && modifyQuery->hasModifyingCTE)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * InvalidateSubPlanResults invalidates the reusable subplan results that were
+ * computed from the given relation, or from any table that references it
+ * through foreign keys, since modifications can cascade to those. If the
+ * relation is InvalidOid, or if triggers on distributed tables are allowed,
+ * all results are invalidated.
+ */
+void
+InvalidateSubPlanResults(Oid relationId)
+{
+	if (ReusableSubPlanResultHash == NULL)
+	{
+		return;
+	}
+
+	if (!OidIsValid(relationId) || EnableUnsafeTriggers)
+	{
+		ereport(DEBUG1, (errmsg("invalidating all reusable intermediate results")));
+
+		ResetSubPlanResultCache();
+		return;
+	}
+
+	List *modifiedRelationIdList = list_make1_oid(relationId);
+	modifiedRelationIdList = list_concat(modifiedRelationIdList,
+										 ReferencingRelationIdList(relationId));
+
+	ModificationCounter++;
+
+	Oid modifiedRelationId = InvalidOid;
+	foreach_declared_oid(modifiedRelationId, modifiedRelationIdList)
+	{
+		ereport(DEBUG1, (errmsg("invalidating reusable intermediate results on "
+								"table %s", get_rel_name(modifiedRelationId))));
+
+		RelationModificationVersion *version =
+			hash_search(RelationModificationVersionHash, &modifiedRelationId,
+						HASH_ENTER, NULL);
+
+		version->modificationVersion = ModificationCounter;
+	}
+}
+
+
+/*
+ * ResetSubPlanResultCache forgets all reusable subplan results. It is called
+ * at the end of the transaction, when the intermediate results are removed,
+ * and when a subtransaction is rolled back, which may revert modifications
+ * that the results were computed after.
+ */
+void
+ResetSubPlanResultCache(void)
+{
+	if (ReusableSubPlanResultHash != NULL)
+	{
+		hash_destroy(ReusableSubPlanResultHash);
+		hash_destroy(RelationModificationVersionHash);
+	}
+
+	ReusableSubPlanResultHash = NULL;
+	RelationModificationVersionHash = NULL;
+	ModificationCounter = 0;
 }
@@ -30,8 +30,12 @@
 #include "distributed/worker_protocol.h"
 
 
+/* size of the reads from the file or program of a COPY FROM */
+#define COPY_INPUT_READ_SIZE (64 * 1024)
+
+
 /* Local functions forward declarations */
-static void SendCopyInStart(void);
+static void SendCopyInStart(bool binaryFormat, int columnCount);
 static void SendCopyOutStart(void);
 static void SendCopyDone(void);
 static void SendCopyData(StringInfo fileBuffer);
@@ -46,13 +50,27 @@ static void FreeStringInfo(StringInfo stringInfo);
  */
 void
 RedirectCopyDataToRegularFile(const char *filename)
+{
+	RelayCopyDataToRegularFile(filename, NULL, NULL);
+}
+
+
+/*
+ * RelayCopyDataToRegularFile works like RedirectCopyDataToRegularFile, but
+ * also passes each message of received data to the given relay function before
+ * appending it to the file, such that the data can be forwarded to other nodes
+ * while it is received.
+ */
+void
+RelayCopyDataToRegularFile(const char *filename, CopyDataRelayFunction relayFunction,
+						   void *relayContext)
 {
 	StringInfo copyData = makeStringInfo();
 	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
 	File fileDesc = FileOpenForTransmit(filename, fileFlags);
 	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
 
-	SendCopyInStart();
+	SendCopyInStart(true, 0);
 
 	bool copyDone = ReceiveCopyData(copyData);
 	while (!copyDone)
@@ -60,6 +78,11 @@ RedirectCopyDataToRegularFile(const char *filename)
 		/* if received data has contents, append to regular file */
 		if (copyData->len > 0)
 		{
+			if (relayFunction != NULL)
+			{
+				relayFunction(copyData, relayContext);
+			}
+
 			int appended = FileWriteCompat(&fileCompat, copyData->data,
 										   copyData->len, PG_WAIT_IO);
 
@@ -79,6 +102,121 @@ RedirectCopyDataToRegularFile(const char *filename)
 }
 
 
+/*
+ * ReceiveCopyDataFromFrontend receives text or CSV data for a COPY FROM STDIN
+ * into columnCount columns from the client using the standard copy protocol,
+ * and passes each message of received data to the given function.
+ */
+void
+ReceiveCopyDataFromFrontend(int columnCount, CopyDataRelayFunction receiveFunction,
+							void *receiveContext)
+{
+	StringInfo copyData = makeStringInfo();
+
+	SendCopyInStart(false, columnCount);
+
+	bool copyDone = ReceiveCopyData(copyData);
+	while (!copyDone)
+	{
+		if (copyData->len > 0)
+		{
+			receiveFunction(copyData, receiveContext);
+		}
+
+		resetStringInfo(copyData);
+		copyDone = ReceiveCopyData(copyData);
+	}
+
+	FreeStringInfo(copyData);
+}
+
+
+/*
+ * RelayCopyFromInput reads the text or CSV input of a COPY FROM into
+ * columnCount columns from the client, the given file, or the output of the
+ * given program, and passes each piece of data that was read to the given
+ * function.
+ */
+void
+RelayCopyFromInput(const char *filename, bool isProgram, int columnCount,
+				   CopyDataRelayFunction relayFunction, void *relayContext)
+{
+	if (filename == NULL)
+	{
+		ReceiveCopyDataFromFrontend(columnCount, relayFunction, relayContext);
+		return;
+	}
+
+	FILE *inputFile = NULL;
+
+	if (isProgram)
+	{
+		inputFile = OpenPipeStream(filename, PG_BINARY_R);
+		if (inputFile == NULL)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not execute command \"%s\": %m",
+								   filename)));
+		}
+	}
+	else
+	{
+		inputFile = AllocateFile(filename, PG_BINARY_R);
+		if (inputFile == NULL)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open file \"%s\" for reading: %m",
+								   filename)));
+		}
+	}
+
+	StringInfo copyData = makeStringInfo();
+	enlargeStringInfo(copyData, COPY_INPUT_READ_SIZE);
+
+	while (true)
+	{
+		size_t bytesRead = fread(copyData->data, 1, COPY_INPUT_READ_SIZE, inputFile);
+		if (ferror(inputFile))
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read from COPY file: %m")));
+		}
+
+		if (bytesRead == 0)
+		{
+			break;
+		}
+
+		copyData->len = bytesRead;
+		relayFunction(copyData, relayContext);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	FreeStringInfo(copyData);
+
+	if (isProgram)
+	{
+		int programResult = ClosePipeStream(inputFile);
+		if (programResult == -1)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not close pipe to external command: %m")));
+		}
+		else if (programResult != 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION),
+							errmsg("program \"%s\" failed", filename),
+							errdetail_internal("%s", wait_result_to_str(programResult))));
+		}
+	}
+	else
+	{
+		FreeFile(inputFile);
+	}
+}
+
+
 /*
  * SendRegularFile reads data from the given file, and sends these data to
  * stdout using the standard copy protocol. After all file data are sent, the
@@ -124,6 +262,31 @@ SendRegularFile(const char *filename)
 }
 
 
+/*
+ * SendRegularBuffer sends the given data to the client using the standard copy
+ * protocol, in the same way as SendRegularFile sends the contents of a file.
+ */
+void
+SendRegularBuffer(const char *data, Size length)
+{
+	const Size messageSize = 32768; /* 32 KB */
+	StringInfoData messageBuffer = { NULL, 0, 0, 0 };
+
+	SendCopyOutStart();
+
+	for (Size offset = 0; offset < length; offset += messageSize)
+	{
+		/* point the buffer into the data, SendCopyData only reads it */
+		messageBuffer.data = (char *) data + offset;
+		messageBuffer.len = Min(messageSize, length - offset);
+
+		SendCopyData(&messageBuffer);
+	}
+
+	SendCopyDone();
+}
+
+
 /* Helper function that deallocates string info object. */
 static void
 FreeStringInfo(StringInfo stringInfo)
@@ -164,6 +327,17 @@ FileOpenForTransmitPerm(const char *filename, int fileFlags, int fileMode)
 			ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
 							errmsg("\"%s\" is a directory", filename)));
 		}
+
+		/*
+		 * Replace existing files instead of truncating them in place, since
+		 * an intermediate result scan may have the old file mapped into memory
+		 * and reading a truncated mapping raises SIGBUS.
+		 */
+		if ((fileFlags & O_TRUNC) != 0 && unlink(filename) != 0 && errno != ENOENT)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not remove file \"%s\": %m", filename)));
+		}
 	}
 
 	File fileDesc = PathNameOpenFilePerm((char *) filename, fileFlags, fileMode);
@@ -179,17 +353,22 @@ FileOpenForTransmitPerm(const char *filename, int fileFlags, int fileMode)
 
 /*
  * SendCopyInStart sends the start copy in message to initiate receiving data
- * from stdin. The frontend should now send copy data.
+ * for columnCount columns in the given format from stdin. The frontend should
+ * now send copy data.
  */
 static void
-SendCopyInStart(void)
+SendCopyInStart(bool binaryFormat, int columnCount)
 {
 	StringInfoData copyInStart = { NULL, 0, 0, 0 };
-	const char copyFormat = 1; /* binary copy format */
+	const char copyFormat = binaryFormat ? 1 : 0;
 
 	pq_beginmessage(&copyInStart, 'G');
 	pq_sendbyte(&copyInStart, copyFormat);
-	pq_sendint(&copyInStart, 0, 2);
+	pq_sendint(&copyInStart, columnCount, 2);
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		pq_sendint(&copyInStart, copyFormat, 2);
+	}
 	pq_endmessage(&copyInStart);
 
 	/* flush here to ensure that FE knows it can send data */
@@ -65,6 +65,7 @@
 #include "distributed/citus_ruleutils.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/connection_management.h"
+#include "distributed/fast_path_query_cache.h"
 #include "distributed/foreign_key_relationship.h"
 #include "distributed/function_utils.h"
 #include "distributed/listutils.h"
@@ -4172,6 +4173,7 @@ InitializeCaches(void)
 			RegisterLocalGroupIdCacheCallbacks();
 			RegisterAuthinfoCacheCallbacks();
 			RegisterCitusTableCacheEntryReleaseCallbacks();
+			RegisterFastPathQueryCacheCallbacks();
 		}
 		PG_CATCH();
 		{
@@ -4781,6 +4783,7 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 		InvalidateDistTableCache();
 		InvalidateDistObjectCache();
 		InvalidateMetadataSystemCache();
+		InvalidateFastPathQueryCache();
 	}
 	else
 	{
@@ -4797,6 +4800,9 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 		if (foundInCache)
 		{
 			InvalidateCitusTableCacheEntrySlot(cacheSlot);
+
+			/* cached shard query strings may refer to the old table definition */
+			InvalidateFastPathQueryCache();
 		}
 
 		/*
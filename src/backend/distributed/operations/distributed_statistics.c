@@ -0,0 +1,798 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_statistics.c
+ *
+ * This file contains functions to collect the planner statistics of
+ * distributed tables from their shards, and to store them on the shell
+ * tables on the coordinator.
+ *
+ * The shell tables are empty, hence ANALYZE on the coordinator does not
+ * tell the postgres planner anything about the distributed tables. We
+ * instead read the row and page counts of all shards from the workers and
+ * store their sums in pg_class. Since rows are distributed over the shards
+ * by hash, a shard is a sample of its table, hence we also copy the column
+ * statistics of the largest shard into pg_statistic. The distribution
+ * column is the exception: its values are not shared between shards, so
+ * its number of distinct values is scaled with the number of shards and
+ * its most common values are skipped.
+ *
+ * The postgres planner takes the size of a table from the number of blocks
+ * of its relation file rather than from pg_class, so the planner hook
+ * replaces the size of empty shell tables with the collected one.
+ *
+ * Statistics are collected periodically by the maintenance daemon when
+ * citus.distributed_statistics_interval is set, or on demand via the
+ * citus_update_distributed_statistics UDF. In both cases the shards need to
+ * have been analyzed on the workers, by autovacuum or by ANALYZE. VACUUM and
+ * ANALYZE of the shell tables reset their row and page counts, hence they
+ * collect the statistics again for the tables that have collected statistics.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "commands/vacuum.h"
+#include "parser/parse_oper.h"
+#include "storage/lmgr.h"
+#include "nodes/pathnodes.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
+#include "distributed/coordinator_protocol.h"
+#include "distributed/distributed_statistics.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/relay_utility.h"
+#include "distributed/remote_commands.h"
+#include "distributed/worker_manager.h"
+
+/* managed via a GUC, 0 disables periodic collection */
+int DistributedStatisticsInterval = 0;
+
+
+/*
+ * NodeShardList contains the shards of a distributed table whose first
+ * active placement is on the given node.
+ */
+typedef struct NodeShardList
+{
+	int32 groupId;
+	char *nodeName;
+	int nodePort;
+	List *shardIntervalList;
+} NodeShardList;
+
+
+/*
+ * DistributedTableStatistics contains the statistics of the shards of a
+ * distributed table that are collected from the worker nodes.
+ */
+typedef struct DistributedTableStatistics
+{
+	/* number of shards that have an active placement */
+	int placedShardCount;
+
+	/* number of shards that have been analyzed, and their total size */
+	int analyzedShardCount;
+	double reltuples;
+	double relpages;
+
+	/* analyzed shard with the most rows, whose column statistics we copy */
+	uint64 sampleShardId;
+	double sampleShardTuples;
+	char *sampleNodeName;
+	int sampleNodePort;
+} DistributedTableStatistics;
+
+
+static bool HasCollectedStatistics(Oid relationId);
+static uint64 TotalShardLength(Oid relationId);
+static List * GroupShardsByFirstPlacement(Oid relationId, int *placedShardCount);
+static bool CollectShardRelationStatistics(NodeShardList *nodeShardList,
+										   DistributedTableStatistics *tableStatistics,
+										   int logLevel);
+static void UpdateColumnStatistics(Relation relation,
+								   DistributedTableStatistics *tableStatistics,
+								   double totalTuples, int logLevel);
+static void WriteColumnStatistics(Relation statisticRelation,
+								  Form_pg_attribute attribute, PGresult *result,
+								  int rowIndex, bool isDistributionColumn,
+								  int shardCount, double totalTuples);
+static Datum StatisticsArrayFromString(char *arrayString, Oid elementType,
+									   int32 typeMod);
+
+
+PG_FUNCTION_INFO_V1(citus_update_distributed_statistics);
+
+
+/*
+ * citus_update_distributed_statistics collects the statistics of the shards
+ * of the given distributed table and stores them on the shell table. It
+ * returns false if the statistics could not be collected.
+ */
+Datum
+citus_update_distributed_statistics(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	Oid relationId = PG_GETARG_OID(0);
+	EnsureTableOwner(relationId);
+
+	if (!IsCitusTableType(relationId, DISTRIBUTED_TABLE) &&
+		!IsCitusTableType(relationId, REFERENCE_TABLE))
+	{
+		ereport(ERROR, (errmsg("relation \"%s\" is not a distributed table",
+							   get_rel_name(relationId))));
+	}
+
+	/* ANALYZE takes the same lock to update the statistics */
+	LockRelationOid(relationId, ShareUpdateExclusiveLock);
+
+	bool statisticsUpdated = UpdateDistributedTableStatistics(relationId, WARNING);
+
+	PG_RETURN_BOOL(statisticsUpdated);
+}
+
+
+/*
+ * UpdateAllDistributedTableStatistics collects the statistics of all
+ * distributed and reference tables. Tables that are locked, for instance
+ * because they are being altered, are skipped until the next round.
+ */
+void
+UpdateAllDistributedTableStatistics(void)
+{
+	List *relationIdList = list_concat(CitusTableTypeIdList(DISTRIBUTED_TABLE),
+									   CitusTableTypeIdList(REFERENCE_TABLE));
+
+	Oid relationId = InvalidOid;
+	foreach_declared_oid(relationId, relationIdList)
+	{
+		if (!ConditionalLockRelationOid(relationId, ShareUpdateExclusiveLock))
+		{
+			continue;
+		}
+
+		/* the table might have been dropped or undistributed in the meantime */
+		if (SearchSysCacheExists1(RELOID, ObjectIdGetDatum(relationId)) &&
+			IsCitusTable(relationId))
+		{
+			UpdateDistributedTableStatistics(relationId, DEBUG1);
+		}
+
+		UnlockRelationOid(relationId, ShareUpdateExclusiveLock);
+	}
+}
+
+
+/*
+ * RefreshDistributedTableStatistics collects the statistics of the given
+ * distributed and reference tables again if they were collected before. It
+ * is called after VACUUM or ANALYZE, which reset the row and page counts of
+ * the shell tables to those of the empty shell tables.
+ */
+void
+RefreshDistributedTableStatistics(List *relationIdList)
+{
+	/* statistics are only collected on the coordinator */
+	if (!IsCoordinator())
+	{
+		return;
+	}
+
+	Oid relationId = InvalidOid;
+	foreach_declared_oid(relationId, relationIdList)
+	{
+		if ((!IsCitusTableType(relationId, DISTRIBUTED_TABLE) &&
+			 !IsCitusTableType(relationId, REFERENCE_TABLE)) ||
+			!HasCollectedStatistics(relationId))
+		{
+			continue;
+		}
+
+		LockRelationOid(relationId, ShareUpdateExclusiveLock);
+
+		UpdateDistributedTableStatistics(relationId, WARNING);
+	}
+}
+
+
+/*
+ * HasCollectedStatistics returns whether the column statistics of the given
+ * distributed table were collected. ANALYZE does not store column statistics
+ * for the empty shell tables, so those can only come from the shards.
+ */
+static bool
+HasCollectedStatistics(Oid relationId)
+{
+	bool hasStatistics = false;
+
+	Relation relation = relation_open(relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+
+	for (int attributeIndex = 0; attributeIndex < tupleDescriptor->natts;
+		 attributeIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, attributeIndex);
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		if (SearchSysCacheExists3(STATRELATTINH, ObjectIdGetDatum(relationId),
+								  Int16GetDatum(attribute->attnum),
+								  BoolGetDatum(false)))
+		{
+			hasStatistics = true;
+			break;
+		}
+	}
+
+	relation_close(relation, NoLock);
+
+	return hasStatistics;
+}
+
+
+/*
+ * AdjustDistributedRelationSize replaces the size that the postgres planner
+ * estimated for the empty shell table of a distributed or reference table
+ * with the collected size of its shards, if any.
+ */
+void
+AdjustDistributedRelationSize(Oid relationId, RelOptInfo *relOptInfo)
+{
+	if (!IsCitusTableType(relationId, DISTRIBUTED_TABLE) &&
+		!IsCitusTableType(relationId, REFERENCE_TABLE))
+	{
+		return;
+	}
+
+	HeapTuple classTuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relationId));
+	if (!HeapTupleIsValid(classTuple))
+	{
+		return;
+	}
+
+	Form_pg_class classForm = (Form_pg_class) GETSTRUCT(classTuple);
+	if (classForm->relpages > 0 && classForm->reltuples >= 0)
+	{
+		relOptInfo->pages = classForm->relpages;
+		relOptInfo->tuples = classForm->reltuples;
+	}
+
+	ReleaseSysCache(classTuple);
+}
+
+
+/*
+ * UpdateDistributedTableStatistics collects the statistics of the shards of
+ * the given distributed table and stores them on the shell table. The caller
+ * is expected to hold a lock on the table. Failures are reported at the given
+ * log level and the function returns false in that case.
+ */
+bool
+UpdateDistributedTableStatistics(Oid relationId, int logLevel)
+{
+	/* the shards of partitioned tables do not have statistics of their own */
+	if (get_rel_relkind(relationId) != RELKIND_RELATION)
+	{
+		return false;
+	}
+
+	DistributedTableStatistics tableStatistics;
+	memset(&tableStatistics, 0, sizeof(tableStatistics));
+
+	List *nodeShardListList =
+		GroupShardsByFirstPlacement(relationId, &tableStatistics.placedShardCount);
+
+	NodeShardList *nodeShardList = NULL;
+	foreach_declared_ptr(nodeShardList, nodeShardListList)
+	{
+		if (!CollectShardRelationStatistics(nodeShardList, &tableStatistics,
+											logLevel))
+		{
+			return false;
+		}
+	}
+
+	if (tableStatistics.analyzedShardCount == 0)
+	{
+		ereport(logLevel, (errmsg("shards of \"%s\" have not been analyzed, "
+								  "skipping statistics collection",
+								  get_rel_name(relationId))));
+		return false;
+	}
+
+	/* extrapolate to the shards that have not been analyzed yet */
+	double analyzedShardRatio = (double) tableStatistics.placedShardCount /
+								tableStatistics.analyzedShardCount;
+	double totalTuples = tableStatistics.reltuples * analyzedShardRatio;
+	double totalPages = tableStatistics.relpages * analyzedShardRatio;
+
+	Relation relation = relation_open(relationId, NoLock);
+
+	UpdateColumnStatistics(relation, &tableStatistics, totalTuples, logLevel);
+
+	bool frozenXidUpdated = false;
+	bool minMultiUpdated = false;
+
+	/*
+	 * The frozen xid and multixact of the shell table are left as they are,
+	 * and we might be in a transaction block when called via the UDF.
+	 */
+	vac_update_relstats(relation, (BlockNumber) Min(totalPages, MaxBlockNumber),
+						totalTuples, 0, relation->rd_rel->relhasindex,
+						InvalidTransactionId, InvalidMultiXactId,
+						&frozenXidUpdated, &minMultiUpdated, true);
+
+	relation_close(relation, NoLock);
+
+	return true;
+}
+
+
+/*
+ * ShellRelationSize returns the size of the given distributed table in bytes
+ * as recorded on the shell table by UpdateDistributedTableStatistics, or 0
+ * if the statistics of the table have not been collected.
+ */
+uint64
+ShellRelationSize(Oid relationId)
+{
+	HeapTuple classTuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relationId));
+	if (!HeapTupleIsValid(classTuple))
+	{
+		return 0;
+	}
+
+	Form_pg_class classForm = (Form_pg_class) GETSTRUCT(classTuple);
+	uint64 relationSize = (uint64) classForm->relpages * BLCKSZ;
+
+	ReleaseSysCache(classTuple);
+
+	return relationSize;
+}
+
+
+/*
+ * EstimatedDistributedTableSize returns the estimated size of the given
+ * distributed table in bytes, based on the shard sizes in the metadata or
+ * otherwise on the collected statistics, or 0 if the size is not known.
+ */
+uint64
+EstimatedDistributedTableSize(Oid relationId)
+{
+	uint64 relationSize = TotalShardLength(relationId);
+	if (relationSize == 0)
+	{
+		relationSize = ShellRelationSize(relationId);
+	}
+
+	return relationSize;
+}
+
+
+/*
+ * TotalShardLength returns the total size of the shards of the given
+ * distributed table, as recorded in the metadata. Shard sizes are not kept
+ * up to date for hash distributed tables, in which case this returns 0 unless
+ * they are updated via citus_update_shard_statistics.
+ */
+static uint64
+TotalShardLength(Oid relationId)
+{
+	uint64 totalShardLength = 0;
+
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+		if (placementList == NIL)
+		{
+			continue;
+		}
+
+		ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+		totalShardLength += placement->shardLength;
+	}
+
+	return totalShardLength;
+}
+
+
+/*
+ * GroupShardsByFirstPlacement returns a NodeShardList for each node that holds
+ * the first active placement of a shard of the given table, such that we can
+ * collect the statistics with a single query per node. The number of shards
+ * that have an active placement is written to placedShardCount.
+ */
+static List *
+GroupShardsByFirstPlacement(Oid relationId, int *placedShardCount)
+{
+	List *nodeShardListList = NIL;
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	ShardInterval *shardInterval = NULL;
+	foreach_declared_ptr(shardInterval, shardIntervalList)
+	{
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+		if (placementList == NIL)
+		{
+			continue;
+		}
+
+		ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+
+		NodeShardList *nodeShardList = NULL;
+		NodeShardList *existingNodeShardList = NULL;
+		foreach_declared_ptr(existingNodeShardList, nodeShardListList)
+		{
+			if (existingNodeShardList->groupId == placement->groupId)
+			{
+				nodeShardList = existingNodeShardList;
+				break;
+			}
+		}
+
+		if (nodeShardList == NULL)
+		{
+			nodeShardList = palloc0(sizeof(NodeShardList));
+			nodeShardList->groupId = placement->groupId;
+			nodeShardList->nodeName = placement->nodeName;
+			nodeShardList->nodePort = placement->nodePort;
+
+			nodeShardListList = lappend(nodeShardListList, nodeShardList);
+		}
+
+		nodeShardList->shardIntervalList =
+			lappend(nodeShardList->shardIntervalList, shardInterval);
+
+		(*placedShardCount)++;
+	}
+
+	return nodeShardListList;
+}
+
+
+/*
+ * CollectShardRelationStatistics reads the row and page counts of the given
+ * shards from pg_class on their node and adds them to tableStatistics. Shards
+ * that have never been analyzed are skipped.
+ */
+static bool
+CollectShardRelationStatistics(NodeShardList *nodeShardList,
+							   DistributedTableStatistics *tableStatistics,
+							   int logLevel)
+{
+	StringInfo shardIdArray = makeStringInfo();
+	StringInfo shardNameArray = makeStringInfo();
+
+	ShardInterval *shardInterval = NULL;
+	foreach_declared_ptr(shardInterval, nodeShardList->shardIntervalList)
+	{
+		if (shardIdArray->len > 0)
+		{
+			appendStringInfoChar(shardIdArray, ',');
+			appendStringInfoChar(shardNameArray, ',');
+		}
+
+		appendStringInfo(shardIdArray, UINT64_FORMAT, shardInterval->shardId);
+		appendStringInfoString(shardNameArray, quote_literal_cstr(
+								   ConstructQualifiedShardName(shardInterval)));
+	}
+
+	/* shards that are moved or dropped concurrently do not show up */
+	StringInfo statisticsQuery = makeStringInfo();
+	appendStringInfo(statisticsQuery,
+					 "SELECT s.shard_id, c.reltuples, c.relpages "
+					 "FROM ROWS FROM (pg_catalog.unnest(ARRAY[%s]::bigint[]), "
+					 "pg_catalog.unnest(ARRAY[%s]::text[])) AS s(shard_id, shard_name) "
+					 "JOIN pg_catalog.pg_class c "
+					 "ON (c.oid = pg_catalog.to_regclass(s.shard_name))",
+					 shardIdArray->data, shardNameArray->data);
+
+	uint32 connectionFlags = 0;
+	PGresult *result = NULL;
+	bool raiseErrors = false;
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags,
+													nodeShardList->nodeName,
+													nodeShardList->nodePort);
+	if (ExecuteOptionalRemoteCommand(connection, statisticsQuery->data, &result) !=
+		RESPONSE_OKAY)
+	{
+		ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
+						   errmsg("could not collect shard statistics from %s:%d",
+								  nodeShardList->nodeName,
+								  nodeShardList->nodePort)));
+		return false;
+	}
+
+	int rowCount = PQntuples(result);
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		uint64 shardId = SafeStringToUint64(PQgetvalue(result, rowIndex, 0));
+		double shardTuples = strtod(PQgetvalue(result, rowIndex, 1), NULL);
+		double shardPages = strtod(PQgetvalue(result, rowIndex, 2), NULL);
+
+		/* reltuples is -1 for tables that have never been vacuumed or analyzed */
+		if (shardTuples < 0)
+		{
+			continue;
+		}
+
+		tableStatistics->analyzedShardCount++;
+		tableStatistics->reltuples += shardTuples;
+		tableStatistics->relpages += shardPages;
+
+		if (shardTuples > tableStatistics->sampleShardTuples)
+		{
+			tableStatistics->sampleShardId = shardId;
+			tableStatistics->sampleShardTuples = shardTuples;
+			tableStatistics->sampleNodeName = nodeShardList->nodeName;
+			tableStatistics->sampleNodePort = nodeShardList->nodePort;
+		}
+	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	return true;
+}
+
+
+/*
+ * UpdateColumnStatistics copies the column statistics of the sample shard,
+ * as shown in pg_stats on its node, into pg_statistic for the shell table.
+ * Columns that the shard does not have statistics for are left alone.
+ */
+static void
+UpdateColumnStatistics(Relation relation, DistributedTableStatistics *tableStatistics,
+					   double totalTuples, int logLevel)
+{
+	if (tableStatistics->sampleShardId == INVALID_SHARD_ID)
+	{
+		return;
+	}
+
+	Oid relationId = RelationGetRelid(relation);
+	char *shardName = get_rel_name(relationId);
+	AppendShardIdToName(&shardName, tableStatistics->sampleShardId);
+
+	char *schemaName = get_namespace_name(RelationGetNamespace(relation));
+
+	StringInfo statisticsQuery = makeStringInfo();
+	appendStringInfo(statisticsQuery,
+					 "SELECT attname, null_frac, avg_width, n_distinct, "
+					 "most_common_vals, most_common_freqs, histogram_bounds, "
+					 "correlation FROM pg_catalog.pg_stats "
+					 "WHERE schemaname = %s AND tablename = %s AND NOT inherited",
+					 quote_literal_cstr(schemaName), quote_literal_cstr(shardName));
+
+	uint32 connectionFlags = 0;
+	PGresult *result = NULL;
+	bool raiseErrors = false;
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags,
+													tableStatistics->sampleNodeName,
+													tableStatistics->sampleNodePort);
+	if (ExecuteOptionalRemoteCommand(connection, statisticsQuery->data, &result) !=
+		RESPONSE_OKAY)
+	{
+		ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
+						   errmsg("could not collect column statistics from %s:%d",
+								  tableStatistics->sampleNodeName,
+								  tableStatistics->sampleNodePort)));
+		return;
+	}
+
+	AttrNumber distributionColumnAttrNumber = InvalidAttrNumber;
+	Var *distributionColumn = DistPartitionKey(relationId);
+	if (distributionColumn != NULL)
+	{
+		distributionColumnAttrNumber = distributionColumn->varattno;
+	}
+
+	Relation statisticRelation = table_open(StatisticRelationId, RowExclusiveLock);
+
+	int rowCount = PQntuples(result);
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		/* shards do not have dropped columns, hence we match columns by name */
+		char *attributeName = PQgetvalue(result, rowIndex, 0);
+		AttrNumber attributeNumber = get_attnum(relationId, attributeName);
+		if (attributeNumber == InvalidAttrNumber)
+		{
+			continue;
+		}
+
+		Form_pg_attribute attribute =
+			TupleDescAttr(RelationGetDescr(relation), attributeNumber - 1);
+		bool isDistributionColumn = attributeNumber == distributionColumnAttrNumber;
+
+		WriteColumnStatistics(statisticRelation, attribute, result, rowIndex,
+							  isDistributionColumn, tableStatistics->placedShardCount,
+							  totalTuples);
+	}
+
+	table_close(statisticRelation, RowExclusiveLock);
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+}
+
+
+/*
+ * WriteColumnStatistics inserts or updates the pg_statistic row of the given
+ * column based on the pg_stats row of a shard at rowIndex in result. Like
+ * ANALYZE, we store the most common values, the histogram and the correlation
+ * of the column, using the default operators of its type.
+ */
+static void
+WriteColumnStatistics(Relation statisticRelation, Form_pg_attribute attribute,
+					  PGresult *result, int rowIndex, bool isDistributionColumn,
+					  int shardCount, double totalTuples)
+{
+	int16 slotKinds[STATISTIC_NUM_SLOTS] = { 0 };
+	Oid slotOperators[STATISTIC_NUM_SLOTS] = { InvalidOid };
+	Oid slotCollations[STATISTIC_NUM_SLOTS] = { InvalidOid };
+	Datum slotNumbers[STATISTIC_NUM_SLOTS] = { 0 };
+	Datum slotValues[STATISTIC_NUM_SLOTS] = { 0 };
+	int slotCount = 0;
+
+	float4 nullFraction = strtod(PQgetvalue(result, rowIndex, 1), NULL);
+	int32 averageWidth = pg_strtoint32(PQgetvalue(result, rowIndex, 2));
+	float4 distinctCount = strtod(PQgetvalue(result, rowIndex, 3), NULL);
+
+	if (isDistributionColumn && distinctCount > 0)
+	{
+		/* each shard has its own distinct values of the distribution column */
+		distinctCount *= shardCount;
+
+		/* like ANALYZE, store the number as a fraction of the rows when it is large */
+		if (distinctCount > totalTuples * 0.1)
+		{
+			distinctCount = -Min(distinctCount / totalTuples, 1.0);
+		}
+	}
+
+	Oid lessThanOperator = InvalidOid;
+	Oid equalityOperator = InvalidOid;
+	get_sort_group_operators(attribute->atttypid, false, false, false,
+							 &lessThanOperator, &equalityOperator, NULL, NULL);
+
+	/* the text representation of arrays of arrays is ambiguous */
+	bool canCopyValues = !OidIsValid(get_element_type(attribute->atttypid));
+
+	/* the most common values of the distribution column are in a single shard */
+	if (canCopyValues && !isDistributionColumn && OidIsValid(equalityOperator) &&
+		!PQgetisnull(result, rowIndex, 4) && !PQgetisnull(result, rowIndex, 5))
+	{
+		slotKinds[slotCount] = STATISTIC_KIND_MCV;
+		slotOperators[slotCount] = equalityOperator;
+		slotCollations[slotCount] = attribute->attcollation;
+		slotValues[slotCount] =
+			StatisticsArrayFromString(PQgetvalue(result, rowIndex, 4),
+									  attribute->atttypid, attribute->atttypmod);
+		slotNumbers[slotCount] =
+			StatisticsArrayFromString(PQgetvalue(result, rowIndex, 5), FLOAT4OID, -1);
+		slotCount++;
+	}
+
+	if (canCopyValues && OidIsValid(lessThanOperator) &&
+		!PQgetisnull(result, rowIndex, 6))
+	{
+		slotKinds[slotCount] = STATISTIC_KIND_HISTOGRAM;
+		slotOperators[slotCount] = lessThanOperator;
+		slotCollations[slotCount] = attribute->attcollation;
+		slotValues[slotCount] =
+			StatisticsArrayFromString(PQgetvalue(result, rowIndex, 6),
+									  attribute->atttypid, attribute->atttypmod);
+		slotCount++;
+	}
+
+	if (OidIsValid(lessThanOperator) && !PQgetisnull(result, rowIndex, 7))
+	{
+		Datum correlation =
+			Float4GetDatum(strtod(PQgetvalue(result, rowIndex, 7), NULL));
+
+		slotKinds[slotCount] = STATISTIC_KIND_CORRELATION;
+		slotOperators[slotCount] = lessThanOperator;
+		slotCollations[slotCount] = attribute->attcollation;
+		slotNumbers[slotCount] =
+			PointerGetDatum(construct_array(&correlation, 1, FLOAT4OID,
+											sizeof(float4), true, TYPALIGN_INT));
+		slotCount++;
+	}
+
+	Datum values[Natts_pg_statistic];
+	bool nulls[Natts_pg_statistic];
+	bool replaces[Natts_pg_statistic];
+
+	memset(nulls, false, sizeof(nulls));
+	memset(replaces, true, sizeof(replaces));
+
+	values[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(attribute->attrelid);
+	values[Anum_pg_statistic_staattnum - 1] = Int16GetDatum(attribute->attnum);
+	values[Anum_pg_statistic_stainherit - 1] = BoolGetDatum(false);
+	values[Anum_pg_statistic_stanullfrac - 1] = Float4GetDatum(nullFraction);
+	values[Anum_pg_statistic_stawidth - 1] = Int32GetDatum(averageWidth);
+	values[Anum_pg_statistic_stadistinct - 1] = Float4GetDatum(distinctCount);
+
+	for (int slotIndex = 0; slotIndex < STATISTIC_NUM_SLOTS; slotIndex++)
+	{
+		values[Anum_pg_statistic_stakind1 - 1 + slotIndex] =
+			Int16GetDatum(slotKinds[slotIndex]);
+		values[Anum_pg_statistic_staop1 - 1 + slotIndex] =
+			ObjectIdGetDatum(slotOperators[slotIndex]);
+		values[Anum_pg_statistic_stacoll1 - 1 + slotIndex] =
+			ObjectIdGetDatum(slotCollations[slotIndex]);
+
+		values[Anum_pg_statistic_stanumbers1 - 1 + slotIndex] = slotNumbers[slotIndex];
+		nulls[Anum_pg_statistic_stanumbers1 - 1 + slotIndex] =
+			slotNumbers[slotIndex] == (Datum) 0;
+
+		values[Anum_pg_statistic_stavalues1 - 1 + slotIndex] = slotValues[slotIndex];
+		nulls[Anum_pg_statistic_stavalues1 - 1 + slotIndex] =
+			slotValues[slotIndex] == (Datum) 0;
+	}
+
+	HeapTuple statisticTuple = NULL;
+	HeapTuple oldStatisticTuple = SearchSysCache3(STATRELATTINH,
+												  ObjectIdGetDatum(attribute->attrelid),
+												  Int16GetDatum(attribute->attnum),
+												  BoolGetDatum(false));
+	if (HeapTupleIsValid(oldStatisticTuple))
+	{
+		statisticTuple = heap_modify_tuple(oldStatisticTuple,
+										   RelationGetDescr(statisticRelation),
+										   values, nulls, replaces);
+		ReleaseSysCache(oldStatisticTuple);
+
+		CatalogTupleUpdate(statisticRelation, &statisticTuple->t_self, statisticTuple);
+	}
+	else
+	{
+		statisticTuple = heap_form_tuple(RelationGetDescr(statisticRelation),
+										 values, nulls);
+
+		CatalogTupleInsert(statisticRelation, statisticTuple);
+	}
+
+	heap_freetuple(statisticTuple);
+}
+
+
+/*
+ * StatisticsArrayFromString parses the text representation of an array of
+ * the given element type, as shown in pg_stats.
+ */
+static Datum
+StatisticsArrayFromString(char *arrayString, Oid elementType, int32 typeMod)
+{
+	return OidInputFunctionCall(F_ARRAY_IN, arrayString, elementType, typeMod);
+}
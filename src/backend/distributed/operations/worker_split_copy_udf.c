@@ -332,7 +332,8 @@ CreatePartitionedSplitCopyDestReceiver(EState *estate,
 		shardSearchInfo,
 		shardCopyDestReceivers,
 		true /* lazyStartup */,
-		false /* allowNullPartitionColumnValues */);
+		false /* allowNullPartitionColumnValues */,
+		NULL /* joinKeyFilter */);
 
 	return splitCopyDestReceiver;
 }
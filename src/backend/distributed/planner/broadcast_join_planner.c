@@ -0,0 +1,282 @@
+/*-------------------------------------------------------------------------
+ *
+ * broadcast_join_planner.c
+ *
+ * This file contains functions to recursively plan small distributed
+ * tables that are joined with large distributed tables which they are
+ * not co-located with.
+ *
+ * Without it, such joins are planned as repartition joins, which shuffle
+ * the rows of both tables across the cluster, or fail when repartition
+ * joins are disabled. When one of the tables is small, it is usually much
+ * cheaper to compute its (filtered) rows once and to send them to all the
+ * nodes that run tasks of the query, which is what recursive planning does
+ * with intermediate results. The remaining join then no longer contains
+ * non-co-located distributed tables.
+ *
+ * ```sql
+ * -- assuming the estimated size of dim is below citus.broadcast_join_threshold
+ * SELECT * FROM fact JOIN dim ON (fact.dim_id = dim.id) WHERE dim.name = 'x';
+ * ```
+ *
+ * is planned as
+ *
+ * ```sql
+ * SELECT * FROM fact JOIN (SELECT id, name FROM dim WHERE name = 'x') dim
+ *   ON (fact.dim_id = dim.id);
+ * ```
+ *
+ * where the subquery on dim is recursively planned.
+ *
+ * The estimated size of a table is the total size of its shards, as
+ * recorded in pg_dist_placement or, failing that, as collected on the shell
+ * table by citus_update_distributed_statistics, multiplied by the
+ * selectivity that the postgres planner estimates for the filters on the
+ * table. Tables of unknown size are never broadcast. The largest distributed table in
+ * the join, and the tables that are co-located with it, are never broadcast
+ * either.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "nodes/pathnodes.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/restrictinfo.h"
+#include "parser/parsetree.h"
+#include "utils/lsyscache.h"
+
+#include "pg_version_constants.h"
+
+#include "distributed/broadcast_join_planner.h"
+#include "distributed/distributed_statistics.h"
+#include "distributed/listutils.h"
+#include "distributed/local_distributed_join_planner.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/recursive_planning.h"
+#include "distributed/relation_restriction_equivalence.h"
+#include "distributed/version_compat.h"
+
+/* managed via a GUC, 0 disables broadcast joins */
+int BroadcastJoinThreshold = 0;
+
+
+/*
+ * BroadcastCandidate contains the estimated size of a distributed table in
+ * a join.
+ */
+typedef struct BroadcastCandidate
+{
+	RangeTblEntry *rangeTableEntry;
+	uint32 colocationId;
+
+	/* estimated size of the filtered table in bytes, -1 if unknown */
+	double estimatedSize;
+} BroadcastCandidate;
+
+
+static List * BroadcastCandidateList(Query *query,
+									 PlannerRestrictionContext *plannerRestrictionContext);
+static double EstimatedFilteredRelationSize(RangeTblEntry *rangeTableEntry,
+											PlannerRestrictionContext *
+											plannerRestrictionContext);
+static bool IsDistributedTableRTE(Node *node);
+
+
+/*
+ * ShouldRecursivelyPlanSmallDistributedTables returns true if broadcast
+ * joins are enabled and the query joins multiple distributed tables.
+ */
+bool
+ShouldRecursivelyPlanSmallDistributedTables(Query *query)
+{
+	if (BroadcastJoinThreshold <= 0)
+	{
+		return false;
+	}
+
+	/* the target relation of modifications cannot be recursively planned */
+	if (query->commandType != CMD_SELECT)
+	{
+		return false;
+	}
+
+	int distributedTableCount = 0;
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_declared_ptr(rangeTableEntry, query->rtable)
+	{
+		if (IsDistributedTableRTE((Node *) rangeTableEntry))
+		{
+			distributedTableCount++;
+		}
+	}
+
+	return distributedTableCount > 1;
+}
+
+
+/*
+ * RecursivelyPlanSmallDistributedTables recursively plans the distributed
+ * tables in the query whose estimated size is below the broadcast join
+ * threshold, except for the largest distributed table and the tables that
+ * are co-located with it.
+ */
+void
+RecursivelyPlanSmallDistributedTables(Query *query, RecursivePlanningContext *context)
+{
+	PlannerRestrictionContext *plannerRestrictionContext =
+		GetPlannerRestrictionContext(context);
+
+	/*
+	 * The intermediate results would end up on the inner side of outer joins,
+	 * which we leave to the existing outer join logic.
+	 */
+	if (plannerRestrictionContext->joinRestrictionContext->hasOuterJoin)
+	{
+		return;
+	}
+
+	List *candidateList = BroadcastCandidateList(query, plannerRestrictionContext);
+
+	BroadcastCandidate *largestCandidate = NULL;
+	BroadcastCandidate *candidate = NULL;
+	foreach_declared_ptr(candidate, candidateList)
+	{
+		/* tables of unknown size might be large */
+		if (candidate->estimatedSize < 0)
+		{
+			return;
+		}
+
+		if (largestCandidate == NULL ||
+			candidate->estimatedSize > largestCandidate->estimatedSize)
+		{
+			largestCandidate = candidate;
+		}
+	}
+
+	double threshold = (double) BroadcastJoinThreshold * 1024;
+
+	foreach_declared_ptr(candidate, candidateList)
+	{
+		if (candidate == largestCandidate ||
+			candidate->colocationId == largestCandidate->colocationId ||
+			candidate->estimatedSize > threshold)
+		{
+			continue;
+		}
+
+		RangeTblEntry *rangeTableEntry = candidate->rangeTableEntry;
+
+		ereport(DEBUG1, (errmsg("broadcasting %s since its estimated size is "
+								"below citus.broadcast_join_threshold",
+								get_rel_name(rangeTableEntry->relid))));
+
+		List *requiredAttributeNumbers =
+			RequiredAttrNumbersForRelation(rangeTableEntry, plannerRestrictionContext);
+
+		RTEPermissionInfo *perminfo = NULL;
+#if PG_VERSION_NUM >= PG_VERSION_16
+		if (rangeTableEntry->perminfoindex)
+		{
+			perminfo = getRTEPermissionInfo(query->rteperminfos, rangeTableEntry);
+		}
+#endif
+
+		ReplaceRTERelationWithRteSubquery(rangeTableEntry, requiredAttributeNumbers,
+										  context, perminfo);
+	}
+}
+
+
+/*
+ * BroadcastCandidateList returns a BroadcastCandidate for each of the
+ * distributed tables in the range table of the query.
+ */
+static List *
+BroadcastCandidateList(Query *query, PlannerRestrictionContext *plannerRestrictionContext)
+{
+	List *candidateList = NIL;
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_declared_ptr(rangeTableEntry, query->rtable)
+	{
+		if (!IsDistributedTableRTE((Node *) rangeTableEntry))
+		{
+			continue;
+		}
+
+		CitusTableCacheEntry *cacheEntry =
+			GetCitusTableCacheEntry(rangeTableEntry->relid);
+
+		BroadcastCandidate *candidate = palloc0(sizeof(BroadcastCandidate));
+		candidate->rangeTableEntry = rangeTableEntry;
+		candidate->colocationId = cacheEntry->colocationId;
+		candidate->estimatedSize =
+			EstimatedFilteredRelationSize(rangeTableEntry, plannerRestrictionContext);
+
+		candidateList = lappend(candidateList, candidate);
+	}
+
+	return candidateList;
+}
+
+
+/*
+ * EstimatedFilteredRelationSize returns the estimated size in bytes of the rows
+ * of the given distributed table that pass the filters on it in the query, or
+ * -1 if the size of the table is not known.
+ */
+static double
+EstimatedFilteredRelationSize(RangeTblEntry *rangeTableEntry,
+							  PlannerRestrictionContext *plannerRestrictionContext)
+{
+	uint64 relationSize = EstimatedDistributedTableSize(rangeTableEntry->relid);
+	if (relationSize == 0)
+	{
+		return -1;
+	}
+
+	RelationRestriction *relationRestriction =
+		RelationRestrictionForRelation(rangeTableEntry, plannerRestrictionContext);
+	if (relationRestriction == NULL)
+	{
+		return relationSize;
+	}
+
+	RelOptInfo *relOptInfo = relationRestriction->relOptInfo;
+	Selectivity selectivity =
+		clauselist_selectivity(relationRestriction->plannerInfo,
+							   get_all_actual_clauses(relOptInfo->baserestrictinfo),
+							   relOptInfo->relid, JOIN_INNER, NULL);
+
+	return relationSize * selectivity;
+}
+
+
+/*
+ * IsDistributedTableRTE returns whether the given node is a range table
+ * entry of a distributed table with a distribution key.
+ */
+static bool
+IsDistributedTableRTE(Node *node)
+{
+	if (node == NULL || !IsA(node, RangeTblEntry))
+	{
+		return false;
+	}
+
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+	if (!IsRecursivelyPlannableRelation(rangeTableEntry))
+	{
+		return false;
+	}
+
+	return IsCitusTableType(rangeTableEntry->relid, DISTRIBUTED_TABLE) &&
+		   HasDistributionKey(rangeTableEntry->relid);
+}
@@ -9,6 +9,8 @@
  *-------------------------------------------------------------------------
  */
 
+#include <ctype.h>
+
 #include "postgres.h"
 
 #include "c.h"
@@ -24,6 +26,7 @@
 #include "nodes/pg_list.h"
 #include "parser/parsetree.h"
 #include "storage/lock.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
@@ -38,16 +41,35 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/relay_utility.h"
 #include "distributed/shard_utils.h"
 #include "distributed/utils/citus_stat_tenants.h"
 #include "distributed/version_compat.h"
 
 
+/*
+ * ShardNameSubstitution describes a schema-qualified shard name that appears
+ * in the query string of a template task, and the shard name that replaces it
+ * in the query string of a task that accesses another shard.
+ */
+typedef struct ShardNameSubstitution
+{
+	char *sourceName;
+	int sourceNameLength;
+	char *targetName;
+} ShardNameSubstitution;
+
+
 static void UpdateTaskQueryString(Query *query, Task *task);
 static RelationShard * FindRelationShard(Oid inputRelationId, List *relationShardList);
 static void ConvertRteToSubqueryWithEmptyResult(RangeTblEntry *rte);
 static bool ShouldLazyDeparseQuery(Task *task);
 static char * DeparseTaskQuery(Task *task, Query *query);
+static List * ShardNameSubstitutionList(List *sourceRelationShardList,
+										List *targetRelationShardList);
+static char * QualifiedShardName(RelationShard *relationShard);
+static bool IsShardNameBoundary(const char *queryString, const char *position,
+								const char *name, int nameLength);
 
 
 /*
@@ -550,3 +572,188 @@ TaskQueryString(Task *task)
 	SetTaskQueryString(task, queryString);
 	return task->taskQuery.data.queryStringLazy;
 }
+
+
+/*
+ * CanDeriveQueryStringFromTask returns whether the query string of the given
+ * task can be derived from the query string of the template task by replacing
+ * the names of the shards in the template task with the names of the shards
+ * in the task.
+ *
+ * Both tasks are expected to be deparsed from the same query. We verify that
+ * the substitution indeed yields the deparsed query string of the task, such
+ * that shard names that happen to also appear elsewhere in the query string,
+ * for instance in a string literal, do not lead to a wrong query.
+ */
+bool
+CanDeriveQueryStringFromTask(Task *templateTask, Task *task)
+{
+	if (GetTaskQueryType(templateTask) != TASK_QUERY_TEXT ||
+		GetTaskQueryType(task) != TASK_QUERY_TEXT)
+	{
+		return false;
+	}
+
+	if (list_length(templateTask->relationShardList) !=
+		list_length(task->relationShardList))
+	{
+		return false;
+	}
+
+	RelationShard *templateRelationShard = NULL;
+	RelationShard *relationShard = NULL;
+	forboth_ptr(templateRelationShard, templateTask->relationShardList,
+				relationShard, task->relationShardList)
+	{
+		if (templateRelationShard->relationId != relationShard->relationId)
+		{
+			return false;
+		}
+	}
+
+	char *derivedQueryString =
+		DeriveQueryStringFromTask(templateTask, task->relationShardList);
+
+	return strcmp(derivedQueryString, TaskQueryString(task)) == 0;
+}
+
+
+/*
+ * DeriveQueryStringFromTask returns the query string of the template task with
+ * the shard names replaced by the names of the shards in the given relation
+ * shard list, which is expected to list the same relations as the relation
+ * shard list of the template task. This is considerably cheaper than deparsing
+ * the query for every shard.
+ */
+char *
+DeriveQueryStringFromTask(Task *templateTask, List *relationShardList)
+{
+	char *templateQueryString = TaskQueryString(templateTask);
+	List *substitutionList =
+		ShardNameSubstitutionList(templateTask->relationShardList, relationShardList);
+
+	if (substitutionList == NIL)
+	{
+		return pstrdup(templateQueryString);
+	}
+
+	StringInfo queryString = makeStringInfo();
+	const char *position = templateQueryString;
+
+	while (*position != '\0')
+	{
+		ShardNameSubstitution *matchingSubstitution = NULL;
+
+		ShardNameSubstitution *substitution = NULL;
+		foreach_declared_ptr(substitution, substitutionList)
+		{
+			if (strncmp(position, substitution->sourceName,
+						substitution->sourceNameLength) == 0 &&
+				IsShardNameBoundary(templateQueryString, position,
+									substitution->sourceName,
+									substitution->sourceNameLength))
+			{
+				matchingSubstitution = substitution;
+				break;
+			}
+		}
+
+		if (matchingSubstitution != NULL)
+		{
+			appendStringInfoString(queryString, matchingSubstitution->targetName);
+			position += matchingSubstitution->sourceNameLength;
+		}
+		else
+		{
+			appendStringInfoChar(queryString, *position);
+			position++;
+		}
+	}
+
+	return queryString->data;
+}
+
+
+/*
+ * ShardNameSubstitutionList returns a list of ShardNameSubstitutions for the
+ * relations whose shards differ between the two relation shard lists.
+ */
+static List *
+ShardNameSubstitutionList(List *sourceRelationShardList, List *targetRelationShardList)
+{
+	List *substitutionList = NIL;
+
+	Assert(list_length(sourceRelationShardList) ==
+		   list_length(targetRelationShardList));
+
+	RelationShard *sourceRelationShard = NULL;
+	RelationShard *targetRelationShard = NULL;
+	forboth_ptr(sourceRelationShard, sourceRelationShardList,
+				targetRelationShard, targetRelationShardList)
+	{
+		Assert(sourceRelationShard->relationId == targetRelationShard->relationId);
+
+		if (sourceRelationShard->shardId == targetRelationShard->shardId)
+		{
+			/* e.g. reference tables access the same shard in all tasks */
+			continue;
+		}
+
+		ShardNameSubstitution *substitution = palloc0(sizeof(ShardNameSubstitution));
+		substitution->sourceName = QualifiedShardName(sourceRelationShard);
+		substitution->sourceNameLength = strlen(substitution->sourceName);
+		substitution->targetName = QualifiedShardName(targetRelationShard);
+
+		substitutionList = lappend(substitutionList, substitution);
+	}
+
+	return substitutionList;
+}
+
+
+/*
+ * QualifiedShardName returns the schema-qualified name of the shard in the
+ * given relation shard in the same form as the deparser prints it.
+ */
+static char *
+QualifiedShardName(RelationShard *relationShard)
+{
+	char *shardName = get_rel_name(relationShard->relationId);
+	AppendShardIdToName(&shardName, relationShard->shardId);
+
+	Oid schemaId = get_rel_namespace(relationShard->relationId);
+	char *schemaName = get_namespace_name(schemaId);
+
+	return quote_qualified_identifier(schemaName, shardName);
+}
+
+
+/*
+ * IsShardNameBoundary returns whether the name that starts at the given
+ * position of the query string is not merely a part of a longer identifier.
+ */
+static bool
+IsShardNameBoundary(const char *queryString, const char *position,
+					const char *name, int nameLength)
+{
+	if (position > queryString)
+	{
+		char previousChar = *(position - 1);
+		if (isalnum((unsigned char) previousChar) || previousChar == '_' ||
+			previousChar == '$' || previousChar == '.' || previousChar == '"')
+		{
+			return false;
+		}
+	}
+
+	if (name[nameLength - 1] != '"')
+	{
+		char nextChar = position[nameLength];
+		if (isalnum((unsigned char) nextChar) || nextChar == '_' || nextChar == '$')
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -48,9 +48,11 @@
 #include "distributed/coordinator_protocol.h"
 #include "distributed/cte_inline.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/distributed_statistics.h"
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/intermediate_result_pruning.h"
+#include "distributed/intermediate_result_scan.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/merge_planner.h"
@@ -1973,6 +1975,7 @@ multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
 
 	AdjustReadIntermediateResultCost(rte, relOptInfo);
 	AdjustReadIntermediateResultArrayCost(rte, relOptInfo);
+	ReplaceReadIntermediateResultPath(rte, relOptInfo);
 
 	if (rte->rtekind != RTE_RELATION)
 	{
@@ -2042,6 +2045,9 @@ multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
  * if necessary, to avoid a crash in PG16 caused by our
  * Citus function AdjustPartitioningForDistributedPlanning().
  *
+ * It also replaces the size of the empty shell tables of distributed tables
+ * with the size collected from their shards, if any.
+ *
  * AdjustPartitioningForDistributedPlanning() is a hack that we use
  * to prevent Postgres' standard_planner() to expand all the partitions
  * for the distributed planning when a distributed partitioned table
@@ -2064,6 +2070,11 @@ multi_get_relation_info_hook(PlannerInfo *root, Oid relationObjectId, bool inhpa
 		return;
 	}
 
+	if (!inhparent && IsCitusTable(relationObjectId))
+	{
+		AdjustDistributedRelationSize(relationObjectId, rel);
+	}
+
 	Index varno = rel->relid;
 	RangeTblEntry *rangeTableEntry = planner_rt_fetch(varno, root);
 
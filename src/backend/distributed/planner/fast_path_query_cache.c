@@ -0,0 +1,653 @@
+/*-------------------------------------------------------------------------
+ *
+ * fast_path_query_cache.c
+ *   Cache of the shard query strings of fast path router queries that is
+ *   shared across backends.
+ *
+ * For fast path router queries, we defer shard pruning to the executor, at
+ * which point we deparse the query for the shard the distribution key value
+ * prunes to. With many (pooled) backends executing the same statements, each
+ * backend deparses the same query strings over and over again. Instead, we
+ * keep the deparsed query strings in a hash in shared memory, keyed by the
+ * database, the shard and a key of the statement, which consists of the text
+ * of the statement, the parameter values and the settings that affect how the
+ * statement text is resolved. The hash is looked up by a hash of the statement
+ * key, the full statement key is kept in the entry and compared on lookup.
+ *
+ * Entries are invalidated by bumping a generation counter from the metadata
+ * cache invalidation callbacks. A query string is only cached if the
+ * generation did not change while it was being deparsed, and a cached query
+ * string is only used if the generation did not change since it was cached.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "catalog/namespace.h"
+#include "catalog/pg_type.h"
+#include "common/hashfn.h"
+#include "nodes/nodeFuncs.h"
+#include "parser/parser.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+
+#include "distributed/deparse_shard_query.h"
+#include "distributed/fast_path_query_cache.h"
+#include "distributed/local_executor.h"
+#include "distributed/relay_utility.h"
+#include "distributed/utils/citus_stat_tenants.h"
+
+
+/*
+ * The data structure used to store data in shared memory. The cached query
+ * strings are kept in a separately allocated hash map.
+ */
+typedef struct FastPathQueryCacheSharedData
+{
+	int fastPathQueryCacheTrancheId;
+	char *fastPathQueryCacheTrancheName;
+
+	LWLock fastPathQueryCacheLock;
+
+	/* bumped whenever metadata that affects the query strings changes */
+	pg_atomic_uint64 generation;
+
+	/* generation at which we last removed outdated entries */
+	uint64 lastEvictionGeneration;
+} FastPathQueryCacheSharedData;
+
+
+typedef struct FastPathQueryCacheHashKey
+{
+	Oid databaseId;
+	uint64 statementKeyHash;
+	uint64 shardId;
+} FastPathQueryCacheHashKey;
+
+
+/* hash entry for a cached shard query string */
+typedef struct FastPathQueryCacheHashEntry
+{
+	FastPathQueryCacheHashKey key;
+
+	/* generation of the cache at the time we deparsed the query */
+	uint64 generation;
+
+	/* full key of the statement, to tell apart statements with the same hash */
+	char statementKey[FAST_PATH_QUERY_CACHE_MAX_KEY_LENGTH];
+
+	char queryString[FAST_PATH_QUERY_CACHE_MAX_QUERY_LENGTH];
+} FastPathQueryCacheHashEntry;
+
+
+/* GUC, maximum number of query strings in the cache, 0 disables the cache */
+int FastPathQueryCacheSize = 0;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *FastPathQueryCacheHash = NULL;
+static FastPathQueryCacheSharedData *FastPathQueryCacheState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static bool ContainsConstWithUnstableOutput(Node *node, void *context);
+static bool TypeHasStableOutput(Oid typeId);
+static void AppendStatementKeyPart(StringInfo statementKey, const char *part,
+								   int partLength);
+static bool AppendParamListInfo(StringInfo statementKey, ParamListInfo paramListInfo);
+static void InitializeFastPathQueryCacheHashKey(FastPathQueryCacheHashKey *key,
+												char *statementKey, uint64 shardId);
+static char * GetCachedQueryString(FastPathQueryCacheHashKey *key, char *statementKey,
+								   uint64 generation);
+static void StoreQueryString(FastPathQueryCacheHashKey *key, char *statementKey,
+							 uint64 generation, char *queryString);
+static void EvictFastPathQueryCacheEntries(uint64 generation);
+static void InvalidateFastPathQueryCacheCallback(Datum argument, int cacheId,
+												 uint32 hashValue);
+
+
+/*
+ * FastPathQueryCacheKey returns the key of the statement that the given job
+ * query belongs to, after its parameters were evaluated into the job query.
+ * Together with the shard ID, the key determines the shard query string. The
+ * function returns NULL if the query string of the statement should not be
+ * cached.
+ *
+ * The source text may contain several statements, for instance in a simple
+ * query message with multiple statements or in a SQL function, hence we only
+ * use the text of the statement itself, which we find through the location
+ * and length of the statement in the source text.
+ */
+char *
+FastPathQueryCacheKey(Query *jobQuery, ParamListInfo paramListInfo,
+					  const char *sourceText)
+{
+	if (FastPathQueryCacheState == NULL || sourceText == NULL)
+	{
+		return NULL;
+	}
+
+	/* we cannot use parameters that are fetched on demand (e.g. PL/pgSQL) */
+	if (paramListInfo != NULL && paramListInfo->paramFetch != NULL)
+	{
+		return NULL;
+	}
+
+	/* the deparsed form of e.g. dates depends on the settings of the backend */
+	if (ContainsConstWithUnstableOutput((Node *) jobQuery, NULL))
+	{
+		return NULL;
+	}
+
+	/* the location is unknown when the query does not come from the source text */
+	int sourceTextLength = strlen(sourceText);
+	int statementLocation = jobQuery->stmt_location;
+	int statementLength = jobQuery->stmt_len;
+	if (statementLocation < 0 || statementLocation >= sourceTextLength)
+	{
+		return NULL;
+	}
+
+	/* a length of 0 means the rest of the source text */
+	if (statementLength <= 0 ||
+		statementLength > sourceTextLength - statementLocation)
+	{
+		statementLength = sourceTextLength - statementLocation;
+	}
+
+	StringInfo statementKey = makeStringInfo();
+
+	AppendStatementKeyPart(statementKey, sourceText + statementLocation,
+						   statementLength);
+
+	/* object names in the statement text may resolve differently per user */
+	appendStringInfo(statementKey, "%u:%d:%d:", GetUserId(),
+					 standard_conforming_strings, StatTenantsTrack);
+
+	const char *searchPath = namespace_search_path != NULL ? namespace_search_path : "";
+	AppendStatementKeyPart(statementKey, searchPath, strlen(searchPath));
+
+	if (!AppendParamListInfo(statementKey, paramListInfo) ||
+		statementKey->len >= FAST_PATH_QUERY_CACHE_MAX_KEY_LENGTH)
+	{
+		return NULL;
+	}
+
+	return statementKey->data;
+}
+
+
+/*
+ * AppendStatementKeyPart appends the given part to the statement key, prefixed
+ * by its length such that different parts never produce the same key.
+ */
+static void
+AppendStatementKeyPart(StringInfo statementKey, const char *part, int partLength)
+{
+	appendStringInfo(statementKey, "%d:", partLength);
+	appendBinaryStringInfo(statementKey, part, partLength);
+}
+
+
+/*
+ * ContainsConstWithUnstableOutput returns whether the given node contains a
+ * constant of a type whose text representation may differ across backends.
+ */
+static bool
+ContainsConstWithUnstableOutput(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Const))
+	{
+		Const *constNode = (Const *) node;
+
+		return !constNode->constisnull && !TypeHasStableOutput(constNode->consttype);
+	}
+
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ContainsConstWithUnstableOutput,
+								 context, 0);
+	}
+
+	return expression_tree_walker(node, ContainsConstWithUnstableOutput, context);
+}
+
+
+/*
+ * TypeHasStableOutput returns whether the output function of the given type
+ * does not depend on any settings, such as DateStyle or extra_float_digits.
+ */
+static bool
+TypeHasStableOutput(Oid typeId)
+{
+	switch (typeId)
+	{
+		case BOOLOID:
+		case CHAROID:
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case OIDOID:
+		case NAMEOID:
+		case TEXTOID:
+		case VARCHAROID:
+		case BPCHAROID:
+		case NUMERICOID:
+		case UUIDOID:
+		{
+			return true;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * AppendParamListInfo appends the types and the hex encoded values of the
+ * parameters in the given parameter list to the statement key. It returns
+ * false if the key would become too long to be cached.
+ */
+static bool
+AppendParamListInfo(StringInfo statementKey, ParamListInfo paramListInfo)
+{
+	if (paramListInfo == NULL)
+	{
+		return true;
+	}
+
+	for (int paramIndex = 0; paramIndex < paramListInfo->numParams; paramIndex++)
+	{
+		ParamExternData *param = &paramListInfo->params[paramIndex];
+
+		appendStringInfo(statementKey, "%u:%d:", param->ptype, param->isnull);
+
+		if (param->isnull || !OidIsValid(param->ptype))
+		{
+			continue;
+		}
+
+		int16 typeLength = 0;
+		bool typeByValue = false;
+		get_typlenbyval(param->ptype, &typeLength, &typeByValue);
+
+		const char *valueBytes = NULL;
+		Size valueSize = 0;
+
+		if (typeByValue)
+		{
+			valueBytes = (const char *) &param->value;
+			valueSize = sizeof(Datum);
+		}
+		else
+		{
+			Datum value = param->value;
+			if (typeLength == -1)
+			{
+				value = PointerGetDatum(PG_DETOAST_DATUM_PACKED(value));
+			}
+
+			valueBytes = DatumGetPointer(value);
+			valueSize = datumGetSize(value, typeByValue, typeLength);
+		}
+
+		if (statementKey->len + 2 * valueSize >= FAST_PATH_QUERY_CACHE_MAX_KEY_LENGTH)
+		{
+			return false;
+		}
+
+		char *hexValue = palloc(2 * valueSize + 1);
+		uint64 hexLength = hex_encode(valueBytes, valueSize, hexValue);
+
+		AppendStatementKeyPart(statementKey, hexValue, (int) hexLength);
+	}
+
+	return true;
+}
+
+
+/*
+ * SetTaskQueryFromFastPathQueryCache sets the query of a fast path task that
+ * accesses the given shard. If the statement can be cached, we take the query
+ * string from the cache or add it to the cache after deparsing the query.
+ */
+void
+SetTaskQueryFromFastPathQueryCache(Task *task, Query *query,
+								   char *statementKey, uint64 shardId)
+{
+	/*
+	 * Local execution does not need the query string, we keep deparsing lazily
+	 * for tasks that might be executed locally.
+	 */
+	if (statementKey == NULL || FastPathQueryCacheState == NULL ||
+		shardId == INVALID_SHARD_ID || TaskAccessesLocalNode(task))
+	{
+		SetTaskQueryIfShouldLazyDeparse(task, query);
+		return;
+	}
+
+	FastPathQueryCacheHashKey key;
+	InitializeFastPathQueryCacheHashKey(&key, statementKey, shardId);
+
+	uint64 generation = pg_atomic_read_u64(&FastPathQueryCacheState->generation);
+
+	char *cachedQueryString = GetCachedQueryString(&key, statementKey, generation);
+	if (cachedQueryString != NULL)
+	{
+		SetTaskQueryString(task, cachedQueryString);
+		return;
+	}
+
+	SetTaskQueryIfShouldLazyDeparse(task, query);
+
+	if (GetTaskQueryType(task) == TASK_QUERY_TEXT)
+	{
+		StoreQueryString(&key, statementKey, generation, TaskQueryString(task));
+	}
+}
+
+
+/*
+ * InitializeFastPathQueryCacheHashKey fills the hash key for the given
+ * statement key and shard in the current database.
+ */
+static void
+InitializeFastPathQueryCacheHashKey(FastPathQueryCacheHashKey *key,
+									char *statementKey, uint64 shardId)
+{
+	/* the key has padding bytes, which are compared as well */
+	memset(key, 0, sizeof(FastPathQueryCacheHashKey));
+	key->databaseId = MyDatabaseId;
+	key->statementKeyHash = hash_bytes_extended((const unsigned char *) statementKey,
+												strlen(statementKey), 0);
+	key->shardId = shardId;
+}
+
+
+/*
+ * GetCachedQueryString returns a copy of the cached query string for the given
+ * key, or NULL if there is no query string cached for the statement at the
+ * given generation.
+ */
+static char *
+GetCachedQueryString(FastPathQueryCacheHashKey *key, char *statementKey,
+					 uint64 generation)
+{
+	char *queryString = NULL;
+	bool entryFound = false;
+
+	LWLockAcquire(&FastPathQueryCacheState->fastPathQueryCacheLock, LW_SHARED);
+
+	FastPathQueryCacheHashEntry *entry =
+		hash_search(FastPathQueryCacheHash, key, HASH_FIND, &entryFound);
+	if (entryFound && entry->generation == generation &&
+		strcmp(entry->statementKey, statementKey) == 0)
+	{
+		queryString = pstrdup(entry->queryString);
+	}
+
+	LWLockRelease(&FastPathQueryCacheState->fastPathQueryCacheLock);
+
+	return queryString;
+}
+
+
+/*
+ * StoreQueryString adds the given query string to the cache, unless the cache
+ * was invalidated since we read the given generation, in which case the query
+ * string might have been deparsed based on outdated metadata.
+ */
+static void
+StoreQueryString(FastPathQueryCacheHashKey *key, char *statementKey, uint64 generation,
+				 char *queryString)
+{
+	if (strlen(queryString) >= FAST_PATH_QUERY_CACHE_MAX_QUERY_LENGTH)
+	{
+		return;
+	}
+
+	LWLockAcquire(&FastPathQueryCacheState->fastPathQueryCacheLock, LW_EXCLUSIVE);
+
+	if (pg_atomic_read_u64(&FastPathQueryCacheState->generation) != generation)
+	{
+		LWLockRelease(&FastPathQueryCacheState->fastPathQueryCacheLock);
+		return;
+	}
+
+	bool entryFound = false;
+	hash_search(FastPathQueryCacheHash, key, HASH_FIND, &entryFound);
+
+	if (!entryFound && hash_get_num_entries(FastPathQueryCacheHash) >=
+		FastPathQueryCacheSize)
+	{
+		EvictFastPathQueryCacheEntries(generation);
+	}
+
+	FastPathQueryCacheHashEntry *entry =
+		hash_search(FastPathQueryCacheHash, key, HASH_ENTER_NULL, &entryFound);
+	if (entry != NULL)
+	{
+		entry->generation = generation;
+		strlcpy(entry->statementKey, statementKey, FAST_PATH_QUERY_CACHE_MAX_KEY_LENGTH);
+		strlcpy(entry->queryString, queryString, FAST_PATH_QUERY_CACHE_MAX_QUERY_LENGTH);
+	}
+
+	LWLockRelease(&FastPathQueryCacheState->fastPathQueryCacheLock);
+}
+
+
+/*
+ * EvictFastPathQueryCacheEntries makes room in the full cache. If the cache was
+ * invalidated since the last eviction, we remove all outdated entries. Otherwise,
+ * we remove an arbitrary entry. The caller should hold the lock in exclusive mode.
+ */
+static void
+EvictFastPathQueryCacheEntries(uint64 generation)
+{
+	HASH_SEQ_STATUS status;
+	FastPathQueryCacheHashEntry *entry = NULL;
+
+	hash_seq_init(&status, FastPathQueryCacheHash);
+
+	if (FastPathQueryCacheState->lastEvictionGeneration != generation)
+	{
+		while ((entry = hash_seq_search(&status)) != NULL)
+		{
+			if (entry->generation != generation)
+			{
+				hash_search(FastPathQueryCacheHash, &entry->key, HASH_REMOVE, NULL);
+			}
+		}
+
+		FastPathQueryCacheState->lastEvictionGeneration = generation;
+
+		if (hash_get_num_entries(FastPathQueryCacheHash) < FastPathQueryCacheSize)
+		{
+			return;
+		}
+
+		hash_seq_init(&status, FastPathQueryCacheHash);
+	}
+
+	entry = hash_seq_search(&status);
+	if (entry != NULL)
+	{
+		FastPathQueryCacheHashKey key = entry->key;
+
+		hash_seq_term(&status);
+		hash_search(FastPathQueryCacheHash, &key, HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * InvalidateFastPathQueryCache invalidates all the cached query strings, which
+ * will be replaced the next time the statements are executed.
+ */
+void
+InvalidateFastPathQueryCache(void)
+{
+	if (FastPathQueryCacheState == NULL)
+	{
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(&FastPathQueryCacheState->generation, 1);
+}
+
+
+/*
+ * RegisterFastPathQueryCacheCallbacks registers the callbacks for catalog
+ * changes that affect the query strings, but that do not invalidate the
+ * metadata cache, such as renaming a schema or a function.
+ */
+void
+RegisterFastPathQueryCacheCallbacks(void)
+{
+	if (FastPathQueryCacheSize == 0)
+	{
+		return;
+	}
+
+	CacheRegisterSyscacheCallback(NAMESPACEOID, InvalidateFastPathQueryCacheCallback,
+								  (Datum) 0);
+	CacheRegisterSyscacheCallback(PROCOID, InvalidateFastPathQueryCacheCallback,
+								  (Datum) 0);
+}
+
+
+/*
+ * InvalidateFastPathQueryCacheCallback invalidates the fast path query cache
+ * when a schema or function changes.
+ */
+static void
+InvalidateFastPathQueryCacheCallback(Datum argument, int cacheId, uint32 hashValue)
+{
+	InvalidateFastPathQueryCache();
+}
+
+
+/*
+ * InitializeFastPathQueryCache sets up the shared memory startup hook.
+ */
+void
+InitializeFastPathQueryCache(void)
+{
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = FastPathQueryCacheShmemInit;
+}
+
+
+/*
+ * FastPathQueryCacheShmemSize returns the size that should be allocated
+ * on the shared memory for the fast path query cache.
+ */
+size_t
+FastPathQueryCacheShmemSize(void)
+{
+	Size size = 0;
+
+	if (FastPathQueryCacheSize == 0)
+	{
+		return size;
+	}
+
+	size = add_size(size, sizeof(FastPathQueryCacheSharedData));
+
+	Size hashSize = hash_estimate_size(FastPathQueryCacheSize,
+									   sizeof(FastPathQueryCacheHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * FastPathQueryCacheShmemInit initializes the shared memory used for caching
+ * the query strings of fast path queries.
+ */
+void
+FastPathQueryCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	if (FastPathQueryCacheSize == 0)
+	{
+		if (prev_shmem_startup_hook != NULL)
+		{
+			prev_shmem_startup_hook();
+		}
+
+		return;
+	}
+
+	/* create (database, statement, shard) -> query string */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(FastPathQueryCacheHashKey);
+	info.entrysize = sizeof(FastPathQueryCacheHashEntry);
+	uint32 hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	FastPathQueryCacheState =
+		(FastPathQueryCacheSharedData *) ShmemInitStruct(
+			"Fast Path Query Cache Data",
+			sizeof(FastPathQueryCacheSharedData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		FastPathQueryCacheState->fastPathQueryCacheTrancheId = LWLockNewTrancheId();
+		FastPathQueryCacheState->fastPathQueryCacheTrancheName =
+			"Fast Path Query Cache Tranche";
+		LWLockRegisterTranche(FastPathQueryCacheState->fastPathQueryCacheTrancheId,
+							  FastPathQueryCacheState->fastPathQueryCacheTrancheName);
+
+		LWLockInitialize(&FastPathQueryCacheState->fastPathQueryCacheLock,
+						 FastPathQueryCacheState->fastPathQueryCacheTrancheId);
+
+		pg_atomic_init_u64(&FastPathQueryCacheState->generation, 1);
+		FastPathQueryCacheState->lastEvictionGeneration = 1;
+	}
+
+	/* allocate hash table */
+	FastPathQueryCacheHash =
+		ShmemInitHash("Fast Path Query Cache Hash", FastPathQueryCacheSize,
+					  FastPathQueryCacheSize, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(FastPathQueryCacheHash != NULL);
+	Assert(FastPathQueryCacheState->fastPathQueryCacheTrancheId != 0);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
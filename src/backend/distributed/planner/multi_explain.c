@@ -437,7 +437,6 @@ static void
 ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 {
 	ListCell *subPlanCell = NULL;
-	uint64 planId = distributedPlan->planId;
 
 	ExplainOpenGroup("Subplans", "Subplans", false, es);
 
@@ -479,7 +478,7 @@ ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 
 		if (es->format == EXPLAIN_FORMAT_TEXT)
 		{
-			char *resultId = GenerateResultId(planId, subPlan->subPlanId);
+			char *resultId = subPlan->resultId;
 
 			appendStringInfoSpaces(es->str, es->indent * 2);
 			appendStringInfo(es->str, "->  Distributed Subplan %s\n", resultId);
@@ -22,6 +22,7 @@
 #include "catalog/indexing.h"
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_namespace.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/extension.h"
@@ -35,10 +36,12 @@
 #include "parser/parse_oper.h"
 #include "parser/parsetree.h"
 #include "rewrite/rewriteManip.h"
+#include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
+#include "utils/typcache.h"
 
 #include "pg_version_constants.h"
 
@@ -53,6 +56,7 @@
 #include "distributed/multi_logical_optimizer.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_server_executor.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/string_utils.h"
@@ -64,6 +68,7 @@
 int LimitClauseRowFetchCount = -1; /* number of rows to fetch from each task */
 double CountDistinctErrorRate = 0.0; /* precision of count(distinct) approximate */
 int CoordinatorAggregationStrategy = COORDINATOR_AGGREGATION_ROW_GATHER;
+bool EnableRepartitionedWindowFunctions = false; /* repartition rows for window functions */
 
 /* Constant used throughout file */
 static const uint32 masterTableId = 1; /* first range table reference on the master node */
@@ -204,6 +209,11 @@ static void PullUpUnaryNode(MultiUnaryNode *unaryNode);
 static void ParentSetNewChild(MultiNode *parentNode, MultiNode *oldChildNode,
 							  MultiNode *newChildNode);
 
+/* Local functions forward declarations for window function repartitioning */
+static Var * WindowRepartitionColumn(MultiExtendedOp *extendedOpNode);
+static void ApplyWindowRepartition(MultiExtendedOp *extendedOpNode,
+								   Var *partitionColumn);
+
 /* Local functions forward declarations for aggregate expressions */
 static void ApplyExtendedOpNodes(MultiExtendedOp *originalNode,
 								 MultiExtendedOp *masterNode,
@@ -284,6 +294,8 @@ static Oid TypeOid(Oid schemaId, const char *typeName);
 static SortGroupClause * CreateSortGroupClause(Var *column);
 
 /* Local functions forward declarations for count(distinct) approximations */
+static bool HllExtensionLoaded(void);
+static bool IsCitusHllAddAggregate(Node *expression);
 static const char * CountDistinctHashFunctionName(Oid argumentType);
 static int CountDistinctStorageSize(double approximationErrorRate);
 static Const * MakeIntegerConstInt64(int64 integerValue);
@@ -419,6 +431,30 @@ MultiLogicalPlanOptimize(MultiTreeRoot *multiLogicalPlan)
 		PullUpCollectLoop(collectNode);
 	}
 
+	/*
+	 * Window functions that are not partitioned by the distribution column are
+	 * computed on the coordinator over all rows. If enabled and all windows are
+	 * partitioned by a common column, we instead repartition the rows by that
+	 * column, such that each partition of the window functions ends up in a
+	 * single task. The window functions can then be computed on the workers, as
+	 * if they were partitioned by the distribution column.
+	 */
+	if (EnableRepartitionedWindowFunctions && EnableRepartitionJoins &&
+		extendedOpNodeProperties.hasWindowFuncs &&
+		!extendedOpNodeProperties.onlyPushableWindowFunctions)
+	{
+		Var *windowPartitionColumn = WindowRepartitionColumn(extendedOpNode);
+		if (windowPartitionColumn != NULL)
+		{
+			ApplyWindowRepartition(extendedOpNode, windowPartitionColumn);
+
+			extendedOpNode->onlyPushableWindowFunctions = true;
+			extendedOpNodeProperties =
+				BuildExtendedOpNodeProperties(extendedOpNode,
+											  hasNonDistributableAggregates);
+		}
+	}
+
 	/*
 	 * We split the extended operator node into its equivalent master and worker
 	 * operator nodes; and if the extended operator has aggregates, we transform
@@ -461,10 +497,10 @@ MultiLogicalPlanOptimize(MultiTreeRoot *multiLogicalPlan)
 	}
 
 	/*
-	 * When enabled, count(distinct) approximation uses hll as the intermediate
-	 * data type. We currently have a mismatch between hll target entry and sort
-	 * clause's sortop oid, so we can't push an order by on the hll data type to
-	 * the worker node. We check that here and error out if necessary.
+	 * When enabled, count(distinct) approximation uses hll or a built-in sketch
+	 * as the intermediate data type. We currently have a mismatch between these
+	 * target entries and the sort clause's sortop oid, so we can't push an order
+	 * by on them to the worker node. We check that here and error out if necessary.
 	 */
 	bool hasOrderByHllType = HasOrderByHllType(workerExtendedOpNode->sortClauseList,
 											   workerExtendedOpNode->targetList);
@@ -1316,6 +1352,131 @@ ApplyExtendedOpNodes(MultiExtendedOp *originalNode, MultiExtendedOp *masterNode,
 }
 
 
+/*
+ * WindowRepartitionColumn returns a column by which all window functions of the
+ * given extended operator node are partitioned, such that repartitioning the
+ * rows by it allows computing the window functions on the workers. The function
+ * returns NULL if there is no such column, or if the query does something else
+ * on top of the rows that we do not support in combination with repartitioning,
+ * such as aggregation or repartition joins.
+ */
+static Var *
+WindowRepartitionColumn(MultiExtendedOp *extendedOpNode)
+{
+	List *targetList = extendedOpNode->targetList;
+
+	if (extendedOpNode->groupClauseList != NIL ||
+		extendedOpNode->havingQual != NULL ||
+		extendedOpNode->distinctClause != NIL ||
+		TargetListHasAggregates(targetList))
+	{
+		return NULL;
+	}
+
+	MultiNode *childNode = ChildNode((MultiUnaryNode *) extendedOpNode);
+	if (!CitusIsA(childNode, MultiCollect))
+	{
+		return NULL;
+	}
+
+	/* we only add a partition job at the top, on top of regular tasks */
+	if (FindNodesOfType(childNode, T_MultiPartition) != NIL)
+	{
+		return NULL;
+	}
+
+	MultiTable *tableNode = NULL;
+	List *tableNodeList = FindNodesOfType(childNode, T_MultiTable);
+	foreach_declared_ptr(tableNode, tableNodeList)
+	{
+		if (tableNode->relationId == SUBQUERY_RELATION_ID ||
+			tableNode->relationId == SUBQUERY_PUSHDOWN_RELATION_ID)
+		{
+			return NULL;
+		}
+	}
+
+	List *windowClauseList = extendedOpNode->windowClause;
+	if (windowClauseList == NIL)
+	{
+		return NULL;
+	}
+
+	/* the column has to be in the PARTITION BY of every window */
+	WindowClause *firstWindowClause = (WindowClause *) linitial(windowClauseList);
+
+	SortGroupClause *partitionClause = NULL;
+	foreach_declared_ptr(partitionClause, firstWindowClause->partitionClause)
+	{
+		Node *partitionExpression = get_sortgroupclause_expr(partitionClause,
+															 targetList);
+		if (!IsA(partitionExpression, Var))
+		{
+			continue;
+		}
+
+		Var *partitionColumn = (Var *) partitionExpression;
+		if (partitionColumn->varlevelsup != 0)
+		{
+			continue;
+		}
+
+		/* the rows are hash partitioned by the column */
+		TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->vartype,
+													  TYPECACHE_HASH_PROC);
+		if (!OidIsValid(typeEntry->hash_proc))
+		{
+			continue;
+		}
+
+		bool partitionsAllWindows = true;
+
+		WindowClause *windowClause = NULL;
+		foreach_declared_ptr(windowClause, windowClauseList)
+		{
+			List *partitionExpressionList =
+				get_sortgrouplist_exprs(windowClause->partitionClause, targetList);
+
+			if (!list_member(partitionExpressionList, partitionColumn))
+			{
+				partitionsAllWindows = false;
+				break;
+			}
+		}
+
+		if (partitionsAllWindows)
+		{
+			return partitionColumn;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ApplyWindowRepartition adds a partition node on top of the collect node
+ * below the given extended operator node, and a new collect node on top of
+ * that. The worker extended operator node is later placed between the new
+ * collect node and the partition node, such that the window functions are
+ * computed in tasks that each read a hash partition of the rows.
+ */
+static void
+ApplyWindowRepartition(MultiExtendedOp *extendedOpNode, Var *partitionColumn)
+{
+	MultiNode *collectNode = ChildNode((MultiUnaryNode *) extendedOpNode);
+
+	MultiPartition *partitionNode = CitusMakeNode(MultiPartition);
+	partitionNode->partitionColumn = copyObject(partitionColumn);
+
+	MultiCollect *partitionCollectNode = CitusMakeNode(MultiCollect);
+
+	SetChild((MultiUnaryNode *) extendedOpNode, (MultiNode *) partitionCollectNode);
+	SetChild((MultiUnaryNode *) partitionCollectNode, (MultiNode *) partitionNode);
+	SetChild((MultiUnaryNode *) partitionNode, collectNode);
+}
+
+
 /*
  * TransformSubqueryNode splits the extended operator node under subquery
  * multi table node into its equivalent master and worker operator nodes, and
@@ -1698,6 +1859,49 @@ MasterAggregateExpression(Aggref *originalAggregate,
 
 		newMasterExpression = (Expr *) aggregate;
 	}
+	else if (aggregateType == AGGREGATE_COUNT && originalAggregate->aggdistinct &&
+			 CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION &&
+			 !HllExtensionLoaded())
+	{
+		/*
+		 * Without the hll extension, we use the built-in sketches instead. We
+		 * first compute citus_hll_add_agg(column, log2m) on worker nodes, and
+		 * get sketches. We then gather sketches on the master node, and compute
+		 * citus_hll_cardinality(citus_hll_union_agg(sketch)).
+		 */
+		const int argCount = 1;
+		const int defaultTypeMod = -1;
+
+		Oid unionFunctionId = FunctionOid("pg_catalog", CITUS_HLL_UNION_AGGREGATE_NAME,
+										  argCount);
+		Oid cardinalityFunctionId = FunctionOid("pg_catalog",
+												CITUS_HLL_CARDINALITY_FUNC_NAME,
+												argCount);
+
+		Var *sketchColumn = makeVar(masterTableId, walkerContext->columnId, BYTEAOID,
+									defaultTypeMod, InvalidOid, columnLevelsUp);
+		walkerContext->columnId++;
+
+		TargetEntry *sketchTargetEntry = makeTargetEntry((Expr *) sketchColumn,
+														 argumentId, NULL, false);
+
+		Aggref *unionAggregate = makeNode(Aggref);
+		unionAggregate->aggfnoid = unionFunctionId;
+		unionAggregate->aggtype = BYTEAOID;
+		unionAggregate->args = list_make1(sketchTargetEntry);
+		unionAggregate->aggkind = AGGKIND_NORMAL;
+		unionAggregate->aggfilter = NULL;
+		unionAggregate->aggtranstype = InvalidOid;
+		unionAggregate->aggargtypes = list_make1_oid(BYTEAOID);
+		unionAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		FuncExpr *cardinalityExpression = makeNode(FuncExpr);
+		cardinalityExpression->funcid = cardinalityFunctionId;
+		cardinalityExpression->funcresulttype = INT8OID;
+		cardinalityExpression->args = list_make1(unionAggregate);
+
+		newMasterExpression = (Expr *) cardinalityExpression;
+	}
 	else if (aggregateType == AGGREGATE_COUNT && originalAggregate->aggdistinct &&
 			 CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
 	{
@@ -3107,6 +3311,47 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 
 		walkerContext->createGroupByClause = true;
 	}
+	else if (aggregateType == AGGREGATE_COUNT && originalAggregate->aggdistinct &&
+			 CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION &&
+			 !HllExtensionLoaded())
+	{
+		/*
+		 * If the original aggregate is a count(distinct) approximation and hll
+		 * is not installed, we want to compute citus_hll_add_agg(var, storageSize)
+		 * on worker nodes.
+		 */
+		const AttrNumber firstArgumentId = 1;
+		const AttrNumber secondArgumentId = 2;
+		const int addArgumentCount = 2;
+
+		Oid argumentType = AggregateArgumentType(originalAggregate);
+		TargetEntry *argument = (TargetEntry *) linitial(originalAggregate->args);
+		Expr *argumentExpression = copyObject(argument->expr);
+
+		Oid addFunctionId = FunctionOid("pg_catalog", CITUS_HLL_ADD_AGGREGATE_NAME,
+										addArgumentCount);
+		int logOfStorageSize = CountDistinctStorageSize(CountDistinctErrorRate);
+		Const *logOfStorageSizeConst = MakeIntegerConst(logOfStorageSize);
+
+		TargetEntry *columnArgument = makeTargetEntry(argumentExpression,
+													  firstArgumentId, NULL, false);
+		TargetEntry *storageSizeArgument = makeTargetEntry((Expr *) logOfStorageSizeConst,
+														   secondArgumentId, NULL, false);
+
+		Aggref *addAggregateFunction = makeNode(Aggref);
+		addAggregateFunction->aggfnoid = addFunctionId;
+		addAggregateFunction->aggtype = BYTEAOID;
+		addAggregateFunction->args = list_make2(columnArgument, storageSizeArgument);
+		addAggregateFunction->aggkind = AGGKIND_NORMAL;
+		addAggregateFunction->aggfilter = (Expr *) copyObject(
+			originalAggregate->aggfilter);
+		addAggregateFunction->aggtranstype = InvalidOid;
+		addAggregateFunction->aggargtypes = list_make2_oid(argumentType, INT4OID);
+		addAggregateFunction->aggsplit = AGGSPLIT_SIMPLE;
+		addAggregateFunction->inputcollid = originalAggregate->inputcollid;
+
+		workerAggregateList = lappend(workerAggregateList, addAggregateFunction);
+	}
 	else if (aggregateType == AGGREGATE_COUNT && originalAggregate->aggdistinct &&
 			 CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
 	{
@@ -3705,6 +3950,42 @@ CreateSortGroupClause(Var *column)
 }
 
 
+/*
+ * HllExtensionLoaded returns whether the hll extension is installed, in which
+ * case we use it for count(distinct) approximations rather than the built-in
+ * sketches.
+ */
+static bool
+HllExtensionLoaded(void)
+{
+	bool missingOK = true;
+	Oid hllId = get_extension_oid(HLL_EXTENSION_NAME, missingOK);
+
+	return OidIsValid(hllId);
+}
+
+
+/*
+ * IsCitusHllAddAggregate returns whether the given expression is a call to the
+ * built-in citus_hll_add_agg aggregate.
+ */
+static bool
+IsCitusHllAddAggregate(Node *expression)
+{
+	if (expression == NULL || !IsA(expression, Aggref))
+	{
+		return false;
+	}
+
+	Aggref *aggregate = (Aggref *) expression;
+	char *functionName = get_func_name(aggregate->aggfnoid);
+
+	return functionName != NULL &&
+		   strcmp(functionName, CITUS_HLL_ADD_AGGREGATE_NAME) == 0 &&
+		   get_func_namespace(aggregate->aggfnoid) == PG_CATALOG_NAMESPACE;
+}
+
+
 /*
  * CountDistinctHashFunctionName resolves the hll_hash function name to use for
  * the given input type, and returns this function name.
@@ -4113,21 +4394,26 @@ DeferErrorIfUnsupportedAggregateDistinct(Aggref *aggregateExpression,
 	if (aggregateType == AGGREGATE_COUNT &&
 		CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
 	{
-		bool missingOK = true;
-		Oid distinctExtensionId = get_extension_oid(HLL_EXTENSION_NAME, missingOK);
-
 		/* if extension for distinct approximation is loaded, we are good */
-		if (distinctExtensionId != InvalidOid)
+		if (HllExtensionLoaded())
 		{
 			return NULL;
 		}
-		else
+
+		/* otherwise, the built-in sketches need a hash function for the type */
+		Oid argumentType = AggregateArgumentType(aggregateExpression);
+		TypeCacheEntry *typeEntry = lookup_type_cache(argumentType,
+													  TYPECACHE_HASH_EXTENDED_PROC);
+		if (OidIsValid(typeEntry->hash_extended_proc))
 		{
-			return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
-								 "cannot compute count (distinct) approximation",
-								 NULL,
-								 "You need to have the hll extension loaded.");
+			return NULL;
 		}
+
+		return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+							 "cannot compute count (distinct) approximation",
+							 psprintf("type %s does not have an extended hash "
+									  "function", format_type_be(argumentType)),
+							 "You need to have the hll extension loaded.");
 	}
 
 	if (aggregateType == AGGREGATE_COUNT)
@@ -4982,7 +5268,8 @@ HasOrderByComplexExpression(List *sortClauseList, List *targetList)
 
 /*
  * HasOrderByHllType walks over the given order by clauses, and checks if any of
- * those clauses operate on hll data type. If they do, the function returns true.
+ * those clauses operate on hll data type or on built-in sketches. If they do,
+ * the function returns true.
  */
 static bool
 HasOrderByHllType(List *sortClauseList, List *targetList)
@@ -4990,22 +5277,22 @@ HasOrderByHllType(List *sortClauseList, List *targetList)
 	bool hasOrderByHllType = false;
 
 	/* check whether HLL is loaded */
+	Oid hllTypeId = InvalidOid;
 	Oid hllId = get_extension_oid(HLL_EXTENSION_NAME, true);
-	if (!OidIsValid(hllId))
+	if (OidIsValid(hllId))
 	{
-		return hasOrderByHllType;
+		Oid hllSchemaOid = get_extension_schema(hllId);
+		hllTypeId = TypeOid(hllSchemaOid, HLL_TYPE_NAME);
 	}
 
-	Oid hllSchemaOid = get_extension_schema(hllId);
-	Oid hllTypeId = TypeOid(hllSchemaOid, HLL_TYPE_NAME);
-
 	SortGroupClause *sortClause = NULL;
 	foreach_declared_ptr(sortClause, sortClauseList)
 	{
 		Node *sortExpression = get_sortgroupclause_expr(sortClause, targetList);
 
 		Oid sortColumnTypeId = exprType(sortExpression);
-		if (sortColumnTypeId == hllTypeId)
+		if ((OidIsValid(hllTypeId) && sortColumnTypeId == hllTypeId) ||
+			IsCitusHllAddAggregate(sortExpression))
 		{
 			hasOrderByHllType = true;
 			break;
@@ -63,6 +63,7 @@
 #include "distributed/colocation_utils.h"
 #include "distributed/coordinator_protocol.h"
 #include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_statistics.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/log_utils.h"
@@ -80,6 +81,7 @@
 #include "distributed/recursive_planning.h"
 #include "distributed/shard_pruning.h"
 #include "distributed/shardinterval_utils.h"
+#include "distributed/shared_worker_pool_stats.h"
 #include "distributed/string_utils.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
@@ -88,10 +90,19 @@
 /* RepartitionJoinBucketCountPerNode determines bucket amount during repartitions */
 int RepartitionJoinBucketCountPerNode = 4;
 
+/*
+ * RepartitionJoinBucketSize is the estimated size in kB of the input per bucket
+ * that repartitions aim for, 0 uses RepartitionJoinBucketCountPerNode instead.
+ */
+int RepartitionJoinBucketSize = 0;
+
 /* Policy to use when assigning tasks to worker nodes */
 int TaskAssignmentPolicy = TASK_ASSIGNMENT_GREEDY;
 bool EnableUniqueJobIds = true;
 
+/* whether to filter dual hash repartition joins with a join key bloom filter */
+bool EnableRepartitionJoinBloomFilter = false;
+
 
 /*
  * OperatorCache is used for caching operator identifiers for given typeId,
@@ -119,6 +130,41 @@ typedef struct AddAnyValueAggregatesContext
 } AddAnyValueAggregatesContext;
 
 
+/*
+ * QueryPushdownRelation holds the information on a relation of a query pushdown
+ * job that is the same for all of its tasks, such that it is looked up once per
+ * job rather than once per task.
+ */
+typedef struct QueryPushdownRelation
+{
+	CitusTableCacheEntry *cacheEntry;
+
+	/*
+	 * Co-located shards are placed on the same nodes, so we only look up the
+	 * placements of the last relation of each colocation group when finding
+	 * the nodes that have all shards of a task.
+	 */
+	bool lookupPlacements;
+} QueryPushdownRelation;
+
+
+/*
+ * PlacementNodeLoad is used by the latency-aware task assignment policy to
+ * keep track of the expected load on the node of a placement.
+ */
+typedef struct PlacementNodeLoad
+{
+	char *nodeName;
+	uint32 nodePort;
+
+	/* moving average of the response times of the node, in microseconds */
+	double responseTime;
+
+	/* tasks running on the node and tasks we assigned to it during planning */
+	int taskCount;
+} PlacementNodeLoad;
+
+
 /* Local functions forward declarations for job creation */
 static Job * BuildJobTree(MultiTreeRoot *multiTree);
 static MultiNode * LeftMostNode(MultiTreeRoot *multiTree);
@@ -160,20 +206,24 @@ static List * ChildNodeList(MultiNode *multiNode);
 static Job * BuildJob(Query *jobQuery, List *dependentJobList);
 static MapMergeJob * BuildMapMergeJob(Query *jobQuery, List *dependentJobList,
 									  Var *partitionKey, PartitionType partitionType,
-									  Oid baseRelationId,
+									  Oid baseRelationId, uint32 hashPartitionCount,
 									  BoundaryNodeJobType boundaryNodeJobType);
-static uint32 HashPartitionCount(void);
+static uint32 HashPartitionCount(List *inputNodeList);
+static uint64 EstimatedInputSize(List *inputNodeList);
 
 /* Local functions forward declarations for task list creation and helper functions */
 static Job * BuildJobTreeTaskList(Job *jobTree,
 								  PlannerRestrictionContext *plannerRestrictionContext);
 static bool IsInnerTableOfOuterJoin(RelationRestriction *relationRestriction);
 static void ErrorIfUnsupportedShardDistribution(Query *query);
+static QueryPushdownRelation * QueryPushdownRelationArray(
+	RelationRestrictionContext *restrictionContext);
 static Task * QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
-									  RelationRestrictionContext *restrictionContext,
-									  uint32 taskId,
+									  QueryPushdownRelation *relationArray,
+									  int relationCount, uint32 taskId,
 									  TaskType taskType,
 									  bool modifyRequiresCoordinatorEvaluation,
+									  Task *templateTask,
 									  DeferredErrorMessage **planningError);
 static List * SqlTaskList(Job *job);
 static bool DependsOnHashPartitionJob(Job *job);
@@ -213,6 +263,9 @@ static Task * GreedyAssignTask(WorkerNode *workerNode, List *taskList,
 							   List *activeShardPlacementLists);
 static List * ReorderAndAssignTaskList(List *taskList,
 									   ReorderFunction reorderFunction);
+static List * ReorderPlacementsByNodeLoad(List *placementList, List **nodeLoadList);
+static PlacementNodeLoad * FindOrCreatePlacementNodeLoad(ShardPlacement *placement,
+														 List **nodeLoadList);
 static int CompareTasksByShardId(const void *leftElement, const void *rightElement);
 static List * ActiveShardPlacementLists(List *taskList);
 static List * LeftRotateList(List *list, uint32 rotateCount);
@@ -221,8 +274,11 @@ static List * AssignDualHashTaskList(List *taskList);
 static void AssignDataFetchDependencies(List *taskList);
 static uint32 TaskListHighestTaskId(List *taskList);
 static List * MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList);
+static uint32 MapMergeJobPartitionColumnResNo(MapMergeJob *mapMergeJob);
 static StringInfo CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
-									   uint32 partitionColumnIndex, bool useBinaryFormat);
+									   char *filterQueryString,
+									   uint32 partitionColumnIndex, bool useBinaryFormat,
+									   char *joinKeyFilterResultId);
 static char * PartitionResultNamePrefix(uint64 jobId, int32 taskId);
 static char * PartitionResultName(uint64 jobId, uint32 taskId, uint32 partitionId);
 static ShardInterval ** RangeIntervalArrayWithNullBucket(ShardInterval **intervalArray,
@@ -325,6 +381,13 @@ BuildJobTree(MultiTreeRoot *multiTree)
 				boundaryNodeJobType = JOIN_MAP_MERGE_JOB;
 			}
 		}
+		else if (currentNodeType == T_MultiPartition &&
+				 parentNodeType == T_MultiExtendedOp &&
+				 CitusIsA(ParentNode(parentNode), MultiCollect))
+		{
+			/* rows are repartitioned for window functions, see ApplyWindowRepartition */
+			boundaryNodeJobType = WINDOW_MAP_MERGE_JOB;
+		}
 		else if (currentNodeType == T_MultiCollect &&
 				 parentNodeType != T_MultiPartition)
 		{
@@ -343,6 +406,7 @@ BuildJobTree(MultiTreeRoot *multiTree)
 
 			PartitionType partitionType = PARTITION_INVALID_FIRST;
 			Oid baseRelationId = InvalidOid;
+			uint32 hashPartitionCount = 0;
 
 			if (joinNode->joinRuleType == SINGLE_RANGE_PARTITION_JOIN)
 			{
@@ -357,6 +421,10 @@ BuildJobTree(MultiTreeRoot *multiTree)
 			else if (joinNode->joinRuleType == DUAL_PARTITION_JOIN)
 			{
 				partitionType = DUAL_HASH_PARTITION_TYPE;
+
+				/* both sides need to be partitioned into the same buckets */
+				hashPartitionCount =
+					HashPartitionCount(list_make2(leftChildNode, rightChildNode));
 			}
 
 			if (CitusIsA(leftChildNode, MultiPartition))
@@ -372,6 +440,7 @@ BuildJobTree(MultiTreeRoot *multiTree)
 				MapMergeJob *mapMergeJob = BuildMapMergeJob(jobQuery, dependentJobList,
 															partitionKey, partitionType,
 															baseRelationId,
+															hashPartitionCount,
 															JOIN_MAP_MERGE_JOB);
 
 				/* reset dependent job list */
@@ -393,12 +462,34 @@ BuildJobTree(MultiTreeRoot *multiTree)
 				MapMergeJob *mapMergeJob = BuildMapMergeJob(jobQuery, NIL,
 															partitionKey, partitionType,
 															baseRelationId,
+															hashPartitionCount,
 															JOIN_MAP_MERGE_JOB);
 
 				/* append to the dependent job list for on-going dependencies */
 				loopDependentJobList = lappend(loopDependentJobList, mapMergeJob);
 			}
 		}
+		else if (boundaryNodeJobType == WINDOW_MAP_MERGE_JOB)
+		{
+			MultiPartition *partitionNode = (MultiPartition *) currentNode;
+			MultiNode *queryNode = GrandChildNode((MultiUnaryNode *) partitionNode);
+			Var *partitionKey = partitionNode->partitionColumn;
+
+			/*
+			 * Hash partition the rows by the common PARTITION BY column of the
+			 * window functions. The job above reads one partition per task.
+			 */
+			List *dependentJobList = list_copy(loopDependentJobList);
+			Query *jobQuery = BuildJobQuery(queryNode, dependentJobList);
+			uint32 hashPartitionCount = HashPartitionCount(list_make1(queryNode));
+			MapMergeJob *mapMergeJob = BuildMapMergeJob(jobQuery, dependentJobList,
+														partitionKey,
+														DUAL_HASH_PARTITION_TYPE,
+														InvalidOid, hashPartitionCount,
+														WINDOW_MAP_MERGE_JOB);
+
+			loopDependentJobList = list_make1(mapMergeJob);
+		}
 		else if (boundaryNodeJobType == TOP_LEVEL_WORKER_JOB)
 		{
 			MultiNode *childNode = ChildNode((MultiUnaryNode *) currentNode);
@@ -1947,12 +2038,12 @@ BuildJob(Query *jobQuery, List *dependentJobList)
  * BuildMapMergeJob builds a MapMerge job from the given query and dependent job
  * list. The function then copies and updates the logical plan's partition
  * column, and uses the join rule type to determine the physical repartitioning
- * method to apply.
+ * method to apply. Hash partitioning uses hashPartitionCount buckets.
  */
 static MapMergeJob *
 BuildMapMergeJob(Query *jobQuery, List *dependentJobList, Var *partitionKey,
 				 PartitionType partitionType, Oid baseRelationId,
-				 BoundaryNodeJobType boundaryNodeJobType)
+				 uint32 hashPartitionCount, BoundaryNodeJobType boundaryNodeJobType)
 {
 	List *rangeTableList = jobQuery->rtable;
 	Var *partitionColumn = copyObject(partitionKey);
@@ -1976,10 +2067,8 @@ BuildMapMergeJob(Query *jobQuery, List *dependentJobList, Var *partitionKey,
 	 */
 	if (partitionType == DUAL_HASH_PARTITION_TYPE)
 	{
-		uint32 partitionCount = HashPartitionCount();
-
 		mapMergeJob->partitionType = DUAL_HASH_PARTITION_TYPE;
-		mapMergeJob->partitionCount = partitionCount;
+		mapMergeJob->partitionCount = hashPartitionCount;
 	}
 	else if (partitionType == SINGLE_HASH_PARTITION_TYPE || partitionType ==
 			 RANGE_PARTITION_TYPE)
@@ -2018,22 +2107,83 @@ BuildMapMergeJob(Query *jobQuery, List *dependentJobList, Var *partitionKey,
 
 /*
  * HashPartitionCount returns the number of partition files we create for a hash
- * partition task. The function follows Hadoop's method for picking the number
- * of reduce tasks: 0.95 or 1.75 * node count * max reduces per node. We choose
+ * partition task that repartitions the rows of the given logical plan nodes.
+ *
+ * If citus.repartition_join_bucket_size is set and the size of the input can
+ * be estimated, we pick the number of buckets of that size that fit the input,
+ * but at least one and at most MAX_BUCKET_COUNT_PER_NODE buckets per node. That
+ * way small repartitions do not pay for many small fragments, while large
+ * repartitions get enough buckets to balance the work across the nodes.
+ *
+ * Otherwise, the function follows Hadoop's method for picking the number of
+ * reduce tasks: 0.95 or 1.75 * node count * max reduces per node. We choose
  * the lower constant 0.95 so that all tasks can start immediately, but round it
  * to 1.0 so that we have a smooth number of partition tasks.
  */
 static uint32
-HashPartitionCount(void)
+HashPartitionCount(List *inputNodeList)
 {
 	uint32 groupCount = list_length(ActiveReadableNodeList());
 	double maxReduceTasksPerNode = RepartitionJoinBucketCountPerNode;
 
+	if (RepartitionJoinBucketSize > 0)
+	{
+		uint64 inputSize = EstimatedInputSize(inputNodeList);
+		if (inputSize > 0)
+		{
+			double bucketSize = (double) RepartitionJoinBucketSize * 1024;
+			double bucketCount = ceil(inputSize / bucketSize);
+
+			bucketCount = Max(bucketCount, groupCount);
+			bucketCount = Min(bucketCount, groupCount * MAX_BUCKET_COUNT_PER_NODE);
+
+			return (uint32) bucketCount;
+		}
+	}
+
 	uint32 partitionCount = (uint32) rint(groupCount * maxReduceTasksPerNode);
 	return partitionCount;
 }
 
 
+/*
+ * EstimatedInputSize returns the estimated total size in bytes of the tables
+ * that are read by the given logical plan nodes, or 0 if the size of any of
+ * them is not known.
+ */
+static uint64
+EstimatedInputSize(List *inputNodeList)
+{
+	uint64 inputSize = 0;
+
+	MultiNode *inputNode = NULL;
+	foreach_declared_ptr(inputNode, inputNodeList)
+	{
+		List *tableNodeList = FindNodesOfType(inputNode, T_MultiTable);
+
+		MultiTable *tableNode = NULL;
+		foreach_declared_ptr(tableNode, tableNodeList)
+		{
+			if (tableNode->relationId == SUBQUERY_RELATION_ID ||
+				tableNode->relationId == SUBQUERY_PUSHDOWN_RELATION_ID)
+			{
+				return 0;
+			}
+
+			uint64 tableSize = EstimatedDistributedTableSize(tableNode->relationId);
+			if (tableSize == 0)
+			{
+				return 0;
+			}
+
+			inputSize += tableSize;
+		}
+	}
+
+	return inputSize;
+}
+
+
 /* ------------------------------------------------------------
  * Functions that relate to building and assigning tasks follow
  * ------------------------------------------------------------
@@ -2183,6 +2333,9 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 	int minShardOffset = INT_MAX;
 	int prevShardCount = 0;
 	Bitmapset *taskRequiredForShardIndex = NULL;
+	Task *firstReadTask = NULL;
+	Task *templateTask = NULL;
+	bool templateTaskChecked = false;
 
 	/* error if shards are not co-partitioned */
 	ErrorIfUnsupportedShardDistribution(query);
@@ -2258,14 +2411,19 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 	 * allocated till the last shard we have added. Therefore, the iterator will quickly
 	 * identify the end of the bitmapset.
 	 */
+	int relationCount = list_length(relationRestrictionContext->relationRestrictionList);
+	QueryPushdownRelation *relationArray =
+		QueryPushdownRelationArray(relationRestrictionContext);
+
 	int shardOffset = minShardOffset - 1;
 	while ((shardOffset = bms_next_member(taskRequiredForShardIndex, shardOffset)) >= 0)
 	{
 		Task *subqueryTask = QueryPushdownTaskCreate(query, shardOffset,
-													 relationRestrictionContext,
+													 relationArray, relationCount,
 													 taskIdIndex,
 													 taskType,
 													 modifyRequiresCoordinatorEvaluation,
+													 templateTask,
 													 planningError);
 		if (*planningError != NULL)
 		{
@@ -2274,6 +2432,30 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 		subqueryTask->jobId = jobId;
 		sqlTaskList = lappend(sqlTaskList, subqueryTask);
 
+		/*
+		 * Deparsing the query for every shard is expensive when there are many
+		 * shards. The query strings of the tasks only differ in the shard names,
+		 * so once we have verified that we can derive the query string of the
+		 * second task from the first one, we derive the remaining query strings
+		 * from the first task as well.
+		 */
+		if (taskType == READ_TASK && !templateTaskChecked)
+		{
+			if (firstReadTask == NULL)
+			{
+				firstReadTask = subqueryTask;
+			}
+			else
+			{
+				if (CanDeriveQueryStringFromTask(firstReadTask, subqueryTask))
+				{
+					templateTask = firstReadTask;
+				}
+
+				templateTaskChecked = true;
+			}
+		}
+
 		++taskIdIndex;
 	}
 
@@ -2431,22 +2613,70 @@ ErrorIfUnsupportedShardDistribution(Query *query)
 }
 
 
+/*
+ * QueryPushdownRelationArray returns an array with the information on each of
+ * the relations in the given restriction context that the tasks of a query
+ * pushdown job need.
+ */
+static QueryPushdownRelation *
+QueryPushdownRelationArray(RelationRestrictionContext *restrictionContext)
+{
+	List *relationRestrictionList = restrictionContext->relationRestrictionList;
+	int relationCount = list_length(relationRestrictionList);
+	QueryPushdownRelation *relationArray =
+		palloc0(relationCount * sizeof(QueryPushdownRelation));
+
+	int relationIndex = 0;
+	RelationRestriction *relationRestriction = NULL;
+	foreach_declared_ptr(relationRestriction, relationRestrictionList)
+	{
+		relationArray[relationIndex].cacheEntry =
+			GetCitusTableCacheEntry(relationRestriction->relationId);
+		relationArray[relationIndex].lookupPlacements = true;
+		relationIndex++;
+	}
+
+	/*
+	 * Keep the last relation of each colocation group, such that the placements
+	 * of the task still come from the last relation in the list.
+	 */
+	List *colocationIdList = NIL;
+	for (relationIndex = relationCount - 1; relationIndex >= 0; relationIndex--)
+	{
+		uint32 colocationId = relationArray[relationIndex].cacheEntry->colocationId;
+		if (colocationId == INVALID_COLOCATION_ID)
+		{
+			continue;
+		}
+
+		if (list_member_int(colocationIdList, colocationId))
+		{
+			relationArray[relationIndex].lookupPlacements = false;
+		}
+		else
+		{
+			colocationIdList = lappend_int(colocationIdList, colocationId);
+		}
+	}
+
+	return relationArray;
+}
+
+
 /*
  * SubqueryTaskCreate creates a sql task by replacing the target
  * shardInterval's boundary value.
  */
 static Task *
 QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
-						RelationRestrictionContext *restrictionContext, uint32 taskId,
-						TaskType taskType, bool modifyRequiresCoordinatorEvaluation,
-						DeferredErrorMessage **planningError)
+						QueryPushdownRelation *relationArray, int relationCount,
+						uint32 taskId, TaskType taskType,
+						bool modifyRequiresCoordinatorEvaluation,
+						Task *templateTask, DeferredErrorMessage **planningError)
 {
-	Query *taskQuery = copyObject(originalQuery);
-
-	StringInfo queryString = makeStringInfo();
-	ListCell *restrictionCell = NULL;
-	List *taskShardList = NIL;
 	List *relationShardList = NIL;
+	List *taskPlacementList = NIL;
+	bool firstPlacementList = true;
 	uint64 jobId = INVALID_JOB_ID;
 	uint64 anchorShardId = INVALID_SHARD_ID;
 	bool modifyWithSubselect = false;
@@ -2467,14 +2697,13 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 	/*
 	 * Find the relevant shard out of each relation for this task.
 	 */
-	foreach(restrictionCell, restrictionContext->relationRestrictionList)
+	for (int relationIndex = 0; relationIndex < relationCount; relationIndex++)
 	{
-		RelationRestriction *relationRestriction =
-			(RelationRestriction *) lfirst(restrictionCell);
-		Oid relationId = relationRestriction->relationId;
+		QueryPushdownRelation *relation = &relationArray[relationIndex];
+		CitusTableCacheEntry *cacheEntry = relation->cacheEntry;
+		Oid relationId = cacheEntry->relationId;
 		ShardInterval *shardInterval = NULL;
 
-		CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
 		if (!HasDistributionKeyCacheEntry(cacheEntry))
 		{
 			/* non-distributed tables have only one shard */
@@ -2486,10 +2715,10 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 				anchorShardId = shardInterval->shardId;
 			}
 		}
-		else if (UpdateOrDeleteOrMergeQuery(originalQuery))
+		else if (modifyWithSubselect)
 		{
 			shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
-			if (!modifyWithSubselect || relationId == resultRelationOid)
+			if (relationId == resultRelationOid)
 			{
 				/* for UPDATE/DELETE the shard in the result relation becomes the anchor shard */
 				anchorShardId = shardInterval->shardId;
@@ -2502,20 +2731,32 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 			anchorShardId = shardInterval->shardId;
 		}
 
-		ShardInterval *copiedShardInterval = CopyShardInterval(shardInterval);
-
-		taskShardList = lappend(taskShardList, list_make1(copiedShardInterval));
-
 		RelationShard *relationShard = CitusMakeNode(RelationShard);
-		relationShard->relationId = copiedShardInterval->relationId;
-		relationShard->shardId = copiedShardInterval->shardId;
+		relationShard->relationId = shardInterval->relationId;
+		relationShard->shardId = shardInterval->shardId;
 
 		relationShardList = lappend(relationShardList, relationShard);
+
+		/* keep the placements on nodes that have all shards so far */
+		if (relation->lookupPlacements)
+		{
+			List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+
+			if (firstPlacementList)
+			{
+				taskPlacementList = placementList;
+				firstPlacementList = false;
+			}
+			else
+			{
+				taskPlacementList = IntersectPlacementList(taskPlacementList,
+														   placementList);
+			}
+		}
 	}
 
 	Assert(anchorShardId != INVALID_SHARD_ID);
 
-	List *taskPlacementList = PlacementsForWorkersContainingAllShards(taskShardList);
 	if (list_length(taskPlacementList) == 0)
 	{
 		*planningError = DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
@@ -2526,28 +2767,38 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 		return NULL;
 	}
 
-	/*
-	 * Augment the relations in the query with the shard IDs.
-	 */
-	UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
+	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
 
-	/*
-	 * Ands are made implicit during shard pruning, as predicate comparison and
-	 * refutation depend on it being so. We need to make them explicit again so
-	 * that the query string is generated as (...) AND (...) as opposed to
-	 * (...), (...).
-	 */
-	if (taskQuery->jointree->quals != NULL && IsA(taskQuery->jointree->quals, List))
+	if (templateTask != NULL)
 	{
-		taskQuery->jointree->quals = (Node *) make_ands_explicit(
-			(List *) taskQuery->jointree->quals);
+		/* the query string only differs from the template task in shard names */
+		char *queryString = DeriveQueryStringFromTask(templateTask, relationShardList);
+		ereport(DEBUG4, (errmsg("distributed statement: %s", queryString)));
+		SetTaskQueryString(subqueryTask, queryString);
 	}
+	else if ((taskType == MODIFY_TASK && !modifyRequiresCoordinatorEvaluation) ||
+			 taskType == READ_TASK)
+	{
+		Query *taskQuery = copyObject(originalQuery);
+		StringInfo queryString = makeStringInfo();
 
-	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
+		/*
+		 * Augment the relations in the query with the shard IDs.
+		 */
+		UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
+
+		/*
+		 * Ands are made implicit during shard pruning, as predicate comparison and
+		 * refutation depend on it being so. We need to make them explicit again so
+		 * that the query string is generated as (...) AND (...) as opposed to
+		 * (...), (...).
+		 */
+		if (taskQuery->jointree->quals != NULL && IsA(taskQuery->jointree->quals, List))
+		{
+			taskQuery->jointree->quals = (Node *) make_ands_explicit(
+				(List *) taskQuery->jointree->quals);
+		}
 
-	if ((taskType == MODIFY_TASK && !modifyRequiresCoordinatorEvaluation) ||
-		taskType == READ_TASK)
-	{
 		pg_get_query_def(taskQuery, queryString);
 		ereport(DEBUG4, (errmsg("distributed statement: %s",
 								queryString->data)));
@@ -4288,24 +4539,8 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 	List *mapTaskList = NIL;
 	Query *filterQuery = mapMergeJob->job.jobQuery;
 	ListCell *filterTaskCell = NULL;
-	Var *partitionColumn = mapMergeJob->partitionColumn;
-
-	uint32 partitionColumnResNo = 0;
-	List *groupClauseList = filterQuery->groupClause;
-	if (groupClauseList != NIL)
-	{
-		List *targetEntryList = filterQuery->targetList;
-		List *groupTargetEntryList = GroupTargetEntryList(groupClauseList,
-														  targetEntryList);
-		TargetEntry *groupByTargetEntry = (TargetEntry *) linitial(groupTargetEntryList);
 
-		partitionColumnResNo = groupByTargetEntry->resno;
-	}
-	else
-	{
-		partitionColumnResNo = PartitionColumnIndex(partitionColumn,
-													filterQuery->targetList);
-	}
+	uint32 partitionColumnResNo = MapMergeJobPartitionColumnResNo(mapMergeJob);
 
 	/* determine whether all types have binary input/output functions */
 	bool useBinaryFormat = CanUseBinaryCopyFormatForTargetList(filterQuery->targetList);
@@ -4313,9 +4548,23 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 	foreach(filterTaskCell, filterTaskList)
 	{
 		Task *filterTask = (Task *) lfirst(filterTaskCell);
+		char *filterQueryString = TaskQueryString(filterTask);
 		StringInfo mapQueryString = CreateMapQueryString(mapMergeJob, filterTask,
+														 filterQueryString,
 														 partitionColumnResNo,
-														 useBinaryFormat);
+														 useBinaryFormat, NULL);
+
+		/*
+		 * The executor needs the filter queries to build join key bloom filters
+		 * and to rebuild the map queries with them.
+		 */
+		if (EnableRepartitionJoinBloomFilter &&
+			mapMergeJob->partitionType == DUAL_HASH_PARTITION_TYPE)
+		{
+			mapMergeJob->filterQueryStringList =
+				lappend(mapMergeJob->filterQueryStringList,
+						makeString(filterQueryString));
+		}
 
 		/* convert filter query task into map task */
 		Task *mapTask = filterTask;
@@ -4336,6 +4585,64 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 }
 
 
+/*
+ * MapMergeJobPartitionColumnResNo returns the resno of the column by which the
+ * results of the filter queries of the given MapMerge job are partitioned.
+ */
+static uint32
+MapMergeJobPartitionColumnResNo(MapMergeJob *mapMergeJob)
+{
+	Query *filterQuery = mapMergeJob->job.jobQuery;
+	List *groupClauseList = filterQuery->groupClause;
+	if (groupClauseList != NIL)
+	{
+		List *targetEntryList = filterQuery->targetList;
+		List *groupTargetEntryList = GroupTargetEntryList(groupClauseList,
+														  targetEntryList);
+		TargetEntry *groupByTargetEntry = (TargetEntry *) linitial(groupTargetEntryList);
+
+		return groupByTargetEntry->resno;
+	}
+
+	return PartitionColumnIndex(mapMergeJob->partitionColumn, filterQuery->targetList);
+}
+
+
+/*
+ * MapMergeJobPartitionColumnIndex returns the zero-based index of the partition
+ * column in the results of the filter queries of the given MapMerge job, as
+ * expected by worker_partition_query_result and worker_join_key_bloom_filter.
+ */
+int
+MapMergeJobPartitionColumnIndex(MapMergeJob *mapMergeJob)
+{
+	return MapMergeJobPartitionColumnResNo(mapMergeJob) - 1;
+}
+
+
+/*
+ * SetMapTaskJoinKeyFilter rebuilds the query string of the given map task such
+ * that the filter query results whose partition column values are not in the
+ * join key bloom filter stored in the given intermediate result are not written.
+ */
+void
+SetMapTaskJoinKeyFilter(MapMergeJob *mapMergeJob, Task *mapTask,
+						char *filterQueryString, char *joinKeyFilterResultId)
+{
+	Query *filterQuery = mapMergeJob->job.jobQuery;
+	uint32 partitionColumnResNo = MapMergeJobPartitionColumnResNo(mapMergeJob);
+	bool useBinaryFormat = CanUseBinaryCopyFormatForTargetList(filterQuery->targetList);
+
+	StringInfo mapQueryString = CreateMapQueryString(mapMergeJob, mapTask,
+													 filterQueryString,
+													 partitionColumnResNo,
+													 useBinaryFormat,
+													 joinKeyFilterResultId);
+
+	SetTaskQueryString(mapTask, mapQueryString->data);
+}
+
+
 /*
  * PartitionColumnIndex finds the index of the given target var.
  */
@@ -4366,10 +4673,13 @@ PartitionColumnIndex(Var *targetVar, List *targetList)
 
 /*
  * CreateMapQueryString creates and returns the map query string for the given filterTask.
+ * If joinKeyFilterResultId is not NULL, the map query only writes the rows whose
+ * partition column value may be in the bloom filter stored in that result.
  */
 static StringInfo
 CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
-					 uint32 partitionColumnIndex, bool useBinaryFormat)
+					 char *filterQueryString, uint32 partitionColumnIndex,
+					 bool useBinaryFormat, char *joinKeyFilterResultId)
 {
 	uint64 jobId = filterTask->jobId;
 	uint32 taskId = filterTask->taskId;
@@ -4377,7 +4687,6 @@ CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 
 	/* wrap repartition query string around filter query string */
 	StringInfo mapQueryString = makeStringInfo();
-	char *filterQueryString = TaskQueryString(filterTask);
 	PartitionType partitionType = mapMergeJob->partitionType;
 
 	Var *partitionColumn = mapMergeJob->partitionColumn;
@@ -4437,7 +4746,7 @@ CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 					 ", %s || '_' || partition_index::text "
 					 ", rows_written "
 					 "FROM pg_catalog.worker_partition_query_result"
-					 "(%s,%s,%d,%s,%s,%s,%s,%s,%s) WHERE rows_written > 0",
+					 "(%s,%s,%d,%s,%s,%s,%s,%s,%s",
 					 quote_literal_cstr(resultNamePrefix),
 					 quote_literal_cstr(resultNamePrefix),
 					 quote_literal_cstr(filterQueryString),
@@ -4449,6 +4758,14 @@ CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 					 allowNullPartitionColumnValue ? "true" : "false",
 					 generateEmptyResults ? "true" : "false");
 
+	if (joinKeyFilterResultId != NULL)
+	{
+		appendStringInfo(mapQueryString, ",%s",
+						 quote_literal_cstr(joinKeyFilterResultId));
+	}
+
+	appendStringInfoString(mapQueryString, ") WHERE rows_written > 0");
+
 	return mapQueryString;
 }
 
@@ -5025,6 +5342,10 @@ AssignAnchorShardTaskList(List *taskList)
 	{
 		assignedTaskList = RoundRobinAssignTaskList(taskList);
 	}
+	else if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LATENCY_AWARE)
+	{
+		assignedTaskList = LatencyAwareAssignTaskList(taskList);
+	}
 
 	Assert(assignedTaskList != NIL);
 	return assignedTaskList;
@@ -5239,6 +5560,178 @@ RoundRobinReorder(List *placementList)
 }
 
 
+/*
+ * LatencyAwareAssignTaskList assigns each task to the placement on the node with
+ * the lowest expected response time. The expected response time of a node is the
+ * moving average of its response times, as observed by the adaptive executor on
+ * any backend, multiplied by the number of tasks that would be running on it.
+ * Tasks that we assign here also count towards the load of the node, such that
+ * the tasks of a single query are spread across the replicas.
+ */
+List *
+LatencyAwareAssignTaskList(List *taskList)
+{
+	List *assignedTaskList = NIL;
+	List *nodeLoadList = NIL;
+	ListCell *taskCell = NULL;
+	ListCell *placementListCell = NULL;
+	uint32 unAssignedTaskCount = 0;
+
+	if (taskList == NIL)
+	{
+		return NIL;
+	}
+
+	/* sort the tasks, such that the assignment does not depend on their order */
+	taskList = SortList(taskList, CompareTasksByShardId);
+	List *activeShardPlacementLists = ActiveShardPlacementLists(taskList);
+
+	forboth(taskCell, taskList, placementListCell, activeShardPlacementLists)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		List *placementList = (List *) lfirst(placementListCell);
+
+		/* inactive placements are already filtered out */
+		if (placementList == NIL)
+		{
+			unAssignedTaskCount++;
+			continue;
+		}
+
+		task->taskPlacementList = ReorderPlacementsByNodeLoad(placementList,
+															  &nodeLoadList);
+
+		ShardPlacement *primaryPlacement = (ShardPlacement *) linitial(
+			task->taskPlacementList);
+		ereport(DEBUG3, (errmsg("assigned task %u to node %s:%u", task->taskId,
+								primaryPlacement->nodeName,
+								primaryPlacement->nodePort)));
+
+		assignedTaskList = lappend(assignedTaskList, task);
+	}
+
+	/* if we have unassigned tasks, error out */
+	if (unAssignedTaskCount > 0)
+	{
+		ereport(ERROR, (errmsg("failed to assign %u task(s) to worker nodes",
+							   unAssignedTaskCount)));
+	}
+
+	return assignedTaskList;
+}
+
+
+/*
+ * LatencyAwareReorder moves the placement on the node with the lowest expected
+ * response time to the front of the given placement list, for a single task.
+ */
+List *
+LatencyAwareReorder(List *placementList)
+{
+	List *nodeLoadList = NIL;
+
+	return ReorderPlacementsByNodeLoad(placementList, &nodeLoadList);
+}
+
+
+/*
+ * ReorderPlacementsByNodeLoad returns a copy of the placement list in which the
+ * placement on the node with the lowest expected response time comes first, and
+ * the remaining placements keep their order for failover. The load of the chosen
+ * node in nodeLoadList is increased by one task.
+ */
+static List *
+ReorderPlacementsByNodeLoad(List *placementList, List **nodeLoadList)
+{
+	ShardPlacement *bestPlacement = NULL;
+	PlacementNodeLoad *bestNodeLoad = NULL;
+	double bestExpectedResponseTime = 0;
+
+	ShardPlacement *placement = NULL;
+	foreach_declared_ptr(placement, placementList)
+	{
+		PlacementNodeLoad *nodeLoad = FindOrCreatePlacementNodeLoad(placement,
+																	nodeLoadList);
+
+		/*
+		 * Until we observed any tasks at all, the nodes only differ by their
+		 * load. Ties are broken by the placement order.
+		 */
+		double expectedResponseTime =
+			Max(nodeLoad->responseTime, 1.0) * (1 + nodeLoad->taskCount);
+
+		if (bestPlacement == NULL || expectedResponseTime < bestExpectedResponseTime)
+		{
+			bestPlacement = placement;
+			bestNodeLoad = nodeLoad;
+			bestExpectedResponseTime = expectedResponseTime;
+		}
+	}
+
+	if (bestPlacement == NULL)
+	{
+		return placementList;
+	}
+
+	bestNodeLoad->taskCount++;
+
+	List *reorderedPlacementList = list_make1(bestPlacement);
+	foreach_declared_ptr(placement, placementList)
+	{
+		if (placement != bestPlacement)
+		{
+			reorderedPlacementList = lappend(reorderedPlacementList, placement);
+		}
+	}
+
+	return reorderedPlacementList;
+}
+
+
+/*
+ * FindOrCreatePlacementNodeLoad returns the load of the node of the given
+ * placement from nodeLoadList, fetching it from shared memory when we see the
+ * node for the first time.
+ */
+static PlacementNodeLoad *
+FindOrCreatePlacementNodeLoad(ShardPlacement *placement, List **nodeLoadList)
+{
+	PlacementNodeLoad *nodeLoad = NULL;
+	foreach_declared_ptr(nodeLoad, *nodeLoadList)
+	{
+		if (nodeLoad->nodePort == placement->nodePort &&
+			strncmp(nodeLoad->nodeName, placement->nodeName, WORKER_LENGTH) == 0)
+		{
+			return nodeLoad;
+		}
+	}
+
+	nodeLoad = palloc0(sizeof(PlacementNodeLoad));
+	nodeLoad->nodeName = placement->nodeName;
+	nodeLoad->nodePort = placement->nodePort;
+
+	int inFlightTaskCount = 0;
+	nodeLoad->responseTime = GetNodeResponseTime(placement->nodeName,
+												 placement->nodePort,
+												 &inFlightTaskCount);
+	nodeLoad->taskCount = inFlightTaskCount;
+
+	if (nodeLoad->responseTime <= 0)
+	{
+		/*
+		 * We did not observe any tasks on the node yet. Assume it is as fast as
+		 * the average node, such that it neither attracts all tasks nor is
+		 * never tried.
+		 */
+		nodeLoad->responseTime = GetMeanNodeResponseTime();
+	}
+
+	*nodeLoadList = lappend(*nodeLoadList, nodeLoad);
+
+	return nodeLoad;
+}
+
+
 /*
  * ReorderAndAssignTaskList finds the placements for a task based on its anchor
  * shard id and then sorts them by insertion time. If reorderFunction is given,
@@ -58,6 +58,7 @@
 #include "distributed/distribution_column.h"
 #include "distributed/errormessage.h"
 #include "distributed/executor_util.h"
+#include "distributed/fast_path_query_cache.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/listutils.h"
@@ -164,7 +165,7 @@ static List * SingleShardTaskList(Query *query, uint64 jobId,
 								  List *relationShardList, List *placementList,
 								  uint64 shardId, bool parametersInQueryResolved,
 								  bool isLocalTableModification, Const *partitionKeyValue,
-								  int colocationId);
+								  int colocationId, char *queryStringCacheKey);
 static bool RowLocksOnRelations(Node *node, List **rtiLockList);
 static void ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 														TaskAssignmentPolicyType
@@ -1970,7 +1971,8 @@ GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
 											shardId,
 											job->parametersInJobQueryResolved,
 											isLocalTableModification,
-											job->partitionKeyValue, job->colocationId);
+											job->partitionKeyValue, job->colocationId,
+											job->queryStringCacheKey);
 
 		/*
 		 * Queries to reference tables, or distributed tables with multiple replica's have
@@ -2001,7 +2003,8 @@ GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
 											shardId,
 											job->parametersInJobQueryResolved,
 											isLocalTableModification,
-											job->partitionKeyValue, job->colocationId);
+											job->partitionKeyValue, job->colocationId,
+											job->queryStringCacheKey);
 	}
 }
 
@@ -2012,6 +2015,8 @@ GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
  *
  * Supported Types
  * - TASK_ASSIGNMENT_ROUND_ROBIN round robin schedule queries among placements
+ * - TASK_ASSIGNMENT_LATENCY_AWARE prefer the placement on the node with the lowest
+ *   expected response time
  *
  * By default it does not reorder the task list, implying a first-replica strategy.
  */
@@ -2047,6 +2052,22 @@ ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 		List *reorderedPlacementList = RoundRobinReorder(placementList);
 		task->taskPlacementList = reorderedPlacementList;
 
+		ShardPlacement *primaryPlacement = (ShardPlacement *) linitial(
+			reorderedPlacementList);
+		ereport(DEBUG3, (errmsg("assigned task %u to node %s:%u", task->taskId,
+								primaryPlacement->nodeName,
+								primaryPlacement->nodePort)));
+	}
+	else if (taskAssignmentPolicy == TASK_ASSIGNMENT_LATENCY_AWARE)
+	{
+		Assert(list_length(job->taskList) == 1);
+		Task *task = (Task *) linitial(job->taskList);
+
+		Assert(ReadOnlyTask(task->taskType));
+
+		List *reorderedPlacementList = LatencyAwareReorder(placementList);
+		task->taskPlacementList = reorderedPlacementList;
+
 		ShardPlacement *primaryPlacement = (ShardPlacement *) linitial(
 			reorderedPlacementList);
 		ereport(DEBUG3, (errmsg("assigned task %u to node %s:%u", task->taskId,
@@ -2096,7 +2117,7 @@ SingleShardTaskList(Query *query, uint64 jobId, List *relationShardList,
 					List *placementList, uint64 shardId,
 					bool parametersInQueryResolved,
 					bool isLocalTableModification, Const *partitionKeyValue,
-					int colocationId)
+					int colocationId, char *queryStringCacheKey)
 {
 	TaskType taskType = READ_TASK;
 	char replicationModel = 0;
@@ -2168,7 +2189,7 @@ SingleShardTaskList(Query *query, uint64 jobId, List *relationShardList,
 	task->taskPlacementList = placementList;
 	task->partitionKeyValue = partitionKeyValue;
 	task->colocationId = colocationId;
-	SetTaskQueryIfShouldLazyDeparse(task, query);
+	SetTaskQueryFromFastPathQueryCache(task, query, queryStringCacheKey, shardId);
 	task->anchorShardId = shardId;
 	task->jobId = jobId;
 	task->relationShardList = relationShardList;
@@ -52,6 +52,7 @@
 
 #include "catalog/pg_class.h"
 #include "catalog/pg_type.h"
+#include "common/hashfn.h"
 #include "lib/stringinfo.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
@@ -71,6 +72,7 @@
 
 #include "pg_version_constants.h"
 
+#include "distributed/broadcast_join_planner.h"
 #include "distributed/citus_nodes.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands/multi_copy.h"
@@ -85,11 +87,14 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/namespace_utils.h"
 #include "distributed/query_colocation_checker.h"
 #include "distributed/query_pushdown_planning.h"
+#include "distributed/query_utils.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/relation_restriction_equivalence.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/subplan_execution.h"
 #include "distributed/version_compat.h"
 
 /*
@@ -175,8 +180,10 @@ static bool RecursivelyPlanSubquery(Query *subquery,
 static void RecursivelyPlanSetOperations(Query *query, Node *node,
 										 RecursivePlanningContext *context);
 static bool IsLocalTableRteOrMatView(Node *node);
-static DistributedSubPlan * CreateDistributedSubPlan(uint32 subPlanId,
+static DistributedSubPlan * CreateDistributedSubPlan(uint64 planId, uint32 subPlanId,
 													 Query *subPlanQuery);
+static char * ReusableSubPlanResultId(Query *subquery, List **relationIdList,
+									  char **queryString);
 static bool CteReferenceListWalker(Node *node, CteReferenceWalkerContext *context);
 static bool ContainsReferencesToOuterQueryWalker(Node *node,
 												 VarLevelsUpWalkerContext *context);
@@ -347,6 +354,19 @@ RecursivelyPlanSubqueriesAndCTEs(Query *query, RecursivePlanningContext *context
 		RecursivelyPlanLocalTableJoins(query, context);
 	}
 
+	/*
+	 * Joins between distributed tables that are not co-located would need to
+	 * repartition both tables. When some of the tables are expected to be small,
+	 * we instead recursively plan them, which broadcasts their rows to the nodes
+	 * of the large table.
+	 */
+	if (!context->allDistributionKeysInQueryAreEqual &&
+		ShouldRecursivelyPlanSmallDistributedTables(query) &&
+		!AllDistributionKeysInSubqueryAreEqual(query, context->plannerRestrictionContext))
+	{
+		RecursivelyPlanSmallDistributedTables(query, context);
+	}
+
 	/*
 	 * Similarly, logical planner cannot handle outer joins when the outer rel
 	 * is recurring, such as "<recurring> LEFT JOIN <distributed>". In that case,
@@ -1146,11 +1166,12 @@ RecursivelyPlanCTEs(Query *query, RecursivePlanningContext *planningContext)
 		}
 
 		/* build a sub plan for the CTE */
-		DistributedSubPlan *subPlan = CreateDistributedSubPlan(subPlanId, subquery);
+		DistributedSubPlan *subPlan = CreateDistributedSubPlan(planId, subPlanId,
+															   subquery);
 		planningContext->subPlanList = lappend(planningContext->subPlanList, subPlan);
 
 		/* build the result_id parameter for the call to read_intermediate_result */
-		char *resultId = GenerateResultId(planId, subPlanId);
+		char *resultId = subPlan->resultId;
 
 		if (subquery->returningList)
 		{
@@ -1540,11 +1561,11 @@ RecursivelyPlanSubquery(Query *subquery, RecursivePlanningContext *planningConte
 	 */
 	int subPlanId = list_length(planningContext->subPlanList) + 1;
 
-	DistributedSubPlan *subPlan = CreateDistributedSubPlan(subPlanId, subquery);
+	DistributedSubPlan *subPlan = CreateDistributedSubPlan(planId, subPlanId, subquery);
 	planningContext->subPlanList = lappend(planningContext->subPlanList, subPlan);
 
 	/* build the result_id parameter for the call to read_intermediate_result */
-	char *resultId = GenerateResultId(planId, subPlanId);
+	char *resultId = subPlan->resultId;
 
 	/*
 	 * BuildSubPlanResultQuery() can optionally use provided column aliases.
@@ -1572,12 +1593,24 @@ RecursivelyPlanSubquery(Query *subquery, RecursivePlanningContext *planningConte
 /*
  * CreateDistributedSubPlan creates a distributed subplan by recursively calling
  * the planner from the top, which may either generate a local plan or another
- * distributed plan, which can itself contain subplans.
+ * distributed plan, which can itself contain subplans. The result of the
+ * subplan is named after the plan and subplan IDs, unless it can be reused
+ * across executions.
  */
 static DistributedSubPlan *
-CreateDistributedSubPlan(uint32 subPlanId, Query *subPlanQuery)
+CreateDistributedSubPlan(uint64 planId, uint32 subPlanId, Query *subPlanQuery)
 {
 	int cursorOptions = 0;
+	List *relationIdList = NIL;
+	char *resultQueryString = NULL;
+
+	/* the planner modifies the query, so derive the result ID beforehand */
+	char *resultId = ReusableSubPlanResultId(subPlanQuery, &relationIdList,
+											 &resultQueryString);
+	if (resultId == NULL)
+	{
+		resultId = GenerateResultId(planId, subPlanId);
+	}
 
 	if (ContainsReadIntermediateResultFunction((Node *) subPlanQuery))
 	{
@@ -1595,11 +1628,87 @@ CreateDistributedSubPlan(uint32 subPlanId, Query *subPlanQuery)
 	DistributedSubPlan *subPlan = CitusMakeNode(DistributedSubPlan);
 	subPlan->plan = planner(subPlanQuery, NULL, cursorOptions, NULL);
 	subPlan->subPlanId = subPlanId;
+	subPlan->resultId = resultId;
+	subPlan->relationIdList = relationIdList;
+	subPlan->resultQueryString = resultQueryString;
 
 	return subPlan;
 }
 
 
+/*
+ * ReusableSubPlanResultId returns a result ID that is derived from the query
+ * text of the given subquery if its result can be reused by later executions
+ * of the same subquery in the transaction, and NULL otherwise.
+ *
+ * That is the case for SELECT queries that only read reference tables and do
+ * not call mutable functions, such that the result only changes when one of
+ * the tables is modified. The reference tables are returned in relationIdList
+ * for invalidating the result on modifications. The query text is returned in
+ * queryString, such that a result is only reused for the same text and not
+ * just for the same hash.
+ */
+static char *
+ReusableSubPlanResultId(Query *subquery, List **relationIdList, char **queryString)
+{
+	List *rangeTableList = NIL;
+	List *referenceTableIdList = NIL;
+
+	if (!EnableSubPlanResultReuse)
+	{
+		return NULL;
+	}
+
+	if (subquery->commandType != CMD_SELECT || subquery->hasModifyingCTE ||
+		subquery->rowMarks != NIL)
+	{
+		return NULL;
+	}
+
+	/* this also excludes subqueries that read other intermediate results */
+	if (contain_mutable_functions((Node *) subquery))
+	{
+		return NULL;
+	}
+
+	ExtractRangeTableRelationWalker((Node *) subquery, &rangeTableList);
+	if (rangeTableList == NIL)
+	{
+		return NULL;
+	}
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_declared_ptr(rangeTableEntry, rangeTableList)
+	{
+		if (!IsCitusTableType(rangeTableEntry->relid, REFERENCE_TABLE) ||
+			rangeTableEntry->tablesample != NULL)
+		{
+			return NULL;
+		}
+
+		referenceTableIdList = list_append_unique_oid(referenceTableIdList,
+													  rangeTableEntry->relid);
+	}
+
+	/* qualify all names, such that the text identifies the same relations */
+	StringInfo qualifiedQueryString = makeStringInfo();
+	int saveNestLevel = PushEmptySearchPath();
+	pg_get_query_def(subquery, qualifiedQueryString);
+	PopEmptySearchPath(saveNestLevel);
+
+	uint64 queryHash = hash_bytes_extended((unsigned char *) qualifiedQueryString->data,
+										   qualifiedQueryString->len, 0);
+
+	StringInfo resultId = makeStringInfo();
+	appendStringInfo(resultId, "reuse_" UINT64_FORMAT, queryHash);
+
+	*relationIdList = referenceTableIdList;
+	*queryString = qualifiedQueryString->data;
+
+	return resultId->data;
+}
+
+
 /*
  * CteReferenceListWalker finds all references to CTEs in the top level of a query
  * and adds them to context->cteReferenceList.
@@ -35,6 +35,7 @@
 #include "optimizer/plancat.h"
 #include "optimizer/planner.h"
 #include "port/atomics.h"
+#include "postmaster/bgworker.h"
 #include "postmaster/postmaster.h"
 #include "replication/walsender.h"
 #include "storage/ipc.h"
@@ -53,6 +54,7 @@
 #include "distributed/adaptive_executor.h"
 #include "distributed/backend_data.h"
 #include "distributed/background_jobs.h"
+#include "distributed/broadcast_join_planner.h"
 #include "distributed/causal_clock.h"
 #include "distributed/citus_depended_object.h"
 #include "distributed/citus_nodefuncs.h"
@@ -66,8 +68,14 @@
 #include "distributed/cte_inline.h"
 #include "distributed/distributed_deadlock_detection.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/distributed_statistics.h"
 #include "distributed/errormessage.h"
+#include "distributed/fast_path_query_cache.h"
+#include "distributed/intermediate_result_compression.h"
+#include "distributed/intermediate_result_memory.h"
 #include "distributed/intermediate_result_pruning.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/intermediate_results.h"
 #include "distributed/local_distributed_join_planner.h"
 #include "distributed/local_executor.h"
 #include "distributed/local_multi_copy.h"
@@ -85,6 +93,8 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/parallel_multi_copy.h"
+#include "distributed/pass_through_multi_copy.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/placement_connection.h"
 #include "distributed/priority.h"
@@ -104,6 +114,7 @@
 #include "distributed/shard_transfer.h"
 #include "distributed/shardsplit_shared_memory.h"
 #include "distributed/shared_connection_stats.h"
+#include "distributed/shared_worker_pool_stats.h"
 #include "distributed/shared_library_init.h"
 #include "distributed/statistics_collection.h"
 #include "distributed/subplan_execution.h"
@@ -241,6 +252,7 @@ static const struct config_enum_entry task_assignment_policy_options[] = {
 	{ "greedy", TASK_ASSIGNMENT_GREEDY, false },
 	{ "first-replica", TASK_ASSIGNMENT_FIRST_REPLICA, false },
 	{ "round-robin", TASK_ASSIGNMENT_ROUND_ROBIN, false },
+	{ "latency-aware", TASK_ASSIGNMENT_LATENCY_AWARE, false },
 	{ NULL, 0, false }
 };
 
@@ -314,6 +326,17 @@ static const struct config_enum_entry create_object_propagation_options[] = {
 	{NULL,        0,                                   false}
 };
 
+static const struct config_enum_entry intermediate_result_compression_options[] = {
+	{ "none", INTERMEDIATE_RESULT_COMPRESSION_NONE, false },
+#if HAVE_CITUS_LIBLZ4
+	{ "lz4", INTERMEDIATE_RESULT_COMPRESSION_LZ4, false },
+#endif
+#if HAVE_LIBZSTD
+	{ "zstd", INTERMEDIATE_RESULT_COMPRESSION_ZSTD, false },
+#endif
+	{ NULL, 0, false }
+};
+
 /*
  * This used to choose CPU priorities for GUCs. For most other integer options
  * we use the -1 value as inherit/default/unset. For CPU priorities this isn't
@@ -446,6 +469,7 @@ _PG_init(void)
 
 	/* make our custom scan nodes known */
 	RegisterCitusCustomScanMethods();
+	RegisterIntermediateResultScanMethods();
 
 	/* intercept planner */
 	planner_hook = distributed_planner;
@@ -486,6 +510,9 @@ _PG_init(void)
 	InitRelationAccessHash();
 	InitializeCitusQueryStats();
 	InitializeSharedConnectionStats();
+	InitializeIntermediateResultMemory();
+	InitializeSharedWorkerPoolStats();
+	InitializeFastPathQueryCache();
 	InitializeLocallyReservedSharedConnections();
 	InitializeClusterClockMem();
 
@@ -611,6 +638,9 @@ citus_shmem_request(void)
 
 	RequestAddinShmemSpace(BackendManagementShmemSize());
 	RequestAddinShmemSpace(SharedConnectionStatsShmemSize());
+	RequestAddinShmemSpace(IntermediateResultMemoryShmemSize());
+	RequestAddinShmemSpace(SharedWorkerPoolStatsShmemSize());
+	RequestAddinShmemSpace(FastPathQueryCacheShmemSize());
 	RequestAddinShmemSpace(MaintenanceDaemonShmemSize());
 	RequestAddinShmemSpace(CitusQueryStatsSharedMemSize());
 	RequestAddinShmemSpace(LogicalClockShmemSize());
@@ -899,6 +929,21 @@ CreateRequiredDirectories(void)
 static void
 RegisterCitusConfigVariables(void)
 {
+	DefineCustomRealVariable(
+		"citus.adaptive_pool_size_latency_threshold",
+		gettext_noop("Sets the increase in task execution time on a node that is "
+					 "considered as saturation of the node."),
+		gettext_noop("When citus.enable_adaptive_pool_size_control is enabled and "
+					 "the average task execution time on a node exceeds the moving "
+					 "average of the earlier executions multiplied by this value, "
+					 "the maximum number of connections the executor opens to the "
+					 "node is halved."),
+		&AdaptivePoolSizeLatencyThreshold,
+		2.0, 1.0, 1000.0,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.all_modifications_commutative",
 		gettext_noop("Bypasses commutativity checks when enabled"),
@@ -993,6 +1038,22 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.broadcast_join_threshold",
+		gettext_noop("Sets the estimated size in KB below which distributed tables "
+					 "are broadcast in joins with non-co-located distributed tables."),
+		gettext_noop("When a query joins distributed tables that are not co-located, "
+					 "the distributed tables whose estimated size after filtering is "
+					 "below this threshold are planned as intermediate results that "
+					 "are broadcast to the nodes of the largest table, instead of "
+					 "repartitioning both tables. The estimate is based on the shard "
+					 "sizes in pg_dist_placement. 0 disables broadcast joins."),
+		&BroadcastJoinThreshold,
+		0, 0, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.check_available_space_before_move",
 		gettext_noop("When enabled will check free disk space before a shard move"),
@@ -1176,6 +1237,38 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		ErrorIfNotASuitableDeadlockFactor, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.distributed_statistics_interval",
+		gettext_noop("Sets the time to wait between collecting the statistics "
+					 "of distributed tables from their shards."),
+		gettext_noop("The maintenance daemon on the coordinator periodically "
+					 "reads the row counts, page counts and column statistics "
+					 "of the shards from the worker nodes, and stores them on "
+					 "the distributed tables such that the planner can use them. "
+					 "The shards need to be analyzed on the workers. When set "
+					 "to 0, statistics are only collected by "
+					 "citus_update_distributed_statistics."),
+		&DistributedStatisticsInterval,
+		0, 0, 7 * 24 * 3600 * 1000,
+		PGC_SIGHUP,
+		GUC_UNIT_MS,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_adaptive_pool_size_control",
+		gettext_noop("Enables learning the executor pool size per worker node."),
+		gettext_noop("When enabled, the adaptive executor shares the task execution "
+					 "times and connection failures it observes per worker node "
+					 "with the other backends. The maximum number of connections "
+					 "opened to a node is halved when the node appears saturated, "
+					 "and increased by one when the limit was the bottleneck, "
+					 "up to citus.max_adaptive_executor_pool_size."),
+		&EnableAdaptivePoolSizeControl,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_alter_database_owner",
 		gettext_noop("Enables propagating ALTER DATABASE ... OWNER TO ... statements to "
@@ -1242,6 +1335,23 @@ RegisterCitusConfigVariables(void)
 		PGC_USERSET,
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_columnar_intermediate_results",
+		gettext_noop("Stores binary intermediate results in a columnar layout."),
+		gettext_noop("When enabled, intermediate results in binary format are "
+					 "written column by column in groups of rows, and compressed "
+					 "per column when citus.intermediate_result_compression is "
+					 "set. Reads that only need some of the columns, such as "
+					 "intermediate result scans and read_intermediate_result "
+					 "with a list of columns, then skip the other columns, "
+					 "which helps when subplans return wide rows."),
+		&EnableColumnarIntermediateResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_cost_based_connection_establishment",
 		gettext_noop("When enabled the connection establishment times "
@@ -1321,6 +1431,37 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_hedged_reads",
+		gettext_noop("Enables sending slow reads to a second shard placement."),
+		gettext_noop("When enabled, a read-only task on a replicated shard that "
+					 "runs longer than citus.hedged_read_latency_percentile of "
+					 "the recent task execution times on its node is also sent "
+					 "to another placement. The results of the placement that "
+					 "answers first are used and the other one is cancelled. "
+					 "Reads in transaction blocks are never hedged."),
+		&EnableHedgedReads,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_intermediate_result_scan",
+		gettext_noop("Reads binary intermediate results without materializing "
+					 "them first."),
+		gettext_noop("When enabled, read_intermediate_result and "
+					 "read_intermediate_results calls in binary format with "
+					 "constant result IDs are planned as a custom scan that maps "
+					 "the result files into memory and decodes one row at a time, "
+					 "instead of a function scan that parses all rows into a "
+					 "tuple store before returning the first one."),
+		&EnableIntermediateResultScan,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_local_execution",
 		gettext_noop("Enables queries on shards that are local to the current node "
@@ -1396,6 +1537,54 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_copy_to",
+		gettext_noop("Exports the shards of distributed tables concurrently in "
+					 "COPY ... TO STDOUT."),
+		gettext_noop("When enabled, COPY of a distributed table to STDOUT runs "
+					 "COPY on all shards at once, using up to "
+					 "citus.max_adaptive_executor_pool_size connections per node, "
+					 "and forwards the data of each shard as it arrives. Rows of "
+					 "different shards are interleaved in the output. COPY with "
+					 "HEADER always exports the shards one by one."),
+		&EnableParallelCopyTo,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_pass_through_copy",
+		gettext_noop("Routes text and CSV input of COPY into hash-distributed tables "
+					 "by only parsing the distribution column."),
+		gettext_noop("When enabled, COPY into hash-distributed tables only parses "
+					 "the distribution column of each line to find its shard, and "
+					 "forwards the line as is. The other columns are parsed by the "
+					 "shards, so errors in them are reported with the line number "
+					 "within the COPY into the shard. Columns that are not in the "
+					 "input must have immutable defaults for the optimisation to "
+					 "apply."),
+		&EnablePassThroughCopy,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_join_bloom_filter",
+		gettext_noop("Filters the rows of dual hash repartition joins using a bloom "
+					 "filter of the join keys of the smaller side."),
+		gettext_noop("When enabled, the executor first builds a bloom filter of the "
+					 "join keys on both sides of inner repartition joins between two "
+					 "tables. The filter of the side with fewer rows is then used to "
+					 "skip the rows of the other side that cannot join, before they "
+					 "are repartitioned across the cluster."),
+		&EnableRepartitionJoinBloomFilter,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_repartition_joins",
 		gettext_noop("Allows Citus to repartition data between nodes."),
@@ -1416,6 +1605,22 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_repartitioned_window_functions",
+		gettext_noop("Computes window functions that are not partitioned by the "
+					 "distribution column on the workers by repartitioning the rows."),
+		gettext_noop("When enabled, and all window functions of a query are "
+					 "partitioned by a common column, the rows are hash "
+					 "repartitioned by that column across the workers, such that "
+					 "the window functions are computed in parallel rather than on "
+					 "the coordinator. Like repartition joins, this requires "
+					 "citus.enable_repartition_joins to be enabled."),
+		&EnableRepartitionedWindowFunctions,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_router_execution",
 		gettext_noop("Enables router execution"),
@@ -1469,6 +1674,22 @@ RegisterCitusConfigVariables(void)
 		&StatisticsCollectionGucCheckHook,
 		NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_subplan_result_reuse",
+		gettext_noop("Reuses the intermediate results of identical subplans on "
+					 "reference tables within a transaction."),
+		gettext_noop("When enabled, CTEs and subqueries that only read reference "
+					 "tables and do not call mutable functions are written to "
+					 "intermediate results that are named after the query text. "
+					 "Later statements of a repeatable read or serializable "
+					 "transaction reuse the results that were already sent to "
+					 "the worker nodes, until one of the tables is modified."),
+		&EnableSubPlanResultReuse,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_unique_job_ids",
 		gettext_noop("Enables unique job IDs by prepending the local process ID and "
@@ -1593,6 +1814,23 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.fast_path_query_cache_size",
+		gettext_noop("Sets the maximum number of fast path router query strings "
+					 "that are cached in shared memory."),
+		gettext_noop("For fast path router queries whose distribution column "
+					 "value is a parameter, the query for the shard is deparsed "
+					 "on every execution. When this setting is larger than 0, "
+					 "the deparsed query strings are cached in shared memory, "
+					 "such that backends executing the same statement with the "
+					 "same parameters can reuse them. Setting it to 0 disables "
+					 "the cache."),
+		&FastPathQueryCacheSize,
+		0, 0, 1000000,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.force_max_query_parallelization",
 		gettext_noop("Open as many connections as possible to maximize query "
@@ -1635,6 +1873,18 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomRealVariable(
+		"citus.hedged_read_latency_percentile",
+		gettext_noop("Sets the percentile of the recent task execution times on a "
+					 "node after which reads are hedged."),
+		gettext_noop("Only effective when citus.enable_hedged_reads is enabled. "
+					 "Lower values send more reads to a second placement."),
+		&HedgedReadLatencyPercentile,
+		95.0, 50.0, 100.0,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.hide_citus_dependent_objects",
 		gettext_noop(
@@ -1667,6 +1917,39 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomEnumVariable(
+		"citus.intermediate_result_compression",
+		gettext_noop("Sets the compression method for intermediate results."),
+		gettext_noop("When set, the intermediate results that this node writes "
+					 "are compressed once, sent and stored in compressed form, "
+					 "and decompressed while they are read. This reduces the "
+					 "network traffic of broadcasting and repartitioning results "
+					 "at the cost of CPU time. Results of repartition joins are "
+					 "written by the worker nodes, so the setting needs to be "
+					 "set on all nodes to compress those."),
+		&IntermediateResultCompression,
+		INTERMEDIATE_RESULT_COMPRESSION_NONE,
+		intermediate_result_compression_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.intermediate_result_relay_fanout",
+		gettext_noop("Sets the number of nodes to which broadcast intermediate "
+					 "results are sent directly."),
+		gettext_noop("When a result is broadcast to more nodes than this, it is "
+					 "only sent to this many nodes, which relay it to the other "
+					 "nodes while writing it locally. This moves the network "
+					 "traffic away from the node that broadcasts the result. "
+					 "Nodes that the relays do not reach receive the result "
+					 "directly. 0 sends the result to all nodes directly."),
+		&IntermediateResultRelayFanout,
+		0, 0, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.isolation_test_session_process_id",
 		NULL,
@@ -1926,6 +2209,50 @@ RegisterCitusConfigVariables(void)
 		NULL, NULL, NULL);
 
 
+	DefineCustomIntVariable(
+		"citus.max_intermediate_result_fetch_connections",
+		gettext_noop("Sets the maximum number of connections over which "
+					 "intermediate results are fetched from a single node."),
+		gettext_noop("fetch_intermediate_results, which is used to move "
+					 "repartitioned data between nodes, fetches multiple results "
+					 "from the same node concurrently over up to this number of "
+					 "connections. Connections beyond the first one are only "
+					 "opened when the shared connection limit allows it."),
+		&MaxIntermediateResultFetchConnections,
+		4, 1, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_intermediate_result_memory_per_node",
+		gettext_noop("Sets the maximum total size of the intermediate results "
+					 "that are kept in shared memory on this node."),
+		gettext_noop("Intermediate results that would exceed this size together "
+					 "with the results that are already kept in memory by all "
+					 "backends on this node are written to a file instead."),
+		&MaxIntermediateResultMemoryPerNode,
+		64 * 1024, 0, MAX_KILOBYTES,
+		PGC_SIGHUP,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_intermediate_result_memory_size",
+		gettext_noop("Sets the maximum size of intermediate results that are "
+					 "kept in shared memory for readers on the same node."),
+		gettext_noop("Intermediate results that are written on a node that also "
+					 "reads them, for instance when the coordinator has shards, "
+					 "are stored in dynamic shared memory instead of a file when "
+					 "they do not exceed this size. Local execution and other "
+					 "backends of the same distributed transaction then read them "
+					 "from memory. 0 disables keeping results in memory."),
+		&MaxIntermediateResultMemorySize,
+		0, 0, 512 * 1024,
+		PGC_SUSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_intermediate_result_size",
 		gettext_noop("Sets the maximum size of the intermediate results in KB for "
@@ -1948,6 +2275,23 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MB | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_parallel_copy_workers",
+		gettext_noop("Sets the maximum number of parallel workers that parse the "
+					 "input of COPY into distributed tables."),
+		gettext_noop("When set to a value above 0, text and CSV input of COPY FROM "
+					 "is split into chunks of lines that parallel workers parse and "
+					 "route to shards, while the backend that runs the COPY sends "
+					 "the rows to the shards over its own connections. COPY falls "
+					 "back to parsing the input itself when the input or the table "
+					 "does not allow parallel parsing, or when no parallel workers "
+					 "are available."),
+		&MaxParallelCopyWorkers,
+		0, 0, MAX_PARALLEL_WORKER_LIMIT,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_rebalancer_logged_ignored_moves",
 		gettext_noop("Sets the maximum number of ignored moves the rebalance logs"),
@@ -1972,6 +2316,22 @@ RegisterCitusConfigVariables(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, MaxSharedPoolSizeGucShowHook);
 
+	DefineCustomIntVariable(
+		"citus.max_tasks_per_batch",
+		gettext_noop("Sets the maximum number of read tasks for the same worker "
+					 "node that are combined into a single query."),
+		gettext_noop("Multi-shard queries that touch many small shards per node "
+					 "need many round trips. When this setting is larger than 1, "
+					 "the adaptive executor combines the shard queries for the "
+					 "same node outside of transaction blocks via UNION ALL, "
+					 "such that up to this many shards are read in a single "
+					 "round trip. The default value of 1 disables batching."),
+		&MaxTasksPerBatch,
+		1, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_worker_nodes_tracked",
 		gettext_noop("Sets the maximum number of worker nodes that are tracked."),
@@ -2272,6 +2632,23 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD | GUC_NO_SHOW_ALL | GUC_NOT_IN_SAMPLE,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.repartition_join_bucket_size",
+		gettext_noop("Sets the estimated input size per bucket for repartitions."),
+		gettext_noop("When set, hash repartitions choose their number of buckets "
+					 "from the estimated size of the tables they read, such that "
+					 "each bucket receives about this much data, with at least "
+					 "one and at most 64 buckets per node. The estimates are "
+					 "based on the shard sizes in the metadata or on the "
+					 "statistics collected from the shards. When 0, or when the "
+					 "size cannot be estimated, "
+					 "citus.repartition_join_bucket_count_per_node is used."),
+		&RepartitionJoinBucketSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	/* deprecated setting */
 	DefineCustomBoolVariable(
 		"citus.replicate_reference_tables_on_activate",
@@ -2560,8 +2937,10 @@ RegisterCitusConfigVariables(void)
 					 "use when making these assignments. The greedy policy aims to "
 					 "evenly distribute tasks across worker nodes, first-replica just "
 					 "assigns tasks in the order shard placements were created, "
-					 "and the round-robin policy assigns tasks to worker nodes in "
-					 "a round-robin fashion."),
+					 "the round-robin policy assigns tasks to worker nodes in "
+					 "a round-robin fashion, and the latency-aware policy prefers "
+					 "the worker nodes with the lowest expected response time "
+					 "based on their recent response times and running tasks."),
 		&TaskAssignmentPolicy,
 		TASK_ASSIGNMENT_GREEDY,
 		task_assignment_policy_options,
@@ -48,3 +48,53 @@ DROP VIEW IF EXISTS pg_catalog.citus_lock_waits;
 #include "udfs/repl_origin_helper/13.1-1.sql"
 #include "udfs/citus_finish_pg_upgrade/13.1-1.sql"
 #include "udfs/citus_is_primary_node/13.1-1.sql"
+#include "udfs/worker_partition_query_result/13.1-1.sql"
+#include "udfs/worker_join_key_bloom_filter/13.1-1.sql"
+#include "udfs/citus_update_distributed_statistics/13.1-1.sql"
+#include "udfs/read_intermediate_result/13.1-1.sql"
+
+CREATE FUNCTION pg_catalog.citus_hll_add_agg_sfunc(internal, anyelement, int)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.citus_hll_add_agg_sfunc(internal, anyelement, int)
+    IS 'transition function for citus_hll_add_agg';
+
+CREATE FUNCTION pg_catalog.citus_hll_union_agg_sfunc(internal, bytea)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.citus_hll_union_agg_sfunc(internal, bytea)
+    IS 'transition function for citus_hll_union_agg';
+
+CREATE FUNCTION pg_catalog.citus_hll_agg_ffunc(internal)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.citus_hll_agg_ffunc(internal)
+    IS 'finalizer for citus_hll_add_agg and citus_hll_union_agg';
+
+-- select citus_hll_add_agg(value, log2m)
+-- returns a HyperLogLog sketch with 2^log2m registers of the hashes of the values
+CREATE AGGREGATE pg_catalog.citus_hll_add_agg(anyelement, int) (
+    STYPE = internal,
+    SFUNC = pg_catalog.citus_hll_add_agg_sfunc,
+    FINALFUNC = pg_catalog.citus_hll_agg_ffunc
+);
+COMMENT ON AGGREGATE pg_catalog.citus_hll_add_agg(anyelement, int)
+    IS 'support aggregate for approximating count(distinct) on workers';
+
+CREATE AGGREGATE pg_catalog.citus_hll_union_agg(bytea) (
+    STYPE = internal,
+    SFUNC = pg_catalog.citus_hll_union_agg_sfunc,
+    FINALFUNC = pg_catalog.citus_hll_agg_ffunc
+);
+COMMENT ON AGGREGATE pg_catalog.citus_hll_union_agg(bytea)
+    IS 'support aggregate for merging HyperLogLog sketches on the coordinator';
+
+CREATE FUNCTION pg_catalog.citus_hll_cardinality(bytea)
+RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.citus_hll_cardinality(bytea)
+    IS 'estimates the number of distinct values in a HyperLogLog sketch';
@@ -41,3 +41,34 @@ DROP FUNCTION citus_internal.start_replication_origin_tracking();
 DROP FUNCTION citus_internal.stop_replication_origin_tracking();
 DROP FUNCTION citus_internal.is_replication_origin_tracking_active();
 #include "../udfs/citus_finish_pg_upgrade/12.1-1.sql"
+
+DROP FUNCTION pg_catalog.worker_join_key_bloom_filter(text, int);
+DROP FUNCTION pg_catalog.worker_partition_query_result(text, text, int, citus.distribution_type, text[], text[], boolean, boolean, boolean, text);
+CREATE FUNCTION pg_catalog.worker_partition_query_result(
+    result_prefix text,
+    query text,
+    partition_column_index int,
+    partition_method citus.distribution_type,
+    partition_min_values text[],
+    partition_max_values text[],
+    binary_copy boolean,
+    allow_null_partition_column boolean DEFAULT false,
+    generate_empty_results boolean DEFAULT false,
+    OUT partition_index int,
+    OUT rows_written bigint,
+    OUT bytes_written bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT VOLATILE
+AS 'MODULE_PATHNAME', $$worker_partition_query_result$$;
+COMMENT ON FUNCTION pg_catalog.worker_partition_query_result(text, text, int, citus.distribution_type, text[], text[], boolean, boolean, boolean)
+IS 'execute a query and partitions its results in set of local result files';
+
+DROP FUNCTION pg_catalog.citus_update_distributed_statistics(regclass);
+DROP FUNCTION pg_catalog.read_intermediate_result(text, pg_catalog.citus_copy_format, int[]);
+
+DROP FUNCTION pg_catalog.citus_hll_cardinality(bytea);
+DROP AGGREGATE pg_catalog.citus_hll_union_agg(bytea);
+DROP AGGREGATE pg_catalog.citus_hll_add_agg(anyelement, int);
+DROP FUNCTION pg_catalog.citus_hll_agg_ffunc(internal);
+DROP FUNCTION pg_catalog.citus_hll_union_agg_sfunc(internal, bytea);
+DROP FUNCTION pg_catalog.citus_hll_add_agg_sfunc(internal, anyelement, int);
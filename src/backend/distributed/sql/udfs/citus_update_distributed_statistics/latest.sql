@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_update_distributed_statistics(relation regclass)
+	RETURNS boolean
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_update_distributed_statistics$$;
+COMMENT ON FUNCTION pg_catalog.citus_update_distributed_statistics(regclass)
+	IS 'collects the planner statistics of the shards of the given table and stores them on the table';
@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION pg_catalog.read_intermediate_result(
+    result_id text,
+    format pg_catalog.citus_copy_format,
+    columns int[])
+RETURNS SETOF record
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE
+AS 'MODULE_PATHNAME', $$read_intermediate_result$$;
+COMMENT ON FUNCTION pg_catalog.read_intermediate_result(text,pg_catalog.citus_copy_format,int[])
+IS 'read the given columns of a file and return them as a set of records';
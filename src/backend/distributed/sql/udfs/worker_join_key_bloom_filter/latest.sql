@@ -0,0 +1,10 @@
+CREATE OR REPLACE FUNCTION pg_catalog.worker_join_key_bloom_filter(
+    query text,
+    partition_column_index int,
+    OUT bloom_filter bytea,
+    OUT rows_read bigint)
+RETURNS record
+LANGUAGE C STRICT VOLATILE
+AS 'MODULE_PATHNAME', $$worker_join_key_bloom_filter$$;
+COMMENT ON FUNCTION pg_catalog.worker_join_key_bloom_filter(text, int)
+IS 'execute a query and build a bloom filter of the hashes of its partition column values';
@@ -0,0 +1,72 @@
+/*-------------------------------------------------------------------------
+ *
+ * test/src/distributed_statistics.c
+ *
+ * This file contains functions to inspect how the postgres planner sees
+ * the statistics of distributed tables.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+
+#include "nodes/makefuncs.h"
+#include "nodes/pathnodes.h"
+#include "optimizer/pathnode.h"
+#include "parser/parse_relation.h"
+#include "storage/lmgr.h"
+#include "utils/lsyscache.h"
+
+#include "pg_version_constants.h"
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(estimated_relation_rows);
+
+
+/*
+ * estimated_relation_rows returns the number of rows that the postgres planner
+ * estimates for a scan of the given table, before applying any filters.
+ */
+Datum
+estimated_relation_rows(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+
+	/* the planner expects the relation to be locked already */
+	LockRelationOid(relationId, AccessShareLock);
+
+	Query *query = makeNode(Query);
+	query->commandType = CMD_SELECT;
+
+	PlannerGlobal *glob = makeNode(PlannerGlobal);
+
+	PlannerInfo *root = makeNode(PlannerInfo);
+	root->parse = query;
+	root->glob = glob;
+	root->query_level = 1;
+	root->planner_cxt = CurrentMemoryContext;
+	root->wt_param_id = -1;
+
+	RangeTblEntry *rangeTableEntry = makeNode(RangeTblEntry);
+	rangeTableEntry->rtekind = RTE_RELATION;
+	rangeTableEntry->relid = relationId;
+	rangeTableEntry->relkind = get_rel_relkind(relationId);
+	rangeTableEntry->rellockmode = AccessShareLock;
+	rangeTableEntry->inFromCl = true;
+	query->rtable = list_make1(rangeTableEntry);
+
+#if PG_VERSION_NUM >= PG_VERSION_16
+	addRTEPermissionInfo(&query->rteperminfos, rangeTableEntry);
+#endif
+
+	/* building the relation calls get_relation_info and its hook */
+	setup_simple_rel_arrays(root);
+	RelOptInfo *relOptInfo = build_simple_rel(root, 1, NULL);
+
+	PG_RETURN_FLOAT8(relOptInfo->tuples);
+}
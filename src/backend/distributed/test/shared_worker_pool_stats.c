@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * test/src/shared_worker_pool_stats.c
+ *
+ * This file contains functions to inspect the execution feedback about
+ * worker nodes that is shared across backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+
+#include "utils/builtins.h"
+
+#include "distributed/shared_worker_pool_stats.h"
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(adaptive_pool_size_limit);
+
+
+/*
+ * adaptive_pool_size_limit returns the maximum number of connections that an
+ * execution opens to the given node, as learned by the adaptive pool size
+ * control.
+ */
+Datum
+adaptive_pool_size_limit(PG_FUNCTION_ARGS)
+{
+	text *nodeNameText = PG_GETARG_TEXT_P(0);
+	int32 nodePort = PG_GETARG_INT32(1);
+
+	char *nodeName = text_to_cstring(nodeNameText);
+
+	PG_RETURN_INT32(GetAdaptivePoolSizeLimit(nodeName, nodePort));
+}
@@ -357,6 +357,7 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 
 			ResetGlobalVariables();
 			ResetRelationAccessHash();
+			ResetSubPlanResultCache();
 			ResetPropagatedObjects();
 
 			/*
@@ -430,6 +431,7 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 
 			ResetGlobalVariables();
 			ResetRelationAccessHash();
+			ResetSubPlanResultCache();
 			ResetPropagatedObjects();
 
 			/* Reset any local replication origin session since transaction has been aborted.*/
@@ -762,6 +764,9 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 			}
 			PopSubXact(subId, false);
 
+			/* rolled back modifications may invalidate reusable subplan results */
+			ResetSubPlanResultCache();
+
 			/*
 			 * Clear MetadataCache table if we're aborting from a CREATE EXTENSION Citus
 			 * so that any created OIDs from the table are cleared and invalidated. We
@@ -101,6 +101,7 @@ copyJobInfo(Job *newnode, Job *from)
 	COPY_NODE_FIELD(partitionKeyValue);
 	COPY_NODE_FIELD(localPlannedStatements);
 	COPY_SCALAR_FIELD(parametersInJobQueryResolved);
+	COPY_STRING_FIELD(queryStringCacheKey);
 }
 
 
@@ -147,6 +148,9 @@ CopyNodeDistributedSubPlan(COPYFUNC_ARGS)
 
 	COPY_SCALAR_FIELD(subPlanId);
 	COPY_NODE_FIELD(plan);
+	COPY_STRING_FIELD(resultId);
+	COPY_NODE_FIELD(relationIdList);
+	COPY_STRING_FIELD(resultQueryString);
 }
 
 
@@ -210,6 +214,7 @@ CopyNodeMapMergeJob(COPYFUNC_ARGS)
 
 	COPY_NODE_FIELD(mapTaskList);
 	COPY_NODE_FIELD(mergeTaskList);
+	COPY_NODE_FIELD(filterQueryStringList);
 }
 
 
@@ -215,6 +215,9 @@ OutDistributedSubPlan(OUTFUNC_ARGS)
 
 	WRITE_UINT_FIELD(subPlanId);
 	WRITE_NODE_FIELD(plan);
+	WRITE_STRING_FIELD(resultId);
+	WRITE_NODE_FIELD(relationIdList);
+	WRITE_STRING_FIELD(resultQueryString);
 }
 
 void
@@ -349,6 +352,7 @@ OutJobFields(StringInfo str, const Job *node)
 	WRITE_NODE_FIELD(partitionKeyValue);
 	WRITE_NODE_FIELD(localPlannedStatements);
 	WRITE_BOOL_FIELD(parametersInJobQueryResolved);
+	WRITE_STRING_FIELD(queryStringCacheKey);
 }
 
 
@@ -415,6 +419,7 @@ OutMapMergeJob(OUTFUNC_ARGS)
 
 	WRITE_NODE_FIELD(mapTaskList);
 	WRITE_NODE_FIELD(mergeTaskList);
+	WRITE_NODE_FIELD(filterQueryStringList);
 }
 
 
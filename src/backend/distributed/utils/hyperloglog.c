@@ -0,0 +1,472 @@
+/*-------------------------------------------------------------------------
+ *
+ * hyperloglog.c
+ *
+ * Implementation of the HyperLogLog sketches that we use to approximate
+ * count(distinct) when citus.count_distinct_error_rate is set and the hll
+ * extension is not installed.
+ *
+ * Workers compute citus_hll_add_agg(column, log2m), which returns a sketch
+ * of the hashes of the column values. The coordinator merges the sketches of
+ * all shards with citus_hll_union_agg, and estimates the number of distinct
+ * values in the result with citus_hll_cardinality. Values are hashed with the
+ * extended hash function of their type, such that values that are equal
+ * according to the type are counted once.
+ *
+ * Sketches are passed around as bytea. They start with a header that holds
+ * the format and log2 of the number of registers, followed by either all
+ * registers (dense format) or only the non-zero registers as (index, value)
+ * pairs (sparse format), whichever is smaller. Sketches of small groups are
+ * therefore small as well.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <math.h>
+
+#include "postgres.h"
+
+#include "fmgr.h"
+
+#include "port/pg_bitutils.h"
+#include "utils/builtins.h"
+#include "utils/typcache.h"
+
+/* sketch formats */
+#define HLL_FORMAT_DENSE 1
+#define HLL_FORMAT_SPARSE 2
+
+/* format and log2m */
+#define HLL_HEADER_SIZE 2
+
+/* 24 bits of register index and 8 bits of register value */
+#define HLL_SPARSE_ENTRY_SIZE 4
+
+/* allowed range of log2 of the number of registers */
+#define HLL_MIN_LOG2M 4
+#define HLL_MAX_LOG2M 17
+
+
+/*
+ * HllState is the transition state of the HyperLogLog aggregates. Each
+ * register holds the maximum rank of the hashes that map to it.
+ */
+typedef struct HllState
+{
+	int log2m;
+	int registerCount;
+	uint8 registers[FLEXIBLE_ARRAY_MEMBER];
+} HllState;
+
+
+static HllState * CreateHllState(MemoryContext memoryContext, int log2m);
+static FmgrInfo * HllHashFunction(FunctionCallInfo fcinfo);
+static void HllAddHash(HllState *state, uint64 hash);
+static int HllSketchLog2m(bytea *sketch);
+static void HllMergeSketch(HllState *state, bytea *sketch);
+static bytea * SerializeHllState(HllState *state);
+static double HllEstimate(HllState *state);
+
+
+PG_FUNCTION_INFO_V1(citus_hll_add_agg_sfunc);
+PG_FUNCTION_INFO_V1(citus_hll_union_agg_sfunc);
+PG_FUNCTION_INFO_V1(citus_hll_agg_ffunc);
+PG_FUNCTION_INFO_V1(citus_hll_cardinality);
+
+
+/*
+ * citus_hll_add_agg_sfunc is the transition function of citus_hll_add_agg. It
+ * adds the hash of the given value to the sketch, ignoring NULL values like
+ * count(distinct) does.
+ */
+Datum
+citus_hll_add_agg_sfunc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggregateContext = NULL;
+	if (!AggCheckCallContext(fcinfo, &aggregateContext))
+	{
+		elog(ERROR, "citus_hll_add_agg_sfunc called from non aggregate context");
+	}
+
+	HllState *state = PG_ARGISNULL(0) ? NULL : (HllState *) PG_GETARG_POINTER(0);
+	if (state == NULL)
+	{
+		if (PG_ARGISNULL(2))
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("log2m of a HyperLogLog sketch cannot be NULL")));
+		}
+
+		state = CreateHllState(aggregateContext, PG_GETARG_INT32(2));
+	}
+
+	if (!PG_ARGISNULL(1))
+	{
+		FmgrInfo *hashFunction = HllHashFunction(fcinfo);
+		Datum hash = FunctionCall2Coll(hashFunction, PG_GET_COLLATION(),
+									   PG_GETARG_DATUM(1), Int64GetDatum(0));
+
+		HllAddHash(state, DatumGetUInt64(hash));
+	}
+
+	PG_RETURN_POINTER(state);
+}
+
+
+/*
+ * citus_hll_union_agg_sfunc is the transition function of citus_hll_union_agg.
+ * It merges the given sketch into the transition state.
+ */
+Datum
+citus_hll_union_agg_sfunc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggregateContext = NULL;
+	if (!AggCheckCallContext(fcinfo, &aggregateContext))
+	{
+		elog(ERROR, "citus_hll_union_agg_sfunc called from non aggregate context");
+	}
+
+	HllState *state = PG_ARGISNULL(0) ? NULL : (HllState *) PG_GETARG_POINTER(0);
+	if (PG_ARGISNULL(1))
+	{
+		if (state == NULL)
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_POINTER(state);
+	}
+
+	bytea *sketch = PG_GETARG_BYTEA_PP(1);
+	if (state == NULL)
+	{
+		state = CreateHllState(aggregateContext, HllSketchLog2m(sketch));
+	}
+
+	HllMergeSketch(state, sketch);
+
+	PG_RETURN_POINTER(state);
+}
+
+
+/*
+ * citus_hll_agg_ffunc is the final function of citus_hll_add_agg and
+ * citus_hll_union_agg, which serializes the transition state into a sketch.
+ */
+Datum
+citus_hll_agg_ffunc(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_NULL();
+	}
+
+	HllState *state = (HllState *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_BYTEA_P(SerializeHllState(state));
+}
+
+
+/*
+ * citus_hll_cardinality returns the estimated number of distinct values that
+ * were added to the given sketch. A NULL sketch means that no sketches were
+ * merged, in which case there are no values.
+ */
+Datum
+citus_hll_cardinality(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_INT64(0);
+	}
+
+	bytea *sketch = PG_GETARG_BYTEA_PP(0);
+	HllState *state = CreateHllState(CurrentMemoryContext, HllSketchLog2m(sketch));
+
+	HllMergeSketch(state, sketch);
+
+	PG_RETURN_INT64((int64) rint(HllEstimate(state)));
+}
+
+
+/*
+ * CreateHllState allocates a transition state with all registers set to zero
+ * in the given memory context.
+ */
+static HllState *
+CreateHllState(MemoryContext memoryContext, int log2m)
+{
+	if (log2m < HLL_MIN_LOG2M || log2m > HLL_MAX_LOG2M)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("log2m of a HyperLogLog sketch must be between "
+							   "%d and %d", HLL_MIN_LOG2M, HLL_MAX_LOG2M)));
+	}
+
+	int registerCount = 1 << log2m;
+
+	HllState *state = MemoryContextAllocZero(memoryContext,
+											 offsetof(HllState, registers) +
+											 registerCount);
+	state->log2m = log2m;
+	state->registerCount = registerCount;
+
+	return state;
+}
+
+
+/*
+ * HllHashFunction returns the extended hash function of the type of the
+ * values passed to citus_hll_add_agg, which is cached across calls.
+ */
+static FmgrInfo *
+HllHashFunction(FunctionCallInfo fcinfo)
+{
+	FmgrInfo *hashFunction = (FmgrInfo *) fcinfo->flinfo->fn_extra;
+	if (hashFunction != NULL)
+	{
+		return hashFunction;
+	}
+
+	Oid argumentType = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	TypeCacheEntry *typeEntry =
+		lookup_type_cache(argumentType, TYPECACHE_HASH_EXTENDED_PROC_FINFO);
+	if (!OidIsValid(typeEntry->hash_extended_proc))
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+						errmsg("could not identify an extended hash function for "
+							   "type %s", format_type_be(argumentType))));
+	}
+
+	hashFunction = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, sizeof(FmgrInfo));
+	fmgr_info_copy(hashFunction, &typeEntry->hash_extended_proc_finfo,
+				   fcinfo->flinfo->fn_mcxt);
+
+	fcinfo->flinfo->fn_extra = hashFunction;
+
+	return hashFunction;
+}
+
+
+/*
+ * HllAddHash adds a 64-bit hash to the sketch. The first log2m bits of the
+ * hash select the register, and the register keeps the maximum position of
+ * the first set bit in the remaining bits.
+ */
+static void
+HllAddHash(HllState *state, uint64 hash)
+{
+	uint32 registerIndex = (uint32) (hash >> (64 - state->log2m));
+	uint64 remainingBits = hash << state->log2m;
+
+	uint8 rank = 0;
+	if (remainingBits == 0)
+	{
+		rank = 64 - state->log2m + 1;
+	}
+	else
+	{
+		rank = 64 - pg_leftmost_one_pos64(remainingBits);
+	}
+
+	if (rank > state->registers[registerIndex])
+	{
+		state->registers[registerIndex] = rank;
+	}
+}
+
+
+/*
+ * HllSketchLog2m returns log2 of the number of registers of the given
+ * sketch.
+ */
+static int
+HllSketchLog2m(bytea *sketch)
+{
+	if (VARSIZE_ANY_EXHDR(sketch) < HLL_HEADER_SIZE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("invalid HyperLogLog sketch")));
+	}
+
+	uint8 *sketchData = (uint8 *) VARDATA_ANY(sketch);
+
+	return sketchData[1];
+}
+
+
+/*
+ * HllMergeSketch merges the registers of the given sketch into the state,
+ * which should have the same number of registers.
+ */
+static void
+HllMergeSketch(HllState *state, bytea *sketch)
+{
+	Size sketchSize = VARSIZE_ANY_EXHDR(sketch);
+	uint8 *sketchData = (uint8 *) VARDATA_ANY(sketch);
+
+	if (HllSketchLog2m(sketch) != state->log2m)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("cannot merge HyperLogLog sketches with a different "
+							   "number of registers")));
+	}
+
+	uint8 format = sketchData[0];
+	uint8 *registerData = sketchData + HLL_HEADER_SIZE;
+	Size registerDataSize = sketchSize - HLL_HEADER_SIZE;
+
+	if (format == HLL_FORMAT_DENSE && registerDataSize == (Size) state->registerCount)
+	{
+		for (int registerIndex = 0; registerIndex < state->registerCount;
+			 registerIndex++)
+		{
+			state->registers[registerIndex] = Max(state->registers[registerIndex],
+												  registerData[registerIndex]);
+		}
+	}
+	else if (format == HLL_FORMAT_SPARSE &&
+			 registerDataSize % HLL_SPARSE_ENTRY_SIZE == 0)
+	{
+		for (Size offset = 0; offset < registerDataSize; offset += HLL_SPARSE_ENTRY_SIZE)
+		{
+			uint32 registerIndex = ((uint32) registerData[offset] << 16) |
+								   ((uint32) registerData[offset + 1] << 8) |
+								   ((uint32) registerData[offset + 2]);
+			uint8 registerValue = registerData[offset + 3];
+
+			if (registerIndex >= (uint32) state->registerCount)
+			{
+				ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+								errmsg("invalid HyperLogLog sketch")));
+			}
+
+			state->registers[registerIndex] = Max(state->registers[registerIndex],
+												  registerValue);
+		}
+	}
+	else
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("invalid HyperLogLog sketch")));
+	}
+}
+
+
+/*
+ * SerializeHllState returns the given state as a sketch in the dense or the
+ * sparse format, whichever is smaller.
+ */
+static bytea *
+SerializeHllState(HllState *state)
+{
+	int nonZeroRegisterCount = 0;
+	for (int registerIndex = 0; registerIndex < state->registerCount; registerIndex++)
+	{
+		if (state->registers[registerIndex] != 0)
+		{
+			nonZeroRegisterCount++;
+		}
+	}
+
+	Size denseSize = state->registerCount;
+	Size sparseSize = (Size) nonZeroRegisterCount * HLL_SPARSE_ENTRY_SIZE;
+	bool useSparseFormat = sparseSize < denseSize;
+
+	Size sketchSize = HLL_HEADER_SIZE + (useSparseFormat ? sparseSize : denseSize);
+	bytea *sketch = palloc(VARHDRSZ + sketchSize);
+	SET_VARSIZE(sketch, VARHDRSZ + sketchSize);
+
+	uint8 *sketchData = (uint8 *) VARDATA(sketch);
+	sketchData[0] = useSparseFormat ? HLL_FORMAT_SPARSE : HLL_FORMAT_DENSE;
+	sketchData[1] = (uint8) state->log2m;
+
+	uint8 *registerData = sketchData + HLL_HEADER_SIZE;
+
+	if (!useSparseFormat)
+	{
+		memcpy(registerData, state->registers, denseSize);
+		return sketch;
+	}
+
+	for (int registerIndex = 0; registerIndex < state->registerCount; registerIndex++)
+	{
+		uint8 registerValue = state->registers[registerIndex];
+		if (registerValue == 0)
+		{
+			continue;
+		}
+
+		registerData[0] = (uint8) (registerIndex >> 16);
+		registerData[1] = (uint8) (registerIndex >> 8);
+		registerData[2] = (uint8) registerIndex;
+		registerData[3] = registerValue;
+		registerData += HLL_SPARSE_ENTRY_SIZE;
+	}
+
+	return sketch;
+}
+
+
+/*
+ * HllEstimate returns the HyperLogLog estimate of the number of distinct
+ * hashes that were added to the state. We use linear counting for small
+ * cardinalities, where it is more accurate. Since we use 64-bit hashes,
+ * no correction for hash collisions is needed at large cardinalities.
+ */
+static double
+HllEstimate(HllState *state)
+{
+	double registerCount = state->registerCount;
+	double inverseSum = 0.0;
+	int zeroRegisterCount = 0;
+
+	for (int registerIndex = 0; registerIndex < state->registerCount; registerIndex++)
+	{
+		inverseSum += ldexp(1.0, -state->registers[registerIndex]);
+
+		if (state->registers[registerIndex] == 0)
+		{
+			zeroRegisterCount++;
+		}
+	}
+
+	double alpha = 0.0;
+	switch (state->registerCount)
+	{
+		case 16:
+		{
+			alpha = 0.673;
+			break;
+		}
+
+		case 32:
+		{
+			alpha = 0.697;
+			break;
+		}
+
+		case 64:
+		{
+			alpha = 0.709;
+			break;
+		}
+
+		default:
+		{
+			alpha = 0.7213 / (1.0 + 1.079 / registerCount);
+			break;
+		}
+	}
+
+	double estimate = alpha * registerCount * registerCount / inverseSum;
+
+	if (estimate <= 2.5 * registerCount && zeroRegisterCount > 0)
+	{
+		estimate = registerCount * log(registerCount / zeroRegisterCount);
+	}
+
+	return estimate;
+}
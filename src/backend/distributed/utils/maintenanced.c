@@ -51,6 +51,7 @@
 #include "distributed/citus_safe_lib.h"
 #include "distributed/coordinator_protocol.h"
 #include "distributed/distributed_deadlock_detection.h"
+#include "distributed/distributed_statistics.h"
 #include "distributed/maintenanced.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
@@ -489,6 +490,7 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 	TimestampTz lastRecoveryTime = 0;
 	TimestampTz lastShardCleanTime = 0;
 	TimestampTz lastStatStatementsPurgeTime = 0;
+	TimestampTz lastDistributedStatisticsTime = 0;
 	TimestampTz nextMetadataSyncTime = 0;
 
 	/* state kept for the background tasks queue monitor */
@@ -790,6 +792,40 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 			timeout = Min(timeout, DeferShardDeleteInterval);
 		}
 
+		if (!RecoveryInProgress() && DistributedStatisticsInterval > 0 &&
+			TimestampDifferenceExceeds(lastDistributedStatisticsTime,
+									   GetCurrentTimestamp(),
+									   DistributedStatisticsInterval))
+		{
+			InvalidateMetadataSystemCache();
+			StartTransactionCommand();
+
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping distributed statistics collection")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			{
+				/*
+				 * Record last collection time at start to ensure we run once per
+				 * DistributedStatisticsInterval.
+				 */
+				lastDistributedStatisticsTime = GetCurrentTimestamp();
+
+				/* the shell tables on the coordinator are the ones that get planned */
+				if (IsCoordinator())
+				{
+					UpdateAllDistributedTableStatistics();
+				}
+			}
+
+			CommitTransactionCommand();
+
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, DistributedStatisticsInterval);
+		}
+
 		if (StatStatementsPurgeInterval > 0 &&
 			StatStatementsTrack != STAT_STATEMENTS_TRACK_NONE &&
 			TimestampDifferenceExceeds(lastStatStatementsPurgeTime, GetCurrentTimestamp(),
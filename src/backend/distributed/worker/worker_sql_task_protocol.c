@@ -21,6 +21,7 @@
 #include "utils/memutils.h"
 
 #include "distributed/commands/multi_copy.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/multi_executor.h"
 #include "distributed/transmit.h"
 #include "distributed/version_compat.h"
@@ -53,6 +54,9 @@ typedef struct TaskFileDestReceiver
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* compresses the COPY data when intermediate result compression is enabled */
+	IntermediateResultCompressor *compressor;
+
 	/* statistics */
 	uint64 tuplesSent;
 	uint64 bytesSent;
@@ -62,6 +66,7 @@ typedef struct TaskFileDestReceiver
 static void TaskFileDestReceiverStartup(DestReceiver *dest, int operation,
 										TupleDesc inputTupleDescriptor);
 static bool TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void FlushCopyData(TaskFileDestReceiver *taskFileDest, bool lastFlush);
 static void WriteToLocalFile(StringInfo copyData, TaskFileDestReceiver *taskFileDest);
 static void TaskFileDestReceiverShutdown(DestReceiver *destReceiver);
 static void TaskFileDestReceiverDestroy(DestReceiver *destReceiver);
@@ -149,6 +154,15 @@ TaskFileDestReceiverStartup(DestReceiver *dest, int operation,
 														   taskFileDest->filePath,
 														   fileFlags));
 
+	bool columnar = EnableColumnarIntermediateResults && copyOutState->binary;
+	if (IntermediateResultCompression != INTERMEDIATE_RESULT_COMPRESSION_NONE ||
+		columnar)
+	{
+		taskFileDest->compressor = CreateIntermediateResultCompressor(
+			(IntermediateResultCompressionType) IntermediateResultCompression,
+			columnar);
+	}
+
 	if (copyOutState->binary)
 	{
 		/* write headers when using binary encoding */
@@ -190,8 +204,7 @@ TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	if (copyData->len > COPY_BUFFER_SIZE)
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, taskFileDest);
-		resetStringInfo(copyData);
+		FlushCopyData(taskFileDest, false);
 	}
 
 	MemoryContextSwitchTo(oldContext);
@@ -204,6 +217,38 @@ TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 }
 
 
+/*
+ * FlushCopyData writes the COPY data in the buffer of the TaskFileDestReceiver
+ * to the file. When the file is compressed, the data is compressed as one block
+ * first, and the last flush also marks the end of the compressed data.
+ */
+static void
+FlushCopyData(TaskFileDestReceiver *taskFileDest, bool lastFlush)
+{
+	StringInfo copyData = taskFileDest->copyOutState->fe_msgbuf;
+	IntermediateResultCompressor *compressor = taskFileDest->compressor;
+
+	if (compressor != NULL)
+	{
+		CompressIntermediateResultData(compressor, copyData);
+		resetStringInfo(copyData);
+
+		if (lastFlush)
+		{
+			FinishIntermediateResultCompression(compressor);
+		}
+
+		copyData = compressor->outputBuffer;
+	}
+
+	if (copyData->len > 0)
+	{
+		WriteToLocalFile(copyData, taskFileDest);
+		resetStringInfo(copyData);
+	}
+}
+
+
 /*
  * WriteToLocalResultsFile writes the bytes in a StringInfo to a local file.
  */
@@ -233,20 +278,14 @@ TaskFileDestReceiverShutdown(DestReceiver *destReceiver)
 	TaskFileDestReceiver *taskFileDest = (TaskFileDestReceiver *) destReceiver;
 	CopyOutState copyOutState = taskFileDest->copyOutState;
 
-	if (copyOutState->fe_msgbuf->len > 0)
-	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, taskFileDest);
-		resetStringInfo(copyOutState->fe_msgbuf);
-	}
-
 	if (copyOutState->binary)
 	{
 		/* write footers when using binary encoding */
 		AppendCopyBinaryFooters(copyOutState);
-		WriteToLocalFile(copyOutState->fe_msgbuf, taskFileDest);
-		resetStringInfo(copyOutState->fe_msgbuf);
 	}
 
+	FlushCopyData(taskFileDest, true);
+
 	FileClose(taskFileDest->fileCompat.fd);
 }
 
@@ -272,6 +311,13 @@ TaskFileDestReceiverDestroy(DestReceiver *destReceiver)
 		taskFileDest->columnOutputFunctions = NULL;
 	}
 
+	if (taskFileDest->compressor)
+	{
+		pfree(taskFileDest->compressor->outputBuffer->data);
+		pfree(taskFileDest->compressor);
+		taskFileDest->compressor = NULL;
+	}
+
 	if (taskFileDest->filePath)
 	{
 		pfree(taskFileDest->filePath);
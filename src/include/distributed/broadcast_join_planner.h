@@ -0,0 +1,27 @@
+/*-------------------------------------------------------------------------
+ *
+ * broadcast_join_planner.h
+ *
+ * Declarations for functions to broadcast small distributed tables in
+ * joins with large distributed tables that are not co-located with them.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef BROADCAST_JOIN_PLANNER_H
+#define BROADCAST_JOIN_PLANNER_H
+
+#include "postgres.h"
+
+#include "distributed/recursive_planning.h"
+
+/* GUC, estimated size in kB below which distributed tables are broadcast in joins */
+extern int BroadcastJoinThreshold;
+
+extern bool ShouldRecursivelyPlanSmallDistributedTables(Query *query);
+extern void RecursivelyPlanSmallDistributedTables(Query *query,
+												  RecursivePlanningContext *context);
+
+#endif /* BROADCAST_JOIN_PLANNER_H */
@@ -159,6 +159,7 @@ typedef struct CitusCopyDestReceiver
 
 /* GUCs */
 extern bool SkipJsonbValidationInCopy;
+extern bool EnableParallelCopyTo;
 
 /* managed via GUC, the default is 4MB */
 extern int CopySwitchOverThresholdBytes;
@@ -171,6 +172,14 @@ extern CitusCopyDestReceiver * CreateCitusCopyDestReceiver(Oid relationId,
 														   EState *executorState,
 														   char *intermediateResultPrefix,
 														   bool isPublishable);
+extern Relation CopyFromInputRelation(Relation distributedRelation,
+									  CopyStmt *copyStatement, int partitionColumnIndex,
+									  CopyOutState copyOutState,
+									  FmgrInfo *columnOutputFunctions);
+extern uint64 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
+							  bool *columnNulls);
+extern void CitusCopyDestReceiverSendRowData(CitusCopyDestReceiver *copyDest,
+											 int64 shardId, StringInfo rowData);
 extern FmgrInfo * ColumnOutputFunctions(TupleDesc rowDescriptor, bool binaryFormat);
 extern bool CanUseBinaryCopyFormat(TupleDesc tupleDescription);
 extern bool CanUseBinaryCopyFormatForTargetList(List *targetEntryList);
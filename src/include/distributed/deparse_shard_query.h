@@ -30,6 +30,8 @@ extern void SetTaskQueryStringList(Task *task, List *queryStringList);
 extern char * TaskQueryString(Task *task);
 extern char * TaskQueryStringAtIndex(Task *task, int index);
 extern int GetTaskQueryType(Task *task);
+extern bool CanDeriveQueryStringFromTask(Task *templateTask, Task *task);
+extern char * DeriveQueryStringFromTask(Task *templateTask, List *relationShardList);
 extern void AddInsertAliasIfNeeded(Query *query);
 
 
@@ -0,0 +1,31 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_statistics.h
+ *   Collection of the planner statistics of distributed tables from the
+ *   shards on the worker nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef DISTRIBUTED_STATISTICS_H
+#define DISTRIBUTED_STATISTICS_H
+
+#include "nodes/pathnodes.h"
+
+/*
+ * GUC, interval in milliseconds at which the maintenance daemon collects
+ * the statistics of distributed tables, 0 disables periodic collection
+ */
+extern int DistributedStatisticsInterval;
+
+
+extern void UpdateAllDistributedTableStatistics(void);
+extern bool UpdateDistributedTableStatistics(Oid relationId, int logLevel);
+extern void RefreshDistributedTableStatistics(List *relationIdList);
+extern void AdjustDistributedRelationSize(Oid relationId, RelOptInfo *relOptInfo);
+extern uint64 ShellRelationSize(Oid relationId);
+extern uint64 EstimatedDistributedTableSize(Oid relationId);
+
+#endif /* DISTRIBUTED_STATISTICS_H */
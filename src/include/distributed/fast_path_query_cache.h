@@ -0,0 +1,41 @@
+/*-------------------------------------------------------------------------
+ *
+ * fast_path_query_cache.h
+ *   Cache of the shard query strings of fast path router queries that is
+ *   shared across backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef FAST_PATH_QUERY_CACHE_H
+#define FAST_PATH_QUERY_CACHE_H
+
+#include "nodes/params.h"
+#include "nodes/parsenodes.h"
+
+#include "distributed/multi_physical_planner.h"
+
+/* longer query strings are not cached */
+#define FAST_PATH_QUERY_CACHE_MAX_QUERY_LENGTH 1024
+
+/* statements with longer keys are not cached */
+#define FAST_PATH_QUERY_CACHE_MAX_KEY_LENGTH 1024
+
+/* GUC, maximum number of query strings in the cache, 0 disables the cache */
+extern int FastPathQueryCacheSize;
+
+
+extern void InitializeFastPathQueryCache(void);
+extern size_t FastPathQueryCacheShmemSize(void);
+extern void FastPathQueryCacheShmemInit(void);
+extern void RegisterFastPathQueryCacheCallbacks(void);
+extern void InvalidateFastPathQueryCache(void);
+extern char * FastPathQueryCacheKey(Query *jobQuery, ParamListInfo paramListInfo,
+									const char *sourceText);
+extern void SetTaskQueryFromFastPathQueryCache(Task *task, Query *query,
+											   char *statementKey,
+											   uint64 shardId);
+
+#endif /* FAST_PATH_QUERY_CACHE_H */
@@ -0,0 +1,79 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_compression.h
+ *   Functions for writing and reading compressed intermediate result files.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_COMPRESSION_H
+#define INTERMEDIATE_RESULT_COMPRESSION_H
+
+
+#include "commands/copy.h"
+#include "lib/stringinfo.h"
+#include "nodes/bitmapset.h"
+#include "utils/relcache.h"
+
+
+/*
+ * IntermediateResultCompressionType represents the compression methods that
+ * can be used for intermediate results.
+ */
+typedef enum IntermediateResultCompressionType
+{
+	INTERMEDIATE_RESULT_COMPRESSION_NONE = 0,
+	INTERMEDIATE_RESULT_COMPRESSION_LZ4 = 1,
+	INTERMEDIATE_RESULT_COMPRESSION_ZSTD = 2
+} IntermediateResultCompressionType;
+
+
+/*
+ * IntermediateResultCompressor keeps the state of compressing the COPY data of
+ * an intermediate result. The compressed data is appended to outputBuffer, which
+ * the caller sends or writes and then resets.
+ */
+typedef struct IntermediateResultCompressor
+{
+	IntermediateResultCompressionType compressionType;
+
+	/* whether binary COPY data is stored in the columnar layout */
+	bool columnar;
+
+	/* compressed data that is ready to be sent or written */
+	StringInfo outputBuffer;
+
+	/* total number of bytes of COPY data that were compressed */
+	uint64 rawBytes;
+
+	/* columnar layout: whether the binary COPY header was seen, and column data */
+	bool copyHeaderSkipped;
+	int columnCount;
+	StringInfo *columnData;
+} IntermediateResultCompressor;
+
+
+/* GUC, compression method for the intermediate results written by this node */
+extern int IntermediateResultCompression;
+
+/* GUC, whether binary intermediate results are written in the columnar layout */
+extern bool EnableColumnarIntermediateResults;
+
+
+extern IntermediateResultCompressor * CreateIntermediateResultCompressor(
+	IntermediateResultCompressionType compressionType, bool columnar);
+extern void CompressIntermediateResultData(IntermediateResultCompressor *compressor,
+										   StringInfo copyData);
+extern void FinishIntermediateResultCompression(
+	IntermediateResultCompressor *compressor);
+extern CopyFromState BeginCopyFromIntermediateResult(Relation relation,
+													 char *fileName,
+													 List *copyOptions,
+													 Bitmapset *skippedColumns);
+extern void EndCopyFromIntermediateResult(CopyFromState copyState);
+extern int64 IntermediateResultFileRawSize(const char *fileName, int64 fileSize);
+extern int64 IntermediateResultDataRawSize(const char *data, int64 length);
+
+#endif /* INTERMEDIATE_RESULT_COMPRESSION_H */
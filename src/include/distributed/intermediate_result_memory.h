@@ -0,0 +1,49 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_memory.h
+ *   Functions for keeping intermediate results in dynamic shared memory.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_MEMORY_H
+#define INTERMEDIATE_RESULT_MEMORY_H
+
+
+#include "storage/dsm.h"
+
+
+/*
+ * IntermediateResultMemory describes the contents of an intermediate result
+ * that is kept in shared memory, as attached by a reader.
+ */
+typedef struct IntermediateResultMemory
+{
+	dsm_handle segmentHandle;
+
+	/* contents of the result, which are the same as those of its file */
+	char *data;
+	Size length;
+} IntermediateResultMemory;
+
+
+/* GUC, maximum size in kB of intermediate results that are kept in memory */
+extern int MaxIntermediateResultMemorySize;
+
+/* GUC, maximum size in kB of all intermediate results in memory on the node */
+extern int MaxIntermediateResultMemoryPerNode;
+
+
+extern void InitializeIntermediateResultMemory(void);
+extern size_t IntermediateResultMemoryShmemSize(void);
+extern bool StoreIntermediateResultInMemory(const char *fileName, const char *data,
+											Size length);
+extern bool IntermediateResultInMemory(const char *fileName, Size *length);
+extern IntermediateResultMemory * AttachIntermediateResultMemory(const char *fileName);
+extern void DetachIntermediateResultMemory(IntermediateResultMemory *resultMemory);
+extern void RemoveIntermediateResultFromMemory(const char *fileName);
+extern void ReleaseIntermediateResultsInMemory(void);
+
+#endif /* INTERMEDIATE_RESULT_MEMORY_H */
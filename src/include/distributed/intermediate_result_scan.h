@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_scan.h
+ *   Custom scan that reads binary intermediate result files directly.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_SCAN_H
+#define INTERMEDIATE_RESULT_SCAN_H
+
+
+#include "nodes/extensible.h"
+#include "nodes/pathnodes.h"
+#include "nodes/parsenodes.h"
+
+
+/* GUC, whether to scan binary intermediate results without a tuple store */
+extern bool EnableIntermediateResultScan;
+
+
+extern void ReplaceReadIntermediateResultPath(RangeTblEntry *rangeTableEntry,
+											  RelOptInfo *relOptInfo);
+extern void RegisterIntermediateResultScanMethods(void);
+
+#endif /* INTERMEDIATE_RESULT_SCAN_H */
@@ -23,6 +23,13 @@
 #include "distributed/commands/multi_copy.h"
 
 
+/* size in bytes of the join key bloom filters used by repartition joins */
+#define JOIN_KEY_BLOOM_FILTER_SIZE (64 * 1024)
+
+/* number of bits set per join key in a join key bloom filter */
+#define JOIN_KEY_BLOOM_FILTER_HASH_COUNT 3
+
+
 /*
  * DistributedResultFragment represents a fragment of a distributed result.
  */
@@ -73,6 +80,12 @@ typedef struct NodeToNodeFragmentsTransfer
 /* Forward Declarations */
 struct CitusTableCacheEntry;
 
+/* GUC, number of nodes to which broadcast results are sent directly */
+extern int IntermediateResultRelayFanout;
+
+/* GUC, maximum number of connections to fetch results from a single node */
+extern int MaxIntermediateResultFetchConnections;
+
 /* intermediate_results.c */
 extern DestReceiver * CreateRemoteFileDestReceiver(const char *resultId,
 												   EState *executorState,
@@ -85,7 +98,9 @@ extern DestReceiver * CreatePartitionedResultDestReceiver(int partitionColumnInd
 														  DestReceiver **
 														  partitionedDestReceivers,
 														  bool lazyStartup,
-														  bool allowNullPartitionValues);
+														  bool allowNullPartitionValues,
+														  bytea *joinKeyFilter);
+extern TupleDesc JoinKeyFilterTupleDescriptor(void);
 extern CitusTableCacheEntry * QueryTupleShardSearchInfo(ArrayType *minValuesArray,
 														ArrayType *maxValuesArray,
 														char partitionMethod,
@@ -93,10 +108,11 @@ extern CitusTableCacheEntry * QueryTupleShardSearchInfo(ArrayType *minValuesArra
 extern void WriteToLocalFile(StringInfo copyData, FileCompat *fileCompat);
 extern uint64 RemoteFileDestReceiverBytesSent(DestReceiver *destReceiver);
 extern void SendQueryResultViaCopy(const char *resultId);
-extern void ReceiveQueryResultViaCopy(const char *resultId);
+extern uint64 ReceiveQueryResultViaCopy(const char *resultId, List *copyOptions);
 extern void RemoveIntermediateResultsDirectories(void);
 extern int64 IntermediateResultSize(const char *resultId);
 extern char * QueryResultFileName(const char *resultId);
+extern char * FindIntermediateResultFile(const char *resultId);
 extern char * CreateIntermediateResultsDirectory(void);
 extern ArrayType * CreateArrayFromDatums(Datum *datumArray, bool *nullsArray, int
 										 datumCount, Oid typeId);
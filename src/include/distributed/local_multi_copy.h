@@ -15,6 +15,8 @@ extern void WriteTupleToLocalShard(TupleTableSlot *slot, CitusCopyDestReceiver *
 								   int64
 								   shardId,
 								   CopyOutState localCopyOutState);
+extern void WriteRowDataToLocalShard(StringInfo rowData, CitusCopyDestReceiver *copyDest,
+									 int64 shardId, CopyOutState localCopyOutState);
 extern void WriteTupleToLocalFile(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
 								  int64 shardId, CopyOutState localFileCopyOutState,
 								  FileCompat *fileCompat);
@@ -42,6 +42,11 @@
 #define HLL_CARDINALITY_FUNC_NAME "hll_cardinality"
 #define HLL_FORCE_GROUPAGG_GUC_NAME "hll.force_groupagg"
 
+/* Built-in count(distinct) approximation, used when hll is not installed */
+#define CITUS_HLL_ADD_AGGREGATE_NAME "citus_hll_add_agg"
+#define CITUS_HLL_UNION_AGGREGATE_NAME "citus_hll_union_agg"
+#define CITUS_HLL_CARDINALITY_FUNC_NAME "citus_hll_cardinality"
+
 /* Definitions related to Top-N approximations */
 #define TOPN_ADD_AGGREGATE_NAME "topn_add_agg"
 #define TOPN_UNION_AGGREGATE_NAME "topn_union_agg"
@@ -158,6 +163,7 @@ static const char *const AggregateNames[] = {
 extern int LimitClauseRowFetchCount;
 extern double CountDistinctErrorRate;
 extern int CoordinatorAggregationStrategy;
+extern bool EnableRepartitionedWindowFunctions;
 
 
 /* Function declaration for optimizing logical plans */
@@ -37,8 +37,10 @@
 /* Definitions local to the physical planner */
 #define NON_PRUNABLE_JOIN -1
 #define RESERVED_HASHED_COLUMN_ID MaxAttrNumber
+#define MAX_BUCKET_COUNT_PER_NODE 64
 
 extern int RepartitionJoinBucketCountPerNode;
+extern int RepartitionJoinBucketSize;
 
 typedef enum CitusRTEKind
 {
@@ -87,7 +89,8 @@ typedef enum
 	TASK_ASSIGNMENT_INVALID_FIRST = 0,
 	TASK_ASSIGNMENT_GREEDY = 1,
 	TASK_ASSIGNMENT_ROUND_ROBIN = 2,
-	TASK_ASSIGNMENT_FIRST_REPLICA = 3
+	TASK_ASSIGNMENT_FIRST_REPLICA = 3,
+	TASK_ASSIGNMENT_LATENCY_AWARE = 4
 } TaskAssignmentPolicyType;
 
 
@@ -96,7 +99,8 @@ typedef enum
 {
 	JOB_INVALID_FIRST = 0,
 	JOIN_MAP_MERGE_JOB = 1,
-	TOP_LEVEL_WORKER_JOB = 2
+	TOP_LEVEL_WORKER_JOB = 2,
+	WINDOW_MAP_MERGE_JOB = 3
 } BoundaryNodeJobType;
 
 
@@ -153,6 +157,12 @@ typedef struct Job
 	 */
 	bool parametersInJobQueryResolved;
 	uint32 colocationId; /* common colocation group ID of the relations */
+
+	/*
+	 * Key of a fast path statement under which its shard query string is
+	 * cached across backends, NULL if the query string should not be cached.
+	 */
+	char *queryStringCacheKey;
 } Job;
 
 
@@ -167,6 +177,9 @@ typedef struct MapMergeJob
 	ShardInterval **sortedShardIntervalArray; /* only applies to range partitioning */
 	List *mapTaskList;
 	List *mergeTaskList;
+
+	/* filter queries of the map tasks, only set for join key bloom filters */
+	List *filterQueryStringList;
 } MapMergeJob;
 
 typedef enum TaskQueryType
@@ -487,6 +500,18 @@ typedef struct DistributedSubPlan
 	uint32 subPlanId;
 	PlannedStmt *plan;
 
+	/* name of the intermediate result the subplan is written to */
+	char *resultId;
+
+	/*
+	 * Reference tables read by a subplan whose result can be reused by
+	 * later executions in the same transaction, NIL if it cannot be reused.
+	 */
+	List *relationIdList;
+
+	/* query text that the ID of a reusable result is derived from */
+	char *resultQueryString;
+
 	/* EXPLAIN ANALYZE instrumentations */
 	uint64 bytesSentPerWorker;
 	uint32 remoteWorkerCount;
@@ -541,6 +566,7 @@ typedef List *(*ReorderFunction)(List *);
 /* Config variable managed via guc.c */
 extern int TaskAssignmentPolicy;
 extern bool EnableUniqueJobIds;
+extern bool EnableRepartitionJoinBloomFilter;
 
 
 /* Function declarations for building physical plans and constructing queries */
@@ -576,6 +602,10 @@ extern bool ShardIntervalsOverlapWithParams(Datum firstMin, Datum firstMax,
 											Oid collation);
 extern bool CoPartitionedTables(Oid firstRelationId, Oid secondRelationId);
 extern ShardInterval ** GenerateSyntheticShardIntervalArray(int partitionCount);
+extern int MapMergeJobPartitionColumnIndex(MapMergeJob *mapMergeJob);
+extern void SetMapTaskJoinKeyFilter(MapMergeJob *mapMergeJob, Task *mapTask,
+									char *filterQueryString,
+									char *joinKeyFilterResultId);
 extern RowModifyLevel RowModifyLevelForQuery(Query *query);
 extern StringInfo ArrayObjectToString(ArrayType *arrayObject,
 									  Oid columnType, int32 columnTypeMod);
@@ -589,6 +619,8 @@ extern List * AssignAnchorShardTaskList(List *taskList);
 extern List * FirstReplicaAssignTaskList(List *taskList);
 extern List * RoundRobinAssignTaskList(List *taskList);
 extern List * RoundRobinReorder(List *placementList);
+extern List * LatencyAwareAssignTaskList(List *taskList);
+extern List * LatencyAwareReorder(List *placementList);
 extern void SetPlacementNodeMetadata(ShardPlacement *placement, WorkerNode *workerNode);
 extern int CompareTasksByTaskId(const void *leftElement, const void *rightElement);
 extern int CompareTasksByExecutionDuration(const void *leftElement, const
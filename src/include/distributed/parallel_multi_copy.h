@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_multi_copy.h
+ *    Declarations for parsing the input of COPY into distributed tables in
+ *    parallel workers.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PARALLEL_MULTI_COPY_H
+#define PARALLEL_MULTI_COPY_H
+
+
+#include "nodes/parsenodes.h"
+#include "storage/dsm.h"
+#include "storage/shm_toc.h"
+#include "utils/relcache.h"
+
+#include "distributed/commands/multi_copy.h"
+
+
+/* GUC, number of parallel workers that parse the input of COPY FROM */
+extern int MaxParallelCopyWorkers;
+
+
+extern bool CanUseParallelCopyFrom(CopyStmt *copyStatement,
+								   CitusCopyDestReceiver *copyDest,
+								   Relation copiedDistributedRelation);
+extern bool ParallelCopyFrom(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+							 uint64 *processedRowCount);
+extern PGDLLEXPORT void ParallelCopyFromWorkerMain(dsm_segment *segment, shm_toc *toc);
+
+#endif /* PARALLEL_MULTI_COPY_H */
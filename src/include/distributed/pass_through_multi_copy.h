@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * pass_through_multi_copy.h
+ *    Declarations for routing the input of COPY into hash-distributed tables
+ *    by only parsing the distribution column.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PASS_THROUGH_MULTI_COPY_H
+#define PASS_THROUGH_MULTI_COPY_H
+
+
+#include "nodes/parsenodes.h"
+
+#include "distributed/commands/multi_copy.h"
+
+
+/* GUC, whether COPY forwards input lines without parsing all columns */
+extern bool EnablePassThroughCopy;
+
+
+extern bool CanUsePassThroughCopyFrom(CopyStmt *copyStatement,
+									  CitusCopyDestReceiver *copyDest);
+extern uint64 PassThroughCopyFrom(CopyStmt *copyStatement,
+								  CitusCopyDestReceiver *copyDest);
+
+#endif /* PASS_THROUGH_MULTI_COPY_H */
@@ -63,6 +63,10 @@ extern PGresult * GetRemoteCommandResult(MultiConnection *connection,
 										 bool raiseInterrupts);
 extern bool PutRemoteCopyData(MultiConnection *connection, const char *buffer,
 							  int nbytes);
+extern MultiConnection * PutRemoteCopyDataToConnectionList(List *connectionList,
+														   const char *buffer,
+														   int nbytes);
+extern MultiConnection * FlushRemoteCopyData(List *connectionList);
 extern bool PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg);
 
 /* waiting for multiple command results */
@@ -0,0 +1,47 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_worker_pool_stats.h
+ *   Execution feedback about worker nodes that is shared across backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_WORKER_POOL_STATS_H
+#define SHARED_WORKER_POOL_STATS_H
+
+#include "nodes/pg_list.h"
+
+/* GUC, determining whether the executor learns pool sizes per worker node */
+extern bool EnableAdaptivePoolSizeControl;
+
+/* GUC, latency increase (as a ratio) that we consider as worker saturation */
+extern double AdaptivePoolSizeLatencyThreshold;
+
+/* GUC, determining whether read tasks are also sent to a second placement */
+extern bool EnableHedgedReads;
+
+/* GUC, percentile of the recent task execution times after which we hedge */
+extern double HedgedReadLatencyPercentile;
+
+
+extern void InitializeSharedWorkerPoolStats(void);
+extern size_t SharedWorkerPoolStatsShmemSize(void);
+extern void SharedWorkerPoolStatsShmemInit(void);
+extern int GetAdaptivePoolSizeLimit(const char *hostname, int port);
+extern void UpdateAdaptivePoolSizeLimit(const char *hostname, int port,
+										double avgTaskExecutionTime,
+										bool hadConnectionFailure,
+										bool limitedByPoolSize);
+extern void RecordTaskExecutionTimes(const char *hostname, int port,
+									 List *taskExecutionTimeList);
+extern long GetHedgedReadDelay(const char *hostname, int port);
+extern void UpdateNodeResponseTime(const char *hostname, int port,
+								   double avgTaskExecutionTime);
+extern double GetNodeResponseTime(const char *hostname, int port,
+								  int *inFlightTaskCount);
+extern double GetMeanNodeResponseTime(void);
+extern void AdjustInFlightTaskCount(const char *hostname, int port, int delta);
+
+#endif /* SHARED_WORKER_POOL_STATS_H */
@@ -16,8 +16,12 @@
 
 extern int MaxIntermediateResult;
 extern int SubPlanLevel;
+extern bool EnableSubPlanResultReuse;
 
 extern void ExecuteSubPlans(DistributedPlan *distributedPlan);
+extern void InvalidateSubPlanResultsForPlan(DistributedPlan *distributedPlan);
+extern void InvalidateSubPlanResults(Oid relationId);
+extern void ResetSubPlanResultCache(void);
 
 /**
  * IntermediateResultsHashEntry is used to store which nodes need to receive
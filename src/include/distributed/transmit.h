@@ -18,9 +18,22 @@
 #include "storage/fd.h"
 
 
+/* function that is called for each message of COPY data that is relayed */
+typedef void (*CopyDataRelayFunction)(StringInfo copyData, void *relayContext);
+
+
 /* Function declarations for transmitting files between two nodes */
 extern void RedirectCopyDataToRegularFile(const char *filename);
+extern void RelayCopyDataToRegularFile(const char *filename,
+									   CopyDataRelayFunction relayFunction,
+									   void *relayContext);
+extern void ReceiveCopyDataFromFrontend(int columnCount,
+										CopyDataRelayFunction receiveFunction,
+										void *receiveContext);
+extern void RelayCopyFromInput(const char *filename, bool isProgram, int columnCount,
+							   CopyDataRelayFunction relayFunction, void *relayContext);
 extern void SendRegularFile(const char *filename);
+extern void SendRegularBuffer(const char *data, Size length);
 extern File FileOpenForTransmit(const char *filename, int fileFlags);
 extern File FileOpenForTransmitPerm(const char *filename, int fileFlags, int fileMode);
 
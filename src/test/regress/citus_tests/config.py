@@ -288,6 +288,14 @@ class CitusCacheManyConnectionsConfig(CitusDefaultClusterConfig):
         }
 
 
+class CitusFastPathQueryCacheConfig(CitusDefaultClusterConfig):
+    def __init__(self, arguments):
+        super().__init__(arguments)
+        self.new_settings = {
+            "citus.fast_path_query_cache_size": 1000,
+        }
+
+
 class CitusUnusualExecutorConfig(CitusDefaultClusterConfig):
     def __init__(self, arguments):
         super().__init__(arguments)
@@ -58,4 +58,78 @@ SELECT select_for_update();
 
 SET citus.log_remote_commands TO off;
 
+-- the pool size limit per node is halved when the tasks on the node slow down,
+-- and grows again when the limit holds back an execution
+CREATE FUNCTION adaptive_pool_size_limit(nodename text, nodeport int)
+RETURNS int LANGUAGE C STRICT AS 'citus', $$adaptive_pool_size_limit$$;
+SET citus.enable_adaptive_pool_size_control TO on;
+SET citus.max_adaptive_executor_pool_size TO 4;
+SELECT count(*) FROM test;
+SELECT adaptive_pool_size_limit(node_name, node_port)
+FROM master_get_active_worker_nodes() ORDER BY node_port;
+SELECT count(*) FROM test a JOIN (SELECT x, pg_sleep(0.2) FROM test) b USING (x);
+SELECT adaptive_pool_size_limit(node_name, node_port)
+FROM master_get_active_worker_nodes() ORDER BY node_port;
+SELECT count(*) FROM test a JOIN (SELECT x, pg_sleep(0.2) FROM test) b USING (x);
+SELECT adaptive_pool_size_limit(node_name, node_port)
+FROM master_get_active_worker_nodes() ORDER BY node_port;
+-- two tasks per node do not fit in a single connection
+SELECT count(*) FROM test;
+SELECT adaptive_pool_size_limit(node_name, node_port)
+FROM master_get_active_worker_nodes() ORDER BY node_port;
+RESET citus.max_adaptive_executor_pool_size;
+RESET citus.enable_adaptive_pool_size_control;
+
+-- hedged reads should not change the results either
+SET citus.enable_hedged_reads TO on;
+SET citus.hedged_read_latency_percentile TO 50;
+SET citus.shard_replication_factor TO 2;
+CREATE TABLE test_replicated (x int, y int);
+SELECT create_distributed_table('test_replicated','x');
+INSERT INTO test_replicated SELECT i, i FROM generate_series(1,100) i;
+
+DO $$
+BEGIN
+    FOR i IN 1..20 LOOP
+        PERFORM count(*) FROM test_replicated;
+    END LOOP;
+END;
+$$;
+
+SELECT count(*), sum(y) FROM test_replicated WHERE y > 50;
+SELECT y FROM test_replicated WHERE x = 42;
+-- a read that takes longer than usual is also sent to the other placement,
+-- and the placement that returns results last is cancelled
+SET client_min_messages TO debug1;
+SELECT y FROM test_replicated WHERE x = 42 AND pg_sleep(0.5) IS NOT NULL;
+RESET client_min_messages;
+
+-- a read that already returned some rows is not sent to another placement, since
+-- its rows would be stored twice
+CREATE TEMP TABLE hedged_read_result AS
+SELECT v FROM test_replicated,
+     LATERAL (SELECT CASE WHEN s = 1 THEN repeat('x', 100000) ELSE 'y' END AS v
+              FROM generate_series(1, 2) s
+              WHERE s = 1 OR pg_sleep(0.5) IS NOT NULL) wide_rows
+WHERE x = 42;
+SELECT count(*), sum(length(v)) FROM hedged_read_result;
+DROP TABLE hedged_read_result;
+RESET citus.shard_replication_factor;
+RESET citus.hedged_read_latency_percentile;
+RESET citus.enable_hedged_reads;
+
+-- batching the tasks per node should not change the results
+SET citus.max_tasks_per_batch TO 4;
+-- the tasks on shards 801009000 and 801009002 go to the same node in one query
+SET citus.log_remote_commands TO on;
+SELECT count(*) FROM test WHERE x = 1 OR x = 8;
+SET citus.log_remote_commands TO off;
+SELECT count(*), sum(y) FROM test;
+SELECT x FROM test ORDER BY x LIMIT 3;
+SELECT y, count(*) FROM test GROUP BY y;
+BEGIN;
+SELECT count(*) FROM test;
+COMMIT;
+RESET citus.max_tasks_per_batch;
+
 DROP SCHEMA adaptive_executor CASCADE;
@@ -79,5 +79,20 @@ select count(*) from trips t1, cars r1, trips t2, cars r2 where t1.trip_id = t2.
 set citus.enable_single_hash_repartition_joins to on;
 select count(*) from trips t1, cars r1, trips t2, cars r2 where t1.trip_id = t2.trip_id and t1.car_id = r1.car_id and t2.car_id = r2.car_id;
 
+-- filter the rows of dual hash repartition joins with a join key bloom filter
+SET citus.enable_repartition_join_bloom_filter TO on;
+set citus.enable_single_hash_repartition_joins to off;
+SELECT count(*) FROM ab k, ab l WHERE k.b = l.b AND k.a < 3;
+SELECT count(*) FROM ab k, ab l WHERE k.b = l.b AND l.a > 100;
+select count(*) from trips t1, cars r1, trips t2, cars r2 where t1.trip_id = t2.trip_id and t1.car_id = r1.car_id and t2.car_id = r2.car_id;
+SELECT length(bloom_filter), rows_read FROM worker_join_key_bloom_filter('SELECT b FROM adaptive_executor.ab', 0);
+-- the join key bloom filter is sent once to each node that runs map tasks
+SET citus.log_remote_commands TO on;
+SET citus.grep_remote_commands TO '%join_key_filter%FROM STDIN%';
+SELECT count(*) FROM ab k, ab l WHERE k.b = l.b AND k.a < 3;
+RESET citus.grep_remote_commands;
+RESET citus.log_remote_commands;
+RESET citus.enable_repartition_join_bloom_filter;
+
 SET client_min_messages TO WARNING;
 DROP SCHEMA adaptive_executor CASCADE;
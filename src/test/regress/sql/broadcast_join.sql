@@ -0,0 +1,43 @@
+--
+-- broadcast_join
+--
+-- Tests recursive planning of small distributed tables that are joined
+-- with non-co-located distributed tables.
+--
+CREATE SCHEMA broadcast_join;
+SET search_path TO broadcast_join;
+SET citus.next_shard_id TO 9160000;
+SET citus.shard_replication_factor TO 1;
+SET citus.enable_repartition_joins TO off;
+
+CREATE TABLE fact (id int, dim_id int, value int);
+SELECT create_distributed_table('fact', 'id', shard_count => 4);
+INSERT INTO fact SELECT i, i % 10, i FROM generate_series(1, 1000) i;
+
+CREATE TABLE dim (id int, name text);
+SELECT create_distributed_table('dim', 'id', colocate_with => 'none', shard_count => 4);
+INSERT INTO dim SELECT i, 'name_' || i FROM generate_series(0, 9) i;
+
+-- broadcast joins are disabled by default
+SELECT count(*) FROM fact JOIN dim ON (fact.dim_id = dim.id) WHERE dim.name = 'name_1';
+
+-- shard sizes are unknown, so we do not broadcast
+SET citus.broadcast_join_threshold TO '4kB';
+SELECT count(*) FROM fact JOIN dim ON (fact.dim_id = dim.id) WHERE dim.name = 'name_1';
+
+SELECT count(citus_update_shard_statistics(shardid)) FROM pg_dist_shard
+WHERE logicalrelid IN ('fact'::regclass, 'dim'::regclass);
+
+-- the filtered dim table is small enough to be broadcast
+SELECT count(*) FROM fact JOIN dim ON (fact.dim_id = dim.id) WHERE dim.name = 'name_1';
+SELECT count(*), sum(value) FROM fact, dim WHERE fact.dim_id = dim.id AND dim.name IN ('name_1', 'name_2');
+
+-- without the filter the dim table is above the threshold
+SELECT count(*) FROM fact JOIN dim ON (fact.dim_id = dim.id);
+
+SET citus.broadcast_join_threshold TO '1MB';
+SELECT count(*) FROM fact JOIN dim ON (fact.dim_id = dim.id);
+
+RESET citus.broadcast_join_threshold;
+SET client_min_messages TO WARNING;
+DROP SCHEMA broadcast_join CASCADE;
@@ -0,0 +1,82 @@
+--
+-- CITUS_HLL_SKETCH
+--
+-- Tests the built-in HyperLogLog sketches that approximate count(distinct)
+-- when the hll extension is not installed.
+--
+CREATE SCHEMA citus_hll_sketch;
+SET search_path TO citus_hll_sketch;
+SET citus.next_shard_id TO 9180000;
+SET citus.shard_count TO 4;
+
+CREATE FUNCTION explain_contains(query text, pattern text)
+RETURNS boolean AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE 'EXPLAIN (VERBOSE, COSTS OFF) ' || query LOOP
+    IF query_plan LIKE pattern
+    THEN
+        RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END; $$ language plpgsql;
+
+CREATE TABLE events (user_id int, event_type text);
+SELECT create_distributed_table('events', 'user_id');
+INSERT INTO events SELECT i % 1000, 'type_' || (i % 7) FROM generate_series(1, 10000) i;
+
+SET citus.count_distinct_error_rate TO 0.005;
+
+-- workers build sketches that the coordinator merges
+SELECT explain_contains('SELECT count(DISTINCT event_type) FROM events',
+                        '%citus_hll_add_agg(%') AS worker_sketches,
+       explain_contains('SELECT count(DISTINCT event_type) FROM events',
+                        '%citus_hll_cardinality(citus_hll_union_agg(%') AS coordinator_merge;
+
+SELECT count(DISTINCT event_type) FROM events;
+
+SELECT event_type, count(DISTINCT user_id) BETWEEN 950 AND 1050 AS approximately_1000
+FROM events GROUP BY event_type ORDER BY event_type;
+
+-- the sketch functions can also be used directly
+SELECT citus_hll_cardinality(citus_hll_union_agg(sketch))
+FROM (SELECT user_id, citus_hll_add_agg(event_type, 14) AS sketch
+      FROM events GROUP BY user_id) user_sketches;
+
+-- NULL values are not counted, and an empty input has no values
+SELECT citus_hll_cardinality(citus_hll_add_agg(value, 10))
+FROM (VALUES (1), (NULL), (1)) v(value);
+SELECT citus_hll_add_agg(value, 10) IS NULL AS no_sketch,
+       citus_hll_cardinality(citus_hll_add_agg(value, 10))
+FROM (VALUES (1)) v(value) WHERE false;
+
+-- sketches in the sparse and in the dense format
+SELECT citus_hll_cardinality('\x020400000001'::bytea);
+SELECT citus_hll_cardinality('\x010401010101010101010101010101010101'::bytea);
+SELECT citus_hll_union_agg(sketch), citus_hll_cardinality(citus_hll_union_agg(sketch))
+FROM (VALUES ('\x020400000001'::bytea), ('\x020400000103'::bytea), (NULL)) s(sketch);
+
+-- log2m must be valid
+SELECT citus_hll_add_agg(value, NULL) FROM (VALUES (1)) v(value);
+SELECT citus_hll_add_agg(value, 3) FROM (VALUES (1)) v(value);
+SELECT citus_hll_add_agg(value, 18) FROM (VALUES (1)) v(value);
+
+-- values need an extended hash function
+SELECT citus_hll_add_agg(value, 10) FROM (VALUES (point(1, 1))) v(value);
+
+-- invalid sketches are rejected
+SELECT citus_hll_cardinality('\x00'::bytea);
+SELECT citus_hll_cardinality('\x0120'::bytea);
+SELECT citus_hll_cardinality('\x0304'::bytea);
+SELECT citus_hll_cardinality('\x01040101'::bytea);
+SELECT citus_hll_cardinality('\x0204000000'::bytea);
+SELECT citus_hll_cardinality('\x020400001001'::bytea);
+
+-- sketches with a different number of registers cannot be merged
+SELECT citus_hll_union_agg(sketch)
+FROM (VALUES ('\x020400000001'::bytea), ('\x020500000001'::bytea)) s(sketch);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA citus_hll_sketch CASCADE;
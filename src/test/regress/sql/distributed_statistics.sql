@@ -0,0 +1,89 @@
+--
+-- distributed_statistics
+--
+-- Tests collecting the planner statistics of distributed tables from
+-- their shards.
+--
+CREATE SCHEMA distributed_statistics;
+SET search_path TO distributed_statistics;
+SET citus.next_shard_id TO 9170000;
+SET citus.shard_replication_factor TO 1;
+
+CREATE TABLE fact (id int, dim_id int, name text);
+SELECT create_distributed_table('fact', 'id', shard_count => 4);
+INSERT INTO fact SELECT i, i % 5, 'name_' || i FROM generate_series(1, 1000) i;
+
+CREATE TABLE dim (id int, name text);
+SELECT create_distributed_table('dim', 'id', colocate_with => 'none', shard_count => 4);
+INSERT INTO dim SELECT i, 'name_' || i FROM generate_series(0, 4) i;
+
+CREATE TABLE ref (id int);
+SELECT create_reference_table('ref');
+INSERT INTO ref SELECT i FROM generate_series(1, 100) i;
+
+CREATE TABLE local_table (id int);
+
+-- ANALYZE only collects the statistics of the empty shell tables
+ANALYZE fact, dim, ref;
+SELECT relname, reltuples, relpages FROM pg_class
+WHERE oid IN ('fact'::regclass, 'dim'::regclass, 'ref'::regclass) ORDER BY relname;
+
+-- so the planner estimates no rows for the shell tables
+CREATE FUNCTION estimated_relation_rows(regclass) RETURNS float8
+	LANGUAGE C STRICT AS 'citus', $$estimated_relation_rows$$;
+SELECT estimated_relation_rows('fact');
+
+SELECT citus_update_distributed_statistics('fact');
+SELECT citus_update_distributed_statistics('dim');
+SELECT citus_update_distributed_statistics('ref');
+SELECT citus_update_distributed_statistics('local_table');
+
+SELECT relname, reltuples, relpages > 0 AS has_pages FROM pg_class
+WHERE oid IN ('fact'::regclass, 'dim'::regclass, 'ref'::regclass) ORDER BY relname;
+
+-- the planner uses the collected row counts instead of those of the shell tables
+SELECT estimated_relation_rows('fact') AS fact, estimated_relation_rows('dim') AS dim,
+	   estimated_relation_rows('ref') AS ref;
+
+-- column statistics are copied from the largest shard
+SELECT attname, null_frac, n_distinct, array_length(most_common_freqs, 1) AS mcv_count,
+	   histogram_bounds IS NOT NULL AS has_histogram
+FROM pg_stats WHERE schemaname = 'distributed_statistics' AND tablename = 'fact'
+ORDER BY attname;
+
+-- shard sizes are unknown, so the broadcast join planner uses the collected statistics
+SET citus.enable_repartition_joins TO off;
+SET citus.broadcast_join_threshold TO '1MB';
+SELECT count(*) FROM fact JOIN dim ON (fact.dim_id = dim.id);
+
+RESET citus.broadcast_join_threshold;
+RESET citus.enable_repartition_joins;
+-- repartition joins pick their bucket count from the collected statistics
+CREATE FUNCTION merge_task_counts(query text) RETURNS SETOF int LANGUAGE plpgsql AS $$
+DECLARE
+	line text;
+BEGIN
+	FOR line IN EXECUTE 'EXPLAIN ' || query LOOP
+		IF line LIKE '%Merge Task Count:%' THEN
+			RETURN NEXT split_part(line, ': ', 2)::int;
+		END IF;
+	END LOOP;
+END;
+$$;
+SET citus.enable_repartition_joins TO on;
+SET citus.repartition_join_bucket_size TO '1GB';
+SELECT DISTINCT bucket_count = (SELECT count(*) FROM pg_dist_node WHERE isactive AND noderole = 'primary') AS one_bucket_per_node
+FROM merge_task_counts('SELECT count(*) FROM fact JOIN dim ON (fact.name = dim.name)') bucket_count;
+SET citus.repartition_join_bucket_size TO '8kB';
+SELECT DISTINCT bucket_count > (SELECT count(*) FROM pg_dist_node WHERE isactive AND noderole = 'primary') AS more_buckets
+FROM merge_task_counts('SELECT count(*) FROM fact JOIN dim ON (fact.name = dim.name)') bucket_count;
+SELECT count(*) FROM fact JOIN dim ON (fact.name = dim.name);
+RESET citus.repartition_join_bucket_size;
+RESET citus.enable_repartition_joins;
+-- ANALYZE resets the shell table, hence it collects the statistics again
+INSERT INTO fact SELECT i, i % 5, 'name_' || i FROM generate_series(1001, 2000) i;
+ANALYZE fact;
+SELECT reltuples FROM pg_class WHERE oid = 'fact'::regclass;
+SELECT estimated_relation_rows('fact');
+SET client_min_messages TO WARNING;
+DROP SCHEMA distributed_statistics CASCADE;
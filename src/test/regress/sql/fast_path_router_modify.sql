@@ -173,4 +173,42 @@ RESET citus.enable_fast_path_router_planner;
 
 RESET client_min_messages;
 RESET citus.log_remote_commands;
+-- shard query strings of fast path queries are cached across backends when
+-- citus.fast_path_query_cache_size is set, which should not change the results
+CREATE TABLE fast_path_cache (key text, value int, day date);
+SELECT create_distributed_table('fast_path_cache', 'key');
+INSERT INTO fast_path_cache VALUES ('a', 1, '2024-01-01'), ('b''s', 2, '2024-01-02');
+PREPARE fast_path_cache_select(text) AS SELECT value FROM fast_path_cache WHERE key = $1;
+PREPARE fast_path_cache_date(text, date) AS
+	SELECT value FROM fast_path_cache WHERE key = $1 AND day = $2;
+EXECUTE fast_path_cache_select('a');
+EXECUTE fast_path_cache_select('b''s');
+EXECUTE fast_path_cache_select('a');
+EXECUTE fast_path_cache_select('b''s');
+EXECUTE fast_path_cache_select('a');
+EXECUTE fast_path_cache_select('b''s');
+EXECUTE fast_path_cache_select('a');
+EXECUTE fast_path_cache_select('b''s');
+EXECUTE fast_path_cache_date('a', '2024-01-01');
+EXECUTE fast_path_cache_date('b''s', '2024-01-02');
+EXECUTE fast_path_cache_date('a', '2024-01-01');
+EXECUTE fast_path_cache_date('b''s', '2024-01-02');
+EXECUTE fast_path_cache_date('a', '2024-01-01');
+EXECUTE fast_path_cache_date('b''s', '2024-01-02');
+EXECUTE fast_path_cache_date('a', '2024-01-01');
+EXECUTE fast_path_cache_date('b''s', '2024-01-02');
+ALTER TABLE fast_path_cache ADD COLUMN extra int;
+EXECUTE fast_path_cache_select('a');
+EXECUTE fast_path_cache_select('b''s');
+DEALLOCATE fast_path_cache_select;
+DEALLOCATE fast_path_cache_date;
+-- statements in the same source text are cached separately
+CREATE FUNCTION fast_path_cache_two_statements(text) RETURNS int LANGUAGE sql AS $$
+	SELECT value FROM fast_path_cache WHERE key = $1;
+	SELECT value * 10 FROM fast_path_cache WHERE key = $1;
+$$;
+SELECT fast_path_cache_two_statements('a');
+SELECT fast_path_cache_two_statements('a');
+DROP FUNCTION fast_path_cache_two_statements(text);
+
 DROP SCHEMA fast_path_router_modify CASCADE;
@@ -124,6 +124,125 @@ SELECT create_intermediate_result('stored_squares', 'SELECT square FROM stored_s
 EXPLAIN (COSTS ON) SELECT * FROM read_intermediate_result('stored_squares', 'text') AS res (s intermediate_results.square_type);
 END;
 
+-- compressed results are decompressed while reading them, and keep their estimates
+SET citus.intermediate_result_compression TO 'lz4';
+BEGIN;
+SELECT create_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,632) s');
+EXPLAIN (COSTS ON) SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int);
+SELECT count(*), sum(x2) FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int);
+SELECT create_intermediate_result('stored_squares', 'SELECT square FROM stored_squares');
+SELECT * FROM read_intermediate_result('stored_squares', 'text') AS res (s intermediate_results.square_type) ORDER BY 1;
+END;
+
+SET citus.intermediate_result_compression TO 'zstd';
+BEGIN;
+-- broadcast a result that spans many compressed blocks
+SELECT broadcast_intermediate_result('hellos', $$SELECT s, 'hello-'||s FROM generate_series(1,100000) s$$);
+SELECT user_id, x, y
+FROM interesting_squares JOIN (SELECT * FROM read_intermediate_result('hellos', 'binary') AS res (x int, y text)) hellos ON (x::text = interested_in)
+ORDER BY x;
+SELECT count(*), count(DISTINCT y), max(x)
+FROM interesting_squares, read_intermediate_result('hellos', 'binary') AS res (x int, y text)
+WHERE user_id = 'jon';
+END;
+RESET citus.intermediate_result_compression;
+
+-- binary results can be scanned without materializing them first
+SET citus.enable_intermediate_result_scan TO on;
+BEGIN;
+SELECT create_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,632) s');
+EXPLAIN (COSTS OFF) SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int) WHERE x > 10;
+SELECT count(*), sum(x2) FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int) WHERE x > 10;
+SELECT create_intermediate_result('mixed', $$SELECT s::int8, s::float8 / 4, s % 2 = 0, 'value-' || s, CASE WHEN s % 3 <> 0 THEN s * 1.5 END FROM generate_series(1,6) s$$);
+SELECT * FROM read_intermediate_result('mixed', 'binary') AS res (a int8, b float8, c bool, d text, e numeric) ORDER BY a;
+-- compressed results are still read through COPY
+SET LOCAL citus.intermediate_result_compression TO 'lz4';
+SELECT create_intermediate_result('squares_lz4', 'SELECT s, s*s FROM generate_series(1,3) s');
+SELECT * FROM read_intermediate_results(ARRAY['squares', 'squares_lz4'], 'binary') AS res (x int, x2 int) WHERE x <= 3 ORDER BY x;
+END;
+RESET citus.enable_intermediate_result_scan;
+
+-- small results can be kept in shared memory instead of a file
+SET citus.max_intermediate_result_memory_size TO '1MB';
+BEGIN;
+SET LOCAL client_min_messages TO DEBUG1;
+SELECT create_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,632) s');
+RESET client_min_messages;
+EXPLAIN (COSTS ON) SELECT * FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int);
+SELECT count(*), sum(x2) FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int);
+SET LOCAL citus.enable_intermediate_result_scan TO on;
+SELECT count(*), sum(x2) FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int) WHERE x > 10;
+-- results that exceed the limit are written to a file
+SET LOCAL citus.max_intermediate_result_memory_size TO '64kB';
+SET LOCAL client_min_messages TO DEBUG1;
+SELECT create_intermediate_result('hellos', $$SELECT s, 'hello-'||s FROM generate_series(1,10000) s$$);
+RESET client_min_messages;
+SELECT count(*), max(x) FROM read_intermediate_result('hellos', 'binary') AS res (x int, y text);
+END;
+RESET citus.max_intermediate_result_memory_size;
+
+-- results that do not fit in the memory left on the node are written to a file
+ALTER SYSTEM SET citus.max_intermediate_result_memory_per_node TO '16kB';
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+SET citus.max_intermediate_result_memory_size TO '1MB';
+BEGIN;
+SET LOCAL client_min_messages TO DEBUG1;
+SELECT create_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,632) s');
+SELECT create_intermediate_result('cubes', 'SELECT s, s*s*s FROM generate_series(1,632) s');
+RESET client_min_messages;
+SELECT count(*), sum(x2) FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int);
+SELECT count(*), sum(x3) FROM read_intermediate_result('cubes', 'binary') AS res (x int, x3 int);
+END;
+RESET citus.max_intermediate_result_memory_size;
+ALTER SYSTEM RESET citus.max_intermediate_result_memory_per_node;
+SELECT pg_reload_conf();
+
+-- broadcast results can be relayed from one worker to the other
+SET citus.intermediate_result_relay_fanout TO 1;
+BEGIN;
+SELECT broadcast_intermediate_result('hellos', $$SELECT s, 'hello-'||s FROM generate_series(1,1000) s$$);
+SELECT user_id, x, y
+FROM interesting_squares JOIN (SELECT * FROM read_intermediate_result('hellos', 'binary') AS res (x int, y text)) hellos ON (x::text = interested_in)
+ORDER BY x;
+END;
+
+-- several results can be relayed in one transaction, and stay on all nodes
+BEGIN;
+SELECT broadcast_intermediate_result('relayed_1', $$SELECT s FROM generate_series(1,10) s$$);
+SELECT broadcast_intermediate_result('relayed_2', $$SELECT s FROM generate_series(11,30) s$$);
+SELECT * FROM fetch_intermediate_results(ARRAY['relayed_1', 'relayed_2']::text[], 'localhost', :worker_1_port);
+SELECT count(*), sum(s) FROM read_intermediate_results(ARRAY['relayed_1', 'relayed_2']::text[], 'binary') AS res (s int);
+SELECT * FROM fetch_intermediate_results(ARRAY['relayed_1', 'relayed_2']::text[], 'localhost', :worker_2_port);
+SELECT count(*), sum(s) FROM read_intermediate_results(ARRAY['relayed_1', 'relayed_2']::text[], 'binary') AS res (s int);
+END;
+RESET citus.intermediate_result_relay_fanout;
+
+-- binary results can be stored column by column, and read per column
+SET citus.enable_columnar_intermediate_results TO on;
+BEGIN;
+SELECT create_intermediate_result('mixed', $$SELECT s::int8, s::float8 / 4, s % 2 = 0, 'value-' || s, CASE WHEN s % 3 <> 0 THEN s * 1.5 END FROM generate_series(1,6) s$$);
+SELECT * FROM read_intermediate_result('mixed', 'binary') AS res (a int8, b float8, c bool, d text, e numeric) ORDER BY a;
+-- columns that are not in the column list are returned as NULL
+SELECT * FROM read_intermediate_result('mixed', 'binary', ARRAY[1,4]) AS res (a int8, b float8, c bool, d text, e numeric) ORDER BY a;
+-- the scan only decodes the columns that the query uses
+SET LOCAL citus.enable_intermediate_result_scan TO on;
+SELECT a, d FROM read_intermediate_result('mixed', 'binary') AS res (a int8, b float8, c bool, d text, e numeric) WHERE e > 5 ORDER BY a;
+-- columns are compressed separately, and large results span many groups
+SET LOCAL citus.intermediate_result_compression TO 'zstd';
+SELECT broadcast_intermediate_result('hellos', $$SELECT s, 'hello-'||s FROM generate_series(1,100000) s$$);
+SELECT user_id, x, y
+FROM interesting_squares JOIN (SELECT * FROM read_intermediate_result('hellos', 'binary') AS res (x int, y text)) hellos ON (x::text = interested_in)
+ORDER BY x;
+SELECT create_intermediate_result('hellos', $$SELECT s, 'hello-'||s FROM generate_series(1,100000) s$$);
+SELECT count(*), count(y), max(x) FROM read_intermediate_result('hellos', 'binary', ARRAY[1]) AS res (x int, y text);
+-- results without columns are stored in groups without columns
+WITH no_columns AS MATERIALIZED (SELECT FROM interesting_squares)
+SELECT count(*) FROM interesting_squares, no_columns;
+END;
+RESET citus.enable_columnar_intermediate_results;
+SELECT * FROM read_intermediate_result('mixed', 'binary', ARRAY[6]) AS res (a int8, b float8, c bool, d text, e numeric);
+
 -- pipe query output into a result file and create a table to check the result
 COPY (SELECT s, s*s FROM generate_series(1,5) s)
 TO PROGRAM
@@ -243,6 +362,11 @@ SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[],
 SELECT * FROM fetch_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'localhost', :worker_1_port);
 SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'binary') AS res (x int, x2 int);
 ROLLBACK TO SAVEPOINT s1;
+-- fetching over a single connection should succeed
+SET LOCAL citus.max_intermediate_result_fetch_connections TO 1;
+SELECT * FROM fetch_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'localhost', :worker_1_port);
+SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'binary') AS res (x int, x2 int);
+ROLLBACK TO SAVEPOINT s1;
 -- empty result id list should succeed
 SELECT * FROM fetch_intermediate_results(ARRAY[]::text[], 'localhost', :worker_1_port);
 -- null in result id list should error gracefully
@@ -792,3 +792,133 @@ red	{"r":255,"g":0,"b":0
 \.
 
 DROP TABLE copy_jsonb;
+
+-- parse the input of COPY in parallel workers
+CREATE TABLE copy_parallel (key int, value text, quoted text);
+SELECT create_distributed_table('copy_parallel', 'key');
+SET citus.max_parallel_copy_workers TO 2;
+
+\COPY copy_parallel FROM STDIN WITH (format csv)
+1,one,"a, b"
+2,two,"multi
+line"
+3,three,
+\.
+\COPY copy_parallel (key, value) FROM STDIN
+4	four
+5	\N
+\.
+SELECT key, value, replace(quoted, E'\n', '|') AS quoted FROM copy_parallel ORDER BY key;
+
+-- input of several chunks, with a quoted line break in every row
+COPY (SELECT i, 'value ' || i, 'multi' || E'\n' || 'line ' || i
+      FROM generate_series(1, 5000) i)
+TO :'temp_dir''copy_parallel.csv' WITH (format csv);
+SET client_min_messages TO DEBUG1;
+COPY copy_parallel FROM :'temp_dir''copy_parallel.csv' WITH (format csv);
+RESET client_min_messages;
+SELECT count(*), count(DISTINCT key), sum(key),
+       bool_and(value = 'value ' || key AND quoted = E'multi\nline ' || key)
+FROM copy_parallel WHERE key > 5;
+
+-- invalid row in a later chunk: should see line number in the whole input
+COPY (SELECT CASE WHEN i = 4000 THEN 'x' ELSE i::text END, 'value ' || i,
+             'multi' || E'\n' || 'line ' || i
+      FROM generate_series(1, 5000) i)
+TO :'temp_dir''copy_parallel.csv' WITH (format csv);
+COPY copy_parallel FROM :'temp_dir''copy_parallel.csv' WITH (format csv);
+SELECT count(*) FROM copy_parallel;
+
+RESET citus.max_parallel_copy_workers;
+DROP TABLE copy_parallel;
+
+-- route COPY input by only parsing the distribution column
+CREATE TABLE copy_pass_through (key int, value text, quoted text, fixed int DEFAULT 42);
+SELECT create_distributed_table('copy_pass_through', 'key');
+SET citus.enable_pass_through_copy TO on;
+
+SET client_min_messages TO DEBUG1;
+\COPY copy_pass_through (key, value, quoted) FROM STDIN WITH (format csv)
+"1",one,"a, ""b"""
+2,two,"multi
+line"
+\.
+RESET client_min_messages;
+\COPY copy_pass_through (value, key) FROM STDIN
+three	3
+\N	\x34
+\.
+SELECT key, value, replace(quoted, E'\n', '|') AS quoted, fixed
+FROM copy_pass_through ORDER BY key;
+
+-- NULL in the distribution column: should see line number
+\COPY copy_pass_through (key, value) FROM STDIN WITH (format csv)
+5,five
+,six
+\.
+SELECT count(*) FROM copy_pass_through;
+
+-- escapes in the distribution column stand for bytes in the server encoding
+CREATE TABLE copy_pass_through_text (key text, value int);
+SELECT create_distributed_table('copy_pass_through_text', 'key');
+\COPY copy_pass_through_text FROM STDIN WITH (encoding 'LATIN1')
+caf\xc3\xa9	1
+\.
+SELECT key, value FROM copy_pass_through_text WHERE key = 'café';
+
+RESET citus.enable_pass_through_copy;
+DROP TABLE copy_pass_through, copy_pass_through_text;
+
+-- export the shards of distributed tables concurrently
+CREATE TABLE copy_parallel_to (key int, value text);
+SELECT create_distributed_table('copy_parallel_to', 'key');
+INSERT INTO copy_parallel_to SELECT i, 'value ' || i FROM generate_series(1, 100) i;
+CREATE TABLE copy_parallel_to_local (key int, value text);
+SET citus.enable_parallel_copy_to TO on;
+
+\COPY copy_parallel_to TO '/tmp/copy_parallel_to.data'
+\COPY copy_parallel_to_local FROM '/tmp/copy_parallel_to.data'
+\COPY copy_parallel_to (value, key) TO '/tmp/copy_parallel_to.data' WITH (format csv)
+\COPY copy_parallel_to_local (value, key) FROM '/tmp/copy_parallel_to.data' WITH (format csv)
+\COPY copy_parallel_to TO '/tmp/copy_parallel_to.data' WITH (format binary)
+\COPY copy_parallel_to_local FROM '/tmp/copy_parallel_to.data' WITH (format binary)
+SELECT count(*), count(DISTINCT (key, value)) FROM copy_parallel_to_local;
+SELECT count(*) FROM (
+    (SELECT * FROM copy_parallel_to EXCEPT SELECT * FROM copy_parallel_to_local)
+    UNION ALL
+    (SELECT * FROM copy_parallel_to_local EXCEPT SELECT * FROM copy_parallel_to)
+) differences;
+
+-- in a transaction, shards that were modified are exported by the same connection
+BEGIN;
+UPDATE copy_parallel_to SET value = 'updated' WHERE key = 1;
+\COPY copy_parallel_to TO '/tmp/copy_parallel_to.data' WITH (format csv)
+ROLLBACK;
+TRUNCATE copy_parallel_to_local;
+\COPY copy_parallel_to_local FROM '/tmp/copy_parallel_to.data' WITH (format csv)
+SELECT count(*), count(*) FILTER (WHERE value = 'updated') FROM copy_parallel_to_local;
+
+-- binary output of composites and enum arrays contains type OIDs, which differ
+-- between nodes
+CREATE TYPE copy_parallel_to_color AS ENUM ('red', 'green');
+CREATE TYPE copy_parallel_to_pair AS (a int, b text);
+CREATE TABLE copy_parallel_to_enums (key int, colors copy_parallel_to_color[]);
+SELECT create_distributed_table('copy_parallel_to_enums', 'key');
+INSERT INTO copy_parallel_to_enums VALUES (1, '{red}'), (2, '{red,green}');
+CREATE TABLE copy_parallel_to_pairs (key int, pair copy_parallel_to_pair);
+SELECT create_distributed_table('copy_parallel_to_pairs', 'key');
+INSERT INTO copy_parallel_to_pairs VALUES (1, ROW(1, 'one')), (2, ROW(2, 'two'));
+CREATE TABLE copy_parallel_to_enums_local (LIKE copy_parallel_to_enums);
+CREATE TABLE copy_parallel_to_pairs_local (LIKE copy_parallel_to_pairs);
+\COPY copy_parallel_to_enums TO '/tmp/copy_parallel_to.data' WITH (format binary)
+\COPY copy_parallel_to_enums_local FROM '/tmp/copy_parallel_to.data' WITH (format binary)
+\COPY copy_parallel_to_pairs TO '/tmp/copy_parallel_to.data' WITH (format binary)
+\COPY copy_parallel_to_pairs_local FROM '/tmp/copy_parallel_to.data' WITH (format binary)
+SELECT * FROM copy_parallel_to_enums_local ORDER BY key;
+SELECT * FROM copy_parallel_to_pairs_local ORDER BY key;
+
+RESET citus.enable_parallel_copy_to;
+DROP TABLE copy_parallel_to, copy_parallel_to_local;
+DROP TABLE copy_parallel_to_enums, copy_parallel_to_enums_local,
+           copy_parallel_to_pairs, copy_parallel_to_pairs_local;
+DROP TYPE copy_parallel_to_color, copy_parallel_to_pair;
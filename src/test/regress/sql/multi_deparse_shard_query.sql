@@ -302,5 +302,10 @@ FROM
 	raw_events_1;
 ');
 
+-- shard names in string literals are kept as is when deriving the task queries
+INSERT INTO raw_events_1 (tenant_id, value_1) VALUES (1, 1);
+SELECT count(*) FROM raw_events_1
+WHERE tenant_id::text <> 'multi_deparse_shard_query.raw_events_1_13100000';
+
 SET client_min_messages TO ERROR;
 DROP SCHEMA multi_deparse_shard_query CASCADE;
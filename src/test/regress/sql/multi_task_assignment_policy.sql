@@ -254,6 +254,23 @@ $cmd$, 'task_assignment_test_table_2');
 -- different workers
 SELECT count(DISTINCT value) FROM explain_outputs;
 
+-- The latency-aware policy should work for router and multi-shard queries
+SET citus.task_assignment_policy TO 'latency-aware';
+SELECT count(*) FROM task_assignment_reference_table;
+SELECT count(*) FROM task_assignment_replicated_hash;
+SELECT count(*) FROM task_assignment_replicated_hash WHERE test_id = 1;
+
+-- The latency-aware policy should prefer the placement on a node that responds
+-- faster
+INSERT INTO task_assignment_replicated_hash SELECT i FROM generate_series(1, 20) i;
+SELECT count(*) FROM task_assignment_replicated_hash
+WHERE CASE WHEN current_setting('port')::int = :worker_2_port
+           THEN pg_sleep(0.1) IS NOT NULL ELSE true END;
+TRUNCATE explain_outputs;
+INSERT INTO explain_outputs
+SELECT parse_explain_output('EXPLAIN SELECT count(*) FROM task_assignment_replicated_hash WHERE test_id = 1;', 'task_assignment_replicated_hash');
+SELECT value LIKE '%@' || :worker_1_port AS uses_faster_node FROM explain_outputs;
+
 RESET citus.task_assignment_policy;
 RESET client_min_messages;
 
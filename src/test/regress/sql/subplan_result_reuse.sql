@@ -0,0 +1,67 @@
+--
+-- subplan_result_reuse
+--
+-- Tests reusing the intermediate results of subplans on reference tables
+-- within a transaction, and their invalidation on modifications.
+--
+CREATE SCHEMA subplan_result_reuse;
+SET search_path TO subplan_result_reuse;
+SET citus.next_shard_id TO 9190000;
+SET citus.shard_replication_factor TO 1;
+
+CREATE TABLE ref (a int PRIMARY KEY, b int);
+SELECT create_reference_table('ref');
+CREATE TABLE ref_child (a int REFERENCES ref (a) ON DELETE CASCADE, c int);
+SELECT create_reference_table('ref_child');
+CREATE TABLE dist (a int, d int);
+SELECT create_distributed_table('dist', 'a');
+
+INSERT INTO ref VALUES (1, 10), (2, 20), (3, 30);
+INSERT INTO ref_child VALUES (1, 100), (2, 200), (3, 300);
+INSERT INTO dist SELECT i, i FROM generate_series(1, 4) i;
+
+SET citus.enable_subplan_result_reuse TO on;
+
+SET client_min_messages TO DEBUG1;
+BEGIN ISOLATION LEVEL REPEATABLE READ;
+WITH r AS MATERIALIZED (SELECT a, b FROM ref)
+SELECT count(*), sum(r.b) FROM dist JOIN r USING (a);
+-- the second execution reuses the result of the first one
+WITH r AS MATERIALIZED (SELECT a, b FROM ref)
+SELECT count(*), sum(r.b) FROM dist JOIN r USING (a);
+-- modifications invalidate the results on the table
+UPDATE ref SET b = b + 1;
+WITH r AS MATERIALIZED (SELECT a, b FROM ref)
+SELECT count(*), sum(r.b) FROM dist JOIN r USING (a);
+WITH c AS MATERIALIZED (SELECT a, c FROM ref_child)
+SELECT count(*), sum(c.c) FROM dist JOIN c USING (a);
+-- as well as the results on tables the modification cascades to
+SAVEPOINT s1;
+DELETE FROM ref WHERE a = 1;
+WITH r AS MATERIALIZED (SELECT a, b FROM ref)
+SELECT count(*), sum(r.b) FROM dist JOIN r USING (a);
+WITH c AS MATERIALIZED (SELECT a, c FROM ref_child)
+SELECT count(*), sum(c.c) FROM dist JOIN c USING (a);
+-- rolling back the modification invalidates the results again
+ROLLBACK TO SAVEPOINT s1;
+WITH r AS MATERIALIZED (SELECT a, b FROM ref)
+SELECT count(*), sum(r.b) FROM dist JOIN r USING (a);
+WITH c AS MATERIALIZED (SELECT a, c FROM ref_child)
+SELECT count(*), sum(c.c) FROM dist JOIN c USING (a);
+-- modifying CTEs that are pushed down invalidate all results
+WITH m AS (UPDATE ref_child SET c = c + 1 WHERE a = 2 RETURNING a)
+SELECT count(*) FROM m;
+WITH c AS MATERIALIZED (SELECT a, c FROM ref_child)
+SELECT count(*), sum(c.c) FROM dist JOIN c USING (a);
+-- executing a prepared statement does not invalidate the results
+PREPARE ref_join AS
+WITH r AS MATERIALIZED (SELECT a, b FROM ref)
+SELECT count(*), sum(r.b) FROM dist JOIN r USING (a);
+EXECUTE ref_join;
+EXECUTE ref_join;
+DEALLOCATE ref_join;
+RESET client_min_messages;
+COMMIT;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA subplan_result_reuse CASCADE;
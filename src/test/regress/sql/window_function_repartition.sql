@@ -0,0 +1,63 @@
+--
+-- window_function_repartition
+--
+-- Tests window functions that are not partitioned by the distribution
+-- column, which are computed on the workers after repartitioning the rows.
+--
+CREATE SCHEMA window_function_repartition;
+SET search_path TO window_function_repartition;
+SET citus.next_shard_id TO 9180000;
+SET citus.shard_replication_factor TO 1;
+
+CREATE TABLE events (tenant_id int, user_id int, event_time int, value int);
+SELECT create_distributed_table('events', 'tenant_id', shard_count => 4);
+INSERT INTO events SELECT i % 3, i % 4, i, (i * 7) % 10 FROM generate_series(1, 24) i;
+
+SET citus.enable_repartition_joins TO on;
+SET citus.enable_repartitioned_window_functions TO on;
+
+-- per-user windows over a table that is distributed by tenant
+SELECT user_id, event_time, value,
+       lag(event_time) OVER (PARTITION BY user_id ORDER BY event_time) AS previous_time,
+       sum(value) OVER (PARTITION BY user_id ORDER BY event_time) AS running_total
+FROM events
+WHERE event_time <= 12
+ORDER BY user_id, event_time;
+
+-- multiple windows that share a partition column, with a limit
+SELECT user_id, event_time,
+       rank() OVER (PARTITION BY user_id ORDER BY value DESC, event_time) AS value_rank,
+       count(*) OVER (PARTITION BY tenant_id, user_id) AS tenant_user_count
+FROM events
+ORDER BY value_rank, user_id
+LIMIT 8;
+
+-- windows without a common partition column are computed on the coordinator
+SELECT user_id, event_time,
+       row_number() OVER (PARTITION BY user_id ORDER BY event_time) AS user_row,
+       row_number() OVER (ORDER BY event_time) AS global_row
+FROM events
+WHERE event_time > 18
+ORDER BY event_time;
+
+-- recursively planned subqueries with such windows are repartitioned as well
+SELECT user_id, max(gap) FROM (
+    SELECT user_id,
+           event_time - lag(event_time) OVER (PARTITION BY user_id ORDER BY event_time) AS gap
+    FROM events
+    WHERE tenant_id <> 1
+) gaps
+GROUP BY user_id
+ORDER BY user_id;
+
+-- the results are the same as when the windows are computed on the coordinator
+SET citus.enable_repartitioned_window_functions TO off;
+SELECT user_id, event_time, value,
+       lag(event_time) OVER (PARTITION BY user_id ORDER BY event_time) AS previous_time,
+       sum(value) OVER (PARTITION BY user_id ORDER BY event_time) AS running_total
+FROM events
+WHERE event_time <= 12
+ORDER BY user_id, event_time;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA window_function_repartition CASCADE;